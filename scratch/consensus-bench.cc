@@ -0,0 +1,578 @@
+/*
+Yiqing Zhu
+yiqing.zhu.314@gmail.com
+**/
+
+/*
+ * throughput and latency of one consensus configuration under an open-loop load, e.g.
+ *
+ * ./waf --run "consensus-bench --protocol=hotstuff --transport=flood --overlay=distributed --n=32 --rate=20"
+ * ./waf --run "consensus-bench --protocol=tendermint --transport=relay --n=32 --batch=8 --partSize=512"
+ * ./waf --run "consensus-bench --protocol=pbft --batch=8 --mempool=1 --mempoolSize=4096"
+ * ./waf --run "consensus-bench --protocol=pbft --batch=8 --mempool=1 --compact=1"
+ * ./waf --run "consensus-bench --protocol=narwhal --transport=relay --n=32 --batch=8"
+ * ./waf --run "consensus-bench --protocol=pbft --n=64 --shards=4 --clients=8"
+ *
+ * scratch/consensus-bench.sh sweeps the configurations.
+ * each run ends with one json record on a line of its own, appended to --out if given:
+ * configuration, offered load (requests per second over all clients), committed blocks per second,
+ * end-to-end request latency percentiles, replica commit latency, bytes and messages received per commit
+ * and the wall time the simulator took. for pbft also the pre-prepare bytes per commit and the time
+ * a pre-prepare takes from the primary to a backup, full or compact.
+ * with --shards every spectral cluster of the topology runs its own pbft committee, blocks add up over
+ * the committees and the record lists the blocks per second of each, the bytes sent over links
+ * inside a committee, and the transit bytes a committee routes over links between non-members,
+ * committees exchange no messages, the record says so with crossShardMessages false and has no
+ * cross-shard bytes. clients are spread round robin over the committees.
+ * every committee relays over shortest path trees, --shards above 1 rejects any other --overlay
+ **/
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/random-variable-stream.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+
+using namespace ns3;
+
+// cite from Decentralization in Bitcoin and Ethereum Networks
+std::array<std::array<double, 2>, 4> bandwidthDistribution_BitcoinV6 = {{
+                                                                        {78.2, 0.5},
+                                                                        {94.3, 0.67},
+                                                                        {207.9, 0.9},
+                                                                        {300, 1}
+                                                                    }};
+
+
+struct BenchResult {
+    uint32_t blocks = 0;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    double commitLatency = 0;   // second, averaged over replicas
+    uint32_t mempoolEvicted = 0;
+    uint32_t mempoolDuplicates = 0;
+    // pbft only
+    uint64_t blockBytes = 0;          // pre-prepares received, with their transaction fetches
+    double blockPropagation = 0;      // second, primary to backup, averaged over backups
+    uint32_t compactBlocks = 0;
+    uint32_t compactRebuilt = 0;      // from the mempool alone
+    uint32_t compactMissingTxs = 0;
+};
+
+
+template<class App>
+BenchResult collect(ApplicationContainer apps, int n, uint32_t blocks) {
+
+    BenchResult res;
+    res.blocks = blocks;
+
+    int replicas = 0;
+
+    for (int i = 0; i < n; ++i) {
+        Ptr<App> app = apps.Get(i)->GetObject<App>();
+        res.messages += app->getTotalRecvMessages();
+        res.bytes += app->getTotalRecvBytes();
+        res.mempoolEvicted += app->getMempool().getEvicted();
+        res.mempoolDuplicates += app->getMempool().getDuplicates();
+        if (app->getAverageCommitLatency() > 0) {
+            res.commitLatency += app->getAverageCommitLatency();
+            replicas++;
+        }
+    }
+
+    if (replicas > 0) res.commitLatency /= replicas;
+    return res;
+}
+
+
+void collectPBFT(ApplicationContainer apps, int n, BenchResult *res) {
+    *res = collect<PBFTCorrect>(apps, n, apps.Get(0)->GetObject<PBFTCorrect>()->getExecutedCount());
+
+    int backups = 0;
+
+    for (int i = 0; i < n; ++i) {
+        Ptr<PBFTCorrect> app = apps.Get(i)->GetObject<PBFTCorrect>();
+        res->blockBytes += app->getBlockRecvBytes();
+        res->compactBlocks += app->getCompactBlocks();
+        res->compactRebuilt += app->getCompactRebuilt();
+        res->compactMissingTxs += app->getCompactMissingTxs();
+        if (app->getAverageBlockPropagation() > 0) {
+            res->blockPropagation += app->getAverageBlockPropagation();
+            backups++;
+        }
+    }
+
+    if (backups > 0) res->blockPropagation /= backups;
+}
+
+
+// committees run independently, their blocks add up
+void collectShardedPBFT(BlockChainTopologyHelper *topology, std::vector<BenchResult> *shardRes, BenchResult *res) {
+
+    *res = BenchResult();
+    shardRes->clear();
+
+    int latencies = 0;
+    int propagations = 0;
+
+    for (int s = 0; s < topology->getShardN(); ++s) {
+        ApplicationContainer apps = topology->getShardApp(s);
+
+        BenchResult r;
+        collectPBFT(apps, apps.GetN(), &r);
+        shardRes->push_back(r);
+
+        res->blocks += r.blocks;
+        res->messages += r.messages;
+        res->bytes += r.bytes;
+        res->mempoolEvicted += r.mempoolEvicted;
+        res->mempoolDuplicates += r.mempoolDuplicates;
+        res->blockBytes += r.blockBytes;
+        res->compactBlocks += r.compactBlocks;
+        res->compactRebuilt += r.compactRebuilt;
+        res->compactMissingTxs += r.compactMissingTxs;
+
+        if (r.commitLatency > 0) {
+            res->commitLatency += r.commitLatency;
+            latencies++;
+        }
+        if (r.blockPropagation > 0) {
+            res->blockPropagation += r.blockPropagation;
+            propagations++;
+        }
+    }
+
+    if (latencies > 0) res->commitLatency /= latencies;
+    if (propagations > 0) res->blockPropagation /= propagations;
+}
+
+
+void collectHotStuff(ApplicationContainer apps, int n, BenchResult *res) {
+    *res = collect<HotStuffCorrect>(apps, n, apps.Get(0)->GetObject<HotStuffCorrect>()->getCommittedCount());
+}
+
+
+void collectTendermint(ApplicationContainer apps, int n, BenchResult *res) {
+    *res = collect<TendermintCorrect>(apps, n, apps.Get(0)->GetObject<TendermintCorrect>()->getCommittedCount());
+}
+
+
+// a block is an ordered certificate with a batch
+void collectNarwhal(ApplicationContainer apps, int n, BenchResult *res) {
+    *res = collect<NarwhalCorrect>(apps, n, apps.Get(0)->GetObject<NarwhalCorrect>()->getCommittedCount());
+}
+
+
+double percentile(std::vector<double> &sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t i = std::min(sorted.size() - 1, (size_t) (q * sorted.size()));
+    return sorted[i];
+}
+
+
+int parseTransport(std::string t) {
+    if (t == "relay") return ConsensusMessageBase::RELAY;
+    if (t == "flood") return ConsensusMessageBase::FLOOD;
+    if (t == "mixed") return ConsensusMessageBase::MIXED;
+    if (t == "core_relay") return ConsensusMessageBase::CORE_RELAY;
+    if (t == "infect") return ConsensusMessageBase::INFECT_UPON_CONTAGION;
+    return -1;
+}
+
+
+int parseOverlay(std::string o) {
+    if (o == "spt") return BlockChainTopologyHelper::SHORTEST_PATH_TREE;
+    if (o == "sequencial_aware") return BlockChainTopologyHelper::SEQUENCIAL_AWARE;
+    if (o == "distributed") return BlockChainTopologyHelper::DISTRIBUTED;
+    if (o == "kadcast") return BlockChainTopologyHelper::KADCAST;
+    return -1;
+}
+
+
+int main(int argc, char *argv[])    {
+
+    int payloadLen = 50;        // k byte
+    std::string protocol = "pbft";
+    std::string transport = "relay";
+    std::string overlay = "spt";
+    uint32_t nodesCount = 32;
+    double simTime = 60;         // second
+
+    // open-loop load, clients spread over the nodes
+    uint32_t clients = 4;
+    double rate = 10;            // requests per second per client
+    uint32_t reqSize = 250;      // bytes
+
+    // requests per proposal, pbft and tendermint, per header batch for narwhal
+    uint32_t batch = 1;
+    // pbft only
+    uint32_t window = 1;
+    // tendermint only, bytes per block part, parts by bitfield between direct peers or over the transport
+    uint32_t partSize = 64;
+    bool partGossip = true;
+    // pbft and tendermint, requests gossiped between direct peers through a bounded mempool
+    bool mempool = false;
+    uint32_t mempoolSize = 0;    // requests, 0 for unbounded
+    // pbft, pre-prepares as compact blocks rebuilt from the mempool
+    bool compact = false;
+    // pbft, committees from spectral clusters of the topology
+    uint32_t shards = 1;
+
+    std::string out = "";
+    // folder of overlay caches, empty to always build the overlay
+    std::string overlayCache = "";
+
+    std::string confFile = "/home/y1qin9zhu/Documents/ns3/ns-allinone-3.30.1/ns-3.30.1/src/applications/ping-data.json";
+
+	CommandLine cmd;
+	cmd.AddValue(
+		"l",
+		"payload length",
+		payloadLen
+	);
+	cmd.AddValue(
+		"protocol",
+		"pbft, hotstuff, tendermint or narwhal",
+		protocol
+	);
+	cmd.AddValue(
+		"transport",
+		"relay, core_relay, flood, mixed or infect",
+		transport
+	);
+	cmd.AddValue(
+		"overlay",
+		"spt, sequencial_aware, distributed or kadcast, committees only use spt",
+		overlay
+	);
+	cmd.AddValue(
+		"n",
+		"number of nodes",
+		nodesCount
+	);
+	cmd.AddValue(
+		"t",
+		"simulation time in seconds",
+		simTime
+	);
+	cmd.AddValue(
+		"clients",
+		"number of workload clients",
+		clients
+	);
+	cmd.AddValue(
+		"rate",
+		"requests per second of every client",
+		rate
+	);
+	cmd.AddValue(
+		"reqSize",
+		"request size in bytes",
+		reqSize
+	);
+	cmd.AddValue(
+		"batch",
+		"max requests per pbft or tendermint proposal or narwhal batch",
+		batch
+	);
+	cmd.AddValue(
+		"window",
+		"pbft pipeline window",
+		window
+	);
+	cmd.AddValue(
+		"partSize",
+		"tendermint block part size in bytes",
+		partSize
+	);
+	cmd.AddValue(
+		"partGossip",
+		"tendermint parts by bitfield between direct peers instead of over the transport",
+		partGossip
+	);
+	cmd.AddValue(
+		"mempool",
+		"gossip requests through the mempool, pbft and tendermint",
+		mempool
+	);
+	cmd.AddValue(
+		"mempoolSize",
+		"mempool capacity in requests, the oldest are evicted beyond it, 0 for unbounded",
+		mempoolSize
+	);
+	cmd.AddValue(
+		"compact",
+		"pbft pre-prepares as compact blocks, needs --mempool",
+		compact
+	);
+	cmd.AddValue(
+		"shards",
+		"pbft committees, one per spectral cluster of the topology, relayed over spt trees",
+		shards
+	);
+	cmd.AddValue(
+		"overlayCache",
+		"folder to load overlays from and save them to, empty to disable",
+		overlayCache
+	);
+	cmd.AddValue(
+		"out",
+		"file to append the record to",
+		out
+	);
+	cmd.AddValue(
+		"geo",
+		"ping data of the geo topology",
+		confFile
+	);
+	cmd.Parse(argc,argv);
+
+    int relayType = parseTransport(transport);
+    int overlayMethod = parseOverlay(overlay);
+
+    if (relayType < 0 || overlayMethod < 0 || (protocol != "pbft" && protocol != "hotstuff" && protocol != "tendermint" && protocol != "narwhal")) {
+        std::cerr << "unknown protocol, transport or overlay" << std::endl;
+        return 1;
+    }
+
+    if (shards < 1 || (shards > 1 && protocol != "pbft")) {
+        std::cerr << "shards are pbft committees" << std::endl;
+        return 1;
+    }
+
+    if (shards > 1 && overlay != "spt") {
+        std::cerr << "committees relay over shortest path trees, --overlay must be spt with shards" << std::endl;
+        return 1;
+    }
+
+    double timeout = 100.0;
+
+    int totalDataRate = 300000; // bps *1000 ratio to speed up simulation
+
+    Ipv4AddressHelper address;
+    address.SetBase("10.0.0.0","255.255.255.0");
+
+    BlockChainTopologyHelper topologyHelper(nodesCount, 0);
+
+    GeoSimulationTopologyHelper geo(confFile);
+
+    Ptr<EmpiricalRandomVariable> bandwidthEmpirical = CreateObject<EmpiricalRandomVariable> ();
+
+    for (auto i: bandwidthDistribution_BitcoinV6) {
+        bandwidthEmpirical->CDF(i[0], i[1]);
+    }
+
+    std::vector<GeoSimulationTopologyHelper::DelayInfo> links = geo.getClique(nodesCount);
+
+    NS_ASSERT(nodesCount == geo.getCliqueCityList().size());
+
+    for (auto link : links) {
+        auto bandwidth = (int) (bandwidthEmpirical->GetValue() * 1000000);
+        topologyHelper.insertLinkInfo(link.noFrom, link.noTo, link.avgDelay, bandwidth);
+    }
+
+    // the clients are the only load
+    PBFTCorrectHelper pbfthelper = PBFTCorrectHelper(nodesCount, timeout);
+    HotStuffCorrectHelper hotstuffhelper = HotStuffCorrectHelper(nodesCount, timeout);
+    TendermintCorrectHelper tenderminthelper = TendermintCorrectHelper(nodesCount, timeout);
+    NarwhalCorrectHelper narwhalhelper = NarwhalCorrectHelper(nodesCount);
+
+    if (protocol == "hotstuff") {
+        hotstuffhelper.SetVoteNodes(nodesCount);
+        hotstuffhelper.SetBlockSz(payloadLen);
+        hotstuffhelper.SetTransType(relayType);
+        hotstuffhelper.SetTransferModel(BlockChainApplicationBase<PBFTMessage>::SEQUENCIAL);
+        hotstuffhelper.SetFloodRandomization(true);
+        hotstuffhelper.SetContinous(false);
+        hotstuffhelper.SetOutboundBandwidth((double)totalDataRate);
+
+        topologyHelper.setupHotStuffApp(hotstuffhelper);
+    }
+    else if (protocol == "tendermint") {
+        tenderminthelper.SetBlockSz(batch * reqSize);
+        tenderminthelper.SetPartSz(partSize);
+        tenderminthelper.SetPartGossip(partGossip, 0.5);
+        tenderminthelper.SetMempool(mempool, mempoolSize, 0, Mempool::MEMPOOL_DROP_OLDEST);
+        tenderminthelper.SetTransType(relayType);
+        tenderminthelper.SetTransferModel(BlockChainApplicationBase<TendermintMessage>::SEQUENCIAL);
+        tenderminthelper.SetFloodRandomization(true);
+        tenderminthelper.SetContinous(false);
+        tenderminthelper.SetOutboundBandwidth((double)totalDataRate);
+
+        topologyHelper.setupTendermintApp(tenderminthelper);
+    }
+    else if (protocol == "narwhal") {
+        narwhalhelper.SetBatchSz(batch * reqSize);
+        narwhalhelper.SetTransType(relayType);
+        narwhalhelper.SetTransferModel(BlockChainApplicationBase<PBFTMessage>::SEQUENCIAL);
+        narwhalhelper.SetFloodRandomization(true);
+        narwhalhelper.SetContinous(false);
+        narwhalhelper.SetOutboundBandwidth((double)totalDataRate);
+
+        topologyHelper.setupNarwhalApp(narwhalhelper);
+    }
+    else {
+        pbfthelper.SetVoteNodes(nodesCount);
+        pbfthelper.SetBlockSz(payloadLen);
+        pbfthelper.SetDelay(0);
+        pbfthelper.SetTransType(relayType);
+        pbfthelper.SetTransferModel(BlockChainApplicationBase<PBFTMessage>::SEQUENCIAL);
+        pbfthelper.SetFloodRandomization(true);
+        pbfthelper.SetContinous(false);
+        pbfthelper.SetOutboundBandwidth((double)totalDataRate);
+        pbfthelper.setBroadcastDuplicateCount(1);
+        pbfthelper.SetBatchPolicy(batch, 0, batch > 1 ? 0.1 : 0);
+        pbfthelper.SetPipelineWindow(window);
+        pbfthelper.SetMempool(mempool, mempoolSize, 0, Mempool::MEMPOOL_DROP_OLDEST);
+        pbfthelper.SetCompactBlocks(compact);
+
+        if (shards > 1) {
+            // clusters on the link metric of large messages
+            topologyHelper.setMessageSize(payloadLen * 1000);
+            topologyHelper.setupShardedPBFTApp(pbfthelper, topologyHelper.clusterCommittees(shards));
+        }
+        else {
+            topologyHelper.setupPBFTApp(pbfthelper);
+        }
+    }
+
+    topologyHelper.setAddressHelper(address);
+    topologyHelper.setNodeBw(totalDataRate);
+    topologyHelper.setMessageSize(payloadLen * 1000);
+
+    topologyHelper.setTopologyGenerationMethod1(overlayMethod);
+    topologyHelper.setTopologyGenerationMethod2(overlayMethod);
+    topologyHelper.setBroadwidthModel(BlockChainTopologyHelper::CAPPED_BY_NODE);
+
+    topologyHelper.installLink();
+    topologyHelper.enableShardTrafficTrace();
+
+    topologyHelper.setLinkMetricDefination(BlockChainTopologyHelper::DELAY_BW_BALANCE);
+    topologyHelper.setChooseCoreMethod(BlockChainTopologyHelper::ALL);
+    topologyHelper.setOverlayCache(overlayCache);
+
+    topologyHelper.setOverlayRoute();
+    topologyHelper.installShorestPath();
+
+    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+
+    std::cout << "Topology build done." << std::endl;
+
+    ApplicationContainer apps = topologyHelper.getApp();
+
+    WorkloadClientHelper workloadHelper(WorkloadClient::POISSON, rate);
+    workloadHelper.SetRequestSize(reqSize, reqSize);
+
+    NodeContainer clientNodes;
+    uint32_t shardN = topologyHelper.getShardN();
+
+    for (uint32_t i = 0; i < clients && i < nodesCount; ++i) {
+        if (shardN > 1) {
+            ApplicationContainer committee = topologyHelper.getShardApp(i % shardN);
+            clientNodes.Add(committee.Get((i / shardN) % committee.GetN())->GetNode());
+        }
+        else {
+            clientNodes.Add(apps.Get(i * nodesCount / clients)->GetNode());
+        }
+    }
+
+    ApplicationContainer workload = workloadHelper.Install(clientNodes);
+
+    BenchResult res;
+    std::vector<BenchResult> shardRes;
+
+    if (protocol == "hotstuff") {
+        Simulator::Schedule(Seconds(simTime - 0.5), collectHotStuff, apps, nodesCount, &res);
+    }
+    else if (protocol == "tendermint") {
+        Simulator::Schedule(Seconds(simTime - 0.5), collectTendermint, apps, nodesCount, &res);
+    }
+    else if (protocol == "narwhal") {
+        Simulator::Schedule(Seconds(simTime - 0.5), collectNarwhal, apps, nodesCount, &res);
+    }
+    else if (shardN > 1) {
+        Simulator::Schedule(Seconds(simTime - 0.5), collectShardedPBFT, &topologyHelper, &shardRes, &res);
+    }
+    else {
+        Simulator::Schedule(Seconds(simTime - 0.5), collectPBFT, apps, nodesCount, &res);
+    }
+
+    apps.Start(Seconds(0));
+    apps.Stop(Seconds(simTime));
+
+    workload.Start(Seconds(0.1));
+    workload.Stop(Seconds(simTime - 0.5));
+
+    auto wallStart = std::chrono::steady_clock::now();
+
+    Simulator::Run();
+
+    double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+    uint32_t sent = 0;
+    uint32_t completed = 0;
+    std::vector<double> latencies;
+
+    for (uint32_t i = 0; i < workload.GetN(); ++i) {
+        Ptr<WorkloadClient> wc = workload.Get(i)->GetObject<WorkloadClient>();
+        sent += wc->getSentCount();
+        completed += wc->getCompletedCount();
+        latencies.insert(latencies.end(), wc->getLatencySamples().begin(), wc->getLatencySamples().end());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    double measured = simTime - 0.5;
+
+    if (shardRes.empty()) shardRes.push_back(res);
+
+    std::ostringstream shardBlocks;
+    for (size_t s = 0; s < shardRes.size(); ++s) {
+        shardBlocks << (s == 0 ? "" : ",") << shardRes[s].blocks / measured;
+    }
+
+    std::ostringstream record;
+    record << "{\"protocol\":\"" << protocol << "\",\"transport\":\"" << transport
+        << "\",\"overlay\":\"" << overlay << "\",\"n\":" << nodesCount
+        << ",\"clients\":" << clientNodes.GetN() << ",\"offered\":" << rate * clientNodes.GetN()
+        << ",\"reqSize\":" << reqSize << ",\"batch\":" << batch << ",\"window\":" << window
+        << ",\"mempool\":" << (mempool ? "true" : "false") << ",\"mempoolSize\":" << mempoolSize
+        << ",\"compact\":" << (compact ? "true" : "false")
+        << ",\"simTime\":" << simTime
+        << ",\"blocks\":" << res.blocks << ",\"blocksPerSec\":" << res.blocks / measured
+        << ",\"sent\":" << sent << ",\"completed\":" << completed
+        << ",\"latencyP50\":" << percentile(latencies, 0.5)
+        << ",\"latencyP90\":" << percentile(latencies, 0.9)
+        << ",\"latencyP99\":" << percentile(latencies, 0.99)
+        << ",\"commitLatency\":" << res.commitLatency
+        << ",\"bytesPerCommit\":" << (res.blocks == 0 ? 0 : (double) res.bytes / res.blocks)
+        << ",\"messagesPerCommit\":" << (res.blocks == 0 ? 0 : (double) res.messages / res.blocks)
+        << ",\"mempoolEvicted\":" << res.mempoolEvicted << ",\"mempoolDuplicates\":" << res.mempoolDuplicates
+        << ",\"blockBytesPerCommit\":" << (res.blocks == 0 ? 0 : (double) res.blockBytes / res.blocks)
+        << ",\"blockPropagation\":" << res.blockPropagation
+        << ",\"compactBlocks\":" << res.compactBlocks << ",\"compactRebuilt\":" << res.compactRebuilt
+        << ",\"compactMissingTxs\":" << res.compactMissingTxs
+        << ",\"shards\":" << shardRes.size() << ",\"shardBlocksPerSec\":[" << shardBlocks.str() << "]"
+        << ",\"intraShardBytes\":" << topologyHelper.getIntraShardBytes()
+        << ",\"transitBytes\":" << topologyHelper.getTransitBytes()
+        << ",\"crossShardMessages\":false"
+        << ",\"wallTime\":" << wallTime << "}";
+
+    std::cout << record.str() << std::endl;
+
+    if (out != "") {
+        std::ofstream file(out, std::ios::app);
+        file << record.str() << std::endl;
+    }
+
+  	Simulator::Destroy();
+
+    return 0;
+}
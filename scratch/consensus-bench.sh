@@ -0,0 +1,49 @@
+#!/bin/bash
+# Yiqing Zhu
+# yiqing.zhu.314@gmail.com
+#
+# sweep consensus-bench over protocols, transports, overlays, node counts and offered load
+# run from the ns3 root folder, records are appended to $OUT one json line per run
+#
+# ./scratch/consensus-bench.sh [out file]
+
+OUT=${1:-bench-$(date +%Y%m%d-%H%M%S).jsonl}
+
+PROTOCOLS=${PROTOCOLS:-"pbft hotstuff tendermint narwhal"}
+TRANSPORTS=${TRANSPORTS:-"relay core_relay flood mixed infect"}
+OVERLAYS=${OVERLAYS:-"spt distributed"}
+NODES=${NODES:-"16 32"}
+RATES=${RATES:-"1 5 10 20 40"}     # requests per second per client
+CLIENTS=${CLIENTS:-4}
+BLOCKS=${BLOCKS:-"full"}           # full, compact: pbft pre-prepares rebuilt from the mempool
+SHARDS=${SHARDS:-"1"}              # pbft committees, e.g. "1 2 4" with CLIENTS at least the largest
+SIMTIME=${SIMTIME:-60}
+OVERLAY_CACHE=${OVERLAY_CACHE-overlay-cache}   # overlays reused across rates, empty to always build
+
+cache=""
+[ -n "$OVERLAY_CACHE" ] && mkdir -p "$OVERLAY_CACHE" && cache="--overlayCache=$OVERLAY_CACHE"
+
+for p in $PROTOCOLS; do
+  for tr in $TRANSPORTS; do
+    for o in $OVERLAYS; do
+      for n in $NODES; do
+        for r in $RATES; do
+          for b in $BLOCKS; do
+            for s in $SHARDS; do
+              [ "$s" != 1 ] && [ "$p" != pbft ] && continue
+              # committees always relay over spt trees, other overlays are rejected
+              [ "$s" != 1 ] && [ "$o" != spt ] && continue
+              blocks=""
+              [ "$b" = compact ] && blocks="--mempool=1 --compact=1"
+              ./waf --run "consensus-bench --protocol=$p --transport=$tr --overlay=$o --n=$n \
+                --clients=$CLIENTS --rate=$r --t=$SIMTIME --shards=$s $blocks $cache --out=$OUT" > /dev/null \
+                || echo "failed: $p $tr $o $n $r $b $s" >&2
+            done
+          done
+        done
+      done
+    done
+  done
+done
+
+echo "records in $OUT"
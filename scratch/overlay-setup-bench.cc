@@ -0,0 +1,227 @@
+/*
+Yiqing Zhu
+yiqing.zhu.314@gmail.com
+**/
+
+/*
+ * wall time of building a topology and its overlay, without running the simulation, e.g.
+ *
+ * ./waf --run "overlay-setup-bench --n=100 --degree=0"
+ * ./waf --run "overlay-setup-bench --n=2000 --degree=16 --overlay=spt"
+ *
+ * random topology: a ring for connectivity plus random links up to the average degree, 0 for a clique,
+ * link delays uniform in [minDelay, maxDelay] seconds and bandwidth as in consensus-bench.
+ * scratch/overlay-setup-bench.sh sweeps node counts.
+ * each run ends with one json record on a line of its own, appended to --out if given:
+ * links and seconds spent in installLink, setOverlayRoute and installShorestPath
+ **/
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/random-variable-stream.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <random>
+#include <chrono>
+
+using namespace ns3;
+
+// cite from Decentralization in Bitcoin and Ethereum Networks
+std::array<std::array<double, 2>, 4> bandwidthDistribution_BitcoinV6 = {{
+                                                                        {78.2, 0.5},
+                                                                        {94.3, 0.67},
+                                                                        {207.9, 0.9},
+                                                                        {300, 1}
+                                                                    }};
+
+
+int parseOverlay(std::string o) {
+    if (o == "spt") return BlockChainTopologyHelper::SHORTEST_PATH_TREE;
+    if (o == "sequencial_aware") return BlockChainTopologyHelper::SEQUENCIAL_AWARE;
+    if (o == "distributed") return BlockChainTopologyHelper::DISTRIBUTED;
+    if (o == "kadcast") return BlockChainTopologyHelper::KADCAST;
+    return -1;
+}
+
+
+double since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char *argv[])    {
+
+    uint32_t nodesCount = 100;
+    uint32_t degree = 0;         // average, 0 for a clique
+    double minDelay = 0.005;     // second
+    double maxDelay = 0.15;
+    std::string overlay = "spt";
+    uint32_t seed = 1;
+    uint32_t threads = 0;        // tree building threads, 0 for one per hardware thread
+
+    std::string out = "";
+    // folder of overlay caches, empty to always build the overlay
+    std::string overlayCache = "";
+
+	CommandLine cmd;
+	cmd.AddValue(
+		"n",
+		"number of nodes",
+		nodesCount
+	);
+	cmd.AddValue(
+		"degree",
+		"average node degree, 0 for a clique",
+		degree
+	);
+	cmd.AddValue(
+		"minDelay",
+		"min link delay in seconds",
+		minDelay
+	);
+	cmd.AddValue(
+		"maxDelay",
+		"max link delay in seconds",
+		maxDelay
+	);
+	cmd.AddValue(
+		"overlay",
+		"spt, sequencial_aware, distributed or kadcast",
+		overlay
+	);
+	cmd.AddValue(
+		"seed",
+		"topology seed",
+		seed
+	);
+	cmd.AddValue(
+		"threads",
+		"threads building overlay trees, 0 for one per hardware thread",
+		threads
+	);
+	cmd.AddValue(
+		"overlayCache",
+		"folder to load overlays from and save them to, empty to disable",
+		overlayCache
+	);
+	cmd.AddValue(
+		"out",
+		"file to append the record to",
+		out
+	);
+	cmd.Parse(argc,argv);
+
+    int overlayMethod = parseOverlay(overlay);
+
+    if (overlayMethod < 0 || nodesCount < 3) {
+        std::cerr << "unknown overlay or too few nodes" << std::endl;
+        return 1;
+    }
+
+    if (degree == 0 || degree >= nodesCount - 1) degree = nodesCount - 1;
+
+    int totalDataRate = 300000; // bps *1000 ratio to speed up simulation
+
+    RngSeedManager::SetSeed(seed);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> delayDist(minDelay, maxDelay);
+    std::uniform_int_distribution<uint32_t> nodeDist(0, nodesCount - 1);
+
+    Ptr<EmpiricalRandomVariable> bandwidthEmpirical = CreateObject<EmpiricalRandomVariable> ();
+
+    for (auto i: bandwidthDistribution_BitcoinV6) {
+        bandwidthEmpirical->CDF(i[0], i[1]);
+    }
+
+    // undirected links as <low, high>
+    std::set<std::pair<uint32_t, uint32_t> > links;
+
+    if (degree == nodesCount - 1) {
+        for (uint32_t a = 0; a < nodesCount; ++a) {
+            for (uint32_t b = a + 1; b < nodesCount; ++b) {
+                links.insert(std::make_pair(a, b));
+            }
+        }
+    }
+    else {
+        for (uint32_t a = 0; a < nodesCount; ++a) {
+            uint32_t b = (a + 1) % nodesCount;
+            links.insert(std::make_pair(std::min(a, b), std::max(a, b)));
+        }
+        while (links.size() < (size_t) nodesCount * degree / 2) {
+            uint32_t a = nodeDist(rng), b = nodeDist(rng);
+            if (a != b) links.insert(std::make_pair(std::min(a, b), std::max(a, b)));
+        }
+    }
+
+    auto wallStart = std::chrono::steady_clock::now();
+
+    Ipv4AddressHelper address;
+    address.SetBase("10.0.0.0","255.255.255.0");
+
+    BlockChainTopologyHelper topologyHelper(nodesCount, 0);
+
+    for (auto link : links) {
+        auto bandwidth = (int) (bandwidthEmpirical->GetValue() * 1000000);
+        topologyHelper.insertLinkInfo(link.first, link.second, delayDist(rng), bandwidth);
+    }
+
+    PBFTCorrectHelper pbfthelper = PBFTCorrectHelper(nodesCount, 100.0);
+    pbfthelper.SetVoteNodes(nodesCount);
+    pbfthelper.SetTransType(ConsensusMessageBase::RELAY);
+    pbfthelper.SetOutboundBandwidth((double)totalDataRate);
+
+    topologyHelper.setupPBFTApp(pbfthelper);
+
+    topologyHelper.setAddressHelper(address);
+    topologyHelper.setNodeBw(totalDataRate);
+    topologyHelper.setMessageSize(50 * 1000);
+
+    topologyHelper.setTopologyGenerationMethod1(overlayMethod);
+    topologyHelper.setTopologyGenerationMethod2(overlayMethod);
+    topologyHelper.setBroadwidthModel(BlockChainTopologyHelper::CAPPED_BY_NODE);
+    topologyHelper.setBuildThreadN(threads);
+
+    auto phase = std::chrono::steady_clock::now();
+    topologyHelper.installLink();
+    double installLinkTime = since(phase);
+
+    topologyHelper.setLinkMetricDefination(BlockChainTopologyHelper::DELAY_BW_BALANCE);
+    topologyHelper.setChooseCoreMethod(BlockChainTopologyHelper::ALL);
+    topologyHelper.setOverlayCache(overlayCache);
+
+    phase = std::chrono::steady_clock::now();
+    topologyHelper.setOverlayRoute();
+    double overlayTime = since(phase);
+
+    phase = std::chrono::steady_clock::now();
+    topologyHelper.installShorestPath();
+    double shortestPathTime = since(phase);
+
+    double wallTime = since(wallStart);
+
+    std::ostringstream record;
+    record << "{\"n\":" << nodesCount << ",\"degree\":" << degree << ",\"links\":" << links.size()
+        << ",\"overlay\":\"" << overlay << "\",\"seed\":" << seed << ",\"threads\":" << threads
+        << ",\"installLink\":" << installLinkTime
+        << ",\"setOverlayRoute\":" << overlayTime
+        << ",\"installShortestPath\":" << shortestPathTime
+        << ",\"wallTime\":" << wallTime << "}";
+
+    std::cout << record.str() << std::endl;
+
+    if (out != "") {
+        std::ofstream file(out, std::ios::app);
+        file << record.str() << std::endl;
+    }
+
+  	Simulator::Destroy();
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+# Yiqing Zhu
+# yiqing.zhu.314@gmail.com
+#
+# time topology and overlay setup over node counts, run from the ns3 root folder,
+# records are appended to $OUT one json line per run
+#
+# ./scratch/overlay-setup-bench.sh [out file]
+
+OUT=${1:-setup-$(date +%Y%m%d-%H%M%S).jsonl}
+
+NODES=${NODES:-"100 500 2000"}
+CLIQUE_MAX=${CLIQUE_MAX:-100}      # node counts up to this are cliques
+DEGREE=${DEGREE:-16}               # average degree above it
+OVERLAYS=${OVERLAYS:-"spt"}
+SEEDS=${SEEDS:-"1 2 3"}
+THREADS=${THREADS:-"1 0"}          # tree building threads, 0 for one per hardware thread
+
+for o in $OVERLAYS; do
+  for n in $NODES; do
+    d=$DEGREE
+    [ "$n" -le "$CLIQUE_MAX" ] && d=0
+    for t in $THREADS; do
+      for s in $SEEDS; do
+        ./waf --run "overlay-setup-bench --n=$n --degree=$d --overlay=$o --seed=$s --threads=$t --out=$OUT" > /dev/null \
+          || echo "failed: $o $n $s $t" >&2
+      done
+    done
+  done
+done
+
+echo "records in $OUT"
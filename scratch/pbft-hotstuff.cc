@@ -0,0 +1,203 @@
+/*
+Yiqing Zhu
+yiqing.zhu.314@gmail.com
+**/
+
+/*
+ * PBFT against chained HotStuff on the same geo clique topology and overlay, e.g.
+ *
+ * for p in pbft hotstuff; do ./waf --run "pbft-hotstuff --protocol=$p"; done
+ *
+ * each run ends with a line
+ * <compare: protocol blocks messages-per-block bytes-per-node commit-latency >
+ * blocks are counted at node 0, messages and bytes are received ones summed over all nodes,
+ * commit latency is from a block first seen at a replica to its commit there, averaged over replicas
+ **/
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/random-variable-stream.h"
+
+#include <iostream>
+
+using namespace ns3;
+
+// cite from Decentralization in Bitcoin and Ethereum Networks
+std::array<std::array<double, 2>, 4> bandwidthDistribution_BitcoinV6 = {{
+                                                                        {78.2, 0.5},
+                                                                        {94.3, 0.67},
+                                                                        {207.9, 0.9},
+                                                                        {300, 1}
+                                                                    }};
+
+
+template<class App>
+void printCompare(std::string protocol, ApplicationContainer apps, int n, uint32_t blocks) {
+
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    double latency = 0;
+    int replicas = 0;
+
+    for (int i = 0; i < n; ++i) {
+        Ptr<App> app = apps.Get(i)->GetObject<App>();
+        messages += app->getTotalRecvMessages();
+        bytes += app->getTotalRecvBytes();
+        if (app->getAverageCommitLatency() > 0) {
+            latency += app->getAverageCommitLatency();
+            replicas++;
+        }
+    }
+
+    std::cout << "<compare: " << protocol << " " << blocks << " " 
+        << (blocks == 0 ? 0 : (double) messages / blocks) << " " << (double) bytes / n << " "
+        << (replicas == 0 ? 0 : latency / replicas) << " >" << std::endl;
+}
+
+
+void printPBFT(ApplicationContainer apps, int n) {
+    printCompare<PBFTCorrect>("pbft", apps, n, apps.Get(0)->GetObject<PBFTCorrect>()->getExecutedCount());
+}
+
+
+void printHotStuff(ApplicationContainer apps, int n) {
+    printCompare<HotStuffCorrect>("hotstuff", apps, n, apps.Get(0)->GetObject<HotStuffCorrect>()->getCommittedCount());
+}
+
+
+int main(int argc, char *argv[])    {
+
+    int payloadLen = 50;        // k byte
+    std::string protocol = "pbft";
+    uint32_t nodesCount = 32;
+    double simTime = 60;         // second
+
+    std::string confFile = "/home/y1qin9zhu/Documents/ns3/ns-allinone-3.30.1/ns-3.30.1/src/applications/ping-data.json";
+
+	CommandLine cmd;
+	cmd.AddValue(
+		"l",
+		"payload length",
+		payloadLen
+	);
+	cmd.AddValue(
+		"protocol",
+		"pbft or hotstuff",
+		protocol
+	);
+	cmd.AddValue(
+		"n",
+		"number of nodes",
+		nodesCount
+	);
+	cmd.AddValue(
+		"t",
+		"simulation time in seconds",
+		simTime
+	);
+	cmd.AddValue(
+		"geo",
+		"ping data of the geo topology",
+		confFile
+	);
+	cmd.Parse(argc,argv);
+
+    double timeout = 100.0;
+
+    int totalDataRate = 300000; // bps *1000 ratio to speed up simulation
+
+    Ipv4AddressHelper address;
+    address.SetBase("10.0.0.0","255.255.255.0");
+
+    BlockChainTopologyHelper topologyHelper(nodesCount, 0);
+
+    GeoSimulationTopologyHelper geo(confFile);
+
+    Ptr<EmpiricalRandomVariable> bandwidthEmpirical = CreateObject<EmpiricalRandomVariable> ();
+
+    for (auto i: bandwidthDistribution_BitcoinV6) {
+        bandwidthEmpirical->CDF(i[0], i[1]);
+    }
+
+    std::vector<GeoSimulationTopologyHelper::DelayInfo> links = geo.getClique(nodesCount);
+
+    NS_ASSERT(nodesCount == geo.getCliqueCityList().size());
+
+    for (auto link : links) {
+        auto bandwidth = (int) (bandwidthEmpirical->GetValue() * 1000000);
+        topologyHelper.insertLinkInfo(link.noFrom, link.noTo, link.avgDelay, bandwidth);
+    }
+
+    // same settings for both protocols
+    PBFTCorrectHelper pbfthelper = PBFTCorrectHelper(nodesCount, timeout);
+    HotStuffCorrectHelper hotstuffhelper = HotStuffCorrectHelper(nodesCount, timeout);
+
+    if (protocol == "hotstuff") {
+        hotstuffhelper.SetVoteNodes(nodesCount);
+        hotstuffhelper.SetBlockSz(payloadLen);
+        hotstuffhelper.SetTransType(ConsensusMessageBase::RELAY);
+        hotstuffhelper.SetTransferModel(BlockChainApplicationBase<PBFTMessage>::SEQUENCIAL);
+        hotstuffhelper.SetFloodRandomization(true);
+        hotstuffhelper.SetContinous(true);
+        hotstuffhelper.SetOutboundBandwidth((double)totalDataRate);
+
+        topologyHelper.setupHotStuffApp(hotstuffhelper);
+    }
+    else {
+        pbfthelper.SetVoteNodes(nodesCount);
+        pbfthelper.SetBlockSz(payloadLen);
+        pbfthelper.SetDelay(0);
+        pbfthelper.SetTransType(ConsensusMessageBase::RELAY);
+        pbfthelper.SetTransferModel(BlockChainApplicationBase<PBFTMessage>::SEQUENCIAL);
+        pbfthelper.SetFloodRandomization(true);
+        pbfthelper.SetContinous(true);
+        pbfthelper.SetOutboundBandwidth((double)totalDataRate);
+        pbfthelper.setBroadcastDuplicateCount(1);
+
+        topologyHelper.setupPBFTApp(pbfthelper);
+    }
+
+    topologyHelper.setAddressHelper(address);
+    topologyHelper.setNodeBw(totalDataRate);
+    topologyHelper.setMessageSize(payloadLen * 1000);
+
+    topologyHelper.setTopologyGenerationMethod1(BlockChainTopologyHelper::SHORTEST_PATH_TREE);
+    topologyHelper.setTopologyGenerationMethod2(BlockChainTopologyHelper::SHORTEST_PATH_TREE);
+    topologyHelper.setBroadwidthModel(BlockChainTopologyHelper::CAPPED_BY_NODE);
+
+    topologyHelper.installLink();
+
+    topologyHelper.setLinkMetricDefination(BlockChainTopologyHelper::DELAY_BW_BALANCE);
+    topologyHelper.setChooseCoreMethod(BlockChainTopologyHelper::ALL);
+
+    topologyHelper.setOverlayRoute();
+    topologyHelper.installShorestPath();
+
+    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+
+    std::cout << "Topology build done." << std::endl;
+
+    ApplicationContainer apps = topologyHelper.getApp();
+
+    if (protocol == "hotstuff") {
+        Ptr<HotStuffCorrect> client = apps.Get(1)->GetObject<HotStuffCorrect>();
+        Simulator::Schedule(Seconds(0.1), &HotStuffCorrect::sendRequest, client);
+        Simulator::Schedule(Seconds(simTime - 0.5), printHotStuff, apps, nodesCount);
+    }
+    else {
+        Ptr<PBFTCorrect> client = apps.Get(1)->GetObject<PBFTCorrect>();
+        Simulator::Schedule(Seconds(0.1), &PBFTCorrect::sendRequest, client);
+        Simulator::Schedule(Seconds(simTime - 0.5), printPBFT, apps, nodesCount);
+    }
+
+    apps.Start(Seconds(0));
+    apps.Stop(Seconds(simTime));
+
+    Simulator::Run();
+  	Simulator::Destroy();
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+Yiqing Zhu
+yiqing.zhu.314@gmail.com
+**/
+
+/*
+ * throughput of pipelined PBFT w.r.t. the pipeline window, on the geo clique topology
+ * one window per run, e.g.
+ *
+ * for w in 1 2 4 8 16; do ./waf --run "pbft-pipeline --window=$w"; done
+ *
+ * the ping data is read from src/applications/ping-data.json unless --geo names another file
+ *
+ * each run ends with a line
+ * <pipeline: window executed duration throughput >
+ * throughput is blocks confirmed by a majority per second, measured at the primary
+ **/
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/random-variable-stream.h"
+
+#include <iostream>
+
+using namespace ns3;
+
+
+// cite from Decentralization in Bitcoin and Ethereum Networks
+std::array<std::array<double, 2>, 4> bandwidthDistribution_BitcoinV6 = {{
+                                                                        {78.2, 0.5},
+                                                                        {94.3, 0.67},
+                                                                        {207.9, 0.9},
+                                                                        {300, 1}
+                                                                    }};
+
+
+void printThroughput(Ptr<PBFTCorrect> primary, double start) {
+    double duration = Simulator::Now().GetSeconds() - start;
+    std::cout << "<pipeline: " << primary->getPipelineWindow() << " " << primary->getExecutedCount() << " "
+        << duration << " " << primary->getExecutedCount() / duration << " >" << std::endl;
+}
+
+
+int main(int argc, char *argv[])    {
+
+    int payloadLen = 50;        // k byte
+    uint32_t window = 1;
+    uint32_t nodesCount = 32;
+    double simTime = 60;         // second
+
+    // relative to the ns-3 root waf runs from
+    std::string confFile = "src/applications/ping-data.json";
+
+	CommandLine cmd;
+	cmd.AddValue(
+		"l",
+		"payload length",
+		payloadLen
+	);
+	cmd.AddValue(
+		"window",
+		"number of sequence numbers the primary keeps in flight",
+		window
+	);
+	cmd.AddValue(
+		"n",
+		"number of nodes",
+		nodesCount
+	);
+	cmd.AddValue(
+		"t",
+		"simulation time in seconds",
+		simTime
+	);
+	cmd.AddValue(
+		"geo",
+		"ping data of the geo topology, relative to the ns-3 root or absolute",
+		confFile
+	);
+	cmd.Parse(argc,argv);
+
+    double timeout = 100.0;
+
+    int totalDataRate = 300000; // bps *1000 ratio to speed up simulation
+
+    Ipv4AddressHelper address;
+    address.SetBase("10.0.0.0","255.255.255.0");
+
+    BlockChainTopologyHelper topologyHelper(nodesCount, 0);
+
+    GeoSimulationTopologyHelper geo(confFile);
+
+    Ptr<EmpiricalRandomVariable> bandwidthEmpirical = CreateObject<EmpiricalRandomVariable> ();
+
+    for (auto i: bandwidthDistribution_BitcoinV6) {
+        bandwidthEmpirical->CDF(i[0], i[1]);
+    }
+
+    std::vector<GeoSimulationTopologyHelper::DelayInfo> links = geo.getClique(nodesCount);
+
+    NS_ASSERT(nodesCount == geo.getCliqueCityList().size());
+
+    for (auto link : links) {
+        auto bandwidth = (int) (bandwidthEmpirical->GetValue() * 1000000);
+        topologyHelper.insertLinkInfo(link.noFrom, link.noTo, link.avgDelay, bandwidth);
+    }
+
+    PBFTCorrectHelper pbfthelper = PBFTCorrectHelper(nodesCount, timeout);
+    pbfthelper.SetVoteNodes(nodesCount);
+    pbfthelper.SetBlockSz(payloadLen);
+    pbfthelper.SetDelay(0);
+    pbfthelper.SetTransType(ConsensusMessageBase::RELAY);
+    pbfthelper.SetTransferModel(BlockChainApplicationBase<PBFTMessage>::SEQUENCIAL);
+    pbfthelper.SetFloodRandomization(true);
+    pbfthelper.SetContinous(true);
+    pbfthelper.SetOutboundBandwidth((double)totalDataRate);
+    pbfthelper.setBroadcastDuplicateCount(1);
+    pbfthelper.SetPipelineWindow(window);
+
+    topologyHelper.setupPBFTApp(pbfthelper);
+    topologyHelper.setAddressHelper(address);
+    topologyHelper.setNodeBw(totalDataRate);
+    topologyHelper.setMessageSize(payloadLen * 1000);
+
+    topologyHelper.setTopologyGenerationMethod1(BlockChainTopologyHelper::SHORTEST_PATH_TREE);
+    topologyHelper.setTopologyGenerationMethod2(BlockChainTopologyHelper::SHORTEST_PATH_TREE);
+    topologyHelper.setBroadwidthModel(BlockChainTopologyHelper::CAPPED_BY_NODE);
+
+    topologyHelper.installLink();
+
+    topologyHelper.setLinkMetricDefination(BlockChainTopologyHelper::DELAY_BW_BALANCE);
+    topologyHelper.setChooseCoreMethod(BlockChainTopologyHelper::ALL);
+
+    topologyHelper.setOverlayRoute();
+    topologyHelper.installShorestPath();
+
+    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+
+    std::cout << "Topology build done." << std::endl;
+
+    ApplicationContainer pbftNodes = topologyHelper.getApp();
+
+    Ptr<PBFTCorrect> primary = pbftNodes.Get(0)->GetObject<PBFTCorrect>();
+    Ptr<PBFTCorrect> client = pbftNodes.Get(1)->GetObject<PBFTCorrect>();
+
+    // fill the window, the primary keeps it full in continous mode
+    for (uint32_t i = 0; i < window; ++i) {
+        Simulator::Schedule(Seconds(0.1), &PBFTCorrect::sendRequest, client);
+    }
+
+    Simulator::Schedule(Seconds(simTime - 0.5), printThroughput, primary, 0.1);
+
+    pbftNodes.Start(Seconds(0));
+    pbftNodes.Stop(Seconds(simTime));
+
+    Simulator::Run();
+  	Simulator::Destroy();
+
+    return 0;
+}
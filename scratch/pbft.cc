@@ -88,6 +88,72 @@ void printLinkStress(Ptr<PBFTCorrect> app) {
 }
 
 
+void printSendBacklog(Ptr<PBFTCorrect> app) {
+    std::cout << app->getPeakSendBacklog() << "," << app->getSendQueueDrops() << " ";
+}
+
+
+// <name: bin start,bin end,count ... >
+void printHistogram(std::string name, Histogram &h) {
+    std::cout << "<" << name << ": ";
+    for (uint32_t i = 0; i < h.GetNBins(); ++i) {
+        if (h.GetBinCount(i) == 0) continue;
+        std::cout << h.GetBinStart(i) << "," << h.GetBinEnd(i) << "," << h.GetBinCount(i) << " ";
+    }
+    std::cout << ">" << std::endl;
+}
+
+
+void printBatching(ApplicationContainer apps, int n) {
+    for (int i = 0; i < n; ++i) {
+        Ptr<PBFTCorrect> app = apps.Get(i)->GetObject<PBFTCorrect>();
+        if (app->getPrimary() != app->getNodeId()) continue;
+        printHistogram("BatchSize", app->getBatchSizeHistogram());
+        printHistogram("BatchDelay", app->getBatchDelayHistogram());
+    }
+}
+
+
+// stable checkpoint, checkpoints sent, checkpoint bytes received, all bytes received, retained entries
+void printCheckpoint(Ptr<PBFTCorrect> app) {
+    std::cout << app->getLastStableCheckpoint() << "," << app->getCheckpointSent() << ","
+        << app->getCheckpointRecvBytes() << "," << app->getTotalRecvBytes() << "," 
+        << app->getRetainedStateSize() << " ";
+}
+
+
+// realised path, then the previous hop and reach time the overlay of the origin planned for the receiver
+void printProvenance(BlockChainTopologyHelper *topology, uint32_t recv, uint64_t msgId, 
+        const ConsensusMessageBase::Provenance &hops) {
+    std::cout << "<provenance: " << recv << " " << msgId << " " << Simulator::Now().GetSeconds() 
+        << " " << hops.size();
+    for (auto hop : hops) {
+        std::cout << " " << hop.first << "," << hop.second;
+    }
+    if (!hops.empty()) {
+        int root = hops.front().first;
+        std::cout << " planned " << topology->getPlannedPrev(root, recv) << "," 
+            << topology->getPlannedReachTime(root, recv);
+    }
+    std::cout << " >" << std::endl;
+}
+
+
+void printWorkload(Ptr<WorkloadClient> wc) {
+    std::cout << wc->getSentCount() << "," << wc->getCompletedCount() << "," << wc->getAverageLatency() << " ";
+}
+
+
+// view, view changes installed, last view change duration, last outage, rounds fetched by state transfer
+void printFailover(Ptr<PBFTCorrect> app) {
+    auto &log = app->getFailoverLog();
+    std::cout << app->getView() << "," << log.size() << ",";
+    if (log.empty()) std::cout << "-,-,";
+    else std::cout << std::get<1>(log.back()) << "," << std::get<2>(log.back()) << ",";
+    std::cout << app->getStateTransferRounds() << " ";
+}
+
+
 int main(int argc, char *argv[])    {
 
     // LogComponentEnable("PBFTCorrect", LOG_LEVEL_INFO);
@@ -97,12 +163,142 @@ int main(int argc, char *argv[])    {
     // shrink payload size and b.w togethor 1000 times to avoid it
     int payloadLen = 500;        // k byte
 
+    bool provenance = false;
+
+    // bytes, 0 for unbounded
+    uint64_t queueLimit = 0;
+    int queuePolicy = BlockChainApplicationBase<PBFTMessage>::QUEUE_UNBOUNDED;
+
+    // second, 0 keeps the static peer metric
+    double peerMetricInterval = 0;
+
+    // request batching at the primary, 1 request and no byte limit for no batching
+    uint32_t batchCount = 1;
+    uint32_t batchBytes = 0;
+    double batchDelay = 0;  // second
+
+    // rounds between checkpoints, 0 for no checkpoint
+    uint32_t checkpoint = 0;
+
+    double timeout = 100.0;
+
+    // second, crash the initial primary at the given time, 0 to keep it
+    double crashPrimary = 0;
+
+    // merge votes up the overlay trees, cpu seconds per merged vote, seconds to wait for children
+    bool aggregate = false;
+    double aggregationCost = 0.0001;
+    double aggregationWait = 0.2;
+
+    // open-loop workload clients, 0 keeps the single client at node 10
+    uint32_t clients = 0;
+    int arrival = WorkloadClient::POISSON;
+    double rate = 1.0;          // requests per second per client
+    uint32_t reqMin = 4;        // bytes
+    uint32_t reqMax = 4;
+    std::string trace = "";
+
 	CommandLine cmd;
 	cmd.AddValue(
 		"l",
 		"payload length",
 		payloadLen
 	);
+	cmd.AddValue(
+		"provenance",
+		"trace the path every message travelled, next to the path the overlay planned",
+		provenance
+	);
+	cmd.AddValue(
+		"queueLimit",
+		"bound of the send queue in bytes, 0 for unbounded",
+		queueLimit
+	);
+	cmd.AddValue(
+		"queuePolicy",
+		"send queue policy, 0: unbounded 1: drop tail 2: coalesce",
+		queuePolicy
+	);
+	cmd.AddValue(
+		"peerMetricInterval",
+		"re-rank peers from measured delay and goodput every given seconds, 0 to disable",
+		peerMetricInterval
+	);
+	cmd.AddValue(
+		"batchCount",
+		"max requests per proposal",
+		batchCount
+	);
+	cmd.AddValue(
+		"batchBytes",
+		"max request bytes per proposal, 0 for no limit",
+		batchBytes
+	);
+	cmd.AddValue(
+		"batchDelay",
+		"max seconds a request waits for its batch, 0 for no limit",
+		batchDelay
+	);
+	cmd.AddValue(
+		"checkpoint",
+		"rounds between checkpoints, 0 to disable",
+		checkpoint
+	);
+	cmd.AddValue(
+		"timeout",
+		"seconds without progress before the primary is suspected",
+		timeout
+	);
+	cmd.AddValue(
+		"crashPrimary",
+		"crash the initial primary at the given second to measure failover, 0 to disable",
+		crashPrimary
+	);
+	cmd.AddValue(
+		"aggregate",
+		"aggregate prepares and commits up the overlay trees",
+		aggregate
+	);
+	cmd.AddValue(
+		"aggregationCost",
+		"cpu seconds spent per merged vote",
+		aggregationCost
+	);
+	cmd.AddValue(
+		"aggregationWait",
+		"seconds a node waits for the votes of its children",
+		aggregationWait
+	);
+	cmd.AddValue(
+		"clients",
+		"number of workload clients spread over the nodes, 0 for the single legacy client",
+		clients
+	);
+	cmd.AddValue(
+		"arrival",
+		"arrival process of every client, 0: poisson 1: constant 2: trace",
+		arrival
+	);
+	cmd.AddValue(
+		"rate",
+		"requests per second of every client",
+		rate
+	);
+	cmd.AddValue(
+		"reqMin",
+		"min request size in bytes",
+		reqMin
+	);
+	cmd.AddValue(
+		"reqMax",
+		"max request size in bytes",
+		reqMax
+	);
+	cmd.AddValue(
+		"trace",
+		"arrival trace to replay, lines of seconds since start and optionally bytes",
+		trace
+	);
 	cmd.Parse(argc,argv);
 
     enum NETMODEL {
@@ -122,8 +318,6 @@ int main(int argc, char *argv[])    {
 
     
 
-    double timeout = 100.0;
-
     int totalDataRate = 300000; // bps *1000 ratio to speed up simulation
 
     // double delay = 0.0001;
@@ -223,6 +417,13 @@ int main(int argc, char *argv[])    {
 
     pbfthelper.SetOutboundBandwidth((double)totalDataRate); 
     pbfthelper.setBroadcastDuplicateCount(1);
+    pbfthelper.SetProvenanceTrace(provenance);
+    pbfthelper.SetSendQueueLimit(queueLimit);
+    pbfthelper.SetSendQueuePolicy(queuePolicy);
+    pbfthelper.SetPeerMetricUpdateInterval(peerMetricInterval);
+    pbfthelper.SetBatchPolicy(batchCount, batchBytes, batchDelay);
+    pbfthelper.SetCheckpointInterval(checkpoint);
+    pbfthelper.SetVoteAggregation(aggregate, aggregationCost, aggregationWait);
 
     topologyHelper.setupPBFTApp(pbfthelper);
     topologyHelper.setAddressHelper(address);
@@ -250,6 +451,12 @@ int main(int argc, char *argv[])    {
 
     ApplicationContainer pbftNodes = topologyHelper.getApp();
 
+    if (provenance) {
+        for (uint32_t i = 0; i < nodesCount; ++i) {
+            pbftNodes.Get(i)->TraceConnectWithoutContext("Provenance", MakeBoundCallback(&printProvenance, &topologyHelper));
+        }
+    }
+
     auto coreNodes = topologyHelper.getCoreNode();
 
     std::vector<int> joinTarget;
@@ -303,8 +510,8 @@ int main(int argc, char *argv[])    {
     }
 
     for (int i = stableCount; i < (int) nodesCount; ++i) {
-        auto churn_node = pbftNodes.Get(i)->GetObject<PBFTCorrect>();
-        Simulator::Schedule(Seconds(churnTime[i - stableCount]), &PBFTCorrect::disablePeer, churn_node);
+        Simulator::Schedule(Seconds(churnTime[i - stableCount]), &BlockChainTopologyHelper::repairOverlay, 
+            &topologyHelper, i);
     }
     
     std::cout << "Churn node schedule done" << std::endl;
@@ -342,11 +549,33 @@ int main(int argc, char *argv[])    {
     }
     std::cout << " Done" << std::endl;
 
-    Ptr<PBFTCorrect> client = pbftNodes.Get(10)->GetObject<PBFTCorrect>();
-    
+    if (crashPrimary > 0) {
+        Simulator::Schedule(Seconds(crashPrimary), &PBFTCorrect::changeStatus, 
+            pbftNodes.Get(0)->GetObject<PBFTCorrect>(), BlockChainApplicationBase<PBFTMessage>::CRASH);
+    }
+
+    ApplicationContainer workload;
+
+    if (clients == 0) {
+        Ptr<PBFTCorrect> client = pbftNodes.Get(10)->GetObject<PBFTCorrect>();
     
-    // Simulator::Schedule(Seconds(0.1), &PBFTCorrect::BroadcastTest, client);
-    Simulator::Schedule(Seconds(0.1), &PBFTCorrect::sendRequestCircle, client, 100.0);
+        // Simulator::Schedule(Seconds(0.1), &PBFTCorrect::BroadcastTest, client);
+        Simulator::Schedule(Seconds(0.1), &PBFTCorrect::sendRequestCircle, client, 100.0);
+    }
+    else {
+        WorkloadClientHelper workloadHelper(arrival, rate);
+        workloadHelper.SetRequestSize(reqMin, reqMax);
+        if (trace != "") workloadHelper.SetTraceFile(trace);
+
+        NodeContainer clientNodes;
+        for (uint32_t i = 0; i < clients && i < stableCount; ++i) {
+            clientNodes.Add(pbftNodes.Get(i * stableCount / clients)->GetNode());
+        }
+
+        workload = workloadHelper.Install(clientNodes);
+        workload.Start(Seconds(0.1));
+        workload.Stop(Seconds(95));
+    }
 
     for (double time = 1; time < 100; ++time) {
         Simulator::Schedule(Seconds(time), &globalView, pbftNodes, nodesCount);
@@ -376,6 +605,46 @@ int main(int argc, char *argv[])    {
         Simulator::Schedule(Seconds(98), printStress, node, false);
     }
     Simulator::Schedule(Seconds(98), [](){std::cout << ">" << std::endl;});
+
+    Simulator::Schedule(Seconds(98), printBatching, pbftNodes, nodesCount);
+
+    Simulator::Schedule(Seconds(98), [](){std::cout << "<Checkpoint: ";});
+    for (uint32_t i = 0; i < nodesCount; ++i) {
+        Ptr<PBFTCorrect> node = pbftNodes.Get(i)->GetObject<PBFTCorrect>();
+        Simulator::Schedule(Seconds(98), printCheckpoint, node);
+    }
+    Simulator::Schedule(Seconds(98), [](){std::cout << ">" << std::endl;});
+
+    // sent, completed, average latency per client
+    Simulator::Schedule(Seconds(98), [](){std::cout << "<Workload: ";});
+    for (uint32_t i = 0; i < workload.GetN(); ++i) {
+        Ptr<WorkloadClient> wc = workload.Get(i)->GetObject<WorkloadClient>();
+        Simulator::Schedule(Seconds(98), printWorkload, wc);
+    }
+    Simulator::Schedule(Seconds(98), [](){std::cout << ">" << std::endl;});
+
+    // aggregated vote messages sent per node
+    Simulator::Schedule(Seconds(98), [](){std::cout << "<Aggregates: ";});
+    for (uint32_t i = 0; i < nodesCount; ++i) {
+        Ptr<PBFTCorrect> node = pbftNodes.Get(i)->GetObject<PBFTCorrect>();
+        Simulator::Schedule(Seconds(98), [node](){std::cout << node->getAggregatesSent() << " ";});
+    }
+    Simulator::Schedule(Seconds(98), [](){std::cout << ">" << std::endl;});
+
+    Simulator::Schedule(Seconds(98), [](){std::cout << "<Failover: ";});
+    for (uint32_t i = 0; i < nodesCount; ++i) {
+        Ptr<PBFTCorrect> node = pbftNodes.Get(i)->GetObject<PBFTCorrect>();
+        Simulator::Schedule(Seconds(98), printFailover, node);
+    }
+    Simulator::Schedule(Seconds(98), [](){std::cout << ">" << std::endl;});
+
+    // <peak sends waiting, sends dropped> per node
+    Simulator::Schedule(Seconds(98), [](){std::cout << "<SendBacklog: ";});
+    for (uint32_t i = 0; i < nodesCount; ++i) {
+        Ptr<PBFTCorrect> node = pbftNodes.Get(i)->GetObject<PBFTCorrect>();
+        Simulator::Schedule(Seconds(98), printSendBacklog, node);
+    }
+    Simulator::Schedule(Seconds(98), [](){std::cout << ">" << std::endl;});
     
     
     //AsciiTraceHelper ascii;
@@ -6,8 +6,14 @@
 #include <random>
 #include <chrono>
 #include <algorithm>
+#include <cmath>
 
 #include <functional>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <unistd.h>
 
 // Todo
 // clean up this file
@@ -45,6 +51,48 @@ void BlockChainTopologyHelper::setupPBFTApp(PBFTCorrectHelper& pbft) {
 }
 
 
+void BlockChainTopologyHelper::setupHotStuffApp(HotStuffCorrectHelper& hotstuff) {
+  installedApps = hotstuff.Install(nodes);
+}
+
+
+void BlockChainTopologyHelper::setupTendermintApp(TendermintCorrectHelper& tendermint) {
+  installedApps = tendermint.Install(nodes);
+}
+
+
+void BlockChainTopologyHelper::setupNarwhalApp(NarwhalCorrectHelper& narwhal) {
+  installedApps = narwhal.Install(nodes);
+}
+
+
+// pbft is the template of every committee and is not installed itself
+void BlockChainTopologyHelper::setupShardedPBFTApp(PBFTCorrectHelper& pbft, std::vector<std::vector<int> > c, uint16_t basePort) {
+
+  committees = std::move(c);
+  shardApps.clear();
+  nodeCommittees.assign(stableNodeN, std::vector<int>());
+  installedApps = ApplicationContainer();
+
+  for (size_t k = 0; k < committees.size(); ++k) {
+
+    PBFTCorrectHelper committee = pbft;
+    committee.SetTotalNodes(committees[k].size());
+    committee.SetVoteNodes(committees[k].size());
+    committee.SetPort(basePort + k);
+
+    ApplicationContainer apps;
+    for (auto node : committees[k]) {
+      apps.Add(committee.Install(nodes.Get(node)));
+      nodeCommittees[node].push_back(k);
+    }
+
+    shardApps.push_back(apps);
+    installedApps.Add(apps);
+  }
+}
+
+
 void BlockChainTopologyHelper::setAddressHelper(Ipv4AddressHelper& addressHelper) {
   address = addressHelper;
 }
@@ -79,7 +127,12 @@ void BlockChainTopologyHelper::installLink() {
 		from.nodeTo = link.nodeA;
 		from.addr = nInterface.GetAddress(0);
 
+		addressIndex.emplace(nodePairKey(to.nodeFrom, to.nodeTo), addressBook.size());
+		addressTo.emplace(to.nodeTo, addressBook.size());
 		addressBook.push_back(to);
+
+		addressIndex.emplace(nodePairKey(from.nodeFrom, from.nodeTo), addressBook.size());
+		addressTo.emplace(from.nodeTo, addressBook.size());
 		addressBook.push_back(from);
 
 	}
@@ -91,19 +144,25 @@ void BlockChainTopologyHelper::installLink() {
 
 // tell appliaction topology informations
 void BlockChainTopologyHelper::setupPeerMetric() {
+
+	// the form of updateLinkMetric, bw in bps is scaled by 1000
+	for (int i = 0; i < nodeN; ++i) {
+		getOverlayApp(i)->SetPeerMetricForm(averageMessageSize, 1000);
+	}
+
 	for (size_t i = 0, sz = allLinkInfo.size(); i < sz; ++i) {
 
 		auto link = allLinkInfo[i];
 		
-		Ptr<PBFTCorrect> app;
+		Ptr<OverlayApp> app;
 
 		// only consider symmetric link for now 
 
-		app = installedApps.Get(link.nodeA)->GetObject<PBFTCorrect>();
+		app = getOverlayApp(link.nodeA);
 		app->AddDirectPeer(link.nodeB);
 		app->AddPeerMetric(link.nodeB, link.linkMetric);
 		
-		app = installedApps.Get(link.nodeB)->GetObject<PBFTCorrect>();
+		app = getOverlayApp(link.nodeB);
 		app->AddDirectPeer(link.nodeA);
 		app->AddPeerMetric(link.nodeA, link.linkMetric);
 	}
@@ -112,11 +171,17 @@ void BlockChainTopologyHelper::setupPeerMetric() {
 
 // tell application peer address 
 void BlockChainTopologyHelper::setupAppPeer() {
-	Ptr<PBFTCorrect> app;
+
+	if (!committees.empty()) {
+		setupShardPeer();
+		return;
+	}
+
+	Ptr<OverlayApp> app;
 	for (int i = 0; i < stableNodeN; ++i) {
-		app = installedApps.Get(i)->GetObject<PBFTCorrect>();
+		app = getOverlayApp(i);
 		for (int j = 0; j < stableNodeN; ++j) {
-			if (j != i) {
+			if (j != i && hasLink(i, j)) {
 				Address addr = findAddress(i,j);
 				if (!addr.IsInvalid()) {
 					app->AddPeer(j, addr);
@@ -129,16 +194,11 @@ void BlockChainTopologyHelper::setupAppPeer() {
 
 // helper func to look up address
 Address BlockChainTopologyHelper::findAddress(int from, int to) {
-	Address maddr; 
-	for (size_t i = 0, sz = addressBook.size(); i < sz; ++i) {
-	  auto entry = addressBook[i];
-		if (entry.nodeTo == to) {
-			maddr = entry.addr;
-			if (entry.nodeFrom == from) {
-				NS_ASSERT(!maddr.IsInvalid());
-				return maddr;
-			}
-		}
+	auto entry = addressIndex.find(nodePairKey(from, to));
+	if (entry != addressIndex.end()) {
+		Address maddr = addressBook[entry->second].addr;
+		NS_ASSERT(!maddr.IsInvalid());
+		return maddr;
 	}
 
 	std::cout << "No address between: " << from << " and " << to << std::endl;
@@ -156,6 +216,10 @@ void BlockChainTopologyHelper::insertLinkInfo(int from, int to, double delay, in
 	LinkInfo link(from, to , delay, bw, 1, 0.0);
 	if (!related_to_churn_node(link)) ++stable_link_count;
 	allLinkInfo.push_back(link);
+
+	adjOffset.clear();
+	linkIndexBuilt = false;
+	invalidateSPCache();
 }
 
 
@@ -168,6 +232,25 @@ void BlockChainTopologyHelper::setOverlayRoute() {
 
 	updateLinkMetric();
 
+	if (!committees.empty()) {
+		setShardOverlayRoute();
+		return;
+	}
+
+	uint64_t cacheKey = 0;
+	std::string cacheFile = "";
+	if (overlayCacheDir != "") {
+		cacheKey = overlayCacheKey();
+		cacheFile = overlayCacheFile(cacheKey);
+	}
+
+	overlayCache = OverlayCache();
+
+	if (cacheFile != "" && loadOverlayCache(cacheFile, cacheKey)) {
+		installOverlayCache();
+		return;
+	}
+
 	// choose broadcasters
 	chooseCoreNodes();
 	installCoreList();
@@ -202,6 +285,13 @@ void BlockChainTopologyHelper::setOverlayRoute() {
 	setupPeerMetric();
 	installRouteTable(LARGE_PACKET);
 
+	if (cacheFile != "") {
+		for (auto &link : allLinkInfo) {
+			overlayCache.peerMetric.push_back(link.linkMetric);
+		}
+		overlayCache.routeTable[LARGE_PACKET] = routeTable;
+	}
+
 
 	// test
 	
@@ -232,15 +322,55 @@ void BlockChainTopologyHelper::setOverlayRoute() {
 
 	installRouteTable(SMALL_PACKET);
 
+	if (cacheFile != "") {
+		overlayCache.coreNodeList = coreNodeList;
+		overlayCache.routeTable[SMALL_PACKET] = routeTable;
+
+		for (auto &link : allLinkInfo) {
+			overlayCache.linkMetric.push_back(link.linkMetric);
+			overlayCache.linkShare.push_back(link.share);
+		}
+
+		// nothing changes the link metric before installShorestPath
+		overlayCache.shortestPath.resize(stableNodeN);
+		for (int src = 0; src < stableNodeN; ++src) {
+			std::vector<double> D(stableNodeN);
+			overlayCache.shortestPath[src].resize(stableNodeN);
+			utilSP(D, overlayCache.shortestPath[src], src);
+		}
+
+		saveOverlayCache(cacheFile, cacheKey);
+
+		// only the shortest paths are still to be installed
+		auto shortestPath = std::move(overlayCache.shortestPath);
+		overlayCache = OverlayCache();
+		overlayCache.shortestPath = std::move(shortestPath);
+	}
+
 }
 
 
 void BlockChainTopologyHelper::installShorestPath () {
-	Ptr<PBFTCorrect> app;
+
+	if (!committees.empty()) {
+		installShardShortestPath();
+		return;
+	}
+
+	Ptr<OverlayApp> app;
+
+	// saved or loaded with the overlay
+	if ((int) overlayCache.shortestPath.size() == stableNodeN) {
+		for (int src = 0; src < stableNodeN; ++src) {
+			getOverlayApp(src)->installShortestPathRoute(std::move(overlayCache.shortestPath[src]));
+		}
+		overlayCache.shortestPath.clear();
+		return;
+	}
 
 	for (int src = 0; src < stableNodeN; ++src) {
 		
-		app = installedApps.Get(src)->GetObject<PBFTCorrect>();
+		app = getOverlayApp(src);
 
 		std::vector<double> D(stableNodeN);
 		std::vector<int> P(stableNodeN);
@@ -253,7 +383,7 @@ void BlockChainTopologyHelper::installShorestPath () {
 
 	// for (int src = stableNodeN; src < nodeN; ++src) {
 		
-	// 	app = installedApps.Get(src)->GetObject<PBFTCorrect>();
+	// 	app = getOverlayApp(src);
 
 	// 	std::vector<double> D(nodeN);
 	// 	std::vector<int> P(nodeN);
@@ -266,11 +396,16 @@ void BlockChainTopologyHelper::installShorestPath () {
 
 
 void BlockChainTopologyHelper::updateLinkMetric() {
+
+	bool changed = false;
+
 	for (size_t i = 0, sz = allLinkInfo.size(); i < sz; ++i) {
 
 		auto link = &allLinkInfo[i];
 		if (related_to_churn_node(link)) continue;
 
+		double old = link->linkMetric;
+
 		switch (linkMetricSetting) {
 		
 			case DELAY_ONLY:
@@ -284,7 +419,11 @@ void BlockChainTopologyHelper::updateLinkMetric() {
 			default:
 			break;
 		}
+
+		changed = changed || link->linkMetric != old;
 	}
+
+	if (changed) invalidateSPCache();
 }
 
 
@@ -334,6 +473,10 @@ void BlockChainTopologyHelper::generateOverlayRoute_PLAIN() {
 		}
 	}
 
+	for (auto &tree : routeTable) {
+		indexTree(tree.first);
+	}
+
 	// updateDepth();
 
 	updateSequencialMetric();
@@ -341,9 +484,8 @@ void BlockChainTopologyHelper::generateOverlayRoute_PLAIN() {
 	// sort tranfer order
 
 	for (auto &tree : routeTable) {
-		for (auto &node : tree.second) {
-			std::sort(node.begin(), node.end(),
-				[this](Route a, Route b){return compareWRTSubtreeMetric(a, b);});
+		for (int node = 0; node < (int) tree.second.size(); ++node) {
+			sortChildren(tree.first, node);
 		}
 	}
 
@@ -358,18 +500,19 @@ void BlockChainTopologyHelper::generateOverlayRoute_SPT() {
 
 	// shortest path from source to other peers w.r.t link metric
 	// D store distance, P store path
+	// shares only change in updateRouteVector, so the link metric is the same for every source
 
-	for (auto source : coreNodeList) {
+	updateLinkMetric();
+	reserveSPCache(stableNodeN);
 
-		updateLinkMetric();
+	std::vector<std::vector<int> > P(coreNodeList.size(), std::vector<int>(stableNodeN));
 
-		std::vector<double> D(stableNodeN);
-		std::vector<int> P(stableNodeN);
+	forEachTree([this, &P](int i){
 
-		utilSP(D, P, source);
+		int source = coreNodeList[i];
+		std::vector<double> D(stableNodeN);
 
-		// store forward policy 
-		updateTempRouteVector(P, source);
+		utilSP(D, P[i], source);
 
 		// store shortest path delay from source to node
 
@@ -379,7 +522,11 @@ void BlockChainTopologyHelper::generateOverlayRoute_SPT() {
 			std::get<3>(sequentialMetricTable[source][n]) = D[n];
 
 		}
+	});
 
+	// store forward policy 
+	for (size_t i = 0, sz = coreNodeList.size(); i < sz; ++i) {
+		updateTempRouteVector(P[i], coreNodeList[i]);
 	}
 
 	// gather relay entry
@@ -394,9 +541,8 @@ void BlockChainTopologyHelper::generateOverlayRoute_SPT() {
 	// todo: baseline should not use global infomation
 
 	for (auto &tree : routeTable) {
-		for (auto &node : tree.second) {
-			std::sort(node.begin(), node.end(),
-				[this](Route a, Route b){return compareWRTSubtreeMetric(a, b);});
+		for (int node = 0; node < (int) tree.second.size(); ++node) {
+			sortChildren(tree.first, node);
 		}
 	}
 
@@ -414,13 +560,17 @@ void BlockChainTopologyHelper::generateOverlayRoute_SA() {
 
 	updateSequencialMetric();
 
-	// for now we treat each tree separetely one by one
+	// dev 
  	for (auto src : coreNodeList) {
-
-		// dev 
 		std::cout << "SPT" << std::endl;
 		peekTreeDebug(src, src, "SPT");
 		std::cout << std::endl;
+	}
+
+	// each tree separetely, in parallel
+	forEachTree([this](int i){
+
+		int src = coreNodeList[i];
 
 		// a simple greedy approach
 		// try move the worst leaf node elsewhere to achieve a better min-max delay
@@ -439,11 +589,14 @@ void BlockChainTopologyHelper::generateOverlayRoute_SA() {
 			if (new_prev < 0) break;
 		}
 
+		flushUnsortedChildren(src);
+	});
+
+ 	for (auto src : coreNodeList) {
 		std::cout << "SA" << std::endl;
 		peekTreeDebug(src, src, "SA");
 		std::cout << std::endl;
 		peekSubtreeWeightDistribution(src);
-
  	}
 }
 
@@ -519,10 +672,15 @@ void BlockChainTopologyHelper::generatedOverlayRoute_DIS() {
 	updateSequencialMetric();
 
 	for (auto src : coreNodeList) {
-
 		std::cout << "SPT" << std::endl;
 		peekTreeDebug(src, src, "SPT");
 		std::cout << std::endl;
+	}
+
+	// each tree separetely, in parallel
+	forEachTree([this](int i){
+
+		int src = coreNodeList[i];
 
 		for (;;) {
 			
@@ -649,6 +807,10 @@ void BlockChainTopologyHelper::generatedOverlayRoute_DIS() {
 
 		}
 
+		flushUnsortedChildren(src);
+	});
+
+	for (auto src : coreNodeList) {
 		std::cout << "DIS" << std::endl;
 		peekTreeDebug(src, src, "DIS");
 		std::cout << std::endl;
@@ -751,6 +913,10 @@ bool BlockChainTopologyHelper::_generateOverlayRoute_KAD() {
 				> getBucketNumber(b.self, b.dst);});
 		}
 	}
+
+	for (auto &tree : routeTable) {
+		indexTree(tree.first);
+	}
 	
 	
 
@@ -1012,7 +1178,7 @@ void BlockChainTopologyHelper::chooseCoreNodes() {
 void BlockChainTopologyHelper::installCoreList() {
 	for (int source = 0; source < stableNodeN; ++source) {
 
-		Ptr<PBFTCorrect> app = installedApps.Get(source)->GetObject<PBFTCorrect>();
+		Ptr<OverlayApp> app = getOverlayApp(source);
 
 		bool isCore = false;
 		for (auto i : coreNodeList) {
@@ -1135,39 +1301,70 @@ int BlockChainTopologyHelper::getDegree(int i) {
 }
 
 
+// links to churn nodes are left out of share and metric queries
 void BlockChainTopologyHelper::IncLinkShare(int a, int b) {
-  for (auto link = allLinkInfo.begin(); link != allLinkInfo.end(); ++link) {
-		if (link->nodeA >= stableNodeN || link->nodeB >= stableNodeN) continue;
-    if ((link->nodeA == a && link->nodeB == b) || (link->nodeB == a && link->nodeA == b)) {
-      link->share = link->share + 1;
-    }
-  }
+	if (a >= stableNodeN || b >= stableNodeN) return;
+	for (int i = findLink(a, b); i >= 0; i = linkNext[i]) {
+		allLinkInfo[i].share = allLinkInfo[i].share + 1;
+	}
 }
 
 
 void BlockChainTopologyHelper::DecLinkShare(int a, int b) {
-	for (auto link = allLinkInfo.begin(); link != allLinkInfo.end(); ++link) {
-		if (link->nodeA >= stableNodeN || link->nodeB >= stableNodeN) continue;
-    if ((link->nodeA == a && link->nodeB == b) || (link->nodeB == a && link->nodeA == b)) {
-      link->share = link->share > 0 ? link->share - 1 : 0;
-    }
-  }
+	if (a >= stableNodeN || b >= stableNodeN) return;
+	for (int i = findLink(a, b); i >= 0; i = linkNext[i]) {
+		auto link = &allLinkInfo[i];
+		link->share = link->share > 0 ? link->share - 1 : 0;
+	}
 }
 
 
 // return 1 if link exist and 0 if not
 // refer glink to the requested link
 int BlockChainTopologyHelper::getLink(int a, int b, LinkInfo &glink) {
-	for (auto link = allLinkInfo.begin(); link != allLinkInfo.end(); ++link) {
-		if (link->nodeA >= stableNodeN || link->nodeB >= stableNodeN) continue;
-    if ((link->nodeA == a && link->nodeB == b) || (link->nodeB == a && link->nodeA == b)) {
-			glink = *link;
-			// direct link exist
-			return 1;
+	if (a >= stableNodeN || b >= stableNodeN) return 0;
+
+	int i = findLink(a, b);
+	if (i < 0) {
+		// no direct link
+		return 0;
+	}
+
+	glink = allLinkInfo[i];
+	return 1;
+}
+
+
+int BlockChainTopologyHelper::findLink(int a, int b) {
+	if (!linkIndexBuilt) buildLinkIndex();
+
+	auto link = linkIndex.find(nodePairKey(std::min(a, b), std::max(a, b)));
+	return link == linkIndex.end() ? -1 : link->second;
+}
+
+
+// walk backwards so every chain is in insertion order
+void BlockChainTopologyHelper::buildLinkIndex() {
+
+	linkIndex.clear();
+	linkIndex.reserve(allLinkInfo.size());
+	linkNext.assign(allLinkInfo.size(), -1);
+
+	for (int i = (int) allLinkInfo.size() - 1; i >= 0; --i) {
+		auto &link = allLinkInfo[i];
+		uint64_t key = nodePairKey(std::min(link.nodeA, link.nodeB), std::max(link.nodeA, link.nodeB));
+
+		auto first = linkIndex.find(key);
+		if (first != linkIndex.end()) {
+			linkNext[i] = first->second;
+			first->second = i;
+		}
+		else {
+			linkIndex.emplace(key, i);
 		}
 	}
-	// no direct link
-	return 0;
+
+	linkIndexBuilt = true;
 }
 
 
@@ -1191,14 +1388,31 @@ double BlockChainTopologyHelper::getLinkDelay(int a, int b) {
 }
 
 
+int BlockChainTopologyHelper::getPlannedPrev(int root, int node) {
+
+	auto tree = treeParent.find(root);
+	if (node == root || tree == treeParent.end() || node < 0 || node >= (int) tree->second.size()) return -1;
+
+	return tree->second[node];
+}
+
+
+double BlockChainTopologyHelper::getPlannedReachTime(int root, int node) {
+
+	auto table = sequentialMetricTable.find(root);
+	if (table == sequentialMetricTable.end() || node < 0 || node >= (int) table->second.size()) return -1;
+
+	return std::get<3>(table->second[node]);
+}
+
+
 int BlockChainTopologyHelper::getPrev(int root, int node) {
 
 	if (node == root) return -1;
 
-	for (int prevNode = 0; prevNode < stableNodeN; ++prevNode) {
-		for (auto r : routeTable[root][prevNode]) {
-			if (r.dst == node) return prevNode;
-		}
+	auto tree = treeParent.find(root);
+	if (tree != treeParent.end() && node >= 0 && node < (int) tree->second.size() && tree->second[node] >= 0) {
+		return tree->second[node];
 	}
 
 	std::cerr << "Bad previous node. Root: " << root << " node: " << node <<std::endl;  
@@ -1228,37 +1442,116 @@ std::pair<int, double> BlockChainTopologyHelper::getWorstMetric(int root) {
 	}
 }
 
+// dijkstra w.r.t. link metric, links to nodes beyond D.size() are left out
 void BlockChainTopologyHelper::utilSP(std::vector<double> &D, std::vector<int> &P, int source) {
 
 	NS_ASSERT((int)D.size() == (int)P.size());
 
 	int sz = D.size();
 
+	reserveSPCache(sz);
+
+	if (!spCacheD[source].empty()) {
+		D = spCacheD[source];
+		P = spCacheP[source];
+		return;
+	}
+
 	for (size_t d = 0; d < (size_t) sz; ++d) D[d] = std::numeric_limits<double>::infinity();
 	for (size_t p = 0; p < (size_t) sz; ++p) P[p] = -1;
 
 	D[source] = 0;
 	P[source] = source;
 
-	for (int i = 0; i < (int) sz - 1; ++i) {
+	// <distance, node>, outdated entries are skipped when popped
+	typedef std::pair<double, int> HeapEntry;
+	std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry> > heap;
+	heap.push(HeapEntry(0, source));
 
-		for (auto link = allLinkInfo.begin(); link != allLinkInfo.end(); ++link) {
-			
-			if (sz == stableNodeN && (link->nodeA >= sz || link->nodeB >= sz)) continue;
+	while (!heap.empty()) {
 
-			if (D[link->nodeA] + link->linkMetric < D[link->nodeB]) {
-				D[link->nodeB] = D[link->nodeA] + link->linkMetric;
-				P[link->nodeB] = link->nodeA;
-			}
+		HeapEntry top = heap.top();
+		heap.pop();
 
-			if (D[link->nodeB] + link->linkMetric < D[link->nodeA]) {
-				D[link->nodeA] = D[link->nodeB] + link->linkMetric;
-				P[link->nodeA] = link->nodeB;
-			}
+		int u = top.second;
+		if (top.first > D[u]) continue;
+
+		for (int e = adjOffset[u]; e < adjOffset[u + 1]; ++e) {
+
+			int v = adjNode[e];
+			if (v >= sz) continue;
+
+			double d = D[u] + allLinkInfo[adjLink[e]].linkMetric;
 
+			if (d < D[v]) {
+				D[v] = d;
+				P[v] = u;
+				heap.push(HeapEntry(d, v));
+			}
 		}
 	}
 
+	spCacheD[source] = D;
+	spCacheP[source] = P;
+
+}
+
+
+void BlockChainTopologyHelper::reserveSPCache(int sz) {
+
+	if (spCacheSize != sz) {
+		invalidateSPCache();
+		spCacheSize = sz;
+	}
+
+	if (spCacheD.empty()) {
+		spCacheD.resize(sz);
+		spCacheP.resize(sz);
+	}
+
+	if (adjOffset.empty()) buildAdjacency();
+}
+
+
+// counting sort of both ends of every link
+void BlockChainTopologyHelper::buildAdjacency() {
+
+	int n = nodeN;
+	for (auto &link : allLinkInfo) {
+		n = std::max(n, std::max(link.nodeA, link.nodeB) + 1);
+	}
+
+	adjOffset.assign(n + 1, 0);
+
+	for (auto &link : allLinkInfo) {
+		adjOffset[link.nodeA + 1]++;
+		adjOffset[link.nodeB + 1]++;
+	}
+
+	for (int i = 0; i < n; ++i) {
+		adjOffset[i + 1] += adjOffset[i];
+	}
+
+	adjNode.assign(adjOffset[n], 0);
+	adjLink.assign(adjOffset[n], 0);
+
+	std::vector<int> next(adjOffset.begin(), adjOffset.end() - 1);
+
+	for (size_t i = 0, sz = allLinkInfo.size(); i < sz; ++i) {
+		auto &link = allLinkInfo[i];
+
+		adjNode[next[link.nodeA]] = link.nodeB;
+		adjLink[next[link.nodeA]++] = i;
+
+		adjNode[next[link.nodeB]] = link.nodeA;
+		adjLink[next[link.nodeB]++] = i;
+	}
+}
+
+
+void BlockChainTopologyHelper::invalidateSPCache() {
+	spCacheD.clear();
+	spCacheP.clear();
 }
 
 
@@ -1269,33 +1562,42 @@ void BlockChainTopologyHelper::changePrev(int source, int changer, int new_prev)
 	// update routes, always placed at the last of same-order routes
 
 	int old_prev = getPrev(source, changer);
-	
-	for (auto r = routeTable[source][old_prev].begin(); r != routeTable[source][old_prev].end();) {
-		if (r->dst == changer) {
-			Route nr = *r;
 
-		  // std::cout << routeTable[source][old_prev].size() <<std::endl;
-			
-			nr.from = getPrev(source, new_prev);
-			nr.self = new_prev;
-			routeTable[source][new_prev].push_back(nr);
+	auto &parent = treeParent[source];
+	auto &position = childPosition[source];
+	auto &oldRoutes = routeTable[source][old_prev];
+	auto &newRoutes = routeTable[source][new_prev];
 
-			r = routeTable[source][old_prev].erase(r);
+	int pos = position[changer];
 
-		}
-		else {
-			++r;
-		}
+	Route nr = oldRoutes[pos];
+	nr.from = getPrev(source, new_prev);
+	nr.self = new_prev;
+
+	// later siblings move up by one
+	oldRoutes.erase(oldRoutes.begin() + pos);
+	for (int i = pos, sz = oldRoutes.size(); i < sz; ++i) {
+		position[oldRoutes[i].dst] = i;
 	}
 
+	newRoutes.push_back(nr);
+	parent[changer] = new_prev;
+	position[changer] = newRoutes.size() - 1;
+
 	for (auto &r : routeTable[source][changer]) {
 			r.from = new_prev;
 	}
 
 	// update load
 
-	IncLinkShare(changer, new_prev);
-	DecLinkShare(changer, old_prev);
+	if (deferShare) {
+		deferredShare[source].push_back(std::make_tuple(changer, new_prev, 1));
+		deferredShare[source].push_back(std::make_tuple(changer, old_prev, -1));
+	}
+	else {
+		IncLinkShare(changer, new_prev);
+		DecLinkShare(changer, old_prev);
+	}
 
 	// update depth
 
@@ -1308,26 +1610,26 @@ void BlockChainTopologyHelper::changePrev(int source, int changer, int new_prev)
 			return true;
 		});
 
-	// update nodes transfer order
-	for (auto &tree : routeTable) {
-		for (auto &node : tree.second) {
-			std::sort(node.begin(), node.end(),
-				[this](Route a, Route b){return compareWRTSubtreeMetric(a, b);});
-		}
-	}
+	// update nodes transfer order, other lists of the tree are still in order
+	auto &unsorted = unsortedChildren[source];
+	unsorted.insert(new_prev);
 
-	// updateDepth();
+	std::vector<int> seeds = {old_prev, new_prev};
+	for (auto node : unsorted) {
+		if (sortChildren(source, node)) seeds.push_back(node);
+	}
+	unsorted.clear();
 
-	// update metric
-	updateSequencialMetric();
+	// update metric of this tree only
+	updateSequencialMetric(source, seeds);
 
 }
 
 
 int BlockChainTopologyHelper::getSequencialOrder(int src, int prev_node, int node) {
 	
-	for (size_t i = 0; i < routeTable[src][prev_node].size(); ++i) {
-		if (routeTable[src][prev_node][i].dst == node) return i + 1;
+	if (getPrev(src, node) == prev_node && prev_node >= 0) {
+		return childPosition[src][node] + 1;
 	}
 	
 	std::cerr << "bad order, parameter:" << src << " "
@@ -1343,6 +1645,41 @@ int BlockChainTopologyHelper::getChildNumber(int src, int node) {
 }
 
 
+void BlockChainTopologyHelper::indexTree(int root) {
+
+	auto &routes = routeTable[root];
+	auto &parent = treeParent[root];
+	auto &position = childPosition[root];
+
+	parent.assign(routes.size(), -1);
+	position.assign(routes.size(), -1);
+
+	for (int node = 0, sz = routes.size(); node < sz; ++node) {
+		for (int i = 0, children = routes[node].size(); i < children; ++i) {
+			parent[routes[node][i].dst] = node;
+			position[routes[node][i].dst] = i;
+		}
+	}
+}
+
+
+bool BlockChainTopologyHelper::sortChildren(int root, int node) {
+
+	auto &routes = routeTable[root][node];
+
+	std::sort(routes.begin(), routes.end(),
+		[this](Route a, Route b){return compareWRTSubtreeMetric(a, b);});
+
+	bool changed = false;
+	auto &position = childPosition[root];
+	for (int i = 0, sz = routes.size(); i < sz; ++i) {
+		changed |= position[routes[i].dst] != i;
+		position[routes[i].dst] = i;
+	}
+	return changed;
+}
+
+
 // fixme
 // too subtle
 void BlockChainTopologyHelper::updateSequencialMetric() {
@@ -1361,7 +1698,6 @@ void BlockChainTopologyHelper::updateSequencialMetric() {
 	for (auto src : coreNodeList) {
 
 		int depth = treeDepth[src];
-		std::map<int, double> subNodes;
 
 	  // std::cout << "tree: " << src << "depth: " << depth << std::endl;
 
@@ -1374,146 +1710,213 @@ void BlockChainTopologyHelper::updateSequencialMetric() {
 				int nodeDepth = std::get<0>(sequentialMetricTable[src][node]);
 
 				if (depth == nodeDepth) {
-
-					subNodes.clear();
-
-				  //	std::cout << node << " ";
-
-					// from bottom to top
-					double subMetric = 0.0;
-
-					int subWeight = 1;
-
-					if (routeTable[src][node].size() > 0) {
-						subMetric += processingDelay;
-					}
-
-					for (auto r : routeTable[src][node]) {
-						
-						int subNode = r.dst;
-						
-						double transferDelay = getNodeTransferDelay(node, subNode);
-						double linkDelay = getLinkDelay(node, subNode);
-						
-						// metric is the time interval from the previous node start sending to all nodes
-						// in its sub-tree received 
-						// root node's metric won't be updated right for it is not used
-						std::get<1>(sequentialMetricTable[src][subNode]) += linkDelay;
-
-						subWeight += std::get<4>(sequentialMetricTable[src][subNode]);
-
-						/*
-						std::cout << "debug subMetric: " << src << " " << node << " " << subNode << std::endl;
-						std::cout << std::get<1>(sequentialMetricTable[src][subNode]) << " " << 
-							transferDelay * getSequencialOrder(src, node, subNode) << " " << transferDelay << " "
-							<< getSequencialOrder(src, node, subNode) << std::endl;
-						*/
-
-						//Todo: check if units are uniform
-						subMetric = std::get<1>(sequentialMetricTable[src][subNode])
-							 + transferDelay * getSequencialOrder(src, node, subNode);
-
-						subNodes[subNode] = subMetric;
-					}
-
-					std::get<4>(sequentialMetricTable[src][node]) = subWeight;
-
-				  auto maxMetric =	std::max_element(subNodes.begin(), subNodes.end(), 
-						[](std::pair<int, double> a, std::pair<int, double> b){return a.second < b.second;});
-					
-					std::get<1>(sequentialMetricTable[src][node]) = maxMetric->second;
-					std::get<2>(sequentialMetricTable[src][node]) = maxMetric->second;
-
+					updateSubtreeMetric(src, node);
 				}
 			}
 
-		  // std::cout << std::endl;
-
 			// process upper level
 			depth--;
 		}
 
 		// calculate delay to reach in top down order
 		breadthFirstTopdownWalk(src, src, [this, src](int n){
-			if (n == src) {
-				std::get<3>(sequentialMetricTable[src][n]) = 0;
-			}
-			else {
-				int prev = getPrev(src, n);
-
-				std::get<3>(sequentialMetricTable[src][n]) = 
-					std::get<3>(sequentialMetricTable[src][prev]) + getLinkDelay(prev, n) +
-					getNodeTransferDelay(prev, n) * getSequencialOrder(src, prev, n);
-				
-				if (prev != src) std::get<3>(sequentialMetricTable[src][n]) += processingDelay;
-
-			}
+			updateReachMetric(src, n);
 			// continue
 			return true;
 		});
 
-		for (size_t i = 0, sz = sequentialMetricTable[src].size(); i < sz; ++i) {
-			double transfer_time = 0.0;
-			for (auto r: routeTable[src][i]) {
-				transfer_time += getNodeTransferDelay(i, r.dst);
-			}
-			std::get<5>(sequentialMetricTable[src][i]) = std::get<3>(sequentialMetricTable[src][i]) 
-				+ transfer_time;
+		updateTreeMetric(src);
+
+		// every metric is new, no list is known to be in order
+		auto &unsorted = unsortedChildren[src];
+		for (auto n = 0; n < stableNodeN; ++n) {
+			unsorted.insert(n);
 		}
+	}
+}
+
 
-		// store worst delay to reach
+void BlockChainTopologyHelper::updateSequencialMetric(int src, const std::vector<int> &seeds) {
 
-		std::vector<std::pair<int, double>> delayViewOfMetricTable;
-		for (size_t i = 0, sz = sequentialMetricTable[src].size(); i < sz; ++i) {
-			delayViewOfMetricTable.push_back(std::pair<int, double>(
-				i,
-				std::get<3>(sequentialMetricTable[src][i])
-			));
+	auto &parent = treeParent[src];
+	auto &metric = sequentialMetricTable[src];
+
+	// depth of the moved subtree is already shifted
+	int depth = 0;
+	for (auto n = 0; n < stableNodeN; ++n) {
+		if (n == src || parent[n] >= 0) {
+			depth = std::max(depth, std::get<0>(metric[n]));
 		}
+	}
+	treeDepth[src] = depth;
 
-		std::sort(delayViewOfMetricTable.begin(), delayViewOfMetricTable.end(),
-			[](const std::pair<int, double> &a, const std::pair<int, double> &b) {
-				return a.second < b.second;
-			}
-		);
+	// seeds and their ancestors, deepest first
+	std::set<int> dirty;
+	for (auto node : seeds) {
+		for (int n = node; n >= 0 && dirty.insert(n).second; n = parent[n]);
+	}
 
-		std::get<0>(treeMetric[src]) = delayViewOfMetricTable[partiPointLast];
-		std::get<1>(treeMetric[src]) = delayViewOfMetricTable[partiPoint90];
-		std::get<2>(treeMetric[src]) = delayViewOfMetricTable[partiPoint70];
+	std::vector<int> groundUp(dirty.begin(), dirty.end());
+	std::stable_sort(groundUp.begin(), groundUp.end(),
+		[&metric](int a, int b){return std::get<0>(metric[a]) > std::get<0>(metric[b]);});
 
+	for (auto node : groundUp) {
+		updateSubtreeMetric(src, node);
 	}
-}
 
+	// subtrees of seeds, once for nested seeds
+	std::set<int> tops(seeds.begin(), seeds.end());
+	for (auto node : tops) {
+		if (node < 0) continue;
 
-// return true if a is greater than b and false else wise
-bool BlockChainTopologyHelper::compareWRTSubtreeMetric(const Route &a, const Route &b) {
+		bool nested = false;
+		for (int n = parent[node]; n >= 0 && !nested; n = parent[n]) {
+			nested = tops.count(n) > 0;
+		}
+		if (nested) continue;
 
-	NS_ASSERT(a.src == b.src && a.self == b.self);
+		breadthFirstTopdownWalk(src, node, [this, src](int n){
+			updateReachMetric(src, n);
+			return true;
+		});
+	}
 
-	int source = a.src;
+	updateTreeMetric(src);
+}
 
-	int nodeA = a.dst;
-	int nodeB = b.dst;
 
-	// std::cout << "debug" << std::endl;
-	// std::cout << " a: " << a.dst << " b: " << b.dst << std::endl;
-	// std::cout << " a metric: " << sequentialMetricTable[source][nodeA].second
-	//				  << " b metric: " << sequentialMetricTable[source][nodeB].second << std::endl;
+void BlockChainTopologyHelper::flushUnsortedChildren(int src) {
 
-	return std::get<1>(sequentialMetricTable[source][nodeA]) > 
-		std::get<1>(sequentialMetricTable[source][nodeB]);
+	auto &unsorted = unsortedChildren[src];
 
+	std::vector<int> seeds;
+	for (auto node : unsorted) {
+		if (sortChildren(src, node)) seeds.push_back(node);
+	}
+	unsorted.clear();
+
+	if (!seeds.empty()) updateSequencialMetric(src, seeds);
 }
 
 
-void BlockChainTopologyHelper::updateDepth() {
+void BlockChainTopologyHelper::updateSubtreeMetric(int src, int node) {
 
-	std::vector<int> nextDepth;
+	auto &metric = sequentialMetricTable[src];
+	auto &routes = routeTable[src][node];
 
-	// ranged-for lead to mysterious out-of-bound error and i donot know why 
-	for (size_t i = 0, sz = coreNodeList.size(); i < sz; ++i) {
-		auto source = coreNodeList[i];
-		int depth = 0;
+	// a leaf has nothing to wait for
+	double subtreeMetric = 0.0;
+	int subWeight = 1;
+
+	for (size_t i = 0, sz = routes.size(); i < sz; ++i) {
+
+		int subNode = routes[i].dst;
+
+		double transferDelay = getNodeTransferDelay(node, subNode);
+		double linkDelay = getLinkDelay(node, subNode);
+
+		// metric is the time interval from the previous node start sending to all nodes
+		// in its sub-tree received 
+		// root node's metric won't be updated right for it is not used
+		double prevMetric = std::get<2>(metric[subNode]) + linkDelay;
+		if (prevMetric != std::get<1>(metric[subNode])) {
+			unsortedChildren[src].insert(node);
+		}
+		std::get<1>(metric[subNode]) = prevMetric;
+
+		subWeight += std::get<4>(metric[subNode]);
+
+		//Todo: check if units are uniform
+		double subMetric = std::get<1>(metric[subNode])
+			 + transferDelay * (int) (i + 1);
+
+		if (i == 0 || subMetric > subtreeMetric) subtreeMetric = subMetric;
+	}
+
+	std::get<4>(metric[node]) = subWeight;
+	std::get<1>(metric[node]) = subtreeMetric;
+	std::get<2>(metric[node]) = subtreeMetric;
+}
+
+
+void BlockChainTopologyHelper::updateReachMetric(int src, int n) {
+
+	auto &metric = sequentialMetricTable[src];
+
+	if (n == src) {
+		std::get<3>(metric[n]) = 0;
+	}
+	else {
+		int prev = getPrev(src, n);
+
+		std::get<3>(metric[n]) = 
+			std::get<3>(metric[prev]) + getLinkDelay(prev, n) +
+			getNodeTransferDelay(prev, n) * getSequencialOrder(src, prev, n);
+		
+		if (prev != src) std::get<3>(metric[n]) += processingDelay;
+	}
+
+	double transfer_time = 0.0;
+	for (auto &r : routeTable[src][n]) {
+		transfer_time += getNodeTransferDelay(n, r.dst);
+	}
+	std::get<5>(metric[n]) = std::get<3>(metric[n]) + transfer_time;
+}
+
+
+void BlockChainTopologyHelper::updateTreeMetric(int src) {
+
+	// store worst delay to reach
+
+	std::vector<std::pair<int, double>> delayViewOfMetricTable;
+	for (size_t i = 0, sz = sequentialMetricTable[src].size(); i < sz; ++i) {
+		delayViewOfMetricTable.push_back(std::pair<int, double>(
+			i,
+			std::get<3>(sequentialMetricTable[src][i])
+		));
+	}
+
+	std::sort(delayViewOfMetricTable.begin(), delayViewOfMetricTable.end(),
+		[](const std::pair<int, double> &a, const std::pair<int, double> &b) {
+			return a.second < b.second;
+		}
+	);
+
+	std::get<0>(treeMetric[src]) = delayViewOfMetricTable[partiPointLast];
+	std::get<1>(treeMetric[src]) = delayViewOfMetricTable[partiPoint90];
+	std::get<2>(treeMetric[src]) = delayViewOfMetricTable[partiPoint70];
+}
+
+
+// return true if a is greater than b and false else wise
+bool BlockChainTopologyHelper::compareWRTSubtreeMetric(const Route &a, const Route &b) {
+
+	NS_ASSERT(a.src == b.src && a.self == b.self);
+
+	int source = a.src;
+
+	int nodeA = a.dst;
+	int nodeB = b.dst;
+
+	// std::cout << "debug" << std::endl;
+	// std::cout << " a: " << a.dst << " b: " << b.dst << std::endl;
+	// std::cout << " a metric: " << sequentialMetricTable[source][nodeA].second
+	//				  << " b metric: " << sequentialMetricTable[source][nodeB].second << std::endl;
+
+	return std::get<1>(sequentialMetricTable[source][nodeA]) > 
+		std::get<1>(sequentialMetricTable[source][nodeB]);
+
+}
+
+
+void BlockChainTopologyHelper::updateDepth() {
+
+	std::vector<int> nextDepth;
+
+	// ranged-for lead to mysterious out-of-bound error and i donot know why 
+	for (size_t i = 0, sz = coreNodeList.size(); i < sz; ++i) {
+		auto source = coreNodeList[i];
+		int depth = 0;
 		nextDepth.clear();
 		nextDepth.push_back(source);
 		
@@ -1630,12 +2033,16 @@ void BlockChainTopologyHelper::updateRouteVector() {
 		}
 	}
 
+	for (auto &tree : routeTable) {
+		indexTree(tree.first);
+	}
+
 }
 
 
 void BlockChainTopologyHelper::installRouteTable(int level) {
 
-	Ptr<PBFTCorrect> app;
+	Ptr<OverlayApp> app;
 
 	// install overlay route to nodes
 
@@ -1651,7 +2058,7 @@ void BlockChainTopologyHelper::installRouteTable(int level) {
 			for (auto src : coreNodeList) {
 				auto tree = routeTable[src];
 				for (int node = 0; node < stableNodeN; ++node) {
-					app = installedApps.Get(node)->GetObject<PBFTCorrect>();
+					app = getOverlayApp(node);
 					for (size_t i = 0, sz = tree[node].size(); i <sz; ++i) {
 						auto r = tree[node][i];
 
@@ -1667,13 +2074,17 @@ void BlockChainTopologyHelper::installRouteTable(int level) {
 			for (auto src : coreNodeList) {
 				auto tree = routeTable[src];
 				for (int node = 0; node < stableNodeN; ++node) {
-					app = installedApps.Get(node)->GetObject<PBFTCorrect>();
+					app = getOverlayApp(node);
 					for (size_t i = 0, sz = tree[node].size(); i <sz; ++i) {
 						auto r = tree[node][i];
 
 						NS_ASSERT(hasLink(r.self, r.dst));
 
 						app->insertRelaySmallPacket(r.src, r.from, r.dst);
+
+						// the same tree walked upwards merges votes on their way to the root
+						app->addAggregationChild(r.src, r.dst);
+						getOverlayApp(r.dst)->setAggregationParent(r.src, r.self);
 					}
 				}
 			}
@@ -1713,6 +2124,300 @@ void BlockChainTopologyHelper::breadthFirstTopdownWalk(int root, int start,
 }
 
 
+void BlockChainTopologyHelper::forEachTree(std::function<void(int)> f) {
+
+	int n = coreNodeList.size();
+	int threadN = buildThreadN > 0 ? buildThreadN : (int) std::thread::hardware_concurrency();
+	threadN = std::max(1, std::min(threadN, n));
+
+	// nothing shared may be built lazily or inserted inside a worker
+	if (!linkIndexBuilt) buildLinkIndex();
+	if (adjOffset.empty()) buildAdjacency();
+
+	for (auto src : coreNodeList) {
+		routeTable[src];
+		treeParent[src];
+		childPosition[src];
+		unsortedChildren[src];
+		sequentialMetricTable[src];
+		treeMetric[src];
+		treeDepth[src];
+		deferredShare[src].clear();
+	}
+
+	deferShare = true;
+
+	std::atomic<int> next(0);
+	auto worker = [&next, n, &f](){
+		for (int i = next++; i < n; i = next++) f(i);
+	};
+
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threadN; ++t) {
+		pool.emplace_back(worker);
+	}
+	worker();
+	for (auto &t : pool) {
+		t.join();
+	}
+
+	deferShare = false;
+
+	// link shares as if the trees were built one by one
+	for (auto src : coreNodeList) {
+		for (auto &op : deferredShare[src]) {
+			if (std::get<2>(op) > 0) IncLinkShare(std::get<0>(op), std::get<1>(op));
+			else DecLinkShare(std::get<0>(op), std::get<1>(op));
+		}
+		deferredShare[src].clear();
+	}
+}
+
+
+// overlay cache file: magic, version, key, then stable node and link counts,
+// core list, route table per PacketRouteLevel, link metrics and shares, shortest paths.
+// native byte order, a file from another version or topology is ignored and rebuilt
+
+static const uint32_t OVERLAY_CACHE_MAGIC = 0x4f564c59;   // OVLY
+static const uint32_t OVERLAY_CACHE_VERSION = 1;
+
+
+// fnv-1a
+static void hashMix(uint64_t &h, const void *p, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		h ^= ((const uint8_t *) p)[i];
+		h *= 1099511628211ULL;
+	}
+}
+
+
+template <typename T>
+static void writeValue(std::ostream &out, T v) {
+	out.write((const char *) &v, sizeof(T));
+}
+
+
+template <typename T>
+static bool readValue(std::istream &in, T &v) {
+	return (bool) in.read((char *) &v, sizeof(T));
+}
+
+
+uint64_t BlockChainTopologyHelper::overlayCacheKey() {
+
+	uint64_t h = 14695981039346656037ULL;
+
+	hashMix(h, &OVERLAY_CACHE_VERSION, sizeof(OVERLAY_CACHE_VERSION));
+
+	// topology, after installLink settled bandwidth
+	hashMix(h, &nodeN, sizeof(nodeN));
+	hashMix(h, &stableNodeN, sizeof(stableNodeN));
+	for (auto &link : allLinkInfo) {
+		hashMix(h, &link.nodeA, sizeof(link.nodeA));
+		hashMix(h, &link.nodeB, sizeof(link.nodeB));
+		hashMix(h, &link.delay, sizeof(link.delay));
+		hashMix(h, &link.bw, sizeof(link.bw));
+		hashMix(h, &link.share, sizeof(link.share));
+	}
+	for (auto &link : excludedLinks) {
+		hashMix(h, &std::get<0>(link), sizeof(int));
+		hashMix(h, &std::get<1>(link), sizeof(int));
+		hashMix(h, &std::get<2>(link), sizeof(int));
+	}
+
+	// parameters
+	int params[] = {averageMessageSize, smallMessageSize, nodeBw, linkMetricSetting,
+		topologyGenerateMethod1, topologyGenerateMethod2, chooseCore, broadwidthModel,
+		clusterN, latencyOptPartiPoint};
+	hashMix(h, params, sizeof(params));
+	hashMix(h, &processingDelay, sizeof(processingDelay));
+	hashMix(h, &delta, sizeof(delta));
+
+	// seed
+	uint32_t seed = RngSeedManager::GetSeed();
+	uint64_t run = RngSeedManager::GetRun();
+	hashMix(h, &seed, sizeof(seed));
+	hashMix(h, &run, sizeof(run));
+
+	return h;
+}
+
+
+std::string BlockChainTopologyHelper::overlayCacheFile(uint64_t key) {
+	std::ostringstream name;
+	name << overlayCacheDir << "/overlay-" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+	return name.str();
+}
+
+
+bool BlockChainTopologyHelper::loadOverlayCache(std::string file, uint64_t key) {
+
+	std::ifstream in(file, std::ios::binary);
+	if (!in) return false;
+
+	uint32_t magic, version, nodes, links, n;
+	if (!readValue(in, magic) || magic != OVERLAY_CACHE_MAGIC) return false;
+	if (!readValue(in, version) || version != OVERLAY_CACHE_VERSION) return false;
+
+	uint64_t fileKey;
+	if (!readValue(in, fileKey) || fileKey != key) return false;
+	if (!readValue(in, nodes) || (int) nodes != stableNodeN) return false;
+	if (!readValue(in, links) || links != allLinkInfo.size()) return false;
+
+	OverlayCache cache;
+
+	if (!readValue(in, n) || n > nodes) return false;
+	cache.coreNodeList.resize(n);
+	for (auto &src : cache.coreNodeList) {
+		int32_t v;
+		if (!readValue(in, v) || v < 0 || v >= stableNodeN) return false;
+		src = v;
+	}
+
+	for (int level = LARGE_PACKET; level <= SMALL_PACKET; ++level) {
+		for (auto src : cache.coreNodeList) {
+			auto &tree = cache.routeTable[level][src];
+			tree.resize(stableNodeN);
+			for (auto &routes : tree) {
+				if (!readValue(in, n) || n > nodes) return false;
+				routes.resize(n);
+				for (auto &r : routes) {
+					int32_t v[4];
+					for (auto &i : v) {
+						if (!readValue(in, i) || i < -1 || i >= stableNodeN) return false;
+					}
+					r = Route(v[0], v[1], v[2], v[3]);
+				}
+			}
+		}
+	}
+
+	cache.peerMetric.resize(links);
+	cache.linkMetric.resize(links);
+	cache.linkShare.resize(links);
+	for (uint32_t i = 0; i < links; ++i) {
+		int32_t share;
+		if (!readValue(in, cache.peerMetric[i]) || !readValue(in, cache.linkMetric[i])
+			|| !readValue(in, share)) return false;
+		cache.linkShare[i] = share;
+	}
+
+	cache.shortestPath.resize(nodes);
+	for (auto &P : cache.shortestPath) {
+		P.resize(nodes);
+		for (auto &p : P) {
+			int32_t v;
+			if (!readValue(in, v) || v < -1 || v >= stableNodeN) return false;
+			p = v;
+		}
+	}
+
+	overlayCache = std::move(cache);
+	return true;
+}
+
+
+// written aside and renamed, runs of a sweep may share the folder
+void BlockChainTopologyHelper::saveOverlayCache(std::string file, uint64_t key) {
+
+	std::string temp = file + ".tmp" + std::to_string(getpid());
+	std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		std::cerr << "Cannot write overlay cache: " << temp << std::endl;
+		return;
+	}
+
+	writeValue<uint32_t>(out, OVERLAY_CACHE_MAGIC);
+	writeValue<uint32_t>(out, OVERLAY_CACHE_VERSION);
+
+	writeValue<uint64_t>(out, key);
+	writeValue<uint32_t>(out, stableNodeN);
+	writeValue<uint32_t>(out, allLinkInfo.size());
+
+	writeValue<uint32_t>(out, overlayCache.coreNodeList.size());
+	for (auto src : overlayCache.coreNodeList) {
+		writeValue<int32_t>(out, src);
+	}
+
+	for (int level = LARGE_PACKET; level <= SMALL_PACKET; ++level) {
+		for (auto src : overlayCache.coreNodeList) {
+			auto &tree = overlayCache.routeTable[level][src];
+			for (int node = 0; node < stableNodeN; ++node) {
+				std::vector<Route> empty;
+				auto &routes = node < (int) tree.size() ? tree[node] : empty;
+				writeValue<uint32_t>(out, routes.size());
+				for (auto &r : routes) {
+					writeValue<int32_t>(out, r.src);
+					writeValue<int32_t>(out, r.dst);
+					writeValue<int32_t>(out, r.from);
+					writeValue<int32_t>(out, r.self);
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0, sz = allLinkInfo.size(); i < sz; ++i) {
+		writeValue<double>(out, overlayCache.peerMetric[i]);
+		writeValue<double>(out, overlayCache.linkMetric[i]);
+		writeValue<int32_t>(out, overlayCache.linkShare[i]);
+	}
+
+	for (auto &P : overlayCache.shortestPath) {
+		for (auto p : P) {
+			writeValue<int32_t>(out, p);
+		}
+	}
+
+	out.close();
+
+	if (!out || std::rename(temp.c_str(), file.c_str()) != 0) {
+		std::cerr << "Cannot write overlay cache: " << file << std::endl;
+		std::remove(temp.c_str());
+	}
+}
+
+
+void BlockChainTopologyHelper::installOverlayCache() {
+
+	coreNodeList = overlayCache.coreNodeList;
+	installCoreList();
+
+	clearState();
+
+	for (size_t i = 0, sz = allLinkInfo.size(); i < sz; ++i) {
+		allLinkInfo[i].linkMetric = overlayCache.peerMetric[i];
+	}
+	invalidateSPCache();
+
+	setupPeerMetric();
+
+	routeTable = overlayCache.routeTable[LARGE_PACKET];
+	installRouteTable(LARGE_PACKET);
+
+	averageMessageSize = smallMessageSize;
+
+	// leave the helper as the last build did, for planned reach times and repair
+	for (size_t i = 0, sz = allLinkInfo.size(); i < sz; ++i) {
+		allLinkInfo[i].linkMetric = overlayCache.linkMetric[i];
+		allLinkInfo[i].share = overlayCache.linkShare[i];
+	}
+	invalidateSPCache();
+
+	routeTable = overlayCache.routeTable[SMALL_PACKET];
+	for (auto &tree : routeTable) {
+		indexTree(tree.first);
+	}
+	updateSequencialMetric();
+
+	installRouteTable(SMALL_PACKET);
+
+	// only the shortest paths are still to be installed
+	auto shortestPath = std::move(overlayCache.shortestPath);
+	overlayCache = OverlayCache();
+	overlayCache.shortestPath = std::move(shortestPath);
+}
+
+
 void BlockChainTopologyHelper::clearState() {
 
 	tempRouteTable.clear();
@@ -1721,6 +2426,9 @@ void BlockChainTopologyHelper::clearState() {
 
 
 	routeTable.clear();
+	treeParent.clear();
+	childPosition.clear();
+	unsortedChildren.clear();
 	sequentialMetricTable.clear();
 
 	for (auto src : coreNodeList) {
@@ -1733,6 +2441,9 @@ void BlockChainTopologyHelper::clearState() {
 			routeTable[src].resize(stableNodeN);
 		}
 
+		treeParent[src].assign(stableNodeN, -1);
+		childPosition[src].assign(stableNodeN, -1);
+
 		if (sequentialMetricTable.find(src) == sequentialMetricTable.end()) {
 			std::vector<std::tuple<int, double, double, double, int, double> > temp(stableNodeN,
 				std::tuple<int, double, double, double, int, double>(0,0,0,0,0,0));
@@ -1829,10 +2540,419 @@ double BlockChainTopologyHelper::getLowerboundDiameter(int root) {
 }
 
 
+/**
+ * incremental overlay repair when a node leaves
+ * 
+ * the departed node's relay tables tell which nodes it fed (orphans) for each source,
+ * its peers tell which nodes fed it. for every source, the orphans are re-attached 
+ * to the closest of the parent and the already re-attached orphans w.r.t link metric,
+ * i.e. a small prim tree rooted at the parent. only the entries of that source on 
+ * the parent and orphan nodes are touched. orphans of a source no peer fed the departed
+ * node with are taken over by the source itself
+ */
+void BlockChainTopologyHelper::repairOverlay(int departed) {
+
+	Ptr<OverlayApp> app = getOverlayApp(departed);
+
+	std::vector<int> peers = app->getDirectPeers();
+	auto handover = app->disablePeer();
+
+	repairRelayTable(departed, peers, handover.first, OverlayApp::LARGEPKT);
+	repairRelayTable(departed, peers, handover.second, OverlayApp::SMALLPKT);
+
+}
+
+
+void BlockChainTopologyHelper::repairRelayTable(int departed, const std::vector<int> &peers, 
+	RelayMap &handover, uint8_t table) {
+
+	// source id, nodes forwarding messages of that source to the departed node
+	std::map<int, std::vector<int> > parents;
+
+	for (auto q : peers) {
+		if (q == departed || q >= nodeN) continue;
+		Ptr<OverlayApp> app = getOverlayApp(q);
+		for (auto k : app->getRelayEntriesTo(table, departed)) {
+			auto &p = parents[k.src];
+			if (std::find(p.begin(), p.end(), q) == p.end()) p.push_back(q);
+		}
+	}
+
+	// source id, next hops of the departed node
+	std::map<int, std::vector<int> > orphans;
+
+	for (auto &entry : handover) {
+		// broadcasts of the departed node stop with it
+		if (entry.first.src == departed) continue;
+		auto &o = orphans[entry.first.src];
+		for (auto t : entry.second) {
+			if (t != departed && std::find(o.begin(), o.end(), t) == o.end()) o.push_back(t);
+		}
+	}
+
+	for (auto &p : parents) {
+
+		int src = p.first;
+
+		// prefer the parent that actually fed the departed node in the overlay
+		int primary = p.second.front();
+		for (auto q : p.second) {
+			if (handover.find(RelayEntry(src, q)) != handover.end()) {
+				primary = q;
+				break;
+			}
+		}
+
+		std::vector<int> remaining;
+		for (auto o : orphans[src]) {
+			if (std::find(p.second.begin(), p.second.end(), o) == p.second.end()) remaining.push_back(o);
+		}
+
+		// <node, delay from primary>, in attach order
+		std::vector<std::pair<int, double> > attached(1, std::make_pair(primary, 0.0));
+		std::map<int, int> newPrev;
+		std::map<int, std::vector<int> > adopted;
+
+		while (!remaining.empty()) {
+
+			double best = std::numeric_limits<double>::infinity();
+			size_t bestOrphan = 0;
+			int bestPrev = primary;
+
+			for (size_t i = 0; i < remaining.size(); ++i) {
+				for (auto a : attached) {
+					double d = a.second + getRepairMetric(a.first, remaining[i]);
+					if (d < best) {
+						best = d;
+						bestOrphan = i;
+						bestPrev = a.first;
+					}
+				}
+			}
+
+			if (best == std::numeric_limits<double>::infinity()) {
+				// no link left, let the primary reach them through its shortest path route
+				for (auto o : remaining) {
+					newPrev[o] = primary;
+					adopted[primary].push_back(o);
+				}
+				break;
+			}
+
+			int o = remaining[bestOrphan];
+			newPrev[o] = bestPrev;
+			adopted[bestPrev].push_back(o);
+			attached.push_back(std::make_pair(o, best));
+			remaining.erase(remaining.begin() + bestOrphan);
+		}
+
+		// parents
+		for (auto q : p.second) {
+			Ptr<OverlayApp> app = getOverlayApp(q);
+			app->replaceRelayTarget(table, src, departed, q == primary ? adopted[primary] : std::vector<int>());
+		}
+
+		// orphans now hear from their new previous hop
+		for (auto n : newPrev) {
+			Ptr<OverlayApp> app = getOverlayApp(n.first);
+			app->reparentRelayEntry(table, src, departed, n.second);
+		}
+
+		// orphans adopting their siblings
+		for (auto &a : adopted) {
+			if (a.first == primary) continue;
+			Ptr<OverlayApp> app = getOverlayApp(a.first);
+			for (auto o : a.second) {
+				app->insertRelay(table, src, newPrev[a.first], o);
+			}
+		}
+	}
+
+	// no peer relayed the source to the departed node, the source sends to the orphans itself
+	// through its shortest path route
+	for (auto &o : orphans) {
+
+		int src = o.first;
+		if (parents.count(src) || src >= nodeN) continue;
+
+		Ptr<OverlayApp> root = getOverlayApp(src);
+
+		for (auto t : o.second) {
+			if (t == src) continue;
+			root->insertRelay(table, src, src, t);
+			getOverlayApp(t)->reparentRelayEntry(table, src, departed, src);
+		}
+	}
+}
+
+
+// link metric for repair, links to churn nodes are not normalized and only their delay counts
+double BlockChainTopologyHelper::getRepairMetric(int a, int b) {
+	int i = findLink(a, b);
+	if (i < 0) return std::numeric_limits<double>::infinity();
+
+	auto &link = allLinkInfo[i];
+	return related_to_churn_node(link) ? link.delay : link.linkMetric;
+}
+
+
 double BlockChainTopologyHelper::getLowerboundAnalysis(int root) {
 	// todo
 	return -1;
 }
 
 
+// sharding
+
+std::vector<std::vector<int> > BlockChainTopologyHelper::clusterCommittees(int shards) {
+
+	std::vector<std::vector<int> > ret;
+
+	if (shards <= 1) {
+		ret.push_back(std::vector<int>());
+		for (int i = 0; i < stableNodeN; ++i) ret[0].push_back(i);
+		return ret;
+	}
+
+	updateLinkMetric();
+
+	// gaussian similarity scaled by the mean link metric, nodes without a link are not alike
+	double mean = 0;
+	int links = 0;
+	for (auto &link : allLinkInfo) {
+		if (related_to_churn_node(link)) continue;
+		mean += link.linkMetric;
+		links++;
+	}
+	if (links == 0 || mean <= 0) mean = links = 1;
+	mean /= links;
+
+	std::vector<std::vector<double> > aff(stableNodeN, std::vector<double>(stableNodeN, 0));
+
+	for (auto &link : allLinkInfo) {
+		if (related_to_churn_node(link)) continue;
+		double x = link.linkMetric / mean;
+		aff[link.nodeA][link.nodeB] = std::exp(-x * x);
+		aff[link.nodeB][link.nodeA] = aff[link.nodeA][link.nodeB];
+	}
+
+	SpectralClustering sc;
+	sc.setAffineMatrix(aff);
+
+	auto cluster = sc.spectral(shards, 0.005, 100000);
+
+	ret.resize(shards);
+	for (size_t i = 0; i < cluster.size(); ++i) {
+		ret[cluster[i]].push_back(i);
+	}
+
+	// k-means may leave a cluster empty
+	ret.erase(std::remove_if(ret.begin(), ret.end(),
+		[](const std::vector<int> &c){return c.empty();}), ret.end());
+
+	return ret;
+}
+
+
+// members of a committee reach each other over their link or over ip routing
+void BlockChainTopologyHelper::setupShardPeer() {
+	for (size_t c = 0; c < committees.size(); ++c) {
+		auto &members = committees[c];
+
+		for (size_t i = 0; i < members.size(); ++i) {
+			Ptr<OverlayApp> app = getShardOverlayApp(c, i);
+
+			for (size_t j = 0; j < members.size(); ++j) {
+				if (j == i) continue;
+
+				// the interface on their link if any, otherwise any interface of the member
+				Address addr;
+				auto linked = addressIndex.find(nodePairKey(members[i], members[j]));
+				auto any = addressTo.find(members[j]);
+				if (linked != addressIndex.end()) {
+					addr = addressBook[linked->second].addr;
+				}
+				else if (any != addressTo.end()) {
+					addr = addressBook[any->second].addr;
+				}
+
+				if (!addr.IsInvalid()) {
+					app->AddPeer(j, addr);
+				}
+				else {
+					std::cout << "No address between: " << members[i] << " and " << members[j] << std::endl;
+				}
+			}
+		}
+	}
+}
+
+
+// every member is a core node of its committee and roots a shortest path tree over the members,
+// hops between members without a link are routed and weigh their shortest path
+void BlockChainTopologyHelper::setShardOverlayRoute() {
+
+	shardMetric.assign(committees.size(), std::vector<std::vector<double> >());
+
+	for (size_t c = 0; c < committees.size(); ++c) {
+		auto &members = committees[c];
+		int k = members.size();
+
+		shardMetric[c].assign(k, std::vector<double>(k, 0));
+
+		for (int i = 0; i < k; ++i) {
+
+			std::vector<double> D(stableNodeN);
+			std::vector<int> P(stableNodeN);
+
+			utilSP(D, P, members[i]);
+
+			Ptr<OverlayApp> app = getShardOverlayApp(c, i);
+			app->SetPeerMetricForm(averageMessageSize, 1000);
+
+			for (int j = 0; j < k; ++j) {
+
+				app->AddCorePeer(j);
+
+				if (j == i) continue;
+
+				LinkInfo link;
+				if (getLink(members[i], members[j], link)) {
+					shardMetric[c][i][j] = link.linkMetric;
+					app->AddDirectPeer(j);
+					app->AddPeerMetric(j, link.linkMetric);
+				}
+				else {
+					shardMetric[c][i][j] = D[members[j]];
+				}
+			}
+		}
+
+		for (int root = 0; root < k; ++root) {
+
+			std::vector<double> D;
+			std::vector<int> P;
+
+			utilShardSP(c, D, P, root);
+
+			// parents send to children with larger subtrees first
+			std::vector<int> subtree(k, 1);
+			for (int node = 0; node < k; ++node) {
+				for (int p = node; p >= 0 && P[p] != p; p = P[p]) {
+					if (P[p] >= 0) subtree[P[p]]++;
+				}
+			}
+
+			std::vector<int> order(k);
+			for (int node = 0; node < k; ++node) order[node] = node;
+			std::stable_sort(order.begin(), order.end(),
+				[&subtree](int a, int b){return subtree[a] > subtree[b];});
+
+			for (auto node : order) {
+				int prev = P[node];
+				if (node == root || prev < 0) continue;
+
+				int from = P[prev];
+				Ptr<OverlayApp> app = getShardOverlayApp(c, prev);
+
+				app->insertRelayLargePacket(root, from, node);
+				app->insertRelaySmallPacket(root, from, node);
+
+				app->addAggregationChild(root, node);
+				getShardOverlayApp(c, node)->setAggregationParent(root, prev);
+			}
+		}
+	}
+}
+
+
+void BlockChainTopologyHelper::installShardShortestPath() {
+	for (size_t c = 0; c < committees.size(); ++c) {
+		for (size_t i = 0; i < committees[c].size(); ++i) {
+
+			std::vector<double> D;
+			std::vector<int> P;
+
+			utilShardSP(c, D, P, i);
+
+			getShardOverlayApp(c, i)->installShortestPathRoute(std::move(P));
+		}
+	}
+}
+
+
+// dijkstra over the members of committee c, local ids
+void BlockChainTopologyHelper::utilShardSP(int c, std::vector<double> &D, std::vector<int> &P, int source) {
+
+	auto &metric = shardMetric[c];
+	int k = metric.size();
+
+	D.assign(k, std::numeric_limits<double>::infinity());
+	P.assign(k, -1);
+
+	std::vector<bool> done(k, false);
+
+	D[source] = 0;
+	P[source] = source;
+
+	for (int n = 0; n < k; ++n) {
+
+		int u = -1;
+		for (int i = 0; i < k; ++i) {
+			if (!done[i] && (u < 0 || D[i] < D[u])) u = i;
+		}
+
+		if (D[u] == std::numeric_limits<double>::infinity()) break;
+
+		done[u] = true;
+
+		for (int v = 0; v < k; ++v) {
+			if (!done[v] && D[u] + metric[u][v] < D[v]) {
+				D[v] = D[u] + metric[u][v];
+				P[v] = u;
+			}
+		}
+	}
+}
+
+
+void BlockChainTopologyHelper::enableShardTrafficTrace() {
+
+	transitLink.assign(allLink.size(), false);
+
+	for (size_t i = 0, sz = allLink.size(); i < sz; ++i) {
+
+		auto &link = allLinkInfo[i];
+
+		// a single committee spans everything
+		if (!committees.empty()) {
+			bool shared = false;
+			if (!related_to_churn_node(link)) {
+				for (auto a : nodeCommittees[link.nodeA]) {
+					for (auto b : nodeCommittees[link.nodeB]) {
+						shared = shared || a == b;
+					}
+				}
+			}
+			transitLink[i] = !shared;
+		}
+
+		for (uint32_t d = 0; d < allLink[i].GetN(); ++d) {
+			allLink[i].Get(d)->TraceConnectWithoutContext("PhyTxEnd",
+				MakeBoundCallback(&BlockChainTopologyHelper::shardLinkTx, this, (int) i));
+		}
+	}
+}
+
+
+void BlockChainTopologyHelper::shardLinkTx(BlockChainTopologyHelper *helper, int link, Ptr<const Packet> p) {
+	if (helper->transitLink[link]) {
+		helper->transitBytes += p->GetSize();
+	}
+	else {
+		helper->intraShardBytes += p->GetSize();
+	}
+}
+
+
 } // namespace ns3
\ No newline at end of file
@@ -19,6 +19,10 @@
 #include <vector>
 #include <queue>
 #include <map>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <atomic>
 
 namespace ns3 {
 
@@ -154,6 +158,14 @@ public:
   // change settings
 
   void setupPBFTApp(PBFTCorrectHelper& pbft);
+  void setupHotStuffApp(HotStuffCorrectHelper& hotstuff);
+  void setupTendermintApp(TendermintCorrectHelper& tendermint);
+  void setupNarwhalApp(NarwhalCorrectHelper& narwhal);
+
+  // independent pbft committees on node lists of the same topology, committee c on port basePort + c,
+  // members get ids 0 .. size - 1 in list order, a node can be in several committees.
+  // peers, relay trees and shortest paths are then set up per committee over its members
+  void setupShardedPBFTApp(PBFTCorrectHelper& pbft, std::vector<std::vector<int> > c, uint16_t basePort = 2333);
 
   void setAddressHelper(Ipv4AddressHelper& addressHelper);
 
@@ -187,6 +199,22 @@ public:
 
   ApplicationContainer getApp() {return installedApps;}
 
+  // sharding
+
+  // group nodes by spectral clustering on link latency, so committees are geographically local
+  std::vector<std::vector<int> > clusterCommittees(int shards);
+
+  int getShardN() {return committees.size();}
+  std::vector<int> getCommittee(int c) {return committees[c];}
+  ApplicationContainer getShardApp(int c) {return shardApps[c];}
+
+  // count bytes sent over links inside a committee, and transit bytes over links whose ends share
+  // no committee. committees exchange no messages, transit bytes are routed hops of a committee
+  // passing through non-members. call after installLink
+  void enableShardTrafficTrace();
+  uint64_t getTransitBytes() {return transitBytes;}
+  uint64_t getIntraShardBytes() {return intraShardBytes;}
+
   std::vector<int> getCoreNode() {return coreNodeList;}
 
   // a simple way to estimate the lower bound is to use the diameter
@@ -194,10 +222,27 @@ public:
 
   double getLowerboundAnalysis(int root);
 
+  // planned overlay of the last generated packet level, to compare with the realised
+  // dissemination path, -1 if root has no tree or node is not on it
+  int getPlannedPrev(int root, int node);
+  double getPlannedReachTime(int root, int node);
+
   void setProcessingDelay(double d) {processingDelay = d;}
 
   void setDelta(double d) {delta = d;}
 
+  // threads building the trees of different roots in SPT, SA and DIS, 0 for one per hardware thread
+  void setBuildThreadN(int n) {buildThreadN = n;}
+
+  // folder of overlay caches, empty to disable. setOverlayRoute loads the overlay built before for the same
+  // topology, parameters and seed instead of building it, and saves what it builds
+  void setOverlayCache(std::string dir) {overlayCacheDir = dir;}
+
+  // churn
+
+  // take a node offline and locally re-parent its orphaned subtrees
+  void repairOverlay(int departed);
+
 private:
 
   // number of nodes
@@ -246,6 +291,49 @@ private:
   
   std::vector<LinkInfo> allLinkInfo;
 
+  // allLinkInfo as compressed adjacency, built on first use after links are inserted:
+  // node i neighbours adjNode[adjOffset[i] .. adjOffset[i + 1]) over links adjLink[...] of allLinkInfo
+  std::vector<int> adjOffset;
+  std::vector<int> adjNode;
+  std::vector<int> adjLink;
+
+  // first link between two nodes by nodePairKey(low, high), parallel links follow in linkNext, -1 ends.
+  // built on first use after links are inserted
+  std::unordered_map<uint64_t, int> linkIndex;
+  std::vector<int> linkNext;
+  bool linkIndexBuilt = false;
+
+  static uint64_t nodePairKey(int a, int b) {return (uint64_t) (uint32_t) a << 32 | (uint32_t) b;}
+
+  // utilSP results per source, empty if not computed since the link metric last changed
+  std::vector<std::vector<double> > spCacheD;
+  std::vector<std::vector<int> > spCacheP;
+  int spCacheSize = 0;
+
+  int buildThreadN = 0;
+
+  // while trees are built in parallel, link share changes of changePrev are logged per root,
+  // <a, b, +1 or -1>, and applied after in coreNodeList order as a serial build would
+  bool deferShare = false;
+  std::map<int, std::vector<std::tuple<int, int, int> > > deferredShare;
+
+  std::string overlayCacheDir;
+
+  // everything setOverlayRoute leaves behind, as saved to or loaded from a cache file
+  struct OverlayCache {
+    std::vector<int> coreNodeList;
+    // indexed by PacketRouteLevel
+    std::map<int, std::vector<std::vector<Route> > > routeTable[2];
+    // link metric of every link when setupPeerMetric ran, and link metric and share at the end
+    std::vector<double> peerMetric;
+    std::vector<double> linkMetric;
+    std::vector<int> linkShare;
+    // utilSP P of every stable node, taken by installShorestPath
+    std::vector<std::vector<int> > shortestPath;
+  };
+
+  OverlayCache overlayCache;
+
   uint32_t stable_link_count = 0;
 
   bool related_to_churn_node(LinkInfo &l) {return l.nodeA >= stableNodeN || l.nodeB >= stableNodeN;}
@@ -260,8 +348,30 @@ private:
   NodeContainer nodes;
 
   ApplicationContainer installedApps;
+
+  // sharded mode: node lists, apps in list order, committees of each node
+  std::vector<std::vector<int> > committees;
+  std::vector<ApplicationContainer> shardApps;
+  std::vector<std::vector<int> > nodeCommittees;
+
+  // committee -> member -> member, link metric or routed distance, committee local ids
+  std::vector<std::vector<std::vector<double> > > shardMetric;
+
+  std::vector<bool> transitLink;
+  uint64_t transitBytes = 0;
+  uint64_t intraShardBytes = 0;
+
+  // overlay setup only uses the overlay interface, so any protocol can be installed
+  typedef BlockChainOverlayNode OverlayApp;
+
+  Ptr<OverlayApp> getOverlayApp(int i) {return DynamicCast<OverlayApp>(installedApps.Get(i));}
+  Ptr<OverlayApp> getShardOverlayApp(int c, int i) {return DynamicCast<OverlayApp>(shardApps[c].Get(i));}
   
   std::vector<AddressEntry> addressBook;
+
+  // addressBook entry by nodePairKey(from, to), and the first entry addressing a node
+  std::unordered_map<uint64_t, int> addressIndex;
+  std::unordered_map<int, int> addressTo;
   PointToPointHelper p2p;
 
   std::vector<int> coreNodeList;
@@ -272,6 +382,15 @@ private:
   // first key is root id, second is node id, order of Route matters
   std::map<int, std::vector<std::vector<Route> > > routeTable;
 
+  // same keys, parent of a node, -1 for the root and nodes out of the tree,
+  // and its position in the route list of the parent. kept in step with routeTable
+  std::map<int, std::vector<int> > treeParent;
+  std::map<int, std::vector<int> > childPosition;
+
+  // nodes of a tree whose route list may be out of subtree metric order,
+  // their children got a new metric since the list was sorted
+  std::map<int, std::set<int> > unsortedChildren;
+
   // first index is root id, second is node id
   // <0> depth,
   // <1> delay from prev start sending to all subnode receive,
@@ -352,6 +471,15 @@ private:
 
   void installRouteTable(int level);
 
+  // sharded counterparts of setupAppPeer, setOverlayRoute and installShorestPath
+  void setupShardPeer();
+  void setShardOverlayRoute();
+  void installShardShortestPath();
+
+  void utilShardSP(int c, std::vector<double> &D, std::vector<int> &P, int source);
+
+  static void shardLinkTx(BlockChainTopologyHelper *helper, int link, Ptr<const Packet> p);
+
   // overlay algorithm
 
   // one layer plain
@@ -374,6 +502,13 @@ private:
 
   void changePrev(int source, int changer, int new_prev);
 
+  // rebuild parents and positions of a tree from routeTable
+  void indexTree(int root);
+
+  // order the route list of node by subtree metric and refresh the positions in it
+  // return true if the order changed
+  bool sortChildren(int root, int node);
+
 
   // getters
 
@@ -385,6 +520,10 @@ private:
 
   int getLink(int a, int b, LinkInfo &glink);
 
+  // index of the first link between a and b in allLinkInfo, churn links included, -1 if none
+  int findLink(int a, int b);
+  void buildLinkIndex();
+
   bool hasLink(int a, int b);
 
   double getNodeTransferDelay(int a, int b);
@@ -395,6 +534,10 @@ private:
 
   int getPrev(int root, int node);
 
+  double getRepairMetric(int a, int b);
+
+  void repairRelayTable(int departed, const std::vector<int> &peers, RelayMap &handover, uint8_t table);
+
   std::pair<int, double> getWorstMetric(int root);
 
   std::tuple<
@@ -418,6 +561,23 @@ private:
 
   void updateSequencialMetric();
 
+  // same result for one tree, after the route lists of seeds changed,
+  // only seeds and their ancestors bottom up, and subtrees of seeds top down
+  void updateSequencialMetric(int src, const std::vector<int> &seeds);
+
+  // sort the pending route lists of a tree and update its metric, as the next changePrev would.
+  // run at the end of an optimisation so no tree is installed with a stale order
+  void flushUnsortedChildren(int src);
+
+  // <1>, <2> and <4> of node from its children, <1> of the children
+  void updateSubtreeMetric(int src, int node);
+
+  // <3> and <5> of node from its previous node
+  void updateReachMetric(int src, int node);
+
+  // worst, 90 and 70 of delay to reach
+  void updateTreeMetric(int src);
+
   void updateDepth();
 
   void updateTempRouteVector(std::vector<int> &P, int source);
@@ -431,6 +591,22 @@ private:
 
   bool compareWRTSubtreeMetric(const Route &a, const Route &b);
   void utilSP(std::vector<double> &D, std::vector<int> &P, int source);
+  void buildAdjacency();
+  void invalidateSPCache();
+  // size the cache for sz nodes, after it utilSP of different sources may run concurrently
+  void reserveSPCache(int sz);
+
+  // run f on the index of every root of coreNodeList over buildThreadN threads,
+  // f may only touch the state of its own tree
+  void forEachTree(std::function<void(int)> f);
+
+  // hash of the current topology, parameters and seed, and the cache file named by it
+  uint64_t overlayCacheKey();
+  std::string overlayCacheFile(uint64_t key);
+  bool loadOverlayCache(std::string file, uint64_t key);
+  void saveOverlayCache(std::string file, uint64_t key);
+  // set up applications and helper state from a loaded cache as setOverlayRoute would
+  void installOverlayCache();
   void breadthFirstTopdownWalk(int root, int start, std::function<bool(int)> f);
 
 
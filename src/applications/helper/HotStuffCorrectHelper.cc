@@ -0,0 +1,203 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#ifndef HOTSTUFF_CORRECT_HELPER
+#define HOTSTUFF_CORRECT_HELPER
+
+#include "ns3/HotStuffCorrectHelper.h"
+#include "ns3/ConsensusMessage.h"
+#include "ns3/string.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/names.h"
+#include "ns3/BlockChainApplicationBase.h"
+#include "ns3/HotStuffCorrect.h"
+
+namespace ns3 {
+
+
+HotStuffCorrectHelper::HotStuffCorrectHelper(uint32_t n, double t) {
+
+  mFactory.SetTypeId("ns3::HotStuffCorrect");
+
+  timeout = t;
+  mTotalNodes = n;
+  mVoteNodes = n;
+
+  /*
+   * default values, same as PBFTCorrectHelper
+   */
+
+  idCounter = 0;
+  blockSz = 4;
+  ttl = 2;
+  floodN = 1;
+  relayType = ConsensusMessageBase::DIRECT;
+  floodR = true;
+  continous = false;
+  transferModel = BlockChainApplicationBase<PBFTMessage>::PARALLEL;
+  provenanceTrace = false;
+  sendQueueLimit = 0;
+  sendQueuePolicy = BlockChainApplicationBase<PBFTMessage>::QUEUE_UNBOUNDED;
+  peerMetricUpdateInterval = 0;
+  
+}
+
+
+HotStuffCorrectHelper::~HotStuffCorrectHelper() {}
+
+
+void HotStuffCorrectHelper::SetAttribute (std::string name, const AttributeValue &value) {
+  mFactory.Set(name, value);
+}
+
+
+/*
+ * Set the number of peers that every instance of this app refers to
+ * Make sure that your create exactly that number of instances later
+ * since it is not guranteed by this class
+ */
+void HotStuffCorrectHelper::SetTotalNodes(uint32_t n) {
+  mTotalNodes = n;
+}
+
+
+void HotStuffCorrectHelper::SetVoteNodes(uint32_t n) {
+  mVoteNodes = n;
+}
+
+
+/*
+ * Set the view timeout in seconds 
+ */
+void HotStuffCorrectHelper::SetTimeout(double t) {
+  timeout = t;
+}
+
+
+/*
+ * Set the payload size of a block in bytes 
+ */
+void HotStuffCorrectHelper::SetBlockSz(int sz) {
+  blockSz = sz;
+}
+
+
+/*
+ * Set the tranport type of proposals, votes and new-views always go directly to the next leader
+ */
+void HotStuffCorrectHelper::SetTransType(int t) {
+  relayType = t;
+}
+
+
+/*
+ * Set Time-To-Live in hops
+ */
+void HotStuffCorrectHelper::SetTTL(int t) {
+  ttl = t;
+}
+
+
+/*
+ * Set number of outbound forward duplications
+ */
+void HotStuffCorrectHelper::SetFloodN(int n) {
+  floodN = n;
+}
+
+
+/*
+ * If set true, leaders propose a full block in every view instead of waiting for requests
+ */
+void HotStuffCorrectHelper::SetContinous(bool c) {
+  continous = c;
+}
+
+
+/*
+ * If set true, app will forward message to random peers
+ */
+void HotStuffCorrectHelper::SetFloodRandomization(bool b) {
+  floodR = b;
+}
+
+
+void HotStuffCorrectHelper::SetTransferModel(int t) {
+  transferModel = t;
+}
+
+void HotStuffCorrectHelper::SetOutboundBandwidth(double bw) {
+  outboundBandwidth = bw; 
+}
+
+void HotStuffCorrectHelper::SetProvenanceTrace(bool b) {
+  provenanceTrace = b;
+}
+
+void HotStuffCorrectHelper::SetSendQueueLimit(uint64_t bytes) {
+  sendQueueLimit = bytes;
+}
+
+void HotStuffCorrectHelper::SetSendQueuePolicy(uint8_t p) {
+  sendQueuePolicy = p;
+}
+
+void HotStuffCorrectHelper::SetPeerMetricUpdateInterval(double s) {
+  peerMetricUpdateInterval = s;
+}
+
+/*
+ * Install functions
+ */
+
+ApplicationContainer HotStuffCorrectHelper::Install(Ptr<Node> node) {
+  return ApplicationContainer(InstallPriv(node));
+}
+
+
+ApplicationContainer HotStuffCorrectHelper::Install(std::string nodeName) {
+  Ptr<Node> node = Names::Find<Node> (nodeName);
+  return ApplicationContainer (InstallPriv (node));
+}
+
+
+ApplicationContainer HotStuffCorrectHelper::Install(NodeContainer c) {
+  ApplicationContainer apps;
+  for (NodeContainer::Iterator i = c.Begin(); i != c.End(); ++i) {
+    apps.Add(InstallPriv(*i));
+  }
+  return apps;
+}
+
+
+Ptr<Application> HotStuffCorrectHelper::InstallPriv (Ptr<Node> node) {
+  Ptr<HotStuffCorrect> app = mFactory.Create<HotStuffCorrect>();
+
+  app->setTimeout(timeout);
+  app->setNodeId(idCounter++);
+  app->setTotalNode(mTotalNodes);
+  app->setVote(mVoteNodes);
+  app->setBlockSize(blockSz);
+  app->setDelay(0);
+  app->setRelayType(relayType);
+
+  app->setQuorum();
+
+  app->setDefaultTTL(ttl);
+  app->setDefaultFloodN(floodN);
+  app->setFloodRandomization(floodR);
+  app->setContinous(continous);
+  app->setTransferModel(transferModel);
+  app->setOutboundBandwidth(outboundBandwidth);
+
+  app->setProvenanceTrace(provenanceTrace);
+  app->setSendQueueLimit(sendQueueLimit);
+  app->setSendQueuePolicy(sendQueuePolicy);
+  app->setPeerMetricUpdateInterval(peerMetricUpdateInterval);
+  node->AddApplication (app);
+  return app;
+}
+
+}
+
+#endif // !HOTSTUFF_CORRECT_HELPER
@@ -0,0 +1,207 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#ifndef NARWHAL_CORRECT_HELPER
+#define NARWHAL_CORRECT_HELPER
+
+#include "ns3/NarwhalCorrectHelper.h"
+#include "ns3/ConsensusMessage.h"
+#include "ns3/string.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/names.h"
+#include "ns3/BlockChainApplicationBase.h"
+#include "ns3/NarwhalCorrect.h"
+
+namespace ns3 {
+
+
+NarwhalCorrectHelper::NarwhalCorrectHelper(uint32_t n) {
+
+  mFactory.SetTypeId("ns3::NarwhalCorrect");
+
+  mTotalNodes = n;
+
+  /*
+   * default values, same as PBFTCorrectHelper
+   */
+
+  idCounter = 0;
+  batchSz = 4;
+  headerDelay = 0.1;
+  gcDepth = 50;
+  ttl = 2;
+  floodN = 1;
+  relayType = ConsensusMessageBase::DIRECT;
+  floodR = true;
+  continous = false;
+  transferModel = BlockChainApplicationBase<PBFTMessage>::PARALLEL;
+  outboundBandwidth = 0;
+  provenanceTrace = false;
+  sendQueueLimit = 0;
+  sendQueuePolicy = BlockChainApplicationBase<PBFTMessage>::QUEUE_UNBOUNDED;
+  peerMetricUpdateInterval = 0;
+  
+}
+
+
+NarwhalCorrectHelper::~NarwhalCorrectHelper() {}
+
+
+void NarwhalCorrectHelper::SetAttribute (std::string name, const AttributeValue &value) {
+  mFactory.Set(name, value);
+}
+
+
+/*
+ * Set the number of peers that every instance of this app refers to
+ * Make sure that your create exactly that number of instances later
+ * since it is not guranteed by this class
+ */
+void NarwhalCorrectHelper::SetTotalNodes(uint32_t n) {
+  mTotalNodes = n;
+}
+
+
+/*
+ * Set the payload size of a header batch in bytes 
+ */
+void NarwhalCorrectHelper::SetBatchSz(int sz) {
+  batchSz = sz;
+}
+
+
+/*
+ * Set how long a header waits for a full batch in seconds, once its parents are certified
+ */
+void NarwhalCorrectHelper::SetHeaderDelay(double d) {
+  headerDelay = d;
+}
+
+
+/*
+ * Set the number of rounds kept below the last committed anchor
+ */
+void NarwhalCorrectHelper::SetGcDepth(uint32_t d) {
+  gcDepth = d;
+}
+
+
+/*
+ * Set the tranport type of headers and certificates, votes go to the author directly
+ */
+void NarwhalCorrectHelper::SetTransType(int t) {
+  relayType = t;
+}
+
+
+/*
+ * Set Time-To-Live in hops
+ */
+void NarwhalCorrectHelper::SetTTL(int t) {
+  ttl = t;
+}
+
+
+/*
+ * Set number of outbound forward duplications
+ */
+void NarwhalCorrectHelper::SetFloodN(int n) {
+  floodN = n;
+}
+
+
+/*
+ * If set true, validators propose a full batch in every round instead of waiting for requests
+ */
+void NarwhalCorrectHelper::SetContinous(bool c) {
+  continous = c;
+}
+
+
+/*
+ * If set true, app will forward message to random peers
+ */
+void NarwhalCorrectHelper::SetFloodRandomization(bool b) {
+  floodR = b;
+}
+
+
+void NarwhalCorrectHelper::SetTransferModel(int t) {
+  transferModel = t;
+}
+
+void NarwhalCorrectHelper::SetOutboundBandwidth(double bw) {
+  outboundBandwidth = bw; 
+}
+
+void NarwhalCorrectHelper::SetProvenanceTrace(bool b) {
+  provenanceTrace = b;
+}
+
+void NarwhalCorrectHelper::SetSendQueueLimit(uint64_t bytes) {
+  sendQueueLimit = bytes;
+}
+
+void NarwhalCorrectHelper::SetSendQueuePolicy(uint8_t p) {
+  sendQueuePolicy = p;
+}
+
+void NarwhalCorrectHelper::SetPeerMetricUpdateInterval(double s) {
+  peerMetricUpdateInterval = s;
+}
+
+/*
+ * Install functions
+ */
+
+ApplicationContainer NarwhalCorrectHelper::Install(Ptr<Node> node) {
+  return ApplicationContainer(InstallPriv(node));
+}
+
+
+ApplicationContainer NarwhalCorrectHelper::Install(std::string nodeName) {
+  Ptr<Node> node = Names::Find<Node> (nodeName);
+  return ApplicationContainer (InstallPriv (node));
+}
+
+
+ApplicationContainer NarwhalCorrectHelper::Install(NodeContainer c) {
+  ApplicationContainer apps;
+  for (NodeContainer::Iterator i = c.Begin(); i != c.End(); ++i) {
+    apps.Add(InstallPriv(*i));
+  }
+  return apps;
+}
+
+
+Ptr<Application> NarwhalCorrectHelper::InstallPriv (Ptr<Node> node) {
+  Ptr<NarwhalCorrect> app = mFactory.Create<NarwhalCorrect>();
+
+  app->setNodeId(idCounter++);
+  app->setTotalNode(mTotalNodes);
+  app->setBatchSize(batchSz);
+  app->setHeaderDelay(headerDelay);
+  app->setGcDepth(gcDepth);
+  app->setDelay(0);
+  app->setRelayType(relayType);
+
+  app->setQuorum();
+
+  app->setDefaultTTL(ttl);
+  app->setDefaultFloodN(floodN);
+  app->setFloodRandomization(floodR);
+  app->setContinous(continous);
+  app->setTransferModel(transferModel);
+  app->setOutboundBandwidth(outboundBandwidth);
+
+  app->setProvenanceTrace(provenanceTrace);
+  app->setSendQueueLimit(sendQueueLimit);
+  app->setSendQueuePolicy(sendQueuePolicy);
+  app->setPeerMetricUpdateInterval(peerMetricUpdateInterval);
+  node->AddApplication (app);
+  return app;
+}
+
+}
+
+#endif // !NARWHAL_CORRECT_HELPER
@@ -27,6 +27,7 @@ PBFTCorrectHelper::PBFTCorrectHelper(uint32_t n, double t) {
    */
 
   idCounter = 0;
+  mPort = 2333;
   blockSz = 4;
   delay = 0.05;
   ttl = 2;
@@ -35,6 +36,23 @@ PBFTCorrectHelper::PBFTCorrectHelper(uint32_t n, double t) {
   floodR = true;
   continous = false;
   transferModel = BlockChainApplicationBase<PBFTMessage>::PARALLEL;
+  provenanceTrace = false;
+  sendQueueLimit = 0;
+  sendQueuePolicy = BlockChainApplicationBase<PBFTMessage>::QUEUE_UNBOUNDED;
+  peerMetricUpdateInterval = 0;
+  pipelineWindow = 1;
+  batchMaxCount = 1;
+  batchMaxBytes = 0;
+  batchMaxDelay = 0;
+  checkpointInterval = 0;
+  voteAggregation = false;
+  aggregationCost = 0;
+  aggregationWait = 0.2;
+  mempoolOn = false;
+  mempoolCount = 0;
+  mempoolBytes = 0;
+  mempoolPolicy = Mempool::MEMPOOL_DROP_OLDEST;
+  compactBlocks = false;
   
 }
 
@@ -62,6 +80,15 @@ void PBFTCorrectHelper::SetVoteNodes(uint32_t n) {
 }
 
 
+/*
+ * Set the port the apps listen and send on,
+ * committees sharing nodes need one port each
+ */
+void PBFTCorrectHelper::SetPort(uint16_t p) {
+  mPort = p;
+}
+
+
 /*
  * Set the timeout in seconds 
  */
@@ -140,6 +167,93 @@ void PBFTCorrectHelper::setBroadcastDuplicateCount(int c) {
   broadcastDuplicateCount = c;
 }
 
+/*
+ * If set true, messages sent by the apps carry a hop-by-hop provenance trailer
+ * which is reported by the "Provenance" trace source on first delivery
+ */
+void PBFTCorrectHelper::SetProvenanceTrace(bool b) {
+  provenanceTrace = b;
+}
+
+/*
+ * Bound the sequencial send queue of every app in bytes, 0 for unbounded
+ * Only takes effect with the SEQUENCIAL transfer model and a policy other than QUEUE_UNBOUNDED
+ */
+void PBFTCorrectHelper::SetSendQueueLimit(uint64_t bytes) {
+  sendQueueLimit = bytes;
+}
+
+
+/*
+ * Set what to do when the send queue is full, see BlockChainApplicationBase::SEND_QUEUE_POLICY
+ */
+void PBFTCorrectHelper::SetSendQueuePolicy(uint8_t p) {
+  sendQueuePolicy = p;
+}
+
+/*
+ * If set positive, apps estimate delay and goodput of their neighbours from received messages 
+ * and re-rank gossip and core peers every s seconds, instead of keeping the pre-simulation metric
+ */
+void PBFTCorrectHelper::SetPeerMetricUpdateInterval(double s) {
+  peerMetricUpdateInterval = s;
+}
+
+/*
+ * Number of sequence numbers the primary may have in flight
+ * 1 keeps the one-round-at-a-time protocol
+ */
+void PBFTCorrectHelper::SetPipelineWindow(uint32_t w) {
+  pipelineWindow = w;
+}
+
+/*
+ * Let the primary propose requests in batches
+ * a batch closes at maxCount requests, maxBytes payload bytes or maxDelay seconds after its first request,
+ * 0 disables a limit. maxCount 1 with no byte limit turns batching off
+ */
+void PBFTCorrectHelper::SetBatchPolicy(uint32_t maxCount, uint32_t maxBytes, double maxDelay) {
+  batchMaxCount = maxCount;
+  batchMaxBytes = maxBytes;
+  batchMaxDelay = maxDelay;
+}
+
+/*
+ * Exchange checkpoints every k executed rounds and discard state below stable ones, 0 disables it
+ */
+void PBFTCorrectHelper::SetCheckpointInterval(uint32_t k) {
+  checkpointInterval = k;
+}
+
+/*
+ * Merge prepares and commits up the primary's overlay tree into aggregated signatures
+ * cost is the simulated cpu time per merged vote, wait how long a node waits for its children, in seconds
+ * needs the overlay routes installed by BlockChainTopologyHelper
+ */
+void PBFTCorrectHelper::SetVoteAggregation(bool on, double cost, double wait) {
+  voteAggregation = on;
+  aggregationCost = cost;
+  aggregationWait = wait;
+}
+
+/*
+ * Gossip client requests between direct peers through a mempool of at most count requests and bytes bytes,
+ * 0 for unbounded, policy is Mempool::MEMPOOL_DROP_OLDEST or MEMPOOL_REJECT_NEW once full
+ */
+void PBFTCorrectHelper::SetMempool(bool on, uint32_t count, uint64_t bytes, uint8_t policy) {
+  mempoolOn = on;
+  mempoolCount = count;
+  mempoolBytes = bytes;
+  mempoolPolicy = policy;
+}
+
+/*
+ * Send pre-prepares as compact blocks, the header and short ids of the requests, takes effect with the mempool
+ */
+void PBFTCorrectHelper::SetCompactBlocks(bool on) {
+  compactBlocks = on;
+}
+
 /*
  * Install functions
  */
@@ -169,6 +283,7 @@ Ptr<Application> PBFTCorrectHelper::InstallPriv (Ptr<Node> node) {
 
   app->setTimeout(timeout);
   app->setNodeId(idCounter++);
+  app->setPort(mPort);
   app->setTotalNode(mTotalNodes);
   app->setVote(mVoteNodes);
   app->setBlockSize(blockSz);
@@ -186,6 +301,16 @@ Ptr<Application> PBFTCorrectHelper::InstallPriv (Ptr<Node> node) {
 
   app->updatePrimary();
   app->setBroadcastDuplicateCount(broadcastDuplicateCount);
+  app->setProvenanceTrace(provenanceTrace);
+  app->setSendQueueLimit(sendQueueLimit);
+  app->setSendQueuePolicy(sendQueuePolicy);
+  app->setPeerMetricUpdateInterval(peerMetricUpdateInterval);
+  app->setPipelineWindow(pipelineWindow);
+  app->setBatchPolicy(batchMaxCount, batchMaxBytes, batchMaxDelay);
+  app->setCheckpointInterval(checkpointInterval);
+  app->setVoteAggregation(voteAggregation, aggregationCost, aggregationWait);
+  app->setMempool(mempoolOn, mempoolCount, mempoolBytes, mempoolPolicy);
+  app->setCompactBlocks(compactBlocks);
   node->AddApplication (app);
   return app;
 }
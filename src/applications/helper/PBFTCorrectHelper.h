@@ -28,6 +28,7 @@ public:
 
   void SetTotalNodes(uint32_t n);
   void SetVoteNodes(uint32_t n);
+  void SetPort(uint16_t p);
   void SetTimeout(double t);
   void SetBlockSz(int sz);
   void SetDelay(double d);
@@ -39,6 +40,16 @@ public:
   void SetTransferModel(int t);
   void SetOutboundBandwidth(double bw);
   void setBroadcastDuplicateCount(int c);
+  void SetProvenanceTrace(bool b);
+  void SetSendQueueLimit(uint64_t bytes);
+  void SetSendQueuePolicy(uint8_t p);
+  void SetPeerMetricUpdateInterval(double s);
+  void SetPipelineWindow(uint32_t w);
+  void SetBatchPolicy(uint32_t maxCount, uint32_t maxBytes, double maxDelay);
+  void SetCheckpointInterval(uint32_t k);
+  void SetVoteAggregation(bool on, double cost, double wait);
+  void SetMempool(bool on, uint32_t count, uint64_t bytes, uint8_t policy);
+  void SetCompactBlocks(bool on);
 
   void SetAttribute (std::string name, const AttributeValue &value);
 
@@ -54,6 +65,7 @@ protected:
 
   uint32_t mTotalNodes;
   uint32_t mVoteNodes;
+  uint16_t mPort;
 
   double timeout;
   int idCounter;
@@ -67,6 +79,23 @@ protected:
   int transferModel;
   double outboundBandwidth;
   int broadcastDuplicateCount;
+  bool provenanceTrace;
+  uint64_t sendQueueLimit;
+  uint8_t sendQueuePolicy;
+  double peerMetricUpdateInterval;
+  uint32_t pipelineWindow;
+  uint32_t batchMaxCount;
+  uint32_t batchMaxBytes;
+  double batchMaxDelay;
+  uint32_t checkpointInterval;
+  bool voteAggregation;
+  double aggregationCost;
+  double aggregationWait;
+  bool mempoolOn;
+  uint32_t mempoolCount;
+  uint64_t mempoolBytes;
+  uint8_t mempoolPolicy;
+  bool compactBlocks;
     
 };
 
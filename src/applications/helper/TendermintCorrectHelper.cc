@@ -0,0 +1,247 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#ifndef TENDERMINT_CORRECT_HELPER
+#define TENDERMINT_CORRECT_HELPER
+
+#include "ns3/TendermintCorrectHelper.h"
+#include "ns3/ConsensusMessage.h"
+#include "ns3/string.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/names.h"
+#include "ns3/BlockChainApplicationBase.h"
+#include "ns3/TendermintCorrect.h"
+
+namespace ns3 {
+
+
+TendermintCorrectHelper::TendermintCorrectHelper(uint32_t n, double t) {
+
+  mFactory.SetTypeId("ns3::TendermintCorrect");
+
+  timeout = t;
+  mTotalNodes = n;
+
+  /*
+   * default values, same as PBFTCorrectHelper
+   */
+
+  idCounter = 0;
+  blockSz = 4;
+  partSz = 64;
+  partGossip = true;
+  partRepairInterval = 0.5;
+  timeoutDelta = 0.5;
+  ttl = 2;
+  floodN = 1;
+  relayType = ConsensusMessageBase::DIRECT;
+  floodR = true;
+  continous = false;
+  transferModel = BlockChainApplicationBase<TendermintMessage>::PARALLEL;
+  provenanceTrace = false;
+  sendQueueLimit = 0;
+  sendQueuePolicy = BlockChainApplicationBase<TendermintMessage>::QUEUE_UNBOUNDED;
+  peerMetricUpdateInterval = 0;
+  mempoolOn = false;
+  mempoolCount = 0;
+  mempoolBytes = 0;
+  mempoolPolicy = Mempool::MEMPOOL_DROP_OLDEST;
+  
+}
+
+
+TendermintCorrectHelper::~TendermintCorrectHelper() {}
+
+
+void TendermintCorrectHelper::SetAttribute (std::string name, const AttributeValue &value) {
+  mFactory.Set(name, value);
+}
+
+
+/*
+ * Set the number of peers that every instance of this app refers to
+ * Make sure that your create exactly that number of instances later
+ * since it is not guranteed by this class
+ */
+void TendermintCorrectHelper::SetTotalNodes(uint32_t n) {
+  mTotalNodes = n;
+}
+
+
+/*
+ * Set the timeout of round 0 in seconds 
+ */
+void TendermintCorrectHelper::SetTimeout(double t) {
+  timeout = t;
+}
+
+
+/*
+ * Set the payload size of a block in bytes 
+ */
+void TendermintCorrectHelper::SetBlockSz(int sz) {
+  blockSz = sz;
+}
+
+
+/*
+ * Set the part size of a gossiped block in bytes 
+ */
+void TendermintCorrectHelper::SetPartSz(int sz) {
+  partSz = sz;
+}
+
+
+/*
+ * If set true, parts go between direct peers by bitfield advertisement,
+ * otherwise they are broadcast over the transport type like votes.
+ * an incomplete value advertises its bitfield again every repairInterval seconds
+ */
+void TendermintCorrectHelper::SetPartGossip(bool b, double repairInterval) {
+  partGossip = b;
+  partRepairInterval = repairInterval;
+}
+
+
+/*
+ * Set the increase of the timeouts per round in seconds 
+ */
+void TendermintCorrectHelper::SetTimeoutDelta(double d) {
+  timeoutDelta = d;
+}
+
+
+/*
+ * Set the tranport type of proposals, block parts, votes and requests
+ */
+void TendermintCorrectHelper::SetTransType(int t) {
+  relayType = t;
+}
+
+
+/*
+ * Set Time-To-Live in hops
+ */
+void TendermintCorrectHelper::SetTTL(int t) {
+  ttl = t;
+}
+
+
+/*
+ * Set number of outbound forward duplications
+ */
+void TendermintCorrectHelper::SetFloodN(int n) {
+  floodN = n;
+}
+
+
+/*
+ * If set true, proposers propose a full block in every height instead of waiting for requests
+ */
+void TendermintCorrectHelper::SetContinous(bool c) {
+  continous = c;
+}
+
+
+/*
+ * If set true, app will forward message to random peers
+ */
+void TendermintCorrectHelper::SetFloodRandomization(bool b) {
+  floodR = b;
+}
+
+
+void TendermintCorrectHelper::SetTransferModel(int t) {
+  transferModel = t;
+}
+
+void TendermintCorrectHelper::SetOutboundBandwidth(double bw) {
+  outboundBandwidth = bw; 
+}
+
+void TendermintCorrectHelper::SetProvenanceTrace(bool b) {
+  provenanceTrace = b;
+}
+
+void TendermintCorrectHelper::SetSendQueueLimit(uint64_t bytes) {
+  sendQueueLimit = bytes;
+}
+
+void TendermintCorrectHelper::SetSendQueuePolicy(uint8_t p) {
+  sendQueuePolicy = p;
+}
+
+void TendermintCorrectHelper::SetPeerMetricUpdateInterval(double s) {
+  peerMetricUpdateInterval = s;
+}
+
+/*
+ * Gossip requests between direct peers as transactions instead of broadcasting them,
+ * the mempool holds at most count requests and bytes bytes, 0 for unbounded
+ */
+void TendermintCorrectHelper::SetMempool(bool on, uint32_t count, uint64_t bytes, uint8_t policy) {
+  mempoolOn = on;
+  mempoolCount = count;
+  mempoolBytes = bytes;
+  mempoolPolicy = policy;
+}
+
+/*
+ * Install functions
+ */
+
+ApplicationContainer TendermintCorrectHelper::Install(Ptr<Node> node) {
+  return ApplicationContainer(InstallPriv(node));
+}
+
+
+ApplicationContainer TendermintCorrectHelper::Install(std::string nodeName) {
+  Ptr<Node> node = Names::Find<Node> (nodeName);
+  return ApplicationContainer (InstallPriv (node));
+}
+
+
+ApplicationContainer TendermintCorrectHelper::Install(NodeContainer c) {
+  ApplicationContainer apps;
+  for (NodeContainer::Iterator i = c.Begin(); i != c.End(); ++i) {
+    apps.Add(InstallPriv(*i));
+  }
+  return apps;
+}
+
+
+Ptr<Application> TendermintCorrectHelper::InstallPriv (Ptr<Node> node) {
+  Ptr<TendermintCorrect> app = mFactory.Create<TendermintCorrect>();
+
+  app->setTimeout(timeout);
+  app->setNodeId(idCounter++);
+  app->setTotalNode(mTotalNodes);
+  app->setBlockSize(blockSz);
+  app->setPartSize(partSz);
+  app->setPartGossip(partGossip);
+  app->setPartRepairInterval(partRepairInterval);
+  app->setTimeoutDelta(timeoutDelta);
+  app->setDelay(0);
+  app->setRelayType(relayType);
+
+  app->setQuorum();
+
+  app->setDefaultTTL(ttl);
+  app->setDefaultFloodN(floodN);
+  app->setFloodRandomization(floodR);
+  app->setContinous(continous);
+  app->setTransferModel(transferModel);
+  app->setOutboundBandwidth(outboundBandwidth);
+
+  app->setProvenanceTrace(provenanceTrace);
+  app->setSendQueueLimit(sendQueueLimit);
+  app->setSendQueuePolicy(sendQueuePolicy);
+  app->setPeerMetricUpdateInterval(peerMetricUpdateInterval);
+  app->setMempool(mempoolOn, mempoolCount, mempoolBytes, mempoolPolicy);
+  node->AddApplication (app);
+  return app;
+}
+
+}
+
+#endif // !TENDERMINT_CORRECT_HELPER
@@ -0,0 +1,88 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#ifndef TENDERMINTCORRECTHELPER_H
+#define TENDERMINTCORRECTHELPER_H
+
+#include "ns3/object-factory.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/node-container.h"
+#include "ns3/application-container.h"
+#include "ns3/uinteger.h"
+#include "ns3/TendermintCorrect.h"
+
+namespace ns3 {
+
+
+/*
+ * a helper class to create tendermintcorrect applications with setted parameters
+ * same usage as PBFTCorrectHelper, so both protocols can be installed on the same topology
+ */
+
+class TendermintCorrectHelper {
+
+public:
+
+  TendermintCorrectHelper(uint32_t n, double t);
+  ~TendermintCorrectHelper();
+
+  void SetTotalNodes(uint32_t n);
+  void SetTimeout(double t);
+  void SetBlockSz(int sz);
+  void SetPartSz(int sz);
+  void SetPartGossip(bool b, double repairInterval);
+  void SetTimeoutDelta(double d);
+  void SetTransType(int t);
+  void SetTTL(int t);
+  void SetFloodN(int n);
+  void SetFloodRandomization(bool b);
+  void SetContinous(bool c);
+  void SetTransferModel(int t);
+  void SetOutboundBandwidth(double bw);
+  void SetProvenanceTrace(bool b);
+  void SetSendQueueLimit(uint64_t bytes);
+  void SetSendQueuePolicy(uint8_t p);
+  void SetPeerMetricUpdateInterval(double s);
+  void SetMempool(bool on, uint32_t count, uint64_t bytes, uint8_t policy);
+
+  void SetAttribute (std::string name, const AttributeValue &value);
+
+  ApplicationContainer Install (NodeContainer c);
+  ApplicationContainer Install (Ptr<Node> node);
+  ApplicationContainer Install (std::string nodeName);
+
+protected:
+
+  virtual Ptr<Application> InstallPriv (Ptr<Node> node);
+  
+  ObjectFactory mFactory;
+
+  uint32_t mTotalNodes;
+
+  double timeout;
+  double timeoutDelta;
+  int idCounter;
+  int blockSz;
+  int partSz;
+  bool partGossip;
+  double partRepairInterval;
+  int relayType;
+  int ttl;
+  int floodN;
+  bool floodR;
+  bool continous;
+  int transferModel;
+  double outboundBandwidth;
+  bool provenanceTrace;
+  uint64_t sendQueueLimit;
+  uint8_t sendQueuePolicy;
+  double peerMetricUpdateInterval;
+  bool mempoolOn;
+  uint32_t mempoolCount;
+  uint64_t mempoolBytes;
+  uint8_t mempoolPolicy;
+    
+};
+
+}
+#endif
@@ -0,0 +1,135 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#ifndef WORKLOAD_CLIENT_HELPER
+#define WORKLOAD_CLIENT_HELPER
+
+#include "ns3/WorkloadClientHelper.h"
+#include "ns3/names.h"
+#include "ns3/log.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE("WorkloadClientHelper");
+
+
+WorkloadClientHelper::WorkloadClientHelper(uint8_t p, double r) {
+
+  mFactory.SetTypeId("ns3::WorkloadClient");
+
+  process = p;
+  rate = r;
+
+  /*
+   * default values 
+   */
+
+  sizeMin = 4;
+  sizeMax = 4;
+
+}
+
+
+WorkloadClientHelper::~WorkloadClientHelper() {}
+
+
+void WorkloadClientHelper::SetAttribute (std::string name, const AttributeValue &value) {
+  mFactory.Set(name, value);
+}
+
+
+/*
+ * Set the arrival process, see WorkloadClient::ARRIVAL_PROCESS, and the rate in requests per second of every client
+ */
+void WorkloadClientHelper::SetArrival(uint8_t p, double r) {
+  process = p;
+  rate = r;
+}
+
+
+/*
+ * Set the request size in bytes, drawn uniformly from [min, max]
+ */
+void WorkloadClientHelper::SetRequestSize(uint32_t min, uint32_t max) {
+  sizeMin = min;
+  sizeMax = max;
+}
+
+
+/*
+ * Load arrivals to replay, one per line: seconds since the client started and optionally bytes
+ * lines starting with # are skipped. Every client replays the whole trace
+ */
+bool WorkloadClientHelper::SetTraceFile(std::string path) {
+
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    NS_LOG_ERROR("cannot open trace " << path);
+    return false;
+  }
+
+  trace.clear();
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+
+    std::istringstream fields(line);
+    double t;
+    uint32_t bytes = 0;
+
+    if (!(fields >> t)) continue;
+    fields >> bytes;
+
+    trace.push_back(std::make_pair(t, bytes));
+  }
+
+  std::stable_sort(trace.begin(), trace.end(), 
+    [](const std::pair<double, uint32_t> &a, const std::pair<double, uint32_t> &b) {return a.first < b.first;});
+
+  return true;
+}
+
+
+/*
+ * Install functions
+ */
+
+ApplicationContainer WorkloadClientHelper::Install(Ptr<Node> node) {
+  return ApplicationContainer(InstallPriv(node));
+}
+
+
+ApplicationContainer WorkloadClientHelper::Install(std::string nodeName) {
+  Ptr<Node> node = Names::Find<Node> (nodeName);
+  return ApplicationContainer (InstallPriv (node));
+}
+
+
+ApplicationContainer WorkloadClientHelper::Install(NodeContainer c) {
+  ApplicationContainer apps;
+  for (NodeContainer::Iterator i = c.Begin(); i != c.End(); ++i) {
+    apps.Add(InstallPriv(*i));
+  }
+  return apps;
+}
+
+
+Ptr<Application> WorkloadClientHelper::InstallPriv (Ptr<Node> node) {
+  Ptr<WorkloadClient> app = mFactory.Create<WorkloadClient>();
+
+  app->setArrival(process, rate);
+  app->setRequestSize(sizeMin, sizeMax);
+  app->setTrace(trace);
+
+  node->AddApplication (app);
+  return app;
+}
+
+}
+
+#endif // !WORKLOAD_CLIENT_HELPER
@@ -0,0 +1,53 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#ifndef WORKLOADCLIENTHELPER_H
+#define WORKLOADCLIENTHELPER_H
+
+#include "ns3/object-factory.h"
+#include "ns3/node-container.h"
+#include "ns3/application-container.h"
+#include "ns3/WorkloadClient.h"
+
+namespace ns3 {
+
+
+/*
+ * a helper class to put workload clients on nodes that already run a consensus application
+ * install it after the consensus applications, any subset of their nodes will do
+ */
+
+class WorkloadClientHelper {
+
+public:
+
+  WorkloadClientHelper(uint8_t process, double rate);
+  ~WorkloadClientHelper();
+
+  void SetArrival(uint8_t process, double rate);
+  void SetRequestSize(uint32_t min, uint32_t max);
+  bool SetTraceFile(std::string path);
+
+  void SetAttribute (std::string name, const AttributeValue &value);
+
+  ApplicationContainer Install (NodeContainer c);
+  ApplicationContainer Install (Ptr<Node> node);
+  ApplicationContainer Install (std::string nodeName);
+
+protected:
+
+  virtual Ptr<Application> InstallPriv (Ptr<Node> node);
+
+  ObjectFactory mFactory;
+
+  uint8_t process;
+  double rate;
+  uint32_t sizeMin;
+  uint32_t sizeMax;
+
+  std::vector<std::pair<double, uint32_t> > trace;
+
+};
+
+}
+#endif
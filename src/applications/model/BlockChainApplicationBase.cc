@@ -27,9 +27,58 @@ bool RelayEntry::operator<(const RelayEntry &that) const{
 }
 
 
+// implementation of class VoteCounter
+
+VoteCounter::VoteCounter() : votes(0) {}
+
+
+VoteCounter::VoteCounter(int n) : votes(0) {
+  resize(n);
+}
+
+
+void VoteCounter::resize(int n) {
+  bits.assign((n + 63) / 64, 0);
+  votes = 0;
+}
+
+
+void VoteCounter::clear() {
+  std::fill(bits.begin(), bits.end(), 0);
+  votes = 0;
+}
+
+
+int VoteCounter::insert(int id) {
+
+  NS_ASSERT(id >= 0);
+
+  size_t word = id / 64;
+  uint64_t mask = (uint64_t) 1 << (id % 64);
+
+  if (word >= bits.size()) {
+    bits.resize(word + 1, 0);
+  }
+
+  if (!(bits[word] & mask)) {
+    bits[word] |= mask;
+    votes++;
+  }
+
+  return votes;
+}
+
+
+bool VoteCounter::has(int id) {
+  size_t word = id / 64;
+  if (id < 0 || word >= bits.size()) return false;
+  return bits[word] & ((uint64_t) 1 << (id % 64));
+}
+
+
 // implementation of class SendQuestBuffer
 
-SendQuestBuffer::SendQuestBuffer() : currentIndex(0) {}
+SendQuestBuffer::SendQuestBuffer() : currentIndex(0), pendingSends(0), pendingBytes(0) {}
 
 
 bool SendQuestBuffer::empty() {
@@ -44,6 +93,8 @@ std::pair<Ptr<Packet>, int> SendQuestBuffer::getNext() {
   //Todo: will tree-wise scheluding help? 
 
   if (currentIndex < (int) currentQuest.mReceivers.size()) {
+    pendingSends--;
+    pendingBytes -= currentQuest.mPkt->GetSize();
     return std::pair<Ptr<Packet>, int>(
       currentQuest.mPkt,
       currentQuest.mReceivers[currentIndex++]
@@ -57,6 +108,9 @@ std::pair<Ptr<Packet>, int> SendQuestBuffer::getNext() {
     currentQuest = sendBuffer.front();
     sendBuffer.pop_front();
 
+    pendingSends--;
+    pendingBytes -= currentQuest.mPkt->GetSize();
+
     return std::pair<Ptr<Packet>, int>(
       currentQuest.mPkt,
       currentQuest.mReceivers[currentIndex++]
@@ -66,9 +120,148 @@ std::pair<Ptr<Packet>, int> SendQuestBuffer::getNext() {
 
 
 void SendQuestBuffer::insert(SendQuest quest) {
+  pendingSends += quest.mReceivers.size();
+  pendingBytes += (uint64_t) quest.mPkt->GetSize() * quest.mReceivers.size();
   sendBuffer.push_back(quest);
 }
 
 
+// the quest being sent is left untouched
+uint32_t SendQuestBuffer::coalesce(const SendQuest &quest) {
+
+  uint32_t dropped = 0;
+
+  for (auto it = sendBuffer.begin(); it != sendBuffer.end(); ) {
+    if (it->mTagged && it->mKey == quest.mKey && it->mRound < quest.mRound) {
+      dropped += it->mReceivers.size();
+      pendingSends -= it->mReceivers.size();
+      pendingBytes -= (uint64_t) it->mPkt->GetSize() * it->mReceivers.size();
+      it = sendBuffer.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+
+  return dropped;
+}
+
+
+// implementation of class Mempool
+
+Mempool::Mempool(void) : seenLimit(1 << 16) {}
+
+
+void Mempool::setCapacity(uint32_t count, uint64_t bytes) {
+  capacityCount = count;
+  capacityBytes = bytes;
+  seenLimit = std::max((size_t) 1 << 16, (size_t) count * 4);
+}
+
+
+// splitmix64 of <client, request id>, truncated as compact block short ids are
+uint64_t Mempool::shortId(uint32_t client, uint32_t reqId) {
+  uint64_t x = ((uint64_t) client << 32) | reqId;
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  x = x ^ (x >> 31);
+  return x & 0xffffffffffffULL;
+}
+
+
+bool Mempool::full(uint32_t incoming) {
+  return (capacityCount > 0 && txs.size() + 1 > capacityCount) ||
+         (capacityBytes > 0 && totalBytes + incoming > capacityBytes);
+}
+
+
+void Mempool::erase(std::list<MempoolTx>::iterator it) {
+  totalBytes -= it->bytes;
+  index.erase(shortId(it->client, it->reqId));
+  txs.erase(it);
+}
+
+
+void Mempool::remember(uint64_t id) {
+  seenIds.insert(id);
+  seenOrder.push_back(id);
+  if (seenOrder.size() > seenLimit) {
+    seenIds.erase(seenOrder.front());
+    seenOrder.pop_front();
+  }
+}
+
+
+bool Mempool::add(const MempoolTx &tx) {
+
+  uint64_t id = shortId(tx.client, tx.reqId);
+
+  if (seenIds.count(id)) {
+    duplicates++;
+    return false;
+  }
+
+  if (full(tx.bytes)) {
+    if (policy == MEMPOOL_REJECT_NEW || (capacityBytes > 0 && tx.bytes > capacityBytes)) {
+      rejected++;
+      return false;
+    }
+    while (!txs.empty() && full(tx.bytes)) {
+      erase(txs.begin());
+      evicted++;
+    }
+  }
+
+  remember(id);
+
+  txs.push_back(tx);
+  index[id] = std::prev(txs.end());
+  totalBytes += tx.bytes;
+
+  return true;
+}
+
+
+bool Mempool::get(uint64_t id, MempoolTx &tx) {
+  auto it = index.find(id);
+  if (it == index.end()) return false;
+  tx = *(it->second);
+  return true;
+}
+
+
+std::vector<MempoolTx> Mempool::reap(uint32_t maxCount, uint64_t maxBytes) {
+
+  std::vector<MempoolTx> ret;
+  uint64_t b = 0;
+
+  for (auto &tx : txs) {
+    if (maxCount > 0 && ret.size() >= maxCount) break;
+    if (maxBytes > 0 && !ret.empty() && b + tx.bytes > maxBytes) break;
+    ret.push_back(tx);
+    b += tx.bytes;
+  }
+
+  return ret;
+}
+
+
+void Mempool::remove(uint32_t client, uint32_t reqId) {
+
+  uint64_t id = shortId(client, reqId);
+
+  // committed before it got here, never take it later
+  if (!seenIds.count(id)) {
+    remember(id);
+  }
+
+  auto it = index.find(id);
+  if (it != index.end()) {
+    erase(it->second);
+  }
+}
+
+
 
 } // namespace ns3
\ No newline at end of file
@@ -9,9 +9,15 @@
 #include <map>
 #include <list>
 #include <queue>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
 #include <functional>
 #include <random>
 #include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cstring>
 
 #include "ns3/core-module.h"
 #include "ns3/internet-module.h"
@@ -61,6 +67,14 @@ struct SendQuest {
   Ptr<Packet> mPkt;
   std::vector<int> mReceivers;
 
+  // coalescing tag, a tagged quest supersedes waiting quests of a same key and an older round,
+  // round is whatever orders messages of a key, the view for pbft votes
+  bool mTagged = false;
+  uint64_t mKey = 0;
+  uint32_t mRound = 0;
+
+  double mEnqueueTime = 0; // second
+
   SendQuest(Ptr<Packet> pkt, std::vector<int> receivers) 
     : mPkt(pkt), mReceivers(receivers) {}
 
@@ -70,6 +84,33 @@ struct SendQuest {
 
 typedef std::map<RelayEntry, std::vector<int> > RelayMap;
 
+/**
+ * the small packet tree of a root walked upwards
+ * votes travel from the leaves to the root and are merged on the way
+ * parent : next hop towards the root, -1 at the root or off the tree
+ */
+struct AggregationRoute {
+
+  int parent = -1;
+  std::vector<int> children;
+
+};
+
+
+/**
+ * online estimation of a neighbour, fed by received messages
+ * delay : one-way delay, departure timestamp of the previous hop to arrival
+ * goodput : bytes per second, message size over the delay beyond the minimum delay seen
+ */
+struct PeerEstimate {
+
+  double delay = 0;       // second, ewma
+  double minDelay = std::numeric_limits<double>::infinity();  // second
+  double goodput = 0;     // bytes per second, ewma
+  uint32_t samples = 0;
+
+};
+
 class SendQuestBuffer {
 
 private:
@@ -78,6 +119,10 @@ private:
   SendQuest currentQuest;
   int currentIndex;
 
+  // single-receiver sends not started yet, and their bytes
+  uint32_t pendingSends;
+  uint64_t pendingBytes;
+
 public:
 
   SendQuestBuffer(void);
@@ -87,6 +132,188 @@ public:
   std::pair<Ptr<Packet>, int > getNext();
   void insert(SendQuest quest);
 
+  // drop waiting quests superseded by quest, return the number of sends dropped
+  uint32_t coalesce(const SendQuest &quest);
+
+  uint32_t size() {return pendingSends;}
+  uint64_t bytes() {return pendingBytes;}
+
+  // enqueue time of the quest returned by last getNext()
+  double getCurrentEnqueueTime() {return currentQuest.mEnqueueTime;}
+
+};
+
+
+/**
+ * set of voter ids as a bitset, one bit per node
+ * grows if a voter id is beyond the width it was sized to, e.g. a joined churn node
+ */
+class VoteCounter {
+
+private:
+
+  std::vector<uint64_t> bits;
+  int votes;
+
+public:
+
+  VoteCounter(void);
+  VoteCounter(int n);
+  ~VoteCounter() {}
+
+  // drop all votes and size for n voters
+  void resize(int n);
+  void clear();
+
+  // return the number of votes after inserting
+  int insert(int id);
+  bool has(int id);
+
+  inline int size() {return votes;}
+  inline bool empty() {return votes == 0;}
+
+};
+
+
+/**
+ * a transaction waiting in the mempool, a workload request identified by its client node and request id
+ */
+struct MempoolTx {
+  uint32_t client;
+  uint32_t reqId;
+  uint32_t bytes;
+  double arrival;    // when it entered this mempool
+};
+
+
+/**
+ * transactions not ordered yet, oldest first
+ * bounded in count and bytes, dedup by 48 bit short ids that outlive the transactions,
+ * so a transaction gossiped again after it was committed or evicted is not taken twice
+ */
+class Mempool {
+
+public:
+
+  // what add does when the mempool is full
+  enum MEMPOOL_POLICY : uint8_t {
+    MEMPOOL_DROP_OLDEST,
+    MEMPOOL_REJECT_NEW
+  };
+
+  Mempool(void);
+  ~Mempool() {}
+
+  // 0 for unbounded
+  void setCapacity(uint32_t count, uint64_t bytes);
+  void setPolicy(uint8_t p) {policy = p;}
+
+  static uint64_t shortId(uint32_t client, uint32_t reqId);
+
+  // false if known already or rejected
+  bool add(const MempoolTx &tx);
+
+  bool has(uint64_t id) {return index.count(id) > 0;}
+  bool get(uint64_t id, MempoolTx &tx);
+  bool seen(uint64_t id) {return seenIds.count(id) > 0;}
+
+  // oldest first, up to maxCount transactions and maxBytes bytes, 0 for no limit, left in place
+  std::vector<MempoolTx> reap(uint32_t maxCount, uint64_t maxBytes);
+
+  // ordered in a block
+  void remove(uint32_t client, uint32_t reqId);
+
+  uint32_t size() {return txs.size();}
+  uint64_t bytes() {return totalBytes;}
+
+  uint32_t getEvicted() {return evicted;}
+  uint32_t getRejected() {return rejected;}
+  uint32_t getDuplicates() {return duplicates;}
+
+private:
+
+  std::list<MempoolTx> txs;
+  std::unordered_map<uint64_t, std::list<MempoolTx>::iterator> index;
+
+  // short ids taken so far, the oldest forgotten beyond seenLimit
+  std::unordered_set<uint64_t> seenIds;
+  std::deque<uint64_t> seenOrder;
+  size_t seenLimit;
+
+  uint32_t capacityCount = 0;
+  uint64_t capacityBytes = 0;
+  uint8_t policy = MEMPOOL_DROP_OLDEST;
+
+  uint64_t totalBytes = 0;
+
+  uint32_t evicted = 0;
+  uint32_t rejected = 0;
+  uint32_t duplicates = 0;
+
+  bool full(uint32_t incoming);
+  void erase(std::list<MempoolTx>::iterator it);
+  void remember(uint64_t id);
+
+};
+
+
+/**
+ * what the topology helper and a workload client use on an application, whatever message type it speaks
+ * implemented by BlockChainApplicationBase
+ */
+class BlockChainOverlayNode : public Application {
+
+public:
+
+  enum RelayTables : uint8_t {
+    LARGEPKT,
+    SMALLPKT,
+    LARGEPKTALTER,
+    SMALLPKTALTER
+  };
+
+  virtual ~BlockChainOverlayNode (void) {}
+
+  virtual void AddPeer(int id, const Address add) = 0;
+  virtual void AddDirectPeer(int id) = 0;
+  virtual void AddPeerMetric(int id, double metric) = 0;
+  // message size in bytes and bandwidth scale the static peer metric is computed with,
+  // delay + bytes * 8 / (bw * scale), measured metrics take the same form
+  virtual void SetPeerMetricForm(uint32_t messageSize, double bwScale) = 0;
+  virtual void AddCorePeer(int id) = 0;
+  virtual void AddCorePeerMetric(int id, double distance) = 0;
+
+  virtual std::vector<int> getDirectPeers() = 0;
+  virtual std::pair<RelayMap, RelayMap> disablePeer() = 0;
+
+  virtual void insertRelayLargePacket(int src, int from, int to) = 0;
+  virtual void insertRelaySmallPacket(int src, int from, int to) = 0;
+  virtual void insertRelay(uint8_t table, int src, int from, int to) = 0;
+  virtual std::vector<RelayEntry> getRelayEntriesTo(uint8_t table, int target) = 0;
+  virtual void replaceRelayTarget(uint8_t table, int src, int oldTarget, std::vector<int> newTargets) = 0;
+  virtual void reparentRelayEntry(uint8_t table, int src, int oldFrom, int newFrom) = 0;
+
+  virtual void setAggregationParent(int root, int parent) = 0;
+  virtual void addAggregationChild(int root, int child) = 0;
+
+  virtual void installShortestPathRoute(std::vector<int> route) = 0;
+
+  /**
+   * entry point of a workload client sharing the node, see WorkloadClient
+   * request ids start from 1, protocols without clients ignore requests
+   */
+  virtual void submitRequest(uint32_t reqId, uint32_t bytes) {}
+  void setRequestReplyCallback(Callback<void, uint32_t> cb) {requestReplyCallback = cb;}
+
+protected:
+
+  // a workload client on this node, called with the request id once its request is executed
+  Callback<void, uint32_t> requestReplyCallback;
+
+  void notifyRequestReply(uint32_t reqId) {
+    if (!requestReplyCallback.IsNull()) requestReplyCallback(reqId);
+  }
+
 };
 
 
@@ -96,7 +323,7 @@ public:
  * TODO: abstract the common consensus process 
  */
 template<typename MessageType>
-class BlockChainApplicationBase : public Application {
+class BlockChainApplicationBase : public BlockChainOverlayNode {
 
 public:
 
@@ -111,6 +338,13 @@ public:
     PARALLEL
   };
 
+  // what sendInSequence does when the send queue is full
+  enum SEND_QUEUE_POLICY : uint8_t {
+    QUEUE_UNBOUNDED,
+    QUEUE_DROP_TAIL,
+    QUEUE_COALESCE  // drop superseded quests first, then drop tail
+  };
+
   BlockChainApplicationBase(void);
   virtual ~BlockChainApplicationBase (void);
 
@@ -118,16 +352,28 @@ public:
 
   void AddDirectPeer(int id);
   void AddPeerMetric(int id, double metric);
+  void SetPeerMetricForm(uint32_t messageSize, double bwScale);
 
   void acceptPeer(int id, int src, const Address add);
   void joinPeer(int id, const Address add);
 
   std::pair<RelayMap, RelayMap> disablePeer();
-  void handoverPeer(std::pair<RelayMap, RelayMap>, int id, int source);
 
   void insertRelayLargePacket(int src, int from, int to);
   void insertRelaySmallPacket(int src, int from, int to);
 
+  // incremental relay table maintenance, table is one of RelayTables
+  void insertRelay(uint8_t table, int src, int from, int to);
+  std::vector<RelayEntry> getRelayEntriesTo(uint8_t table, int target);
+  void replaceRelayTarget(uint8_t table, int src, int oldTarget, std::vector<int> newTargets);
+  void reparentRelayEntry(uint8_t table, int src, int oldFrom, int newFrom);
+
+  // reverse of the small packet trees, root -> this node's place in its tree
+  void setAggregationParent(int root, int parent);
+  void addAggregationChild(int root, int child);
+  int getAggregationParent(int root);
+  const std::vector<int>& getAggregationChildren(int root);
+
   void AddCorePeer(int id);
   void AddCorePeerMetric(int id, double distance);
 
@@ -150,9 +396,17 @@ public:
   void flood(MessageType msg, double delay);
   void floodAnyway(MessageType msg);
 
+  // send to every replica over a transport, one of the relayType values
+  void broadcast(MessageType msg, int transport);
+
   inline int getNodeId() {return nodeId;}
 
+  std::vector<int> getDirectPeers() {return directPeerList;}
+
   void setNodeId(int id) {nodeId = id;}
+  // apps on the same node, e.g. of different committees, listen on different ports
+  void setPort(uint16_t p) {port = p;}
+  uint16_t getPort() {return port;}
   void setDelay(double d) {mDelay = d;}
   void setTimeout(double t) {timeout = t;}
   void setRelayType(int t) {relayType = t;}
@@ -176,14 +430,63 @@ public:
 
   void setMaxOutboundNumber(uint n) {max_outbound_number = n;}
 
-protected:
+  void setProvenanceTrace(bool b) {provenanceTraceOn = b;}
 
-  enum RelayTables : uint8_t {
-    LARGEPKT,
-    SMALLPKT,
-    LARGEPKTALTER,
-    SMALLPKTALTER
-  };
+  /**
+   * bound of the sequencial send queue in bytes, 0 for unbounded
+   * the queue, its instrumentation and its drops only exist in the SEQUENCIAL transfer model,
+   * PARALLEL hands every send to its socket at once
+   */
+  void setSendQueueLimit(uint64_t bytes) {sendQueueLimit = bytes;}
+  void setSendQueuePolicy(uint8_t p) {sendQueuePolicy = p;}
+
+  // backlog of the sequencial send queue, always empty in PARALLEL model
+  uint32_t getSendBacklog() {return sendquestbuffer.size();}
+  uint64_t getSendBacklogBytes() {return sendquestbuffer.bytes();}
+  uint32_t getSendQueueDrops() {return mSendQueueDrops;}
+  uint32_t getPeakSendBacklog() {return peakSendBacklog;}
+  // backpressure, saturated once a bounded queue is full, a new send would be dropped
+  bool isSendSaturated();
+  bool canSend() {return !isSendSaturated();}
+
+  /**
+   * if on, requests of workload clients enter the mempool and are gossiped between direct peers
+   * as transactions, the protocol builds blocks from the mempool. count and bytes bound it, 0 for unbounded
+   */
+  void setMempool(bool on, uint32_t count, uint64_t bytes, uint8_t policy) {
+    mempoolOn = on;
+    mempool.setCapacity(count, bytes);
+    mempool.setPolicy(policy);
+  }
+  bool isMempoolOn() {return mempoolOn;}
+  Mempool& getMempool() {return mempool;}
+
+  /**
+   * compact block relay, needs the mempool: a block goes out as its header and the short ids of its
+   * transactions, a receiver rebuilds it from its mempool and fetches only the transactions it misses
+   * from the node it got the block from, before relaying and parsing it
+   */
+  void setCompactBlocks(bool on) {compactBlocksOn = on;}
+  // seconds a rebuilding block waits for its transactions before asking another node
+  void setBlockTxTimeout(double t) {blockTxTimeout = t;}
+  bool isCompactBlocksOn() {return compactBlocksOn && mempoolOn;}
+
+  uint32_t getCompactBlocks() {return compactBlocksRecv;}      // received
+  uint32_t getCompactRebuilt() {return compactBlocksRebuilt;}  // from the mempool alone
+  uint32_t getCompactMissingTxs() {return compactMissingTxs;}  // fetched
+
+  // re-rank peers every s seconds from online estimation, 0 keeps the static metric
+  void setPeerMetricUpdateInterval(double s) {peerMetricUpdateInterval = s;}
+  void setPeerMetricGain(double g) {peerMetricGain = g;}
+
+  // negative if the peer is not measured yet
+  double getPeerDelayEstimate(int id);
+  double getPeerGoodputEstimate(int id);
+
+  // receiver, unique message id, hops the message travelled
+  typedef void (* ProvenanceTracedCallback)(uint32_t, uint64_t, const ConsensusMessageBase::Provenance&);
+
+protected:
 
   // unique id for each app
   // will be set by its helper
@@ -223,6 +526,20 @@ protected:
   // second is the distance metric to that peer
   peerMetricPrioQueue corePeerMetric;
 
+  // static distance to core peers, corePeerMetric is rebuilt from it
+  std::map<int, double> corePeerDistance;
+
+  std::map<int, PeerEstimate> peerEstimate;
+
+  double peerMetricUpdateInterval = 0; // second
+  double peerMetricGain = 0.125;       // weight of a new sample
+
+  // see SetPeerMetricForm
+  uint32_t peerMetricMessageSize = 500; // bytes
+  double peerMetricBwScale = 1;
+
+  EventId peerMetricUpdateEvent;
+
   double timeout;
 
   EventId timeoutEvent;
@@ -241,6 +558,60 @@ protected:
   // TODO: do some tracing
   TracedCallback<Ptr<const Packet>> mRxTrace;
 
+  // fired on first delivery of a message that carries a provenance trailer
+  TracedCallback<uint32_t, uint64_t, const ConsensusMessageBase::Provenance&> mProvenanceTrace;
+
+  // if set, every hop appends itself to the message provenance trailer
+  bool provenanceTraceOn = false;
+
+  // send queue instrumentation, only the SEQUENCIAL model queues
+  TracedValue<uint32_t> mSendQueueDepth;   // sends waiting
+  TracedValue<uint64_t> mSendQueueBytes;   // bytes waiting
+  TracedValue<double> mQueueingDelay;      // wait of the latest started send, second
+  TracedValue<uint32_t> mSendQueueDrops;   // sends dropped or coalesced
+
+  uint32_t peakSendBacklog = 0;
+
+  bool mempoolOn = false;
+  Mempool mempool;
+
+  bool compactBlocksOn = false;
+
+  // a compact block waiting for the transactions its sender is asked for
+  struct PendingBlock {
+    std::vector<uint64_t> ids;
+    std::vector<MempoolTx> txs;
+    std::vector<bool> found;
+    uint32_t missing = 0;
+    std::vector<std::pair<MessageType, int> > arrivals;   // <message, duplicates>, relayed once rebuilt
+    std::set<uint32_t> asked;   // nodes asked for the transactions since the last restart
+    EventId retry;
+  };
+
+  // transactions of the blocks this node sent or rebuilt, by message seq, to answer REQUIRE
+  struct BlockTxs {
+    std::vector<MempoolTx> txs;
+    bool parsed = false;
+  };
+
+  std::map<uint64_t, PendingBlock> pendingBlocks;
+  std::map<uint64_t, BlockTxs> blockTxCache;
+  std::deque<uint64_t> blockTxOrder;
+  size_t blockTxCacheLimit = 256;
+  double blockTxTimeout = 1;
+
+  uint32_t compactBlocksRecv = 0;
+  uint32_t compactBlocksRebuilt = 0;
+  uint32_t compactMissingTxs = 0;
+
+  uint64_t sendQueueLimit = 0; // bytes
+  uint8_t sendQueuePolicy = QUEUE_UNBOUNDED;
+
+  // coalescing tag of the next sendInSequence call, see tagQuest()
+  bool questTagged = false;
+  uint64_t questKey = 0;
+  uint32_t questRound = 0;
+
   int relayType;
 
   // define "large" packets and "small" packets
@@ -254,6 +625,12 @@ protected:
   RelayMap relayTableLargePacket;
   RelayMap relayTableSmallPacket;
 
+  // reverse index of the relay tables, next hop -> entries forwarding to it
+  std::map<int, std::set<RelayEntry> > relayIndexLargePacket;
+  std::map<int, std::set<RelayEntry> > relayIndexSmallPacket;
+
+  std::map<int, AggregationRoute> aggregationRoutes;
+
   std::vector<int> shortestPathRoute;
 
   int defaultTTL;
@@ -309,8 +686,62 @@ protected:
 
   void applicationLayerRelay(MessageType msg, int duplicates = 1);
 
+  void stampHop(MessageType& msg);
+
+  /**
+   * messages with a same key supersede each other in the send queue, the one with larger round wins
+   * return false if msg shall never be coalesced
+   */
+  virtual bool getSupersedeKey(MessageType& msg, uint64_t &key, uint32_t &round) {return false;}
+
+  void tagQuest(MessageType& msg);
+
+  // a saturated send queue has room again, protocols holding proposals back resume here
+  virtual void onSendQueueReady() {}
+
+  // feed the online estimator with a message of size bytes just received
+  void samplePeer(MessageType& msg, uint32_t size);
+
+  void updatePeerMetric();
+
+  // metric of a measured neighbour in the form of the static one
+  double measuredPeerMetric(const PeerEstimate &e);
+
+  // a new neighbour starts from its estimate if measured, else from the average of the others
+  double initialPeerMetric(int id);
+
   virtual void parseMessage(MessageType msg) = 0;
 
+  /**
+   * a transaction from a client of this node (from = -1) or gossiped by direct peer from,
+   * if new it is passed on to the other direct peers and handed to onMempoolTx
+   */
+  bool mempoolAdd(MempoolTx tx, int from);
+
+  // encode tx in the protocol message type and send it to a direct peer
+  virtual void sendTransaction(const MempoolTx &tx, int peer) {}
+
+  // a transaction entered the mempool, e.g. a proposer waiting for work
+  virtual void onMempoolTx(const MempoolTx &tx) {}
+
+  /**
+   * turn a block into a compact block before it is sent, if compact blocks are on
+   * the first headerLen bytes of the payload are kept, the rest is the transactions txs, <client, request id>.
+   * signer and seq have to be set already. left as is if a transaction is not in the mempool
+   *
+   * compact payload: [full length 4][header length 4][count 4][short id 6]...[header]
+   */
+  void compactBlock(MessageType &msg, uint32_t headerLen, const std::vector<std::pair<uint32_t, uint32_t> > &txs);
+
+  void onCompactBlock(MessageType msg, int duplicates);
+  void onBlockTxRequest(MessageType msg);
+  void onBlockTxs(MessageType msg);
+  bool requestBlockTxs(uint64_t key, bool restart);
+  void onBlockTxTimeout(uint64_t key);
+  void finishBlock(uint64_t key);
+  MessageType expandBlock(MessageType msg);
+  void cacheBlockTxs(uint64_t key, std::vector<MempoolTx> txs, bool parsed);
+
 private:
 
   void sendTo(Ptr<Packet> pkt, int i);
@@ -320,6 +751,11 @@ private:
   void sendInSequence(Ptr<Packet> pkt, std::vector<int> receivers, double delay);
 
   void sendNext();
+
+  void updateSendQueueTrace();
+
+  RelayMap& getRelayTable(uint8_t table);
+  std::map<int, std::set<RelayEntry> >& getRelayIndex(uint8_t table);
   
   bool compareWRTMetric(const int &a, const int &b);
 
@@ -347,8 +783,15 @@ BlockChainApplicationBase<MessageType>::BlockChainApplicationBase(void) {
   peerMetric.clear();
   relayTableLargePacket.clear();
   relayTableSmallPacket.clear();
+  relayIndexLargePacket.clear();
+  relayIndexSmallPacket.clear();
   outboundBandwidth = 0;
 
+  mSendQueueDepth = 0;
+  mSendQueueBytes = 0;
+  mQueueingDelay = 0;
+  mSendQueueDrops = 0;
+
 }
 
 
@@ -424,6 +867,11 @@ void BlockChainApplicationBase<MessageType>::StartApplication() {
   lastStartTime = Simulator::Now().GetSeconds();
 
   lastSendingStateTransferTime = lastStartTime;
+
+  if (peerMetricUpdateInterval > 0) {
+    peerMetricUpdateEvent = Simulator::Schedule(Seconds(peerMetricUpdateInterval), 
+      &BlockChainApplicationBase<MessageType>::updatePeerMetric, this);
+  }
   
 }
 
@@ -440,6 +888,12 @@ void BlockChainApplicationBase<MessageType>::StopApplication() {
 
   clearDelaySendEvent();
 
+  for (auto &pending : pendingBlocks) {
+    if (checkEventStatus(pending.second.retry)) {
+      Simulator::Cancel(pending.second.retry);
+    }
+  }
+
   lastStopTime = Simulator::Now().GetSeconds();
 
   if (isSending) {
@@ -495,12 +949,33 @@ void BlockChainApplicationBase<MessageType>::AddPeerMetric(int id, double metric
 }
 
 
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::SetPeerMetricForm(uint32_t messageSize, double bwScale) {
+  peerMetricMessageSize = messageSize;
+  peerMetricBwScale = bwScale;
+}
+
+
+template <typename MessageType>
+double BlockChainApplicationBase<MessageType>::initialPeerMetric(int id) {
+
+  auto e = peerEstimate.find(id);
+  if (e != peerEstimate.end() && e->second.samples > 0) return measuredPeerMetric(e->second);
+
+  if (peerMetric.empty()) return 0;
+
+  double sum = 0;
+  for (auto &m : peerMetric) sum += m.second;
+  return sum / peerMetric.size();
+}
+
+
 template <typename MessageType>
 void BlockChainApplicationBase<MessageType>::acceptPeer(int id, int src, const Address add) {
   
   AddPeer(id, add);
   AddDirectPeer(id);
-  AddPeerMetric(id, 0); // Todo: update metric
+  AddPeerMetric(id, initialPeerMetric(id));
 
   // connect socket
   Ptr<Socket> sock = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
@@ -532,15 +1007,16 @@ void BlockChainApplicationBase<MessageType>::acceptPeer(int id, int src, const A
   }
   
   // update relay table
-  for (auto it  = relayTableLargePacket.begin(); it != relayTableLargePacket.end(); ++it) {
-    if (it->first.src == src) {
-      it->second.push_back(id);
+  // entries are ordered by source, so only the entries of src are visited
+  for (uint8_t table : {LARGEPKT, SMALLPKT}) {
+    RelayMap &relayTable = getRelayTable(table);
+    auto begin = relayTable.lower_bound(RelayEntry(src, std::numeric_limits<int>::min()));
+    std::vector<int> froms;
+    for (auto it = begin; it != relayTable.end() && it->first.src == src; ++it) {
+      froms.push_back(it->first.from);
     }
-  }
-
-  for (auto it  = relayTableSmallPacket.begin(); it != relayTableSmallPacket.end(); ++it) {
-    if (it->first.src == src) {
-      it->second.push_back(id);
+    for (auto from : froms) {
+      insertRelay(table, src, from, id);
     }
   }
 
@@ -553,7 +1029,7 @@ template <typename MessageType>
 void BlockChainApplicationBase<MessageType>::joinPeer(int id, const Address add) {
   AddPeer(id, add);
   AddDirectPeer(id);
-  AddPeerMetric(id, 0); // Todo: update metric
+  AddPeerMetric(id, initialPeerMetric(id));
 
   // connect socket
   Ptr<Socket> sock = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
@@ -586,51 +1062,6 @@ std::pair<RelayMap, RelayMap> BlockChainApplicationBase<MessageType>::disablePee
   return std::make_pair(relayTableLargePacket, relayTableSmallPacket);
 }
 
-template <typename MessageType>
-void BlockChainApplicationBase<MessageType>::handoverPeer(std::pair<RelayMap, RelayMap> handover_map, int id, int source) {
-  for (auto it = relayTableLargePacket.begin(); it != relayTableLargePacket.end(); ++it) {
-    if (it->first.src == source) {
-      bool relay = false;
-      for (auto dst = it->second.begin(); dst != it->second.end(); ++dst) {
-        if (*dst == id) {
-          relay = true;
-          it->second.erase(dst);
-          break;
-        }
-      }
-      if (relay) {
-        for (auto handover = handover_map.first.begin(); handover != handover_map.first.end(); ++handover) {
-          for (auto target: handover->second) {
-            (*it).second.push_back(target);
-          }
-        }
-      }
-    }
-  }
-
-  for (auto it = relayTableSmallPacket.begin(); it != relayTableSmallPacket.end(); ++it) {
-    if (it->first.src == source) {
-      bool relay = false;
-      for (auto dst = it->second.begin(); dst != it->second.end(); ++dst) {
-        if (*dst == id) {
-          relay = true;
-          it->second.erase(dst);
-          break;
-        }
-      }
-      if (relay) {
-        for (auto handover = handover_map.first.begin(); handover != handover_map.first.end(); ++handover) {
-          for (auto target: handover->second) {
-            (*it).second.push_back(target);
-          }
-        }
-      }
-    }
-  } 
-}
-
-
-
 template <typename MessageType>
 void BlockChainApplicationBase<MessageType>::AddCorePeer(int id) {
   corePeerList.push_back(id);
@@ -640,13 +1071,24 @@ void BlockChainApplicationBase<MessageType>::AddCorePeer(int id) {
 template <typename MessageType>
 void BlockChainApplicationBase<MessageType>::AddCorePeerMetric(int id, double distance) {
   corePeerMetric.push(std::pair<int, double>(id, distance));
+  corePeerDistance[id] = distance;
 }
 
 
+// the coalescing tag of the message is taken now, the send is queued later
 template <typename MessageType>
 void BlockChainApplicationBase<MessageType>::BroadcastToPeers(Ptr<Packet> pkt, double delay) {
-  void (BlockChainApplicationBase<MessageType>::*fp)(Ptr<Packet>) = &BlockChainApplicationBase<MessageType>::BroadcastToPeers;
-  delaySendEvent = Simulator::Schedule(Seconds(delay), fp, this, pkt);
+  bool tagged = questTagged;
+  uint64_t key = questKey;
+  uint32_t r = questRound;
+
+  delaySendEvent = Simulator::Schedule(Seconds(delay), [this, pkt, tagged, key, r]() {
+    questTagged = tagged;
+    questKey = key;
+    questRound = r;
+    BroadcastToPeers(pkt);
+    questTagged = false;
+  });
 }
 
 
@@ -658,8 +1100,17 @@ void BlockChainApplicationBase<MessageType>::installShortestPathRoute(std::vecto
 
 template <typename MessageType>
 void BlockChainApplicationBase<MessageType>::BroadcastToPeers(Ptr<Packet> pkt, double delay, RelayEntry k) {
-  void (BlockChainApplicationBase<MessageType>::*fp)(Ptr<Packet>, RelayEntry) = &BlockChainApplicationBase<MessageType>::BroadcastToPeers;
-  delaySendEvent = Simulator::Schedule(Seconds(delay), fp, this, pkt, k);
+  bool tagged = questTagged;
+  uint64_t key = questKey;
+  uint32_t r = questRound;
+
+  delaySendEvent = Simulator::Schedule(Seconds(delay), [this, pkt, k, tagged, key, r]() {
+    questTagged = tagged;
+    questKey = key;
+    questRound = r;
+    BroadcastToPeers(pkt, k);
+    questTagged = false;
+  });
 }
 
 
@@ -773,12 +1224,16 @@ void BlockChainApplicationBase<MessageType>::relay(MessageType msg) {
   RelayEntry k(msg.getSrcAddr(), msg.getFromAddr());
 
   msg.setFromAddr(nodeId);
+  stampHop(msg);
+  tagQuest(msg);
 
   // use node identifier instead of address just for coding simplicity
   // actually knowing ip-address is enough 
 
   Ptr<Packet> packet = msg.toPacket();
   BroadcastToPeers(packet, k);
+
+  questTagged = false;
 }
 
 
@@ -813,6 +1268,8 @@ void BlockChainApplicationBase<MessageType>::floodAnyway(MessageType msg) {
   uint8_t ttl = msg.getTTL();
   if (ttl != 0) ttl = ttl - 1;
   msg.setTTL(ttl);
+  stampHop(msg);
+  tagQuest(msg);
   
   Ptr<Packet> packet = msg.toPacket();
 
@@ -846,6 +1303,66 @@ void BlockChainApplicationBase<MessageType>::floodAnyway(MessageType msg) {
     // std::cout << std::endl;
     sendToPeer(packet, randomizedRecvList);
   }
+
+  questTagged = false;
+}
+
+
+/**
+ * DIRECT to every peer, RELAY over the overlay rooted here, MIXED and the flooding types with
+ * the default fanout, CORE_RELAY relays from core nodes and floods from the others
+ */
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::broadcast(MessageType msg, int transport) {
+
+  if (transport == ConsensusMessageBase::DIRECT) {
+    msg.setTransportType(ConsensusMessageBase::DIRECT);
+    stampHop(msg);
+    Ptr<Packet> packet = msg.toPacket();
+    BroadcastToPeers(packet);
+  }
+
+  if (transport == ConsensusMessageBase::RELAY) {
+    msg.setTransportType(ConsensusMessageBase::RELAY);
+    msg.setSrcAddr(nodeId);
+    msg.setFromAddr(nodeId);
+    relay(std::move(msg));
+  }
+
+  if (transport == ConsensusMessageBase::MIXED) {
+    msg.setTransportType(ConsensusMessageBase::MIXED);
+    msg.setForwardN(defaultFloodN);
+    msg.setTTL(defaultTTL);
+    flood(std::move(msg));
+  }
+
+  if (transport == ConsensusMessageBase::CORE_RELAY) {
+    msg.setTransportType(ConsensusMessageBase::CORE_RELAY);
+    msg.setForwardN(defaultFloodN);
+    msg.setTTL(defaultTTL);
+
+    if (isCoreNode()) {
+      msg.setSrcAddr(nodeId);
+      msg.setFromAddr(nodeId);
+      relay(std::move(msg));
+    }
+    else {
+      flood(std::move(msg));
+    }
+  }
+
+  if (transport == ConsensusMessageBase::INFECT_UPON_CONTAGION) {
+    msg.setTransportType(ConsensusMessageBase::INFECT_UPON_CONTAGION);
+    msg.setForwardN(defaultFloodN);
+    msg.setTTL(defaultTTL);
+    floodAnyway(std::move(msg));
+  }
+
+  if (transport == ConsensusMessageBase::FLOOD) {
+    msg.setTransportType(ConsensusMessageBase::FLOOD);
+    msg.setForwardN(defaultFloodN);
+    floodAnyway(std::move(msg));
+  }
 }
 
 
@@ -974,8 +1491,31 @@ void BlockChainApplicationBase<MessageType>::sendInSequence(Ptr<Packet> pkt, std
   if (!receivers.empty()) {
 
     SendQuest questList(pkt, receivers);
+    questList.mEnqueueTime = Simulator::Now().GetSeconds();
+
+    if (questTagged) {
+      questList.mTagged = true;
+      questList.mKey = questKey;
+      questList.mRound = questRound;
+    }
+
+    if (sendQueuePolicy == QUEUE_COALESCE && questList.mTagged) {
+      mSendQueueDrops += sendquestbuffer.coalesce(questList);
+    }
+
+    // an idle sender always takes the quest, otherwise a quest larger than the bound would never go
+    if (sendQueuePolicy != QUEUE_UNBOUNDED && sendQueueLimit > 0 && isSending &&
+        sendquestbuffer.bytes() + (uint64_t) pkt->GetSize() * receivers.size() > sendQueueLimit) {
+
+      NS_LOG_INFO("node " << nodeId << " send queue full, drop " << receivers.size() << " sends");
+
+      mSendQueueDrops += receivers.size();
+      updateSendQueueTrace();
+      return;
+    }
 
     sendquestbuffer.insert(questList);
+    updateSendQueueTrace();
 
     if (!isSending) {
 
@@ -995,19 +1535,33 @@ void BlockChainApplicationBase<MessageType>::sendInSequence(Ptr<Packet> pkt, std
 
 template <typename MessageType>
 void BlockChainApplicationBase<MessageType>::sendInSequence(Ptr<Packet> pkt, std::vector<int> receivers, double delay) {
-  void (BlockChainApplicationBase<MessageType>::*fp)(Ptr<Packet>, std::vector<int>) = &BlockChainApplicationBase<MessageType>::sendInSequence;
-  delayGroupSendEvent = Simulator::Schedule(Seconds(delay), fp, this, pkt, receivers);
+  bool tagged = questTagged;
+  uint64_t key = questKey;
+  uint32_t r = questRound;
+
+  delayGroupSendEvent = Simulator::Schedule(Seconds(delay), [this, pkt, receivers, tagged, key, r]() {
+    questTagged = tagged;
+    questKey = key;
+    questRound = r;
+    sendInSequence(pkt, receivers);
+    questTagged = false;
+  });
 }
 
 
 template <typename MessageType>
 void BlockChainApplicationBase<MessageType>::sendNext() {
   if (!sendquestbuffer.empty()) {
+    bool saturated = isSendSaturated();
+
     auto task = sendquestbuffer.getNext();
 
     auto pkt = task.first;
     auto receiver = task.second;
 
+    mQueueingDelay = Simulator::Now().GetSeconds() - sendquestbuffer.getCurrentEnqueueTime();
+    updateSendQueueTrace();
+
     double finishTime = (double) pkt->GetSize() / outboundBandwidth;
 
     sendTo(pkt, receiver);
@@ -1015,6 +1569,10 @@ void BlockChainApplicationBase<MessageType>::sendNext() {
     void (BlockChainApplicationBase<MessageType>::*fp)() = &BlockChainApplicationBase<MessageType>::sendNext;
 
     Simulator::Schedule(Seconds(finishTime), fp, this);
+
+    if (saturated && !isSendSaturated()) {
+      onSendQueueReady();
+    }
   }
   else {
     // finished all sending quests
@@ -1088,7 +1646,9 @@ void BlockChainApplicationBase<MessageType>::onMessageCallback(MessageType msg)
    bool conflict;
    bool hasfull;
 
-  if (pooledMsg) {
+  // transaction requests and answers of compact blocks are not pooled
+  if (pooledMsg && (msg.getBlockType() == ConsensusMessageBase::NORMAL_BLOCK 
+      || msg.getBlockType() == ConsensusMessageBase::COMPACT_HEAD)) {
     std::tie(count, conflict, hasfull) = messageRecvPool.insertWithDetect(msg);
   }
 
@@ -1099,47 +1659,31 @@ void BlockChainApplicationBase<MessageType>::onMessageCallback(MessageType msg)
     if (pooledMsg) {
       applicationLayerRelay(msg, count);
       if (count <= 1) { // only process once
+        if (msg.hasProvenance()) {
+          mProvenanceTrace(nodeId, msg.uniqueMessageSeq(), msg.getProvenance());
+        }
         parseMessage(std::move(msg));
       }
     }
     else {
       applicationLayerRelay(msg);
+      if (msg.hasProvenance()) {
+        mProvenanceTrace(nodeId, msg.uniqueMessageSeq(), msg.getProvenance());
+      }
       parseMessage(std::move(msg)); 
     }
   break;
 
-  // todo not tested yet
-
   case ConsensusMessageBase::COMPACT_HEAD:
-
-    if (pooledMsg) { 
-      if (!hasfull) {
-        msg.setBlockType(ConsensusMessageBase::REQUIRE);
-        Ptr<Packet> packet = msg.toPacket();
-        std::set<uint32_t> source = messageRecvPool.getSource(msg);
-        if (!source.empty()) {
-          
-          // TODO: choose source
-          
-          sendToPeer(packet, int(*source.begin()));
-        }
-      }
-      else {
-        applicationLayerRelay(msg, count);
-        messageRecvPool.getFullMessage(msg);
-        parseMessage(std::move(msg));
-      }
-    }
+    onCompactBlock(std::move(msg), pooledMsg ? count : 1);
     break;
   
   case ConsensusMessageBase::REQUIRE:
-    if (pooledMsg) {
-      if (hasfull) {
-        messageRecvPool.getFullMessage(msg);
-        Ptr<Packet> packet = msg.toPacket();
-        sendToPeer(packet, int(msg.getSrcAddr()));
-      }
-    }
+    onBlockTxRequest(std::move(msg));
+    break;
+
+  case ConsensusMessageBase::BLOCK_TXN:
+    onBlockTxs(std::move(msg));
     break;
   
   default:
@@ -1161,36 +1705,150 @@ void BlockChainApplicationBase<MessageType>::clearDelaySendEvent() {
     Simulator::Cancel(delayGroupSendEvent);
   }
 
+  if (checkEventStatus(peerMetricUpdateEvent)) {
+    Simulator::Cancel(peerMetricUpdateEvent);
+  }
+
 }
 
 
 template <typename MessageType>
 void BlockChainApplicationBase<MessageType>::insertRelayLargePacket(int src, int from, int to) {
-  
-  RelayEntry k(src, from);
+  insertRelay(LARGEPKT, src, from, to);
+}
+
+
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::insertRelaySmallPacket(int src, int from, int to) {
+  insertRelay(SMALLPKT, src, from, to);
+}
+
 
-  if (relayTableLargePacket.find(k) == relayTableLargePacket.end()) {
-    relayTableLargePacket.insert(std::make_pair(k, std::vector<int>())); 
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::setAggregationParent(int root, int parent) {
+  aggregationRoutes[root].parent = parent;
+}
+
+
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::addAggregationChild(int root, int child) {
+  std::vector<int> &children = aggregationRoutes[root].children;
+  if (std::find(children.begin(), children.end(), child) == children.end()) {
+    children.push_back(child);
   }
+}
 
-  // value of tableInUse is vector<int> type
-  relayTableLargePacket[k].push_back(to);
 
+template <typename MessageType>
+int BlockChainApplicationBase<MessageType>::getAggregationParent(int root) {
+  auto it = aggregationRoutes.find(root);
+  return it == aggregationRoutes.end() ? -1 : it->second.parent;
 }
 
 
 template <typename MessageType>
-void BlockChainApplicationBase<MessageType>::insertRelaySmallPacket(int src, int from, int to) {
+const std::vector<int>& BlockChainApplicationBase<MessageType>::getAggregationChildren(int root) {
+  static const std::vector<int> none;
+  auto it = aggregationRoutes.find(root);
+  return it == aggregationRoutes.end() ? none : it->second.children;
+}
+
+
+template <typename MessageType>
+RelayMap& BlockChainApplicationBase<MessageType>::getRelayTable(uint8_t table) {
+  return table == SMALLPKT ? relayTableSmallPacket : relayTableLargePacket;
+}
+
+
+template <typename MessageType>
+std::map<int, std::set<RelayEntry> >& BlockChainApplicationBase<MessageType>::getRelayIndex(uint8_t table) {
+  return table == SMALLPKT ? relayIndexSmallPacket : relayIndexLargePacket;
+}
+
+
+/**
+ * append to as a next hop of entry <src, from>
+ * order of next hops is kept, a next hop already in the entry is skipped 
+ */
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::insertRelay(uint8_t table, int src, int from, int to) {
   
   RelayEntry k(src, from);
 
-  if (relayTableSmallPacket.find(k) == relayTableSmallPacket.end()) {
-    relayTableSmallPacket.insert(std::make_pair(k, std::vector<int>())); 
-  }
+  auto &index = getRelayIndex(table)[to];
+  if (index.find(k) != index.end()) return;
 
   // value of tableInUse is vector<int> type
-  relayTableSmallPacket[k].push_back(to);
+  getRelayTable(table)[k].push_back(to);
+  index.insert(k);
+
+}
 
+
+// entries that forward to target
+template <typename MessageType>
+std::vector<RelayEntry> BlockChainApplicationBase<MessageType>::getRelayEntriesTo(uint8_t table, int target) {
+  auto &index = getRelayIndex(table);
+  auto it = index.find(target);
+  if (it == index.end()) return std::vector<RelayEntry>();
+  return std::vector<RelayEntry>(it->second.begin(), it->second.end());
+}
+
+
+/**
+ * in every entry of src that forwards to oldTarget, replace oldTarget
+ * with newTargets in place. new targets already in the entry are skipped
+ */
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::replaceRelayTarget(uint8_t table, int src, int oldTarget, 
+  std::vector<int> newTargets) {
+
+  RelayMap &relayTable = getRelayTable(table);
+  auto &index = getRelayIndex(table);
+
+  for (auto k : getRelayEntriesTo(table, oldTarget)) {
+    
+    if (k.src != src) continue;
+
+    std::vector<int> &dsts = relayTable[k];
+    auto pos = std::find(dsts.begin(), dsts.end(), oldTarget);
+    pos = dsts.erase(pos);
+    index[oldTarget].erase(k);
+
+    for (auto t : newTargets) {
+      if (t == (int) nodeId || t == k.from || t == oldTarget) continue;
+      if (index[t].find(k) != index[t].end()) continue;
+      pos = dsts.insert(pos, t) + 1;
+      index[t].insert(k);
+    }
+  }
+
+  if (index[oldTarget].empty()) index.erase(oldTarget);
+}
+
+
+/**
+ * messages from src now arrive from newFrom instead of oldFrom
+ * move the entry, merging it into an existing <src, newFrom> entry if any
+ */
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::reparentRelayEntry(uint8_t table, int src, int oldFrom, int newFrom) {
+  
+  RelayMap &relayTable = getRelayTable(table);
+  auto &index = getRelayIndex(table);
+
+  RelayEntry oldKey(src, oldFrom);
+
+  auto it = relayTable.find(oldKey);
+  if (it == relayTable.end() || oldFrom == newFrom) return;
+
+  std::vector<int> dsts = std::move(it->second);
+  relayTable.erase(it);
+
+  for (auto t : dsts) {
+    index[t].erase(oldKey);
+    if (t != newFrom) insertRelay(table, src, newFrom, t);
+  }
 }
 
 
@@ -1245,6 +1903,7 @@ void BlockChainApplicationBase<MessageType>::applicationLayerRelay(MessageType m
 
     case ConsensusMessageBase::DIRECT:
       if (msg.getDstAddr() != nodeId) {
+        stampHop(msg);
         sendToPeer(msg.toPacket(), msg.getDstAddr());
       }
       break;
@@ -1265,6 +1924,7 @@ void BlockChainApplicationBase<MessageType>::applicationLayerRelay(MessageType m
           relay(msg);
         }
         else {
+          stampHop(msg);
           sendToPeer(msg.toPacket(), msg.getDstAddr());
         }
       }
@@ -1318,6 +1978,136 @@ void BlockChainApplicationBase<MessageType>::applicationLayerRelay(MessageType m
 }
 
 
+/**
+ * append this node to the provenance trailer of an outgoing message
+ * a message that already carries a trailer keeps being stamped, 
+ * so tracing only needs to be turned on at the origin. a node stamps a message once
+ * however many of its send paths it goes through
+ */
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::stampHop(MessageType& msg) {
+  if (msg.hasProvenance() && msg.getProvenance().back().first == nodeId) return;
+
+  if (provenanceTraceOn || msg.hasProvenance()) {
+    msg.appendHop(nodeId, Simulator::Now().GetSeconds());
+  }
+}
+
+
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::tagQuest(MessageType& msg) {
+  questTagged = getSupersedeKey(msg, questKey, questRound);
+}
+
+
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::updateSendQueueTrace() {
+  mSendQueueDepth = sendquestbuffer.size();
+  mSendQueueBytes = sendquestbuffer.bytes();
+  peakSendBacklog = std::max(peakSendBacklog, sendquestbuffer.size());
+}
+
+
+// true if the next quest would be dropped by a bounded send queue
+template <typename MessageType>
+bool BlockChainApplicationBase<MessageType>::isSendSaturated() {
+  if (sendQueuePolicy == QUEUE_UNBOUNDED || sendQueueLimit == 0) return false;
+  return sendquestbuffer.bytes() >= sendQueueLimit;
+}
+
+
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::samplePeer(MessageType& msg, uint32_t size) {
+
+  if (peerMetricUpdateInterval <= 0) return;
+
+  int from = msg.getFromAddr();
+
+  // only neighbours are ranked
+  if (from == (int) nodeId || peerMetric.find(from) == peerMetric.end()) return;
+
+  double d = Simulator::Now().GetSeconds() - msg.getTs();
+  if (d < 0) return;
+
+  PeerEstimate &e = peerEstimate[from];
+
+  e.minDelay = std::min(e.minDelay, d);
+  e.delay = e.samples == 0 ? d : (1 - peerMetricGain) * e.delay + peerMetricGain * d;
+
+  // time spent on the wire and in queues, propagation excluded
+  double busy = d - e.minDelay;
+  if (busy > 0) {
+    double g = size / busy;
+    e.goodput = e.goodput == 0 ? g : (1 - peerMetricGain) * e.goodput + peerMetricGain * g;
+  }
+
+  e.samples++;
+}
+
+
+// goodput is bytes per second, so bytes * 8 / (goodput * 8 * scale)
+template <typename MessageType>
+double BlockChainApplicationBase<MessageType>::measuredPeerMetric(const PeerEstimate &e) {
+  double m = e.delay;
+  if (e.goodput > 0) m += peerMetricMessageSize / (e.goodput * peerMetricBwScale);
+  return m;
+}
+
+
+/**
+ * periodically refresh peerMetric of measured neighbours with the same form as the static one,
+ * delay plus the time to push a message of the size the static metric uses, then re-rank gossip peers and core peers
+ */
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::updatePeerMetric() {
+
+  for (auto &e : peerEstimate) {
+    peerMetric[e.first] = measuredPeerMetric(e.second);
+  }
+
+  if ((relayType == ConsensusMessageBase::FLOOD || relayType == ConsensusMessageBase::MIXED || 
+      relayType == ConsensusMessageBase::INFECT_UPON_CONTAGION) && !floodRandomization) {
+
+    sortPeer();
+
+    linkEstPeerList.clear();
+    for (int i = 0; i < (int) max_outbound_number && i < (int) directPeerList.size(); ++i) {
+      linkEstPeerList.push_back(directPeerList[i]);
+    }
+  }
+
+  // a measured neighbour replaces its static distance
+  if (!corePeerDistance.empty()) {
+    corePeerMetric = peerMetricPrioQueue([](const peerMetricEntry &a, const peerMetricEntry &b)->bool {
+        return a.second > b.second; 
+      });
+    for (auto c : corePeerDistance) {
+      auto e = peerEstimate.find(c.first);
+      corePeerMetric.push(std::make_pair(c.first, e != peerEstimate.end() ? peerMetric[c.first] : c.second));
+    }
+  }
+
+  NS_LOG_INFO("node " << nodeId << " re-ranked " << peerEstimate.size() << " measured peers");
+
+  peerMetricUpdateEvent = Simulator::Schedule(Seconds(peerMetricUpdateInterval), 
+    &BlockChainApplicationBase<MessageType>::updatePeerMetric, this);
+}
+
+
+template <typename MessageType>
+double BlockChainApplicationBase<MessageType>::getPeerDelayEstimate(int id) {
+  auto e = peerEstimate.find(id);
+  return e == peerEstimate.end() ? -1 : e->second.delay;
+}
+
+
+template <typename MessageType>
+double BlockChainApplicationBase<MessageType>::getPeerGoodputEstimate(int id) {
+  auto e = peerEstimate.find(id);
+  return e == peerEstimate.end() ? -1 : e->second.goodput;
+}
+
+
 // get the ratio of time this application is sending something from start to stop, till now if it is still running
 template <typename MessageType>
 double BlockChainApplicationBase<MessageType>::getActiveRate() {
@@ -1348,6 +2138,376 @@ BlockChainApplicationBase<MessageType>::getLinkStress() {
 }
 
 
+template <typename MessageType>
+bool BlockChainApplicationBase<MessageType>::mempoolAdd(MempoolTx tx, int from) {
+
+  tx.arrival = Simulator::Now().GetSeconds();
+
+  if (!mempool.add(tx)) return false;
+
+  for (int peer : directPeerList) {
+    if (peer != from) sendTransaction(tx, peer);
+  }
+
+  onMempoolTx(tx);
+  return true;
+}
+
+
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::cacheBlockTxs(uint64_t key, std::vector<MempoolTx> txs, bool parsed) {
+
+  if (blockTxCache.find(key) == blockTxCache.end()) {
+    blockTxOrder.push_back(key);
+  }
+
+  BlockTxs &entry = blockTxCache[key];
+  entry.txs = std::move(txs);
+  entry.parsed = parsed;
+
+  while (blockTxOrder.size() > blockTxCacheLimit) {
+    blockTxCache.erase(blockTxOrder.front());
+    blockTxOrder.pop_front();
+  }
+}
+
+
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::compactBlock(MessageType &msg, uint32_t headerLen, 
+    const std::vector<std::pair<uint32_t, uint32_t> > &txs) {
+
+  if (!isCompactBlocksOn() || headerLen > msg.getPayloadLen()) return;
+
+  std::vector<MempoolTx> block;
+
+  for (auto &t : txs) {
+    MempoolTx tx;
+    // a peer can only resolve what went through the mempool
+    if (!mempool.get(Mempool::shortId(t.first, t.second), tx)) return;
+    block.push_back(tx);
+  }
+
+  uint32_t fullLen = msg.getPayloadLen();
+  uint32_t count = block.size();
+
+  std::vector<unsigned char> payload(12 + 6 * count + headerLen);
+
+  memcpy(&payload[0], &fullLen, 4);
+  memcpy(&payload[4], &headerLen, 4);
+  memcpy(&payload[8], &count, 4);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    // the low 48 bits, host byte order as the rest of the simulation
+    uint64_t id = Mempool::shortId(block[i].client, block[i].reqId);
+    memcpy(&payload[12 + 6 * i], &id, 6);
+  }
+
+  memcpy(&payload[12 + 6 * count], msg.getPayload(), headerLen);
+
+  msg.setPayload(payload.data(), payload.size());
+  msg.setBlockType(ConsensusMessageBase::COMPACT_HEAD);
+  msg.setFromAddr(nodeId);
+
+  NS_LOG_INFO("compact block of " << count << " transactions, " << payload.size() << "/" << fullLen << " bytes at:" << nodeId);
+
+  cacheBlockTxs(msg.uniqueMessageSeq(), std::move(block), false);
+}
+
+
+template <typename MessageType>
+MessageType BlockChainApplicationBase<MessageType>::expandBlock(MessageType msg) {
+
+  uint32_t fullLen, headerLen, count;
+
+  memcpy(&fullLen, msg.getPayload(), 4);
+  memcpy(&headerLen, msg.getPayload() + 4, 4);
+  memcpy(&count, msg.getPayload() + 8, 4);
+
+  // transaction bytes are not simulated, only their length
+  std::vector<unsigned char> payload(fullLen);
+  memcpy(payload.data(), msg.getPayload() + 12 + 6 * count, headerLen);
+
+  msg.setPayload(payload.data(), payload.size());
+  msg.setBlockType(ConsensusMessageBase::NORMAL_BLOCK);
+  return msg;
+}
+
+
+/**
+ * resolve the short ids against the mempool, ask the node the block came from for the rest,
+ * relay and parse the block once it is complete
+ */
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::onCompactBlock(MessageType msg, int duplicates) {
+
+  // on its way to another node
+  if (msg.getTransportType() == ConsensusMessageBase::DIRECT && msg.getDstAddr() != nodeId) {
+    applicationLayerRelay(std::move(msg));
+    return;
+  }
+
+  uint64_t key = msg.uniqueMessageSeq();
+
+  auto cached = blockTxCache.find(key);
+  if (cached != blockTxCache.end()) {
+    applicationLayerRelay(msg, duplicates);
+    if (!cached->second.parsed) {
+      cached->second.parsed = true;
+      parseMessage(expandBlock(std::move(msg)));
+    }
+    return;
+  }
+
+  auto pending = pendingBlocks.find(key);
+  if (pending != pendingBlocks.end()) {
+    pending->second.arrivals.push_back(std::make_pair(std::move(msg), duplicates));
+    return;
+  }
+
+  if (msg.getPayloadLen() < 12) return;
+
+  uint32_t count;
+  memcpy(&count, msg.getPayload() + 8, 4);
+  if (msg.getPayloadLen() < 12 + 6 * count) return;
+
+  compactBlocksRecv++;
+
+  PendingBlock blk;
+  blk.ids.resize(count, 0);
+  blk.txs.resize(count);
+  blk.found.resize(count, false);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    memcpy(&blk.ids[i], msg.getPayload() + 12 + 6 * i, 6);
+    if (mempool.get(blk.ids[i], blk.txs[i])) {
+      blk.found[i] = true;
+    }
+    else {
+      blk.missing++;
+    }
+  }
+
+  blk.arrivals.push_back(std::make_pair(std::move(msg), duplicates));
+  pendingBlocks[key] = std::move(blk);
+
+  if (pendingBlocks[key].missing == 0) {
+    compactBlocksRebuilt++;
+    finishBlock(key);
+    return;
+  }
+
+  NS_LOG_INFO("compact block at:" << nodeId << " misses " << pendingBlocks[key].missing << " of " << count);
+
+  requestBlockTxs(key, true);
+}
+
+
+/**
+ * ask a node holding the block for the transactions still missing: the nodes it came from first,
+ * then the ones that sent it; once all of them were asked, a restart asks for the whole block again
+ * returns false if there is nobody left to ask without a restart
+ */
+template <typename MessageType>
+bool BlockChainApplicationBase<MessageType>::requestBlockTxs(uint64_t key, bool restart) {
+
+  PendingBlock &blk = pendingBlocks[key];
+
+  std::vector<uint32_t> sources;
+  for (auto &arrival : blk.arrivals) {
+    sources.push_back(arrival.first.getFromAddr());
+  }
+  for (auto src : messageRecvPool.getSource(key)) {
+    sources.push_back(src);
+  }
+
+  uint32_t to = nodeId;
+  for (auto src : sources) {
+    if (src != nodeId && blk.asked.count(src) == 0) {
+      to = src;
+      break;
+    }
+  }
+
+  // the block as an id, the short ids missing as payload, none for the whole block
+  std::vector<unsigned char> missing;
+
+  if (to == nodeId) {
+    if (!restart) return false;
+    blk.asked.clear();
+    to = sources.front();
+  }
+  else {
+    for (uint32_t i = 0; i < blk.ids.size(); ++i) {
+      if (blk.found[i]) continue;
+      size_t at = missing.size();
+      missing.resize(at + 6);
+      memcpy(&missing[at], &blk.ids[i], 6);
+    }
+  }
+
+  blk.asked.insert(to);
+
+  MessageType msg = blk.arrivals.front().first;
+  msg.setPayload(missing.data(), missing.size());
+  msg.setBlockType(ConsensusMessageBase::REQUIRE);
+  msg.setTransportType(ConsensusMessageBase::DIRECT);
+  msg.setSrcAddr(nodeId);
+  msg.setFromAddr(nodeId);
+  msg.setDstAddr(to);
+  stampHop(msg);
+
+  sendToPeer(msg.toPacket(), to);
+
+  if (checkEventStatus(blk.retry)) {
+    Simulator::Cancel(blk.retry);
+  }
+  blk.retry = Simulator::Schedule(Seconds(blockTxTimeout), 
+    &BlockChainApplicationBase<MessageType>::onBlockTxTimeout, this, key);
+
+  return true;
+}
+
+
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::onBlockTxTimeout(uint64_t key) {
+  if (pendingBlocks.find(key) == pendingBlocks.end()) return;
+
+  NS_LOG_INFO("compact block at:" << nodeId << " still misses " << pendingBlocks[key].missing << ", asking again");
+  requestBlockTxs(key, true);
+}
+
+
+/**
+ * answer with the transactions asked for, all of them for an empty request,
+ * [short id 6][client 4][request id 4][length 4]... then their bytes;
+ * no entries if the block is no longer cached, the requester asks someone else
+ */
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::onBlockTxRequest(MessageType msg) {
+
+  if (msg.getDstAddr() != nodeId) {
+    applicationLayerRelay(std::move(msg));
+    return;
+  }
+
+  std::vector<unsigned char> payload;
+  uint32_t bytes = 0;
+
+  auto cached = blockTxCache.find(msg.uniqueMessageSeq());
+  if (cached != blockTxCache.end()) {
+
+    std::set<uint64_t> asked;
+    for (uint32_t i = 0; i + 6 <= msg.getPayloadLen(); i += 6) {
+      uint64_t id = 0;
+      memcpy(&id, msg.getPayload() + i, 6);
+      asked.insert(id);
+    }
+
+    for (auto &tx : cached->second.txs) {
+      uint64_t id = Mempool::shortId(tx.client, tx.reqId);
+      if (!asked.empty() && asked.count(id) == 0) continue;
+
+      size_t at = payload.size();
+      payload.resize(at + 18);
+      memcpy(&payload[at], &id, 6);
+      memcpy(&payload[at + 6], &tx.client, 4);
+      memcpy(&payload[at + 10], &tx.reqId, 4);
+      memcpy(&payload[at + 14], &tx.bytes, 4);
+      bytes += tx.bytes;
+    }
+  }
+
+  uint32_t requester = msg.getSrcAddr();
+  uint32_t entries = payload.size();
+
+  payload.resize(4 + entries + bytes);
+  memmove(payload.data() + 4, payload.data(), entries);
+  memcpy(payload.data(), &entries, 4);
+
+  msg.setPayload(payload.data(), payload.size());
+  msg.setBlockType(ConsensusMessageBase::BLOCK_TXN);
+  msg.setTransportType(ConsensusMessageBase::DIRECT);
+  msg.setSrcAddr(nodeId);
+  msg.setFromAddr(nodeId);
+  msg.setDstAddr(requester);
+  stampHop(msg);
+
+  sendToPeer(msg.toPacket(), requester);
+}
+
+
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::onBlockTxs(MessageType msg) {
+
+  if (msg.getDstAddr() != nodeId) {
+    applicationLayerRelay(std::move(msg));
+    return;
+  }
+
+  uint64_t key = msg.uniqueMessageSeq();
+
+  auto pending = pendingBlocks.find(key);
+  if (pending == pendingBlocks.end() || msg.getPayloadLen() < 4) return;
+
+  PendingBlock &blk = pending->second;
+
+  uint32_t entries;
+  memcpy(&entries, msg.getPayload(), 4);
+  if (msg.getPayloadLen() < 4 + entries) return;
+
+  for (uint32_t i = 0; i + 18 <= entries; i += 18) {
+    unsigned char const *e = msg.getPayload() + 4 + i;
+
+    MempoolTx tx;
+    uint64_t id = 0;
+    memcpy(&id, e, 6);
+    memcpy(&tx.client, e + 6, 4);
+    memcpy(&tx.reqId, e + 10, 4);
+    memcpy(&tx.bytes, e + 14, 4);
+    tx.arrival = Simulator::Now().GetSeconds();
+
+    for (uint32_t j = 0; j < blk.ids.size(); ++j) {
+      if (!blk.found[j] && blk.ids[j] == id) {
+        blk.txs[j] = tx;
+        blk.found[j] = true;
+        blk.missing--;
+        compactMissingTxs++;
+      }
+    }
+  }
+
+  if (blk.missing == 0) {
+    finishBlock(key);
+    return;
+  }
+
+  // a miss or a partial answer, ask the next node right away, or wait for the timer
+  // if all were asked already
+  requestBlockTxs(key, false);
+}
+
+
+template <typename MessageType>
+void BlockChainApplicationBase<MessageType>::finishBlock(uint64_t key) {
+
+  PendingBlock blk = std::move(pendingBlocks[key]);
+  pendingBlocks.erase(key);
+
+  if (checkEventStatus(blk.retry)) {
+    Simulator::Cancel(blk.retry);
+  }
+
+  cacheBlockTxs(key, std::move(blk.txs), true);
+
+  // relayed compact, the next hop asks this node for what it misses
+  for (auto &arrival : blk.arrivals) {
+    applicationLayerRelay(arrival.first, arrival.second);
+  }
+
+  parseMessage(expandBlock(std::move(blk.arrivals.front().first)));
+}
+
+
 template <typename MessageType>
 void BlockChainApplicationBase<MessageType>::printState() {
   for (auto relay: relayTableLargePacket) {
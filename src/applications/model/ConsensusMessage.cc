@@ -31,6 +31,7 @@ ConsensusMessageBase::ConsensusMessageBase(const ConsensusMessageBase& msg) {
   mSeq = msg.mSeq;
   mTs = msg.mTs;
   compactHeadSize = msg.compactHeadSize;
+  provenance = msg.provenance;
   if (compactHeadSize > 0) {
       compactHead = new unsigned char[compactHeadSize];
   }
@@ -58,6 +59,7 @@ void swap(ConsensusMessageBase& a, ConsensusMessageBase& b) noexcept{
   std::swap(a.mTs, b.mTs);
   std::swap(a.compactHeadSize, b.compactHeadSize);
   std::swap(a.compactHead, b.compactHead);
+  std::swap(a.provenance, b.provenance);
 }
 
 
@@ -73,6 +75,7 @@ void ConsensusMessageBase::reset() {
   mTs = 0.0;
   compactHeadSize = 32;
   compactHead = NULL;
+  provenance.clear();
 }
 
 
@@ -171,4 +174,64 @@ int ConsensusMessageBase::deserialization(int size, unsigned char const serialIn
 
 }
 
-}
\ No newline at end of file
+
+
+/**
+ * record a hop on the provenance trailer
+ * the trailer is capped at 255 hops, later hops are dropped
+ */
+void ConsensusMessageBase::appendHop(uint32_t node, double ts) {
+  if (provenance.size() < std::numeric_limits<uint8_t>::max()) {
+    provenance.push_back(std::make_pair(node, ts));
+  }
+}
+
+
+/**
+ * trailer layout: 1 byte hop count, then <4 bytes node id, 8 bytes timestamp> per hop
+ * nothing is written if the message carries no trailer, so untraced
+ * messages keep their original size
+ */
+void ConsensusMessageBase::serializeProvenance(std::ostringstream &out) {
+  if (provenance.empty()) return;
+
+  uint8_t hops = provenance.size();
+  out.write((const char*) &hops, 1);
+  for (auto &hop : provenance) {
+    out.write((const char*) &hop.first, 4);
+    out.write((const char*) &hop.second, 8);
+  }
+}
+
+
+int ConsensusMessageBase::deserializeProvenance(int size, unsigned char const serialInput[]) {
+
+  provenance.clear();
+
+  size -= 1;
+  if (size < 0) return 1;
+  uint8_t hops;
+  memcpy(&hops, serialInput, 1);
+  serialInput += 1;
+
+  for (uint8_t i = 0; i < hops; ++i) {
+    uint32_t node;
+    double ts;
+
+    size -= 4;
+    if (size < 0) return 1;
+    memcpy(&node, serialInput, 4);
+    serialInput += 4;
+
+    size -= 8;
+    if (size < 0) return 1;
+    memcpy(&ts, serialInput, 8);
+    serialInput += 8;
+
+    provenance.push_back(std::make_pair(node, ts));
+  }
+
+  return size == 0 ? 0 : 2;
+}
+
+}
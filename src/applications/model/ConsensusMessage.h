@@ -9,6 +9,7 @@
 #include <sstream>
 #include <string>
 #include <cstring>
+#include <vector>
 
 namespace ns3 {
 
@@ -37,6 +38,10 @@ protected:
   // optional fields
   size_t compactHeadSize = 0;
   unsigned char* compactHead = NULL;
+
+  // optional provenance trailer, written after the payload only when present
+  // <node id, departure time> for each hop, 12 bytes per hop
+  std::vector<std::pair<uint32_t, double> > provenance;
   
   //end of fields
 
@@ -59,10 +64,15 @@ public:
   };
 
 
+  /**
+   * COMPACT_HEAD: a block as its header and the short ids of its transactions
+   * REQUIRE: short ids a receiver misses from a compact block, BLOCK_TXN: the transactions answering it
+   */
   enum BLOCKTYPE : uint8_t {
     NORMAL_BLOCK,
     COMPACT_HEAD,
-    REQUIRE
+    REQUIRE,
+    BLOCK_TXN
   };
 
 
@@ -80,6 +90,13 @@ public:
   virtual void packHead() = 0;
   virtual uint64_t uniqueMessageSeq() = 0;
 
+  typedef std::vector<std::pair<uint32_t, double> > Provenance;
+
+  // path provenance, see serializeProvenance() for the wire format
+  void appendHop(uint32_t node, double ts);
+  void serializeProvenance(std::ostringstream &out);
+  int deserializeProvenance(int size, unsigned char const serialInput[]);
+
 
   // access functions 
 
@@ -104,6 +121,8 @@ public:
   inline double getTs() {return mTs;}
   size_t getCompactSize() {return compactHeadSize;}
   unsigned char* getCompactHead() {return compactHead;}
+  inline bool hasProvenance() {return !provenance.empty();}
+  const Provenance& getProvenance() {return provenance;}
 
 };
 
@@ -0,0 +1,527 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#include "HotStuffCorrect.h"
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include <iostream>
+
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED(HotStuffCorrect);
+
+NS_LOG_COMPONENT_DEFINE("HotStuffCorrect");
+
+
+TypeId HotStuffCorrect::GetTypeId (void) {
+  static TypeId tid = TypeId ("ns3::HotStuffCorrect")
+    .SetParent<Application> ()
+    .SetGroupName("Applications")
+    .AddConstructor<HotStuffCorrect> ()
+    .AddTraceSource("Rx",
+                    "A packet has been received",
+                    MakeTraceSourceAccessor(&HotStuffCorrect::mRxTrace),
+                    "ns3::Packet::TracedCallback")
+    .AddTraceSource("Provenance",
+                    "A message carrying a provenance trailer is delivered for the first time",
+                    MakeTraceSourceAccessor(&HotStuffCorrect::mProvenanceTrace),
+                    "ns3::BlockChainApplicationBase::ProvenanceTracedCallback")
+    .AddTraceSource("SendQueueDepth",
+                    "Number of sends waiting in the sequencial send queue",
+                    MakeTraceSourceAccessor(&HotStuffCorrect::mSendQueueDepth),
+                    "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource("SendQueueBytes",
+                    "Bytes waiting in the sequencial send queue",
+                    MakeTraceSourceAccessor(&HotStuffCorrect::mSendQueueBytes),
+                    "ns3::TracedValueCallback::Uint64")
+    .AddTraceSource("QueueingDelay",
+                    "Seconds the latest started send waited in the queue, SEQUENCIAL transfer model only",
+                    MakeTraceSourceAccessor(&HotStuffCorrect::mQueueingDelay),
+                    "ns3::TracedValueCallback::Double")
+    .AddTraceSource("SendQueueDrops",
+                    "Number of sends dropped or coalesced by a bounded send queue, SEQUENCIAL transfer model only",
+                    MakeTraceSourceAccessor(&HotStuffCorrect::mSendQueueDrops),
+                    "ns3::TracedValueCallback::Uint32");
+  return tid;
+}
+
+
+void HotStuffCorrect::DoDispose (void) {
+  BlockChainApplicationBase::DoDispose ();
+}
+
+
+HotStuffCorrect::HotStuffCorrect(void) {
+  // genesis
+  blockParent[0] = 0;
+}
+
+
+HotStuffCorrect::~HotStuffCorrect(void) {}
+
+
+void HotStuffCorrect::StartApplication() {
+
+  // chain up with superclass setups
+  BlockChainApplicationBase::StartApplication();
+
+  // setup listening socket
+  mListeningSocket->Listen();
+  mListeningSocket->ShutdownSend();
+
+  mListeningSocket->SetRecvCallback(MakeCallback(&HotStuffCorrect::RecvCallback, this));
+  mListeningSocket->SetAcceptCallback(MakeNullCallback<bool, Ptr<Socket>, const Address &> (),
+                                      MakeCallback(&HotStuffCorrect::AcceptCallback, this));
+  mListeningSocket->SetCloseCallbacks(MakeCallback(&HotStuffCorrect::NormalCloseCallback, this),
+                                      MakeCallback(&HotStuffCorrect::ErrorCloseCallback, this));
+
+  // the genesis block certifies view 0
+  if (leader(1) == nodeId) {
+    readyView = 1;
+  }
+}
+
+
+void HotStuffCorrect::StopApplication() {
+
+  BlockChainApplicationBase::StopApplication();
+
+  clearDelaySendEvent();
+  clearTimeoutEvent();
+
+  if (checkEventStatus(delayedBroadcast)) {
+    Simulator::Cancel(delayedBroadcast);
+  }
+
+  if (checkEventStatus(delayedFlood)) {
+    Simulator::Cancel(delayedFlood);
+  }
+}
+
+
+void HotStuffCorrect::RecvCallback (Ptr<Socket> sock) {
+
+  if (replicaStat != RUNNING) return;
+
+  Ptr<Packet> packet = sock->Recv();
+
+  mRxTrace(packet);
+
+  int payloadSize = packet->GetSize();
+  uint8_t *buffer = new uint8_t[payloadSize];
+  packet->CopyData(buffer, payloadSize);
+  try {
+    PBFTMessage msg = message(blockSize);
+    msg.deserialization(payloadSize, buffer);
+
+    samplePeer(msg, payloadSize);
+
+    totalRecvMessages++;
+    totalRecvBytes += payloadSize;
+
+    onMessageCallback(std::move(msg));
+  }
+  catch(const std::exception& e) {
+    std::cerr << "parser message failed" << std::endl;
+  }
+  delete[] buffer;
+}
+
+
+void HotStuffCorrect::parseMessage(PBFTMessage msg) {
+
+  if (msg.getDstAddr() == nodeId
+    || msg.getDstAddr() == std::numeric_limits<uint32_t>::infinity()) {
+
+    switch (msg.getType()) {
+      case REQUEST:
+        onRequest(std::move(msg));
+        break;
+      case PROPOSAL:
+        onProposal(std::move(msg));
+        break;
+      case VOTE:
+        onVote(std::move(msg));
+        break;
+      case NEW_VIEW:
+        onNewView(std::move(msg));
+        break;
+      case CLIENT_REPLY:
+        notifyRequestReply(msg.getNo());
+        break;
+      default:
+        std::cerr << "Bad type" << std::endl;
+        break;
+    }
+  }
+}
+
+
+void HotStuffCorrect::onRequest(PBFTMessage msg) {
+
+  NS_LOG_INFO("onRequest");
+  NS_LOG_INFO("at:"<<nodeId<<" from:"<<msg.getSignerId()<<" view:"<<curView);
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  if (leader(curView) != nodeId && readyView <= lastProposedView) {
+    // forward to the leader
+    sendToNode(std::move(msg), leader(curView));
+    return;
+  }
+
+  pendingRequest.push(std::move(msg));
+
+  if (readyView > lastProposedView) {
+    propose(readyView);
+  }
+  else {
+    enterView(curView);
+  }
+}
+
+
+// leader of v only, propose once a certificate of v - 1 or a quorum of new-views is at hand
+void HotStuffCorrect::tryPropose(uint32_t v) {
+
+  if (leader(v) != nodeId || v <= lastProposedView) return;
+
+  readyView = std::max(readyView, v);
+
+  if (hasWork()) {
+    propose(v);
+  }
+}
+
+
+// if there are requests to order or blocks with requests not committed yet
+bool HotStuffCorrect::hasWork() {
+  return continous || !pendingRequest.empty() || lastLoaded > lastCommitted;
+}
+
+
+void HotStuffCorrect::propose(uint32_t v) {
+
+  lastProposedView = v;
+
+  bool loaded = continous;
+
+  if (!pendingRequest.empty()) {
+    PBFTMessage &req = pendingRequest.front();
+    if (req.getNo() != 0) {
+      blockRequest[v] = std::make_pair(req.getSignerId(), req.getNo());
+    }
+    pendingRequest.pop();
+    loaded = true;
+  }
+
+  NS_LOG_INFO("propose:"<<v<<" at:"<<nodeId<<" justify:"<<highQC<<" time:"<<Simulator::Now().GetSeconds());
+
+  // the certificate is a single aggregated signature, part of messageConstantLen
+  PBFTMessage msg = message(messageConstantLen + (loaded ? blockSize : 0));
+  msg.setType(PROPOSAL);
+  msg.setSignerId(nodeId);
+  msg.setRound(v);
+  msg.setProof(highQC);
+
+  if (loaded) lastLoaded = std::max(lastLoaded, v);
+
+  votes.erase(votes.begin(), votes.lower_bound(v));
+  newViews.erase(newViews.begin(), newViews.upper_bound(v));
+
+  broadcast(std::move(msg), relayType);
+
+  acceptBlock(v, highQC);
+}
+
+
+void HotStuffCorrect::onProposal(PBFTMessage msg) {
+
+  NS_LOG_INFO("onProposal");
+  NS_LOG_INFO("at:"<<nodeId<<" from:"<<msg.getSignerId());
+  NS_LOG_INFO("view:"<<curView<<" r-view:"<<msg.getRound()<<" justify:"<<msg.getProof());
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  uint32_t v = msg.getRound();
+
+  if (msg.getSignerId() != leader(v) || msg.getProof() >= v) return;
+
+  if (msg.getPayloadLen() > (uint32_t) messageConstantLen) {
+    lastLoaded = std::max(lastLoaded, v);
+  }
+
+  acceptBlock(v, msg.getProof());
+}
+
+
+void HotStuffCorrect::acceptBlock(uint32_t v, uint32_t justify) {
+
+  if (v <= lastCommitted || blockParent.count(v)) return;
+
+  blockParent[v] = justify;
+  blockSeenTime[v] = Simulator::Now().GetSeconds();
+
+  updateQC(justify);
+
+  // safety rule: extend the locked block, liveness rule: or carry a newer certificate
+  if (v > lastVotedView && (justify > lockedQC || extends(v, lockedQC))) {
+    vote(v);
+  }
+}
+
+
+bool HotStuffCorrect::extends(uint32_t b, uint32_t ancestor) {
+
+  while (b > ancestor) {
+    auto it = blockParent.find(b);
+    if (it == blockParent.end()) return false;
+    b = it->second;
+  }
+
+  return b == ancestor;
+}
+
+
+/**
+ * b is certified, with b' certified by b and b'' certified by b'
+ * lock on b' and commit b'' if the three are of consecutive views
+ */
+void HotStuffCorrect::updateQC(uint32_t b) {
+
+  highQC = std::max(highQC, b);
+
+  auto it = blockParent.find(b);
+  if (it == blockParent.end()) return;
+
+  uint32_t b1 = it->second;
+
+  lockedQC = std::max(lockedQC, b1);
+
+  if (b != b1 + 1) return;
+
+  it = blockParent.find(b1);
+  if (it == blockParent.end()) return;
+
+  uint32_t b2 = it->second;
+
+  if (b1 == b2 + 1) {
+    commit(b2);
+  }
+}
+
+
+// commit b and its ancestors not committed yet, in order
+void HotStuffCorrect::commit(uint32_t b) {
+
+  if (b <= lastCommitted) return;
+
+  double now = Simulator::Now().GetSeconds();
+
+  std::vector<uint32_t> chain;
+
+  for (uint32_t x = b; x > lastCommitted;) {
+    chain.push_back(x);
+    auto it = blockParent.find(x);
+    if (it == blockParent.end()) break;
+    x = it->second;
+  }
+
+  for (auto x = chain.rbegin(); x != chain.rend(); ++x) {
+
+    committedCount++;
+    commitLatency += now - blockSeenTime[*x];
+
+    NS_LOG_INFO("Committed");
+    NS_LOG_INFO("at:"<<nodeId<<" block:"<<*x);
+    NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+    NS_LOG_INFO("");
+
+    if (leader(*x) == nodeId) {
+      std::cout<<"<commit: "<<*x<<" "<<now<<" "<<now - blockSeenTime[*x]<<" >"<<std::endl<<std::endl;
+
+      auto req = blockRequest.find(*x);
+      if (req != blockRequest.end()) {
+        PBFTMessage rmsg = message(messageConstantLen);
+        rmsg.setType(CLIENT_REPLY);
+        rmsg.setSignerId(nodeId);
+        rmsg.setRound(*x);
+        rmsg.setNo(req->second.second);
+        sendToNode(std::move(rmsg), req->second.first);
+      }
+    }
+  }
+
+  lastCommitted = b;
+
+  // blocks below the committed one are never walked again
+  blockParent.erase(blockParent.begin(), blockParent.lower_bound(b));
+  blockSeenTime.erase(blockSeenTime.begin(), blockSeenTime.upper_bound(b));
+  blockRequest.erase(blockRequest.begin(), blockRequest.upper_bound(b));
+  messageRecvPool.eraseIf([b](PBFTMessage &m) {return m.getRound() < b;});
+
+  if (!hasWork()) {
+    clearTimeoutEvent();
+  }
+}
+
+
+// the vote goes to the leader of the next view only
+void HotStuffCorrect::vote(uint32_t v) {
+
+  lastVotedView = v;
+
+  PBFTMessage msg = message(messageConstantLen);
+  msg.setType(VOTE);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setRound(v);
+
+  enterView(v + 1);
+
+  sendToNode(std::move(msg), leader(v + 1));
+}
+
+
+void HotStuffCorrect::onVote(PBFTMessage msg) {
+
+  uint32_t v = msg.getRound();
+
+  if (leader(v + 1) != nodeId || v + 1 <= lastProposedView) return;
+
+  // own vote included
+  if (votes[v].insert(msg.getSignerId()) > quorum) {
+    updateQC(v);
+    tryPropose(v + 1);
+  }
+}
+
+
+void HotStuffCorrect::enterView(uint32_t v) {
+
+  curView = std::max(curView, v);
+
+  if (hasWork()) {
+    setTimeoutEvent();
+  }
+}
+
+
+// no certificate in time, move on and hand the highest certificate to the next leader
+void HotStuffCorrect::onTimeoutCallback() {
+
+  if (replicaStat != RUNNING) return;
+
+  NS_LOG_INFO("timeout");
+  NS_LOG_INFO("at:"<<nodeId<<" view:"<<curView);
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  curView++;
+
+  PBFTMessage msg = message(messageConstantLen);
+  msg.setType(NEW_VIEW);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setRound(curView);
+  msg.setProof(highQC);
+
+  setTimeoutEvent();
+
+  sendToNode(std::move(msg), leader(curView));
+}
+
+
+void HotStuffCorrect::onNewView(PBFTMessage msg) {
+
+  uint32_t v = msg.getRound();
+
+  if (leader(v) != nodeId || v <= lastProposedView) return;
+
+  highQC = std::max(highQC, msg.getProof());
+
+  // own new-view included
+  if (newViews[v].insert(msg.getSignerId()) > quorum) {
+    tryPropose(v);
+  }
+}
+
+
+void HotStuffCorrect::setTimeoutEvent() {
+
+  clearTimeoutEvent();
+
+  void (HotStuffCorrect::*fp)(void) = &HotStuffCorrect::onTimeoutCallback;
+  timeoutEvent = Simulator::Schedule(Seconds(timeout), fp, this);
+}
+
+
+void HotStuffCorrect::sendRequest() {
+
+  PBFTMessage msg = message();
+  msg.setType(REQUEST);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+
+  std::cout<<"<req: "<<curView<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
+
+  sendToNode(std::move(msg), leader(curView));
+}
+
+
+void HotStuffCorrect::submitRequest(uint32_t reqId, uint32_t bytes) {
+
+  PBFTMessage msg = message(bytes);
+  msg.setType(REQUEST);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setNo(reqId);
+
+  sendToNode(std::move(msg), leader(curView));
+}
+
+
+void HotStuffCorrect::sendToNode(PBFTMessage msg, uint32_t id) {
+
+  msg.setTransportType(ConsensusMessageBase::DIRECT);
+
+  if (id != nodeId) {
+    msg.setDstAddr(id);
+    stampHop(msg);
+    Ptr<Packet> packet = msg.toPacket();
+    sendToPeer(packet, id);
+  }
+  else {
+    if (replicaStat == RUNNING) {
+      onMessageCallback(std::move(msg));
+    }
+  }
+}
+
+
+void HotStuffCorrect::setTotalNode(int n) {
+  totalNodes = n;
+}
+
+
+void HotStuffCorrect::setQuorum() {
+  quorum = (int) (voteNodes * 2.0 / 3.0);
+}
+
+
+PBFTMessage HotStuffCorrect::message() {
+  PBFTMessage msg;
+  msg.setSeq(seq++);
+  return msg;
+}
+
+
+PBFTMessage HotStuffCorrect::message(int l) {
+  PBFTMessage msg(l);
+  msg.setSeq(seq++);
+  return msg;
+}
+
+
+} // namespace ns3
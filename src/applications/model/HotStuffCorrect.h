@@ -0,0 +1,161 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#ifndef HOTSTUFFCORRECT_H
+#define HOTSTUFFCORRECT_H
+
+#include "BlockChainApplicationBase.h"
+#include "PBFTMessage.h"
+
+#include <queue>
+
+
+namespace ns3 {
+
+/**
+ * chained HotStuff
+ * linear communication, a replica sends its vote to the leader of the next view only,
+ * the leader aggregates a quorum of votes into a certificate and broadcasts it with its proposal
+ * over the same relay overlays PBFT uses.
+ *
+ * the leader of view v is v % totalNodes and proposes at most one block, so a block is named by its view.
+ * a block is committed once it heads a chain of three blocks of consecutive views,
+ * each certified by the next one.
+ *
+ * PBFTMessage is the wire format so that the topology helper sets both protocols up the same way:
+ * round carries the view, proof the view certified by the carried quorum certificate
+ */
+
+class HotStuffCorrect : public BlockChainApplicationBase<PBFTMessage> {
+
+protected:
+
+  int totalNodes;
+  int voteNodes;
+
+  int quorum;
+
+  int blockSize;
+
+  // hash, sign etc, rough estimation, an aggregated signature included
+  int messageConstantLen = 80;
+
+  // view the node waits a proposal for
+  uint32_t curView = 1;
+  uint32_t lastVotedView = 0;
+
+  // leader only, last view proposed in and highest view it may propose in
+  uint32_t lastProposedView = 0;
+  uint32_t readyView = 0;
+
+  // highest view of a block that carries requests
+  uint32_t lastLoaded = 0;
+
+  // views of the highest and locked certificates, the genesis block of view 0 is certified
+  uint32_t highQC = 0;
+  uint32_t lockedQC = 0;
+  uint32_t lastCommitted = 0;
+
+  // view of a block -> view of the block its certificate points to
+  std::map<uint32_t, uint32_t> blockParent;
+
+  // view of a block -> time it was proposed or first seen here
+  std::map<uint32_t, double> blockSeenTime;
+
+  // leader of the next view, votes of a view
+  std::map<uint32_t, VoteCounter> votes;
+  // leader of a view, new-view messages of the view after a timeout
+  std::map<uint32_t, VoteCounter> newViews;
+
+  std::queue<PBFTMessage> pendingRequest;
+
+  // leader only, <client, request id> a workload client waits on per block proposed
+  std::map<uint32_t, std::pair<uint32_t, uint32_t> > blockRequest;
+
+  bool continous;
+
+  uint32_t committedCount = 0;
+  double commitLatency = 0;   // sum over committed blocks
+
+  // traffic, for comparison with PBFT
+  uint64_t totalRecvMessages = 0;
+  uint64_t totalRecvBytes = 0;
+
+  PBFTMessage message();
+  PBFTMessage message(int l);
+
+  virtual void StartApplication(void);
+  virtual void StopApplication(void);
+  virtual void DoDispose(void);
+
+  uint32_t leader(uint32_t v) {return v % totalNodes;}
+
+  bool extends(uint32_t b, uint32_t ancestor);
+
+  bool hasWork();
+
+  void propose(uint32_t v);
+  void tryPropose(uint32_t v);
+  void acceptBlock(uint32_t v, uint32_t justify);
+  void vote(uint32_t v);
+  void updateQC(uint32_t b);
+  void commit(uint32_t b);
+  void enterView(uint32_t v);
+
+  void sendToNode(PBFTMessage msg, uint32_t id);
+
+public:
+
+  enum HOTSTUFF_PRIMITIVE : uint32_t {
+    REQUEST,
+    PROPOSAL,
+    VOTE,
+    NEW_VIEW,
+    CLIENT_REPLY
+  };
+
+  static TypeId GetTypeId (void);
+
+  HotStuffCorrect();
+
+  virtual ~HotStuffCorrect(void);
+
+  void RecvCallback (Ptr<Socket> socket);
+
+  void parseMessage(PBFTMessage msg);
+
+  void onRequest(PBFTMessage msg);
+  void onProposal(PBFTMessage msg);
+  void onVote(PBFTMessage msg);
+  void onNewView(PBFTMessage msg);
+
+  void onTimeoutCallback(void);
+  void setTimeoutEvent(void);
+
+  void sendRequest();
+
+  virtual void submitRequest(uint32_t reqId, uint32_t bytes);
+
+  void setTotalNode(int n);
+  void setVote(int n) {voteNodes = n;}
+  void setQuorum();
+  void setBlockSize(int sz) {blockSize = sz;}
+  void setContinous(bool c) {continous = c;}
+
+  inline uint32_t getView() {return curView;}
+  inline int getLeader() {return leader(curView);}
+
+  uint32_t getCommittedCount() {return committedCount;}
+  uint32_t getLastCommitted() {return lastCommitted;}
+
+  // second, from a block first seen here to its commit, averaged
+  double getAverageCommitLatency() {return committedCount == 0 ? 0 : commitLatency / committedCount;}
+
+  uint64_t getTotalRecvMessages() {return totalRecvMessages;}
+  uint64_t getTotalRecvBytes() {return totalRecvBytes;}
+
+};
+
+}
+
+#endif
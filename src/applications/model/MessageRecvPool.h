@@ -8,6 +8,7 @@
 #include <tuple>
 #include <set>
 #include <vector>
+#include <algorithm>
 
 namespace ns3 {
 
@@ -47,6 +48,12 @@ public:
 
   void clear();
 
+  // drop stored full messages that satisfy pred, e.g. those below a stable checkpoint
+  template <typename Pred>
+  void eraseIf(Pred pred);
+
+  size_t size() {return mMesgRecvPool.size();}
+
 
 private:
 
@@ -91,7 +98,9 @@ typename MessageRecvPool<MessageType>::search_result MessageRecvPool<MessageType
 
   switch (msg.getBlockType()) {
   
+  // a compact block is pooled as any message, it is rebuilt before it is parsed
   case MessageType::NORMAL_BLOCK:
+  case MessageType::COMPACT_HEAD:
 
   {
     msg.packHead();
@@ -149,52 +158,6 @@ typename MessageRecvPool<MessageType>::search_result MessageRecvPool<MessageType
     break;
   }
 
-  case MessageType::COMPACT_HEAD:
-
-  {
-    size_t headsize = msg.getCompactSize();
-
-    /**
-     * if receive a known messages head
-     * increase frequency counter and add source node list
-     */
-    for (auto &m : mMesgRecvPool) {
-      if (headsize == m.compactHeadSize) {
-        bool flag = true;
-        for (size_t i = 0; i < headsize; ++i) {
-          if (msg.getCompactHead()[i] != m.compactHead[i]) {
-            flag = false;
-            break;
-          }
-        }
-        if (flag) {
-          if (insert) {
-            m.sourceNodeList.insert(msg.getSrcAddr());
-            m.receiveFreq++;
-          }
-          return search_result(m.receiveFreq, false, m.hasFull);
-        }
-      }
-    }
-
-    if (insert) {
-      messageEntry newEntry;
-      newEntry.msg = msg;
-      newEntry.compactHeadSize = newEntry.msg.getCompactSize();
-      newEntry.compactHead = newEntry.msg.getCompactHead();
-      newEntry.receiveFreq = 1;
-      newEntry.sourceNodeList.insert(msg.getSrcAddr());
-      newEntry.hasFull = false;
-      mMesgRecvPool.push_back(newEntry);
-      return search_result(1, false, false);
-    }
-    else {
-      return search_result(0, false, false);
-    }
-
-    break;
-  }
-
   default:
     return search_result(0, false, false);
   }
@@ -237,9 +200,8 @@ std::set<uint32_t> MessageRecvPool<MessageType>::getSource(MessageType& msg) {
   switch (msg.getBlockType()) {
   
   case MessageType::NORMAL_BLOCK:
-    return getSource(msg.uniqueMessageSeq());
   case MessageType::COMPACT_HEAD:
-    return getSource(msg.getCompactSize(), msg.getCompactHead());
+    return getSource(msg.uniqueMessageSeq());
   default:
     return std::set<uint32_t>();
   
@@ -337,5 +299,15 @@ void MessageRecvPool<MessageType>::clear() {
 }
 
 
+template <typename MessageType>
+template <typename Pred>
+void MessageRecvPool<MessageType>::eraseIf(Pred pred) {
+  mMesgRecvPool.erase(
+    std::remove_if(mMesgRecvPool.begin(), mMesgRecvPool.end(), 
+      [&pred](messageEntry &m) {return m.hasFull && pred(m.msg);}),
+    mMesgRecvPool.end());
+}
+
+
 } // namespace ns3 
 #endif
\ No newline at end of file
@@ -0,0 +1,626 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#include "NarwhalCorrect.h"
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED(NarwhalCorrect);
+
+NS_LOG_COMPONENT_DEFINE("NarwhalCorrect");
+
+
+TypeId NarwhalCorrect::GetTypeId (void) {
+  static TypeId tid = TypeId ("ns3::NarwhalCorrect")
+    .SetParent<Application> ()
+    .SetGroupName("Applications")
+    .AddConstructor<NarwhalCorrect> ()
+    .AddTraceSource("Rx",
+                    "A packet has been received",
+                    MakeTraceSourceAccessor(&NarwhalCorrect::mRxTrace),
+                    "ns3::Packet::TracedCallback")
+    .AddTraceSource("Provenance",
+                    "A message carrying a provenance trailer is delivered for the first time",
+                    MakeTraceSourceAccessor(&NarwhalCorrect::mProvenanceTrace),
+                    "ns3::BlockChainApplicationBase::ProvenanceTracedCallback")
+    .AddTraceSource("SendQueueDepth",
+                    "Number of sends waiting in the sequencial send queue",
+                    MakeTraceSourceAccessor(&NarwhalCorrect::mSendQueueDepth),
+                    "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource("SendQueueBytes",
+                    "Bytes waiting in the sequencial send queue",
+                    MakeTraceSourceAccessor(&NarwhalCorrect::mSendQueueBytes),
+                    "ns3::TracedValueCallback::Uint64")
+    .AddTraceSource("QueueingDelay",
+                    "Seconds the latest started send waited in the queue, SEQUENCIAL transfer model only",
+                    MakeTraceSourceAccessor(&NarwhalCorrect::mQueueingDelay),
+                    "ns3::TracedValueCallback::Double")
+    .AddTraceSource("SendQueueDrops",
+                    "Number of sends dropped or coalesced by a bounded send queue, SEQUENCIAL transfer model only",
+                    MakeTraceSourceAccessor(&NarwhalCorrect::mSendQueueDrops),
+                    "ns3::TracedValueCallback::Uint32");
+  return tid;
+}
+
+
+void NarwhalCorrect::DoDispose (void) {
+  BlockChainApplicationBase::DoDispose ();
+}
+
+
+NarwhalCorrect::NarwhalCorrect(void) {}
+
+
+NarwhalCorrect::~NarwhalCorrect(void) {}
+
+
+void NarwhalCorrect::StartApplication() {
+
+  // chain up with superclass setups
+  BlockChainApplicationBase::StartApplication();
+
+  // setup listening socket
+  mListeningSocket->Listen();
+  mListeningSocket->ShutdownSend();
+
+  mListeningSocket->SetRecvCallback(MakeCallback(&NarwhalCorrect::RecvCallback, this));
+  mListeningSocket->SetAcceptCallback(MakeNullCallback<bool, Ptr<Socket>, const Address &> (),
+                                      MakeCallback(&NarwhalCorrect::AcceptCallback, this));
+  mListeningSocket->SetCloseCallbacks(MakeCallback(&NarwhalCorrect::NormalCloseCallback, this),
+                                      MakeCallback(&NarwhalCorrect::ErrorCloseCallback, this));
+
+  enterRound(0);
+}
+
+
+void NarwhalCorrect::StopApplication() {
+
+  BlockChainApplicationBase::StopApplication();
+
+  clearDelaySendEvent();
+
+  if (checkEventStatus(headerTimerEvent)) {
+    Simulator::Cancel(headerTimerEvent);
+  }
+
+  if (checkEventStatus(delayedBroadcast)) {
+    Simulator::Cancel(delayedBroadcast);
+  }
+
+  if (checkEventStatus(delayedFlood)) {
+    Simulator::Cancel(delayedFlood);
+  }
+}
+
+
+void NarwhalCorrect::RecvCallback (Ptr<Socket> sock) {
+
+  if (replicaStat != RUNNING) return;
+
+  Ptr<Packet> packet = sock->Recv();
+
+  mRxTrace(packet);
+
+  int payloadSize = packet->GetSize();
+  uint8_t *buffer = new uint8_t[payloadSize];
+  packet->CopyData(buffer, payloadSize);
+  try {
+    PBFTMessage msg = message(messageConstantLen);
+    msg.deserialization(payloadSize, buffer);
+
+    samplePeer(msg, payloadSize);
+
+    totalRecvMessages++;
+    totalRecvBytes += payloadSize;
+
+    onMessageCallback(std::move(msg));
+  }
+  catch(const std::exception& e) {
+    std::cerr << "parser message failed" << std::endl;
+  }
+  delete[] buffer;
+}
+
+
+void NarwhalCorrect::parseMessage(PBFTMessage msg) {
+
+  if (msg.getDstAddr() != nodeId
+    && msg.getDstAddr() != std::numeric_limits<uint32_t>::infinity()) return;
+
+  switch (msg.getType()) {
+    case HEADER:
+      onHeader(std::move(msg));
+      break;
+    case VOTE:
+      onVote(std::move(msg));
+      break;
+    case CERTIFICATE:
+      onCertificate(std::move(msg));
+      break;
+    default:
+      std::cerr << "Bad type" << std::endl;
+      break;
+  }
+}
+
+
+void NarwhalCorrect::submitRequest(uint32_t reqId, uint32_t bytes) {
+
+  NS_LOG_INFO("submitRequest:"<<reqId<<" at:"<<nodeId<<" bytes:"<<bytes);
+
+  // batched here, a validator disseminates its own requests only
+  mempool.add({nodeId, reqId, bytes, Simulator::Now().GetSeconds()});
+
+  tryPropose();
+}
+
+
+// own requests to disseminate, or certified batches not ordered yet that need rounds on top
+bool NarwhalCorrect::hasWork() {
+  return continous || mempool.size() > 0 || unorderedLoaded > 0;
+}
+
+
+bool NarwhalCorrect::hasVertex(uint32_t r, uint32_t a) {
+  auto it = dag.find(r);
+  return it != dag.end() && it->second.count(a) > 0;
+}
+
+
+bool NarwhalCorrect::parentsCertified(uint32_t r, const std::vector<uint32_t> &parents) {
+  if (r == 0 || r - 1 < gcRound) return true;
+  for (auto p : parents) {
+    if (!hasVertex(r - 1, p)) return false;
+  }
+  return true;
+}
+
+
+void NarwhalCorrect::enterRound(uint32_t r) {
+
+  NS_LOG_INFO("enterRound:"<<r<<" at:"<<nodeId<<" time:"<<Simulator::Now().GetSeconds());
+
+  round = r;
+  headerDue = false;
+
+  if (checkEventStatus(headerTimerEvent)) {
+    Simulator::Cancel(headerTimerEvent);
+  }
+  headerTimerEvent = Simulator::Schedule(Seconds(headerDelay), &NarwhalCorrect::onHeaderTimeout, this);
+
+  tryPropose();
+}
+
+
+void NarwhalCorrect::onHeaderTimeout() {
+  headerDue = true;
+  tryPropose();
+}
+
+
+// once per round, with a full batch or after headerDelay
+void NarwhalCorrect::tryPropose() {
+
+  if (proposedRounds > round || !hasWork()) return;
+
+  if (round > 0 && (dag.count(round - 1) == 0 || (int) dag[round - 1].size() < quorum)) return;
+
+  bool full = continous || (batchSize > 0 && mempool.bytes() >= (uint64_t) batchSize);
+
+  if (full || headerDue) {
+    propose();
+  }
+}
+
+
+void NarwhalCorrect::propose() {
+
+  double now = Simulator::Now().GetSeconds();
+
+  NarwhalVertex v;
+
+  for (auto &tx : mempool.reap(0, batchSize)) {
+    v.bytes += tx.bytes;
+    ownRequests[round].push_back(std::make_pair(tx.client, tx.reqId));
+    mempool.remove(tx.client, tx.reqId);
+  }
+
+  if (v.bytes == 0 && continous) {
+    v.bytes = batchSize;
+  }
+
+  if (round > 0) {
+    for (auto &p : dag[round - 1]) v.parents.push_back(p.first);
+  }
+
+  NS_LOG_INFO("header:"<<round<<" at:"<<nodeId<<" parents:"<<v.parents.size()<<" bytes:"<<v.bytes);
+
+  PBFTMessage msg = message(messageConstantLen + 4 + 4 * v.parents.size() + v.bytes);
+  msg.setType(HEADER);
+  msg.setSignerId(nodeId);
+  msg.setRound(round);
+  msg.setProof(v.bytes);
+  encodeParents(msg, v.parents);
+
+  uint32_t r = round;
+
+  ownHeaders[r] = v;
+  ownProposeTime[r] = now;
+  votes[r].resize(totalNodes);
+  votes[r].insert(nodeId);
+  voted.insert(std::make_pair(r, nodeId));
+
+  proposedRounds = r + 1;
+  headerDue = false;
+
+  broadcast(std::move(msg), relayType);
+
+  if (votes[r].size() >= quorum) {
+    certify(r);
+  }
+}
+
+
+void NarwhalCorrect::onHeader(PBFTMessage msg) {
+
+  uint32_t r = msg.getRound();
+  uint32_t a = msg.getSignerId();
+
+  NS_LOG_INFO("onHeader");
+  NS_LOG_INFO("at:"<<nodeId<<" from:"<<a<<" round:"<<r);
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  if (r < gcRound || a == nodeId || voted.count(std::make_pair(r, a))) return;
+
+  std::vector<uint32_t> parents = decodeParents(msg);
+
+  if (r > 0 && (int) parents.size() < quorum) return;
+
+  // the batch is available here, vote once the history it refers to is too
+  if (!parentsCertified(r, parents)) {
+    waitingHeaders.push_back(std::move(msg));
+    return;
+  }
+
+  voted.insert(std::make_pair(r, a));
+
+  PBFTMessage vote = message(messageConstantLen);
+  vote.setType(VOTE);
+  vote.setSignerId(nodeId);
+  vote.setSrcAddr(nodeId);
+  vote.setRound(r);
+  vote.setProof(a);
+
+  sendToNode(std::move(vote), a);
+}
+
+
+void NarwhalCorrect::onVote(PBFTMessage msg) {
+
+  uint32_t r = msg.getRound();
+
+  if (msg.getProof() != nodeId || ownHeaders.count(r) == 0) return;
+
+  if (votes[r].insert(msg.getSignerId()) == quorum) {
+    certify(r);
+  }
+}
+
+
+void NarwhalCorrect::certify(uint32_t r) {
+
+  NarwhalVertex v = ownHeaders[r];
+
+  NS_LOG_INFO("certificate:"<<r<<" at:"<<nodeId<<" time:"<<Simulator::Now().GetSeconds());
+
+  // the parents and the signers of the aggregated signature
+  PBFTMessage msg = message(messageConstantLen + 4 + 4 * v.parents.size() + (totalNodes + 7) / 8);
+  msg.setType(CERTIFICATE);
+  msg.setSignerId(nodeId);
+  msg.setRound(r);
+  msg.setProof(v.bytes);
+  encodeParents(msg, v.parents);
+
+  unsigned char *bitmap = msg.getPayload() + messageConstantLen + 4 + 4 * v.parents.size();
+  for (int id = 0; id < totalNodes; ++id) {
+    if (votes[r].has(id)) bitmap[id / 8] |= 1 << (id % 8);
+  }
+
+  broadcast(std::move(msg), relayType);
+
+  addCertificate(r, nodeId, std::move(v));
+}
+
+
+void NarwhalCorrect::onCertificate(PBFTMessage msg) {
+
+  uint32_t r = msg.getRound();
+
+  NarwhalVertex v;
+  v.parents = decodeParents(msg);
+  v.bytes = msg.getProof();
+
+  if (r > 0 && (int) v.parents.size() < quorum) return;
+
+  addCertificate(r, msg.getSignerId(), std::move(v));
+}
+
+
+void NarwhalCorrect::addCertificate(uint32_t r, uint32_t author, NarwhalVertex v) {
+
+  if (r < gcRound || hasVertex(r, author)) return;
+
+  if (v.bytes > 0) unorderedLoaded++;
+
+  dag[r][author] = std::move(v);
+
+  // headers held for this certificate
+  if (!waitingHeaders.empty()) {
+    std::vector<PBFTMessage> held;
+    held.swap(waitingHeaders);
+    for (auto &m : held) {
+      onHeader(std::move(m));
+    }
+  }
+
+  if ((int) dag[r].size() >= quorum && r + 1 > round) {
+    enterRound(r + 1);
+  }
+
+  tryOrder();
+  tryPropose();
+}
+
+
+/**
+ * commit the first anchor of an even round after the last one that f + 1 certificates of the next round refer to,
+ * earlier anchors it reaches are committed before it
+ */
+void NarwhalCorrect::tryOrder() {
+
+  for (uint32_t r = lastAnchor + 2; dag.count(r + 1); r += 2) {
+
+    uint32_t l = leader(r);
+
+    if (!hasVertex(r, l)) continue;
+
+    int support = 0;
+    for (auto &v : dag[r + 1]) {
+      auto &parents = v.second.parents;
+      if (std::find(parents.begin(), parents.end(), l) != parents.end()) support++;
+    }
+
+    if (support < quorumRound) continue;
+
+    // certificates of its history still on their way
+    if (!historyComplete(r, l)) return;
+
+    std::vector<uint32_t> anchors(1, r);
+    for (int64_t s = (int64_t) r - 2; s > lastAnchor; s -= 2) {
+      if (hasVertex(s, leader(s)) && reaches(anchors.back(), leader(anchors.back()), s, leader(s))) {
+        anchors.push_back(s);
+      }
+    }
+
+    uint32_t before = committedCount;
+
+    for (auto it = anchors.rbegin(); it != anchors.rend(); ++it) {
+      orderHistory(*it, leader(*it));
+      committedAnchors++;
+    }
+
+    lastAnchor = r;
+
+    double now = Simulator::Now().GetSeconds();
+
+    NS_LOG_INFO("anchor:"<<r<<" at:"<<nodeId<<" anchors:"<<anchors.size()<<" batches:"<<committedCount - before);
+
+    if (l == nodeId) {
+      std::cout<<"<commit: "<<r<<" "<<now<<" "<<committedCount - before<<" >"<<std::endl<<std::endl;
+    }
+
+    collectGarbage();
+  }
+}
+
+
+bool NarwhalCorrect::reaches(uint32_t r, uint32_t a, uint32_t tr, uint32_t ta) {
+
+  std::set<std::pair<uint32_t, uint32_t> > seen;
+  std::vector<std::pair<uint32_t, uint32_t> > stack(1, std::make_pair(r, a));
+
+  while (!stack.empty()) {
+    auto v = stack.back();
+    stack.pop_back();
+
+    if (v.first == tr) {
+      if (v.second == ta) return true;
+      continue;
+    }
+    if (v.first < tr || !seen.insert(v).second || !hasVertex(v.first, v.second)) continue;
+
+    for (auto p : dag[v.first][v.second].parents) {
+      stack.push_back(std::make_pair(v.first - 1, p));
+    }
+  }
+  return false;
+}
+
+
+// every certificate an anchor refers to is in, down to what is ordered or collected
+bool NarwhalCorrect::historyComplete(uint32_t r, uint32_t a) {
+
+  std::set<std::pair<uint32_t, uint32_t> > seen;
+  std::vector<std::pair<uint32_t, uint32_t> > stack(1, std::make_pair(r, a));
+
+  while (!stack.empty()) {
+    auto v = stack.back();
+    stack.pop_back();
+
+    if (v.first < gcRound || ordered.count(v) || !seen.insert(v).second) continue;
+    if (!hasVertex(v.first, v.second)) return false;
+
+    if (v.first == 0) continue;
+    for (auto p : dag[v.first][v.second].parents) {
+      stack.push_back(std::make_pair(v.first - 1, p));
+    }
+  }
+  return true;
+}
+
+
+// the certificates of the history not ordered yet, by round and author
+void NarwhalCorrect::orderHistory(uint32_t r, uint32_t a) {
+
+  std::vector<std::pair<uint32_t, uint32_t> > history;
+  std::vector<std::pair<uint32_t, uint32_t> > stack(1, std::make_pair(r, a));
+
+  while (!stack.empty()) {
+    auto v = stack.back();
+    stack.pop_back();
+
+    if (v.first < gcRound || !hasVertex(v.first, v.second) || !ordered.insert(v).second) continue;
+
+    history.push_back(v);
+
+    if (v.first == 0) continue;
+    for (auto p : dag[v.first][v.second].parents) {
+      stack.push_back(std::make_pair(v.first - 1, p));
+    }
+  }
+
+  std::sort(history.begin(), history.end());
+
+  double now = Simulator::Now().GetSeconds();
+
+  for (auto &h : history) {
+    NarwhalVertex &v = dag[h.first][h.second];
+
+    if (v.bytes == 0) continue;
+
+    unorderedLoaded--;
+    committedCount++;
+    committedBytes += v.bytes;
+
+    if (h.second != nodeId) continue;
+
+    ownCommitted++;
+    commitLatency += now - ownProposeTime[h.first];
+
+    for (auto &req : ownRequests[h.first]) {
+      if (req.first == nodeId) notifyRequestReply(req.second);
+    }
+    ownRequests.erase(h.first);
+  }
+}
+
+
+// forget rounds gcDepth below the last anchor, their batches are ordered or never will be
+void NarwhalCorrect::collectGarbage() {
+
+  if (lastAnchor < (int64_t) gcDepth) return;
+
+  uint32_t floor = lastAnchor - gcDepth;
+  if (floor <= gcRound) return;
+
+  for (auto it = dag.begin(); it != dag.end() && it->first < floor; it = dag.erase(it)) {
+    for (auto &v : it->second) {
+      if (v.second.bytes > 0 && !ordered.count(std::make_pair(it->first, v.first))) unorderedLoaded--;
+    }
+  }
+
+  auto below = std::make_pair(floor, (uint32_t) 0);
+  ordered.erase(ordered.begin(), ordered.lower_bound(below));
+  voted.erase(voted.begin(), voted.lower_bound(below));
+
+  ownHeaders.erase(ownHeaders.begin(), ownHeaders.lower_bound(floor));
+  votes.erase(votes.begin(), votes.lower_bound(floor));
+  ownRequests.erase(ownRequests.begin(), ownRequests.lower_bound(floor));
+  ownProposeTime.erase(ownProposeTime.begin(), ownProposeTime.lower_bound(floor));
+
+  waitingHeaders.erase(std::remove_if(waitingHeaders.begin(), waitingHeaders.end(),
+    [floor](PBFTMessage &m) {return m.getRound() < floor;}), waitingHeaders.end());
+
+  gcRound = floor;
+}
+
+
+// [count 4][author 4]... right after the constant part
+void NarwhalCorrect::encodeParents(PBFTMessage &msg, const std::vector<uint32_t> &parents) {
+
+  unsigned char *p = msg.getPayload() + messageConstantLen;
+
+  uint32_t count = parents.size();
+  memcpy(p, &count, 4);
+  for (uint32_t i = 0; i < count; ++i) {
+    memcpy(p + 4 + 4 * i, &parents[i], 4);
+  }
+}
+
+
+std::vector<uint32_t> NarwhalCorrect::decodeParents(PBFTMessage &msg) {
+
+  std::vector<uint32_t> parents;
+
+  if (msg.getPayloadLen() < (uint32_t) messageConstantLen + 4) return parents;
+
+  unsigned char *p = msg.getPayload() + messageConstantLen;
+
+  uint32_t count;
+  memcpy(&count, p, 4);
+  if (count > (uint32_t) totalNodes || msg.getPayloadLen() < messageConstantLen + 4 + 4 * count) return parents;
+
+  parents.resize(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    memcpy(&parents[i], p + 4 + 4 * i, 4);
+  }
+  return parents;
+}
+
+
+void NarwhalCorrect::sendToNode(PBFTMessage msg, uint32_t id) {
+
+  msg.setTransportType(ConsensusMessageBase::DIRECT);
+
+  if (id != nodeId) {
+    msg.setDstAddr(id);
+    stampHop(msg);
+    Ptr<Packet> packet = msg.toPacket();
+    sendToPeer(packet, id);
+  }
+  else {
+    if (replicaStat == RUNNING) {
+      onMessageCallback(std::move(msg));
+    }
+  }
+}
+
+
+void NarwhalCorrect::setQuorum() {
+  int f = (totalNodes - 1) / 3;
+  quorum = totalNodes - f;
+  quorumRound = f + 1;
+}
+
+
+PBFTMessage NarwhalCorrect::message() {
+  PBFTMessage msg;
+  msg.setSeq(seq++);
+  return msg;
+}
+
+
+PBFTMessage NarwhalCorrect::message(int l) {
+  PBFTMessage msg(l);
+  msg.setSeq(seq++);
+  return msg;
+}
+
+}
@@ -0,0 +1,174 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#ifndef NARWHALCORRECT_H
+#define NARWHALCORRECT_H
+
+#include "BlockChainApplicationBase.h"
+#include "PBFTMessage.h"
+
+
+namespace ns3 {
+
+/**
+ * Narwhal, DAG based data dissemination as in "Narwhal and Tusk: A DAG-based Mempool and Efficient BFT Consensus"
+ * every validator broadcasts a header with a batch of its own requests each round over the relay overlays,
+ * validators answer with an availability vote, a quorum of votes makes a certificate that the author broadcasts.
+ * a header of round r refers to a quorum of certificates of round r - 1, a validator enters round r + 1
+ * once it holds a quorum of certificates of round r.
+ *
+ * consensus orders certificates only, on the DAG itself as in Bullshark: the certificate of leader (r / 2) % n
+ * anchors an even round r and is committed once f + 1 certificates of round r + 1 refer to it,
+ * the causal history of an anchor is ordered by round and author.
+ * anchors skipped before are committed first if the new anchor reaches them.
+ *
+ * PBFTMessage is the wire format: round carries the DAG round, proof the batch bytes of a header or certificate,
+ * or the author a vote is for
+ */
+
+class NarwhalCorrect : public BlockChainApplicationBase<PBFTMessage> {
+
+public:
+
+  enum NARWHAL_PRIMITIVE : uint32_t {
+    HEADER,
+    VOTE,
+    CERTIFICATE
+  };
+
+  static TypeId GetTypeId (void);
+
+  NarwhalCorrect();
+
+  virtual ~NarwhalCorrect(void);
+
+  void RecvCallback (Ptr<Socket> socket);
+
+  void parseMessage(PBFTMessage msg);
+
+  void onHeader(PBFTMessage msg);
+  void onVote(PBFTMessage msg);
+  void onCertificate(PBFTMessage msg);
+
+  void onHeaderTimeout();
+
+  // the request joins the batch of the next header of this validator
+  virtual void submitRequest(uint32_t reqId, uint32_t bytes);
+
+  void setTotalNode(int n) {totalNodes = n;}
+  void setQuorum();
+  void setBatchSize(int sz) {batchSize = sz;}
+  // seconds a header waits for a full batch once its parents are certified
+  void setHeaderDelay(double d) {headerDelay = d;}
+  void setContinous(bool c) {continous = c;}
+  // rounds kept below the last committed anchor
+  void setGcDepth(uint32_t d) {gcDepth = d;}
+
+  inline uint32_t getRound() {return round;}
+
+  // certificates ordered, with the bytes of their batches
+  uint32_t getCommittedCount() {return committedCount;}
+  uint64_t getCommittedBytes() {return committedBytes;}
+  uint32_t getCommittedAnchors() {return committedAnchors;}
+
+  // second, from a header of this validator to its certificate ordered, averaged
+  double getAverageCommitLatency() {return ownCommitted == 0 ? 0 : commitLatency / ownCommitted;}
+
+  uint64_t getTotalRecvMessages() {return totalRecvMessages;}
+  uint64_t getTotalRecvBytes() {return totalRecvBytes;}
+
+protected:
+
+  struct NarwhalVertex {
+    std::vector<uint32_t> parents;   // authors of round - 1
+    uint32_t bytes = 0;
+  };
+
+  int totalNodes;
+  int quorum;        // 2f + 1
+  int quorumRound;   // f + 1
+
+  int batchSize;
+  double headerDelay = 0.1;
+
+  bool continous;
+
+  uint32_t gcDepth = 50;
+
+  // hash, sign etc, rough estimation, an aggregated signature included
+  int messageConstantLen = 80;
+
+  // round this validator proposes in, and the last it proposed in plus one
+  uint32_t round = 0;
+  uint32_t proposedRounds = 0;
+
+  bool headerDue = false;
+  EventId headerTimerEvent;
+
+  // round -> author -> certified vertex
+  std::map<uint32_t, std::map<uint32_t, NarwhalVertex> > dag;
+
+  // headers voted for, <round, author>, one per author and round
+  std::set<std::pair<uint32_t, uint32_t> > voted;
+
+  // headers whose parents are not all certified here yet
+  std::vector<PBFTMessage> waitingHeaders;
+
+  // own headers: round -> parents, votes, requests, proposal time
+  std::map<uint32_t, NarwhalVertex> ownHeaders;
+  std::map<uint32_t, VoteCounter> votes;
+  std::map<uint32_t, std::vector<std::pair<uint32_t, uint32_t> > > ownRequests;
+  std::map<uint32_t, double> ownProposeTime;
+
+  // ordering, rounds below gcRound are forgotten and count as ordered
+  std::set<std::pair<uint32_t, uint32_t> > ordered;
+  int64_t lastAnchor = -2;
+  uint32_t gcRound = 0;
+
+  // certified vertices with a batch not ordered yet
+  uint32_t unorderedLoaded = 0;
+
+  uint32_t committedCount = 0;
+  uint64_t committedBytes = 0;
+  uint32_t committedAnchors = 0;
+  uint32_t ownCommitted = 0;
+  double commitLatency = 0;
+
+  uint64_t totalRecvMessages = 0;
+  uint64_t totalRecvBytes = 0;
+
+  PBFTMessage message();
+  PBFTMessage message(int l);
+
+  virtual void StartApplication(void);
+  virtual void StopApplication(void);
+  virtual void DoDispose(void);
+
+  uint32_t leader(uint32_t r) {return (r / 2) % totalNodes;}
+
+  bool hasWork();
+  bool hasVertex(uint32_t r, uint32_t a);
+  bool parentsCertified(uint32_t r, const std::vector<uint32_t> &parents);
+
+  void enterRound(uint32_t r);
+  void tryPropose();
+  void propose();
+  void certify(uint32_t r);
+  void addCertificate(uint32_t r, uint32_t author, NarwhalVertex v);
+
+  void tryOrder();
+  bool reaches(uint32_t r, uint32_t a, uint32_t tr, uint32_t ta);
+  bool historyComplete(uint32_t r, uint32_t a);
+  void orderHistory(uint32_t r, uint32_t a);
+  void collectGarbage();
+
+  void encodeParents(PBFTMessage &msg, const std::vector<uint32_t> &parents);
+  std::vector<uint32_t> decodeParents(PBFTMessage &msg);
+
+  void sendToNode(PBFTMessage msg, uint32_t id);
+
+};
+
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <cstring>
 
 
 namespace ns3 {
@@ -24,7 +25,27 @@ TypeId PBFTCorrect::GetTypeId (void) {
     .AddTraceSource("Rx",
                     "A packet has been received", 
                     MakeTraceSourceAccessor(&PBFTCorrect::mRxTrace),
-                    "ns3::Packet::TracedCallback");
+                    "ns3::Packet::TracedCallback")
+    .AddTraceSource("Provenance",
+                    "A message carrying a provenance trailer is delivered for the first time",
+                    MakeTraceSourceAccessor(&PBFTCorrect::mProvenanceTrace),
+                    "ns3::BlockChainApplicationBase::ProvenanceTracedCallback")
+    .AddTraceSource("SendQueueDepth",
+                    "Number of sends waiting in the sequencial send queue",
+                    MakeTraceSourceAccessor(&PBFTCorrect::mSendQueueDepth),
+                    "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource("SendQueueBytes",
+                    "Bytes waiting in the sequencial send queue",
+                    MakeTraceSourceAccessor(&PBFTCorrect::mSendQueueBytes),
+                    "ns3::TracedValueCallback::Uint64")
+    .AddTraceSource("QueueingDelay",
+                    "Seconds the latest started send waited in the queue, SEQUENCIAL transfer model only",
+                    MakeTraceSourceAccessor(&PBFTCorrect::mQueueingDelay),
+                    "ns3::TracedValueCallback::Double")
+    .AddTraceSource("SendQueueDrops",
+                    "Number of sends dropped or coalesced by a bounded send queue, SEQUENCIAL transfer model only",
+                    MakeTraceSourceAccessor(&PBFTCorrect::mSendQueueDrops),
+                    "ns3::TracedValueCallback::Uint32");
   return tid;
 }
 
@@ -37,6 +58,9 @@ void PBFTCorrect::DoDispose (void) {
 PBFTCorrect::PBFTCorrect(void) {
   stage = IDLE;
   round = 0;
+
+  batchSizeHistogram.SetDefaultBinWidth(1);
+  batchDelayHistogram.SetDefaultBinWidth(0.01);
 }
 
 
@@ -85,24 +109,40 @@ void PBFTCorrect::parseMessage(PBFTMessage msg) {
 
     NS_LOG_INFO("Parse Message");
 
+    // agreement messages only count in the view they were sent in
+    if (msg.getType() == PRE_PREPARE || msg.getType() == PREPARE || msg.getType() == COMMIT
+      || msg.getType() == AGGREGATE_VOTE || msg.getType() == VOTE_CERTIFICATE) {
+      // and not after this node left the view
+      if (msg.getNo() < view || (msg.getNo() == view && stage == NEWEPOCH)) return;
+      if (msg.getNo() > view) {
+        futureViewMessages.push_back(std::move(msg));
+        return;
+      }
+    }
+
     switch (msg.getType()) {
       case REQUEST:
-        onRequest(std::move(msg));
+        if (pipelineWindow > 1) onRequestPipelined(std::move(msg));
+        else onRequest(std::move(msg));
         break;
       case PRE_PREPARE:
-        onPreprepare(std::move(msg));
+        if (pipelineWindow > 1) onPrepreparePipelined(std::move(msg));
+        else onPreprepare(std::move(msg));
         break;
       case PREPARE:
-        onPrepare(std::move(msg));
+        if (pipelineWindow > 1) onPreparePipelined(std::move(msg));
+        else onPrepare(std::move(msg));
         break;
       case COMMIT:
-        onCommit(std::move(msg));
+        if (pipelineWindow > 1) onCommitPipelined(std::move(msg));
+        else onCommit(std::move(msg));
         break;
       case BLAME:
         onBlame(std::move(msg));
         break;
       case REPLY:
-        onReply(std::move(msg));
+        if (pipelineWindow > 1) onReplyPipelined(std::move(msg));
+        else onReply(std::move(msg));
         break;
       case NEWEPOCH:
         onNewEpoch(std::move(msg));
@@ -110,6 +150,27 @@ void PBFTCorrect::parseMessage(PBFTMessage msg) {
       case CONFIRM_NEWEPOCH:
         onConfirmEpoch(std::move(msg));
         break;
+      case CHECKPOINT:
+        onCheckpoint(std::move(msg));
+        break;
+      case STATE_REQUEST:
+        onStateRequest(std::move(msg));
+        break;
+      case STATE_REPLY:
+        onStateReply(std::move(msg));
+        break;
+      case AGGREGATE_VOTE:
+        onAggregateVote(std::move(msg));
+        break;
+      case VOTE_CERTIFICATE:
+        onVoteCertificate(std::move(msg));
+        break;
+      case CLIENT_REPLY:
+        notifyRequestReply(msg.getNo());
+        break;
+      case TRANSACTION:
+        mempoolAdd({msg.getProof(), msg.getNo(), msg.getPayloadLen(), 0}, msg.getSignerId());
+        break;
       default:
         // broadcast test also goes here, for now 
         std::cerr << "Bad type" << std::endl;
@@ -122,7 +183,6 @@ void PBFTCorrect::parseMessage(PBFTMessage msg) {
 }
 
 
-// Todo: fault detect and recovery from timeout
 void PBFTCorrect::onTimeoutCallback() {
 
   if (!replicaStat == RUNNING) return;
@@ -137,6 +197,19 @@ void PBFTCorrect::onTimeoutCallback() {
   std::cout << "timeout" << std::endl << "at:"<<nodeId<<" primary:"<<primaryId << std::endl << "round:"<<round
     << std::endl << "stage:"<<stage << std::endl << "time:"<<Simulator::Now().GetSeconds() << std::endl << std::endl;
 
+  // the new primary did not show up in time, try the next one
+  if (stage == NEWEPOCH) {
+    sendBlame();
+    return;
+  }
+
+  // no progress on the low watermark
+  if (pipelineWindow > 1) {
+    if (awaitingRequest) onRequestTimeout();
+    else if (!pipeline.empty() || requestWatched) sendBlame();
+    return;
+  }
+
   switch (stage)
   {
   case REQUEST:
@@ -149,11 +222,14 @@ void PBFTCorrect::onTimeoutCallback() {
     onPrepareTimeout();
     break;
   case IDLE:
+    if (requestWatched) sendBlame();
+    break;
   case COMMIT:
   case BLAME:
   case REPLY:
   case NEWEPOCH:
   case CONFIRM_NEWEPOCH:
+  case CHECKPOINT:
   // INTENDED
   default:
     // discardRound();
@@ -163,7 +239,15 @@ void PBFTCorrect::onTimeoutCallback() {
 
 
 void PBFTCorrect::onRequestTimeout() {
-  //request new round
+
+  // let every replica watch the primary for this request
+  PBFTMessage msg = message();
+  msg.setType(REQUEST);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+
+  BroadcastPBFT(std::move(msg));
+
   sendBlame();
 }
 
@@ -200,6 +284,17 @@ void PBFTCorrect::RecvCallback (Ptr<Socket> sock) {
         recvMsgLog.push_back(std::make_tuple(msg.getSignerId(), latency, msg.uniqueMessageSeq()));
       }
 
+      samplePeer(msg, payloadSize);
+
+      totalRecvBytes += payloadSize;
+      totalRecvMessages++;
+      if (msg.getType() == CHECKPOINT) {
+        checkpointRecvBytes += payloadSize;
+      }
+      if (msg.getType() == PRE_PREPARE) {
+        blockRecvBytes += payloadSize;
+      }
+
       onMessageCallback(std::move(msg));
     }
   }
@@ -224,25 +319,23 @@ void PBFTCorrect::onRequest(PBFTMessage msg) {
   // just discard requests in other states
   // Todo : queue and pace requests
   if (nodeId == primaryId) {
-    if (stage == IDLE) {
-      // reuse the object, save payload before rest
-      // note that there exist a copy in recv pool
-      msg.reset(messageConstantLen);
-
-      msg.setType(PRE_PREPARE);
-      msg.setSignerId(nodeId);
-      msg.setRound(round);
-
-      BroadcastPBFT(std::move(msg));
-
-      stage = PRE_PREPARE;
-      setTimeoutEvent();
+    if (batchingOn()) {
+      onBatchRequest(std::move(msg));
+    }
+    else if (canPropose()) {
+      propose(std::move(msg));
     }
     else {
       pendingRequest.push(std::move(msg));
     }
   }
   else {
+    // a request broadcast by its client, the primary is late
+    if (msg.getTransportType() != ConsensusMessageBase::DIRECT && !requestWatched) {
+      requestWatched = true;
+      setTimeoutEvent();
+    }
+
     // forward to promary
     sendToPrimary(std::move(msg));
   }
@@ -250,6 +343,152 @@ void PBFTCorrect::onRequest(PBFTMessage msg) {
 }
 
 
+void PBFTCorrect::propose(PBFTMessage msg) {
+
+  trackProposal(msg, round);
+
+  // reuse the object, save payload before rest
+  // note that there exist a copy in recv pool
+  // aggregated votes carry no block, the pre-prepare does
+  msg.reset(messageConstantLen + txListLen(round) + proposalBytes + (voteAggregation ? blockSize : 0));
+  proposalBytes = 0;
+  encodeTxs(msg, round);
+  stampProposal(msg);
+
+  msg.setType(PRE_PREPARE);
+  msg.setSignerId(nodeId);
+  msg.setRound(round);
+  msg.setNo(view);
+
+  // reset cleared the seq, transaction requests name a compact block by it
+  if (clientRequests.count(round)) {
+    msg.setSeq(seq++);
+    compactBlock(msg, messageConstantLen + txListLen(round), clientRequests[round]);
+  }
+
+  awaitingRequest = false;
+
+  BroadcastPBFT(std::move(msg));
+
+  stage = PRE_PREPARE;
+  setTimeoutEvent();
+}
+
+
+void PBFTCorrect::setBatchPolicy(uint32_t maxCount, uint32_t maxBytes, double maxDelay) {
+  batchMaxCount = maxCount;
+  batchMaxBytes = maxBytes;
+  batchMaxDelay = maxDelay;
+}
+
+
+// a prepare carries the block it votes on, the batch of the proposal or the configured block size
+int PBFTCorrect::voteSize(PBFTMessage &proposal) {
+  int body = (int) proposal.getPayloadLen() - messageConstantLen - (voteAggregation ? blockSize : 0);
+  return batchingOn() && body > 0 ? messageConstantLen + body : blockSize;
+}
+
+
+bool PBFTCorrect::canPropose() {
+  // backpressure, a proposal would only be dropped or wait behind a full send queue
+  if (!canSend()) return false;
+  if (pipelineWindow > 1) {
+    // high watermark, two checkpoint intervals above the stable checkpoint
+    if (checkpointInterval > 0 && 
+        (int64_t) nextSeq > lastStableCheckpoint + 2 * (int64_t) checkpointInterval) return false;
+    return nextSeq < round + pipelineWindow;
+  }
+  return stage == IDLE;
+}
+
+
+void PBFTCorrect::onBatchRequest(PBFTMessage msg) {
+
+  batchBuffer.push_back(std::make_pair(Simulator::Now().GetSeconds(), msg.getPayloadLen()));
+  batchClients.push_back(std::make_pair(msg.getSignerId(), msg.getNo()));
+  batchBytes += msg.getPayloadLen();
+
+  if (batchBuffer.size() == 1 && batchMaxDelay > 0) {
+    batchTimerEvent = Simulator::Schedule(Seconds(batchMaxDelay), &PBFTCorrect::onBatchTimeout, this);
+  }
+
+  tryFlushBatch();
+}
+
+
+void PBFTCorrect::onBatchTimeout() {
+  batchDue = true;
+  tryFlushBatch();
+}
+
+
+/**
+ * propose the buffered requests as one block if a limit is hit and the protocol is ready,
+ * requests beyond the limits are left for the next batch
+ */
+void PBFTCorrect::tryFlushBatch() {
+
+  if (batchBuffer.empty() || nodeId != primaryId) return;
+
+  bool full = (batchMaxCount > 0 && batchBuffer.size() >= batchMaxCount) || 
+              (batchMaxBytes > 0 && batchBytes >= batchMaxBytes);
+
+  // no delay limit, whatever is buffered goes as soon as the protocol can take it
+  if (!(full || batchDue || batchMaxDelay <= 0) || !canPropose()) return;
+
+  double now = Simulator::Now().GetSeconds();
+
+  uint32_t count = 0;
+  uint32_t bytes = 0;
+
+  while (!batchBuffer.empty() && (batchMaxCount == 0 || count < batchMaxCount) && 
+         (batchMaxBytes == 0 || bytes < batchMaxBytes)) {
+    batchDelayHistogram.AddValue(now - batchBuffer.front().first);
+    bytes += batchBuffer.front().second;
+    count++;
+    batchBuffer.pop_front();
+
+    if (batchClients.front().second != 0) proposalRequests.push_back(batchClients.front());
+    batchClients.pop_front();
+  }
+
+  batchBytes -= bytes;
+  batchSizeHistogram.AddValue(count);
+
+  NS_LOG_INFO("batch of " << count << " requests, " << bytes << " bytes at:" << nodeId);
+
+  if (checkEventStatus(batchTimerEvent)) {
+    Simulator::Cancel(batchTimerEvent);
+  }
+  batchDue = false;
+
+  // the oldest request left decides the next deadline
+  if (!batchBuffer.empty() && batchMaxDelay > 0) {
+    double wait = batchBuffer.front().first + batchMaxDelay - now;
+    if (wait <= 0) {
+      batchDue = true;
+    }
+    else {
+      batchTimerEvent = Simulator::Schedule(Seconds(wait), &PBFTCorrect::onBatchTimeout, this);
+    }
+  }
+
+  proposalBytes = bytes;
+
+  PBFTMessage msg = message();
+  msg.setType(REQUEST);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+
+  if (pipelineWindow > 1) {
+    issuePreprepare(std::move(msg));
+  }
+  else {
+    propose(std::move(msg));
+  }
+}
+
+
 void PBFTCorrect::onPreprepare(PBFTMessage msg) {
 
   NS_LOG_INFO("onPreprepare");
@@ -262,6 +501,13 @@ void PBFTCorrect::onPreprepare(PBFTMessage msg) {
 
   if (msg.getSignerId() != primaryId) return; 
 
+  decodeTxs(msg);
+  trackPropagation(msg);
+
+  // the primary is alive
+  awaitingRequest = false;
+  requestWatched = false;
+
   if (stage == IDLE || stage == REQUEST) {
     if (msg.getRound() > round) {
       // perhaps lag back
@@ -274,13 +520,14 @@ void PBFTCorrect::onPreprepare(PBFTMessage msg) {
       firstPreprepare = false;
       preprepareTime = Simulator::Now().GetSeconds();
     
-      round = msg.getRound();
-      //Todo: retrieve missing rounds
+      // fetch the rounds skipped
+      skipTo(msg.getRound(), primaryId);
 
-      msg.reset(blockSize);
+      msg.reset(voteSize(msg));
       msg.setType(PREPARE);
       msg.setSignerId(nodeId);
       msg.setRound(round);
+      msg.setNo(view);
 
       double timeE = Simulator::Now().GetSeconds() - preprepareTime;
 
@@ -310,11 +557,12 @@ void PBFTCorrect::onPreprepare(PBFTMessage msg) {
 
       // reuse the object, save payload before rest
       // note that there exist a copy in recv pool
-      msg.reset(blockSize);
+      msg.reset(voteSize(msg));
 
       msg.setType(PREPARE);
       msg.setSignerId(nodeId);
       msg.setRound(round);
+      msg.setNo(view);
 
       double timeE = Simulator::Now().GetSeconds() - preprepareTime;
 
@@ -344,13 +592,14 @@ void PBFTCorrect::onPreprepare(PBFTMessage msg) {
       firstPreprepare = false;
       preprepareTime = Simulator::Now().GetSeconds();
     
-      round = msg.getRound();
-      //Todo: retrieve missing rounds
+      // fetch the rounds skipped
+      skipTo(msg.getRound(), primaryId);
 
-      msg.reset(blockSize);
+      msg.reset(voteSize(msg));
       msg.setType(PREPARE);
       msg.setSignerId(nodeId);
       msg.setRound(round);
+      msg.setNo(view);
 
       double timeE = Simulator::Now().GetSeconds() - preprepareTime;
 
@@ -429,6 +678,7 @@ void PBFTCorrect::prepared(bool shortcut) {
     rmsg.setType(COMMIT);
     rmsg.setSignerId(nodeId);
     rmsg.setRound(round);
+    rmsg.setNo(view);
 
     double timeE = Simulator::Now().GetSeconds() - prepareTime;
 
@@ -482,6 +732,9 @@ void PBFTCorrect::committed() {
 
     if (nodeId != primaryId) {
       sendReply();
+      commitLatency += Simulator::Now().GetSeconds() - preprepareTime;
+      commitLatencyCount++;
+      executed(round);
       newRound();
     }
     else {
@@ -491,172 +744,214 @@ void PBFTCorrect::committed() {
 }
 
 
-void PBFTCorrect::onBlame(PBFTMessage msg) {
+/**
+ * pipelined mode
+ * 
+ * same three phases as above, but votes are counted per sequence number (carried in the round field)
+ * so that the primary can have up to pipelineWindow pre-prepares in flight.
+ * backups execute strictly in order and reply, the primary slides its window 
+ * once a majority replied for the low watermark 
+ */
+void PBFTCorrect::onRequestPipelined(PBFTMessage msg) {
 
-  // note that change-view is not fully implemented and can be stuck
-  // in some cases 
-  // Todo
-  NS_LOG_INFO("onBlame");
+  NS_LOG_INFO("onRequestPipelined");
   NS_LOG_INFO("at:"<<nodeId<<" from:"<<msg.getSignerId());
-  NS_LOG_INFO("round:"<<round<<"stage:"<<stage);
-  NS_LOG_INFO("r-round:"<<msg.getRound());
-  NS_LOG_INFO("priamry:"<<primaryId);
+  NS_LOG_INFO("low:"<<round<<" next:"<<nextSeq);
   NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
   NS_LOG_INFO("");
 
-  if (msg.getRound() == round) {
-    if (incBlameCount(msg.getSignerId()) >= quorum) {
-      if (isBackupPrimary()) {
-        // claim to be the new primary
-        stage = NEWEPOCH;
-        sendNewEpoch();
-      }
-      else {
-        // aware of a epoch-changing event
-        // Todo: timeout waiting for the backup primary node
-        stage = NEWEPOCH;
-      }
+  if (nodeId == primaryId) {
+    if (batchingOn()) {
+      onBatchRequest(std::move(msg));
+    }
+    else if (canPropose()) {
+      issuePreprepare(std::move(msg));
+    }
+    else {
+      pendingRequest.push(std::move(msg));
+    }
+  }
+  else {
+    if (msg.getTransportType() != ConsensusMessageBase::DIRECT && !requestWatched) {
+      requestWatched = true;
+      setTimeoutEvent();
     }
+
+    sendToPrimary(std::move(msg));
   }
 }
 
 
-void PBFTCorrect::onReply(PBFTMessage msg) {
+void PBFTCorrect::issuePreprepare(PBFTMessage msg) {
 
-  NS_LOG_INFO("OnReplay");
+  if (nextSeq < round) nextSeq = round;
+
+  uint32_t n = nextSeq++;
+
+  trackProposal(msg, n);
+
+  // reuse the object, note that there exist a copy in recv pool
+  msg.reset(messageConstantLen + txListLen(n) + proposalBytes + (voteAggregation ? blockSize : 0));
+  proposalBytes = 0;
+  encodeTxs(msg, n);
+  stampProposal(msg);
+
+  msg.setType(PRE_PREPARE);
+  msg.setSignerId(nodeId);
+  msg.setRound(n);
+  msg.setNo(view);
+
+  // reset cleared the seq, transaction requests name a compact block by it
+  if (clientRequests.count(n)) {
+    msg.setSeq(seq++);
+    compactBlock(msg, messageConstantLen + txListLen(n), clientRequests[n]);
+  }
+
+  awaitingRequest = false;
+
+  pipeline[n].stage = PRE_PREPARE;
+
+  BroadcastPBFT(std::move(msg));
+
+  setTimeoutEvent();
+}
+
+
+void PBFTCorrect::onPrepreparePipelined(PBFTMessage msg) {
+
+  NS_LOG_INFO("onPrepreparePipelined");
   NS_LOG_INFO("at:"<<nodeId<<" from:"<<msg.getSignerId());
-  NS_LOG_INFO("round:"<<round<<"stage:"<<stage);
-  NS_LOG_INFO("r-round:"<<msg.getRound());
-  NS_LOG_INFO("priamry:"<<primaryId);
+  NS_LOG_INFO("low:"<<round<<" seq:"<<msg.getRound());
   NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
   NS_LOG_INFO("");
 
-  if (incReplyCount(msg.getRound(), msg.getSignerId()) == totalNodes - 1) {
+  if (msg.getSignerId() != primaryId) return;
 
-      NS_LOG_INFO("AllCommitted");
-      NS_LOG_INFO("round:"<<msg.getRound());
-      NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
-      NS_LOG_INFO(""); 
+  decodeTxs(msg);
+  trackPropagation(msg);
 
-      std::cout<<"<all conf: "<<msg.getRound()<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
-  }
+  awaitingRequest = false;
+  requestWatched = false;
 
-  if (nodeId == primaryId && msg.getRound() == round)  {
-    nextRound();
-  }
-}
+  uint32_t n = msg.getRound();
 
+  // the primary may run ahead of a lagging backup by one window
+  if (n < round || n >= round + 2 * pipelineWindow) return;
 
-void PBFTCorrect::nextRound() {
+  PBFTSlot &slot = pipeline[n];
+
+  if (slot.stage != IDLE) return;
+
+  slot.stage = PRE_PREPARE;
+  slot.preprepareTime = Simulator::Now().GetSeconds();
+
+  msg.reset(voteSize(msg));
+  msg.setType(PREPARE);
+  msg.setSignerId(nodeId);
+  msg.setRound(n);
+  msg.setNo(view);
 
-  if (replyCount.size() <= round) {
-    replyCount.resize(round + 10);
+  if (mDelay <= 0) {
+    BroadcastPBFT(std::move(msg));
+  }
+  else {
+    BroadcastPBFT(std::move(msg), mDelay);
   }
 
-  if ( (int) replyCount[round].size() >= quorum) {
+  setTimeoutEvent();
 
-    NS_LOG_INFO("MajorityCommitted");
-    NS_LOG_INFO("round:"<<round);
-    NS_LOG_INFO("priamry:"<<primaryId);
-    NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
-    NS_LOG_INFO("");
+  // in case message received is quite out-of-order
+  preparedSeq(n);
+}
 
-    std::cout<<"<majority conf: "<<round<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
 
-    // start a new round after honest majority made progress
-    // Todo: piggy-bag this on next pre-prepare message
-    newRound();
+void PBFTCorrect::onPreparePipelined(PBFTMessage msg) {
 
-    if (continous) {
-      sendRequest();
-    }
+  uint32_t n = msg.getRound();
+
+  // same window as pre-prepares, a slot is only made for a sequence number in it
+  if (n < round || n >= round + 2 * pipelineWindow) return;
+
+  PBFTSlot &slot = pipeline[n];
 
+  if (slot.prepareTime < 0) {
+    slot.prepareTime = Simulator::Now().GetSeconds();
   }
+
+  incCount(slot.prepareCount, msg.getSignerId());
+
+  preparedSeq(n);
 }
 
 
-void PBFTCorrect::onNewEpoch(PBFTMessage msg) {
-  
-  NS_LOG_INFO("on new epoch");
-  NS_LOG_INFO("");
+void PBFTCorrect::preparedSeq(uint32_t n) {
 
-  if (msg.getRound() == round && msg.getSignerId() == getBackupPrimary()) {
-    // honest majority stuck at same round and agree to change epoch
-    msg.reset(messageConstantLen);
-    
-    msg.setType(CONFIRM_NEWEPOCH);
-    msg.setSignerId(nodeId);
-    msg.setSrcAddr(nodeId);
-    msg.setRound(round);
+  PBFTSlot &slot = pipeline[n];
 
-    discardRound();
-    updatePrimary();
+  if (slot.stage == PRE_PREPARE && (int) slot.prepareCount.size() >= quorum) {
 
-    sendToPrimary(std::move(msg));
-  }
-  else if (msg.getRound() > round && msg.getSignerId() == msg.getRound() % totalNodes) {
-    // Todo: retrieve missing rounds
+    PBFTMessage rmsg = message(messageConstantLen);
+    rmsg.setType(COMMIT);
+    rmsg.setSignerId(nodeId);
+    rmsg.setRound(n);
+    rmsg.setNo(view);
 
-    // if previous round is correct
-    round = msg.getRound();
+    double timeE = Simulator::Now().GetSeconds() - slot.prepareTime;
 
-    msg.reset(messageConstantLen);
-    msg.setType(CONFIRM_NEWEPOCH);
-    msg.setSignerId(nodeId);
-    msg.setSrcAddr(nodeId);
-    msg.setRound(round);
+    if (timeE >= mDelay) {
+      BroadcastPBFT(std::move(rmsg));
+    }
+    else {
+      BroadcastPBFT(std::move(rmsg), mDelay - timeE);
+    }
 
-    discardRound();
-    updatePrimary();
+    slot.stage = PREPARE;
 
-    sendToPrimary(std::move(msg));
+    // in case message received is quite out-of-order
+    committedSeq(n);
   }
 }
 
 
-void PBFTCorrect::onConfirmEpoch(PBFTMessage msg) {
+void PBFTCorrect::onCommitPipelined(PBFTMessage msg) {
 
-  NS_LOG_INFO("on confirm new epoch");
-  NS_LOG_INFO("");
+  uint32_t n = msg.getRound();
 
-  if (incNewEpochCount(msg.getSignerId()) >= quorum) {
-    
-    updatePrimary();
-    discardRound();
-    // Todo: resume the request
-    // sendRequest();
-  }
-}
+  // same window as pre-prepares, a slot is only made for a sequence number in it
+  if (n < round || n >= round + 2 * pipelineWindow) return;
 
+  incCount(pipeline[n].commitCount, msg.getSignerId());
 
-void PBFTCorrect::sendRequest() {
+  committedSeq(n);
+}
 
-  NS_LOG_INFO("sendRequest");
-  NS_LOG_INFO("at:"<<nodeId);
-  NS_LOG_INFO("round:"<<round<<"stage:"<<stage);
-  NS_LOG_INFO("priamry:"<<primaryId);
-  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
-  NS_LOG_INFO("");
 
-  PBFTMessage msg = message();
-  msg.setType(REQUEST);
-  msg.setSignerId(nodeId);
-  msg.setSrcAddr(nodeId);
+void PBFTCorrect::committedSeq(uint32_t n) {
 
-  std::cout<<"<req: "<<round<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
+  PBFTSlot &slot = pipeline[n];
 
-  sendToPrimary(std::move(msg));
+  if (slot.stage == PREPARE && (int) slot.commitCount.size() >= quorum) {
 
-  stage = REQUEST;
+    slot.stage = COMMIT;
 
-  setTimeoutEvent();
+    NS_LOG_INFO("Committed");
+    NS_LOG_INFO("at:"<<nodeId<<" seq:"<<n);
+    NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+    NS_LOG_INFO("");
 
+    executeInOrder();
+  }
 }
 
 
-void PBFTCorrect::sendReply() {
+// backups execute and reply in sequence order, the primary waits for replies instead
+void PBFTCorrect::executeInOrder() {
+
+  if (nodeId == primaryId) return;
+
+  for (auto it = pipeline.find(round); it != pipeline.end() && it->second.stage == COMMIT; 
+       it = pipeline.find(round)) {
 
-  if (stage == COMMIT) {
     PBFTMessage msg = message(messageConstantLen);
     msg.setType(REPLY);
     msg.setSignerId(nodeId);
@@ -664,53 +959,916 @@ void PBFTCorrect::sendReply() {
     msg.setRound(round);
 
     sendToPrimary(std::move(msg));
-  }
-}
 
+    if (it->second.preprepareTime >= 0) {
+      commitLatency += Simulator::Now().GetSeconds() - it->second.preprepareTime;
+      commitLatencyCount++;
+    }
 
-void PBFTCorrect::sendRequestCircle(double inv) {
-  
-  sendRequest();
-  void (PBFTCorrect::*fp)(double) = &PBFTCorrect::sendRequestCircle;
-  nextRequestEvent = Simulator::Schedule(Seconds(inv), fp, this, inv);
+    pipeline.erase(it);
+    round++;
+    executed(round - 1);
+
+    // without checkpoints, forget duplicates of executed sequence numbers once per window,
+    // those still in flight keep theirs
+    if (checkpointInterval == 0 && round % pipelineWindow == 0) {
+      uint32_t low = round;
+      messageRecvPool.eraseIf([low](PBFTMessage &m) {return m.getRound() < low;});
+    }
+  }
+
+  if (pipeline.empty()) {
+    clearTimeoutEvent();
+  }
+  else {
+    setTimeoutEvent();
+  }
+}
+
+
+void PBFTCorrect::onReplyPipelined(PBFTMessage msg) {
+
+  if (incReplyCount(msg.getRound(), msg.getSignerId()) == totalNodes - 1) {
+    std::cout<<"<all conf: "<<msg.getRound()<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
+  }
+
+  if (nodeId == primaryId) {
+    advanceWatermark();
+  }
+}
+
+
+// primary only, slide the window over sequence numbers a majority has executed
+void PBFTCorrect::advanceWatermark() {
+
+  int advanced = 0;
+
+  while (getReplyCount() >= quorum) {
+
+    std::cout<<"<majority conf: "<<round<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
+
+    pipeline.erase(round);
+    round++;
+    advanced++;
+    executed(round - 1);
+
+    // without checkpoints, forget duplicates of executed sequence numbers once per window,
+    // those still in flight keep theirs
+    if (checkpointInterval == 0 && round % pipelineWindow == 0) {
+      uint32_t low = round;
+      messageRecvPool.eraseIf([low](PBFTMessage &m) {return m.getRound() < low;});
+    }
+  }
+
+  if (advanced == 0) return;
+
+  fillWindow();
+
+  if (continous) {
+    for (int i = 0; i < advanced; ++i) sendRequest();
+  }
+
+  if (pipeline.empty()) {
+    clearTimeoutEvent();
+  }
+  else {
+    setTimeoutEvent();
+  }
+}
+
+
+// primary only, propose pending requests while the window allows
+void PBFTCorrect::fillWindow() {
+
+  while (!pendingRequest.empty() && canPropose()) {
+    PBFTMessage msg = pendingRequest.front();
+    pendingRequest.pop();
+    issuePreprepare(std::move(msg));
+  }
+
+  while (batchingOn() && !batchBuffer.empty() && canPropose()) {
+    size_t left = batchBuffer.size();
+    tryFlushBatch();
+    if (batchBuffer.size() == left) break;
+  }
+}
+
+
+/**
+ * checkpoints
+ * 
+ * the state of a round is not modeled, so the digest only depends on the round.
+ * a conflicting digest is simply not counted
+ */
+uint32_t PBFTCorrect::checkpointDigest(uint32_t r) {
+  return r * 2654435761u;
+}
+
+
+// called after round r is executed
+void PBFTCorrect::sendCheckpoint(uint32_t r) {
+
+  if (checkpointInterval == 0 || (r + 1) % checkpointInterval != 0) return;
+
+  if ((int) r <= lastStableCheckpoint) return;
+
+  PBFTMessage msg = message(messageConstantLen);
+  msg.setType(CHECKPOINT);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setRound(r);
+  msg.setProof(checkpointDigest(r));
+
+  checkpointSent++;
+
+  // own vote
+  if (incCount(checkpointVotes[r], nodeId) > quorum) {
+    stableCheckpoint(r);
+  }
+
+  BroadcastPBFT(std::move(msg));
+}
+
+
+void PBFTCorrect::onCheckpoint(PBFTMessage msg) {
+
+  NS_LOG_INFO("onCheckpoint");
+  NS_LOG_INFO("at:"<<nodeId<<" from:"<<msg.getSignerId());
+  NS_LOG_INFO("r-round:"<<msg.getRound()<<" stable:"<<lastStableCheckpoint);
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  uint32_t r = msg.getRound();
+
+  if ((int) r <= lastStableCheckpoint) return;
+
+  if (msg.getProof() != checkpointDigest(r)) return;
+
+  // quorum of others plus the node itself
+  if (incCount(checkpointVotes[r], msg.getSignerId()) > quorum) {
+    // a pipelined backup too far behind drops the pre-prepares it needs, catch up to the checkpoint
+    if (pipelineWindow > 1 && r + 1 > round) {
+      skipTo(r + 1, msg.getSignerId());
+    }
+    stableCheckpoint(r);
+  }
+}
+
+
+void PBFTCorrect::stableCheckpoint(uint32_t r) {
+
+  NS_LOG_INFO("stable checkpoint:"<<r<<" at:"<<nodeId);
+
+  lastStableCheckpoint = r;
+
+  checkpointVotes.erase(checkpointVotes.begin(), checkpointVotes.upper_bound(r));
+
+  // a lagging node keeps its unexecuted rounds
+  pipeline.erase(pipeline.begin(), pipeline.lower_bound(std::min(r + 1, round)));
+
+  messageRecvPool.eraseIf([r](PBFTMessage &m) {return m.getRound() <= r;});
+
+  for (auto c : recvMsgLog) {
+    truncatedLatency += std::get<1>(c);
+  }
+  truncatedLatencyCount += recvMsgLog.size();
+  recvMsgLog.clear();
+  recvMsgLog.shrink_to_fit();
+
+  if (nodeId == primaryId && pipelineWindow > 1) {
+    fillWindow();
+  }
+}
+
+
+size_t PBFTCorrect::getRetainedStateSize() {
+  size_t sz = messageRecvPool.size() + recvMsgLog.size() + checkpointVotes.size() + pipeline.size();
+  return sz;
+}
+
+
+/**
+ * view change
+ * 
+ * BLAME is the view-change message, No carries the target view, round the low watermark of the sender
+ * and proof the end of its highest prepared certificate.
+ * NEWEPOCH is the new-view message, No carries the view, round and proof the range to re-propose.
+ * CONFIRM_NEWEPOCH acknowledges a new view to its primary
+ */
+void PBFTCorrect::onBlame(PBFTMessage msg) {
+
+  NS_LOG_INFO("onBlame");
+  NS_LOG_INFO("at:"<<nodeId<<" from:"<<msg.getSignerId());
+  NS_LOG_INFO("round:"<<round<<"stage:"<<stage);
+  NS_LOG_INFO("r-round:"<<msg.getRound()<<" r-view:"<<msg.getNo());
+  NS_LOG_INFO("priamry:"<<primaryId);
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  uint32_t v = msg.getNo();
+
+  if (v <= view) return;
+
+  int votes = recordViewChange(v, msg.getSignerId(), msg.getRound(), msg.getProof());
+
+  // f + 1 replicas ask for the view, at least one of them is correct
+  if (votes > voteNodes / 3) {
+    startViewChange(v);
+  }
+
+  // quorum of others plus the node itself
+  if (v > view && v % totalNodes == nodeId && stage == NEWEPOCH && pendingView == v 
+      && viewChanges[v].votes.size() > quorum) {
+    sendNewEpoch(v);
+  }
+}
+
+
+int PBFTCorrect::recordViewChange(uint32_t v, uint32_t signer, uint32_t low, uint32_t high) {
+
+  PBFTViewChange &vc = viewChanges[v];
+
+  if (vc.votes.has(signer)) return vc.votes.size();
+
+  if (vc.votes.empty() || low > vc.low) {
+    vc.low = low;
+    vc.lowSigner = signer;
+  }
+  vc.high = std::max(vc.high, high);
+
+  return incCount(vc.votes, signer);
+}
+
+
+void PBFTCorrect::startViewChange(uint32_t v) {
+
+  if (v <= view || (stage == NEWEPOCH && v <= pendingView)) return;
+
+  // prepared certificates above the low watermark
+  uint32_t high = round;
+
+  if (pipelineWindow > 1) {
+    for (auto &slot : pipeline) {
+      if (slot.second.stage == PREPARE || slot.second.stage == COMMIT) {
+        high = std::max(high, slot.first + 1);
+      }
+    }
+  }
+  else if (stage == PREPARE || stage == COMMIT) {
+    high = round + 1;
+  }
+
+  if (viewChangeStart < 0) {
+    viewChangeStart = Simulator::Now().GetSeconds();
+  }
+
+  stage = NEWEPOCH;
+  pendingView = v;
+
+  NS_LOG_INFO("view change to:"<<v<<" at:"<<nodeId<<" low:"<<round<<" high:"<<high);
+
+  // a prepared certificate is a pre-prepare and a quorum of prepares
+  PBFTMessage msg = message(messageConstantLen + (high - round) * (quorum + 1) * messageConstantLen);
+  msg.setType(BLAME);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setRound(round);
+  msg.setNo(v);
+  msg.setProof(high);
+
+  BroadcastPBFT(std::move(msg));
+
+  // wait twice as long for each further view
+  clearTimeoutEvent();
+  void (PBFTCorrect::*fp)(void) = &PBFTCorrect::onTimeoutCallback;
+  timeoutEvent = Simulator::Schedule(Seconds(timeout * (1 << std::min(v - view - 1, 8u))), fp, this);
+
+  if (recordViewChange(v, nodeId, round, high) > quorum && v % totalNodes == nodeId) {
+    sendNewEpoch(v);
+  }
+}
+
+
+// new primary only, the view-change messages are the proof, modeled by their size
+void PBFTCorrect::sendNewEpoch(uint32_t v) {
+
+  PBFTViewChange vc = viewChanges[v];
+
+  uint32_t high = std::max(vc.high, vc.low);
+
+  PBFTMessage msg = message(messageConstantLen * (vc.votes.size() + 1 + high - vc.low));
+  msg.setType(NEWEPOCH);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setRound(vc.low);
+  msg.setNo(v);
+  msg.setProof(high);
+
+  BroadcastPBFT(std::move(msg));
+
+  installView(v, vc.low, high, vc.lowSigner);
+}
+
+
+void PBFTCorrect::onNewEpoch(PBFTMessage msg) {
+  
+  NS_LOG_INFO("on new epoch");
+  NS_LOG_INFO("at:"<<nodeId<<" from:"<<msg.getSignerId());
+  NS_LOG_INFO("view:"<<view<<" r-view:"<<msg.getNo());
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  uint32_t v = msg.getNo();
+
+  // only the primary of a newer view can install it
+  if (v <= view || msg.getSignerId() != v % totalNodes) return;
+
+  installView(v, msg.getRound(), msg.getProof(), msg.getSignerId());
+
+  msg.reset(messageConstantLen);
+  msg.setType(CONFIRM_NEWEPOCH);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setRound(round);
+  msg.setNo(view);
+
+  sendToPrimary(std::move(msg));
+}
+
+
+/**
+ * everything below low is committed at some correct node, the rounds this node did not
+ * execute are fetched by state transfer while consensus goes on from low
+ */
+void PBFTCorrect::installView(uint32_t v, uint32_t low, uint32_t high, uint32_t source) {
+
+  double now = Simulator::Now().GetSeconds();
+
+  NS_LOG_INFO("install view:"<<v<<" at:"<<nodeId<<" low:"<<low<<" high:"<<high);
+
+  viewChangeDuration = viewChangeStart < 0 ? 0 : now - viewChangeStart;
+  viewChangeStart = -1;
+  failoverPending = true;
+
+  view = v;
+  pendingView = v;
+  updatePrimary();
+
+  viewChanges.erase(viewChanges.begin(), viewChanges.upper_bound(v));
+
+  clearTimeoutEvent();
+
+  // round states of the old view are given up
+  stage = IDLE;
+  firstPrepare = true;
+  firstPreprepare = true;
+  prepareCount.clear();
+  commitCount.clear();
+  blameCount.clear();
+  newEpochCount.clear();
+  messageRecvPool.clear();
+  pipeline.clear();
+  aggregates.clear();
+  clientRequests.clear();
+  blockTxs.clear();
+  requestWatched = false;
+
+  skipTo(low, source);
+
+  nextSeq = round;
+
+  std::vector<PBFTMessage> held;
+  held.swap(futureViewMessages);
+  for (auto &m : held) {
+    parseMessage(std::move(m));
+  }
+
+  if (nodeId == primaryId) {
+    resumeView(high);
+
+    // transactions the old primary had not ordered, except those already queued or proposed here
+    if (mempoolOn) {
+      std::set<uint64_t> queued = queuedTxs();
+      for (auto &tx : mempool.reap(0, 0)) {
+        if (queued.count(Mempool::shortId(tx.client, tx.reqId)) == 0) onMempoolTx(tx);
+      }
+    }
+  }
+  else if (awaitingRequest) {
+    sendRequest();
+  }
+}
+
+
+// new primary only, re-propose sequence numbers that may be prepared in an older view
+void PBFTCorrect::resumeView(uint32_t high) {
+
+  std::cout<<"<new view: "<<view<<" "<<nodeId<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
+
+  uint32_t reproposed = 0;
+
+  for (uint32_t n = round; n < high && (pipelineWindow > 1 || n == round); ++n) {
+    PBFTMessage msg = message();
+    msg.setType(REQUEST);
+    msg.setSignerId(nodeId);
+    msg.setSrcAddr(nodeId);
+
+    if (pipelineWindow > 1) issuePreprepare(std::move(msg));
+    else propose(std::move(msg));
+
+    reproposed++;
+  }
+
+  if (pipelineWindow > 1) {
+    fillWindow();
+  }
+  else if (reproposed == 0) {
+    invokePending();
+  }
+
+  // the requests in flight at the old primary are lost
+  if (continous) {
+    if (pipelineWindow > 1) {
+      for (size_t i = pipeline.size() + pendingRequest.size(); i < pipelineWindow; ++i) sendRequest();
+    }
+    else if (stage == IDLE) {
+      sendRequest();
+    }
+  }
+}
+
+
+void PBFTCorrect::onConfirmEpoch(PBFTMessage msg) {
+
+  NS_LOG_INFO("on confirm new epoch");
+  NS_LOG_INFO("at:"<<nodeId<<" from:"<<msg.getSignerId()<<" r-view:"<<msg.getNo());
+  NS_LOG_INFO("");
+
+  if (nodeId != primaryId || msg.getNo() != view) return;
+
+  if (incNewEpochCount(msg.getSignerId()) == quorum) {
+    std::cout<<"<view confirmed: "<<view<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
+  }
+}
+
+
+// bookkeeping after round r is executed, by the primary: confirmed by a majority
+void PBFTCorrect::executed(uint32_t r) {
+
+  double now = Simulator::Now().GetSeconds();
+
+  executedCount++;
+
+  if (failoverPending) {
+    failoverPending = false;
+    failoverLog.push_back(std::make_tuple(view, viewChangeDuration, now - lastExecuteTime));
+
+    if (nodeId == primaryId) {
+      std::cout<<"<failover: "<<view<<" "<<viewChangeDuration<<" "<<now - lastExecuteTime<<" "<<now<<" >"<<std::endl<<std::endl;
+    }
+  }
+
+  lastExecuteTime = now;
+
+  if (mempoolOn) {
+    auto &ordered = nodeId == primaryId ? clientRequests : blockTxs;
+    auto it = ordered.find(r);
+    if (it != ordered.end()) {
+      for (auto &tx : it->second) mempool.remove(tx.first, tx.second);
+    }
+    blockTxs.erase(blockTxs.begin(), blockTxs.upper_bound(r));
+  }
+
+  if (nodeId == primaryId) replyClients(r);
+
+  sendCheckpoint(r);
+}
+
+
+// primary only, a single request proposed as is, or the requests a batch took
+void PBFTCorrect::trackProposal(PBFTMessage &msg, uint32_t n) {
+
+  if (msg.getType() == REQUEST && msg.getNo() != 0) {
+    proposalRequests.push_back(std::make_pair(msg.getSignerId(), msg.getNo()));
+  }
+
+  if (proposalRequests.empty()) return;
+
+  auto &requests = clientRequests[n];
+  requests.insert(requests.end(), proposalRequests.begin(), proposalRequests.end());
+  proposalRequests.clear();
+}
+
+
+uint32_t PBFTCorrect::txListLen(uint32_t n) {
+  if (!mempoolOn) return 0;
+  auto it = clientRequests.find(n);
+  return 4 + 8 * (it == clientRequests.end() ? 0 : it->second.size());
+}
+
+
+// [count][client, request id]... right after the constant part
+void PBFTCorrect::encodeTxs(PBFTMessage &msg, uint32_t n) {
+
+  if (!mempoolOn) return;
+
+  unsigned char *p = msg.getPayload() + messageConstantLen;
+
+  auto it = clientRequests.find(n);
+  uint32_t count = it == clientRequests.end() ? 0 : it->second.size();
+
+  memcpy(p, &count, 4);
+  for (uint32_t i = 0; i < count; ++i) {
+    memcpy(p + 4 + 8 * i, &it->second[i].first, 4);
+    memcpy(p + 8 + 8 * i, &it->second[i].second, 4);
+  }
+}
+
+
+void PBFTCorrect::decodeTxs(PBFTMessage &msg) {
+
+  if (!mempoolOn || msg.getPayloadLen() < (uint32_t) messageConstantLen + 4) return;
+
+  unsigned char *p = msg.getPayload() + messageConstantLen;
+
+  uint32_t count;
+  memcpy(&count, p, 4);
+  if (msg.getPayloadLen() < messageConstantLen + 4 + 8 * count) return;
+
+  auto &txs = blockTxs[msg.getRound()];
+  txs.clear();
+
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t client, reqId;
+    memcpy(&client, p + 4 + 8 * i, 4);
+    memcpy(&reqId, p + 8 + 8 * i, 4);
+    txs.push_back(std::make_pair(client, reqId));
+  }
+}
+
+
+void PBFTCorrect::stampProposal(PBFTMessage &msg) {
+  double now = Simulator::Now().GetSeconds();
+  memcpy(msg.getPayload(), &now, sizeof(now));
+}
+
+
+void PBFTCorrect::trackPropagation(PBFTMessage &msg) {
+
+  if (nodeId == primaryId || msg.getPayloadLen() < sizeof(double)) return;
+
+  double proposed;
+  memcpy(&proposed, msg.getPayload(), sizeof(proposed));
+
+  blockPropagation += Simulator::Now().GetSeconds() - proposed;
+  blockPropagationCount++;
+}
+
+
+void PBFTCorrect::sendTransaction(const MempoolTx &tx, int peer) {
+
+  PBFTMessage msg = message(tx.bytes);
+  msg.setType(TRANSACTION);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setProof(tx.client);
+  msg.setNo(tx.reqId);
+
+  sendToNode(std::move(msg), peer);
+}
+
+
+// the primary orders a transaction as a request of its client, backups only keep it
+void PBFTCorrect::onMempoolTx(const MempoolTx &tx) {
+
+  if (nodeId != primaryId) return;
+
+  PBFTMessage msg = message(tx.bytes);
+  msg.setType(REQUEST);
+  msg.setSignerId(tx.client);
+  msg.setSrcAddr(nodeId);
+  msg.setNo(tx.reqId);
+  msg.setTransportType(ConsensusMessageBase::DIRECT);
+
+  if (pipelineWindow > 1) onRequestPipelined(std::move(msg));
+  else onRequest(std::move(msg));
+}
+
+
+// short ids of the requests in the batch buffer, waiting for a round or in a proposal of this view
+std::set<uint64_t> PBFTCorrect::queuedTxs() {
+
+  std::set<uint64_t> ids;
+
+  for (auto &req : batchClients) ids.insert(Mempool::shortId(req.first, req.second));
+  for (auto &req : proposalRequests) ids.insert(Mempool::shortId(req.first, req.second));
+
+  for (auto &n : clientRequests) {
+    for (auto &req : n.second) ids.insert(Mempool::shortId(req.first, req.second));
+  }
+
+  std::queue<PBFTMessage> waiting = pendingRequest;
+  for (; !waiting.empty(); waiting.pop()) {
+    ids.insert(Mempool::shortId(waiting.front().getSignerId(), waiting.front().getNo()));
+  }
+
+  return ids;
+}
+
+
+void PBFTCorrect::replyClients(uint32_t r) {
+
+  auto it = clientRequests.find(r);
+
+  if (it != clientRequests.end()) {
+    for (auto &req : it->second) {
+      PBFTMessage msg = message(messageConstantLen);
+      msg.setType(CLIENT_REPLY);
+      msg.setSignerId(nodeId);
+      msg.setSrcAddr(nodeId);
+      msg.setRound(r);
+      msg.setNo(req.second);
+
+      sendToNode(std::move(msg), req.first);
+    }
+  }
+
+  // rounds skipped by a view change lost their requests
+  clientRequests.erase(clientRequests.begin(), clientRequests.upper_bound(r));
+}
+
+
+/**
+ * state transfer
+ * 
+ * STATE_REQUEST asks for the committed rounds in [round, No), STATE_REPLY carries [round, No),
+ * the blocks are modeled by the payload size only
+ */
+void PBFTCorrect::skipTo(uint32_t r, uint32_t source) {
+
+  if (r <= round) return;
+
+  NS_LOG_INFO("skip rounds:"<<round<<"-"<<r<<" at:"<<nodeId);
+
+  bool idle = missingRounds.empty();
+
+  if (!idle && missingRounds.back().second == round) {
+    missingRounds.back().second = r;
+  }
+  else {
+    missingRounds.push_back(std::make_pair(round, r));
+  }
+
+  round = r;
+
+  if (pipelineWindow > 1) {
+    pipeline.erase(pipeline.begin(), pipeline.lower_bound(r));
+  }
+
+  if (idle) {
+    stateSource = source;
+    if (stateSource == nodeId) nextStateSource();
+    requestState();
+  }
+}
+
+
+void PBFTCorrect::nextStateSource() {
+  stateSource = (stateSource + 1) % totalNodes;
+  if (stateSource == nodeId) stateSource = (stateSource + 1) % totalNodes;
+}
+
+
+void PBFTCorrect::requestState() {
+
+  if (missingRounds.empty()) return;
+
+  PBFTMessage msg = message(messageConstantLen);
+  msg.setType(STATE_REQUEST);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setRound(missingRounds.front().first);
+  msg.setNo(missingRounds.front().second);
+
+  sendToNode(std::move(msg), stateSource);
+
+  // the source may be gone, ask the next node if nothing comes back
+  if (checkEventStatus(stateRequestEvent)) {
+    Simulator::Cancel(stateRequestEvent);
+  }
+  stateRequestEvent = Simulator::Schedule(Seconds(timeout), &PBFTCorrect::onStateTimeout, this);
+}
+
+
+void PBFTCorrect::onStateTimeout() {
+
+  if (replicaStat != RUNNING) return;
+
+  nextStateSource();
+  requestState();
+}
+
+
+void PBFTCorrect::onStateRequest(PBFTMessage msg) {
+
+  uint32_t from = msg.getRound();
+
+  // only serve rounds executed here
+  uint32_t to = std::min(std::min(msg.getNo(), round), from + stateChunk);
+
+  for (auto &m : missingRounds) {
+    if (m.first <= from && from < m.second) to = from;
+    else if (from < m.first && m.first < to) to = m.first;
+  }
+
+  if (to < from) to = from;
+
+  NS_LOG_INFO("state request:"<<from<<"-"<<msg.getNo()<<" from:"<<msg.getSignerId()<<" at:"<<nodeId<<" serve to:"<<to);
+
+  uint32_t requester = msg.getSignerId();
+
+  msg.reset(messageConstantLen + (to - from) * blockSize);
+  msg.setType(STATE_REPLY);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setRound(from);
+  msg.setNo(to);
+
+  sendToNode(std::move(msg), requester);
 }
 
 
-void PBFTCorrect::sendBlame() {
+void PBFTCorrect::onStateReply(PBFTMessage msg) {
 
-  // notify an outage possibly due to the leader 
+  if (missingRounds.empty() || msg.getRound() != missingRounds.front().first) return;
 
-  PBFTMessage msg = message(messageConstantLen);
-  msg.setType(BLAME);
+  uint32_t from = msg.getRound();
+  uint32_t to = std::min(msg.getNo(), missingRounds.front().second);
+
+  // nothing to serve, ask the next node right away
+  if (to <= from) {
+    if (msg.getSignerId() == stateSource) {
+      nextStateSource();
+      requestState();
+    }
+    return;
+  }
+
+  NS_LOG_INFO("state transfer:"<<from<<"-"<<to<<" at:"<<nodeId<<" from:"<<msg.getSignerId());
+
+  stateTransferRounds += to - from;
+  stateTransferBytes += msg.getPayloadLen();
+  executedCount += to - from;
+
+  missingRounds.front().first = to;
+  if (to >= missingRounds.front().second) {
+    missingRounds.pop_front();
+  }
+
+  if (missingRounds.empty()) {
+    if (checkEventStatus(stateRequestEvent)) {
+      Simulator::Cancel(stateRequestEvent);
+    }
+  }
+  else {
+    requestState();
+  }
+}
+
+
+void PBFTCorrect::onReply(PBFTMessage msg) {
+
+  NS_LOG_INFO("OnReplay");
+  NS_LOG_INFO("at:"<<nodeId<<" from:"<<msg.getSignerId());
+  NS_LOG_INFO("round:"<<round<<"stage:"<<stage);
+  NS_LOG_INFO("r-round:"<<msg.getRound());
+  NS_LOG_INFO("priamry:"<<primaryId);
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  if (incReplyCount(msg.getRound(), msg.getSignerId()) == totalNodes - 1) {
+
+      NS_LOG_INFO("AllCommitted");
+      NS_LOG_INFO("round:"<<msg.getRound());
+      NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+      NS_LOG_INFO(""); 
+
+      std::cout<<"<all conf: "<<msg.getRound()<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
+  }
+
+  if (nodeId == primaryId && msg.getRound() == round)  {
+    nextRound();
+  }
+}
+
+
+void PBFTCorrect::nextRound() {
+
+  if (getReplyCount() >= quorum) {
+
+    NS_LOG_INFO("MajorityCommitted");
+    NS_LOG_INFO("round:"<<round);
+    NS_LOG_INFO("priamry:"<<primaryId);
+    NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+    NS_LOG_INFO("");
+
+    std::cout<<"<majority conf: "<<round<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
+
+    executed(round);
+
+    // start a new round after honest majority made progress
+    // Todo: piggy-bag this on next pre-prepare message
+    newRound();
+
+    if (continous) {
+      sendRequest();
+    }
+
+  }
+}
+
+
+void PBFTCorrect::sendRequest() {
+
+  NS_LOG_INFO("sendRequest");
+  NS_LOG_INFO("at:"<<nodeId);
+  NS_LOG_INFO("round:"<<round<<"stage:"<<stage);
+  NS_LOG_INFO("priamry:"<<primaryId);
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  PBFTMessage msg = message();
+  msg.setType(REQUEST);
   msg.setSignerId(nodeId);
   msg.setSrcAddr(nodeId);
-  msg.setRound(round);
-  
-  BroadcastPBFT(std::move(msg));
+
+  // before sending, the primary proposes its own request right away
+  awaitingRequest = nodeId != primaryId;
+
+  std::cout<<"<req: "<<round<<" "<<Simulator::Now().GetSeconds()<<" >"<<std::endl<<std::endl;
+
+  sendToPrimary(std::move(msg));
+
+  stage = REQUEST;
+
+  setTimeoutEvent();
+
 }
 
 
-void PBFTCorrect::sendNewEpoch() {
+// the client side, unlike sendRequest the node keeps taking part in rounds it waits on
+void PBFTCorrect::submitRequest(uint32_t reqId, uint32_t bytes) {
+
+  // gossiped to the primary by the mempool
+  if (mempoolOn) {
+    NS_LOG_INFO("submitRequest:"<<reqId<<" at:"<<nodeId<<" bytes:"<<bytes<<" to mempool");
+    mempoolAdd({nodeId, reqId, bytes, 0}, -1);
+    return;
+  }
+
+  PBFTMessage msg = message(bytes);
+  msg.setType(REQUEST);
+  msg.setSignerId(nodeId);
+  msg.setSrcAddr(nodeId);
+  msg.setNo(reqId);
+
+  NS_LOG_INFO("submitRequest:"<<reqId<<" at:"<<nodeId<<" bytes:"<<bytes);
+
+  sendToPrimary(std::move(msg));
+}
 
-  // get a proof that the leader is faulty, or gather enough blames
-  // the proof part is omitted for now
 
-  if (nodeId == getBackupPrimary()) {
-    // assert that this method will only be called by backup primary of the claimed round
+void PBFTCorrect::sendReply() {
 
+  if (stage == COMMIT) {
     PBFTMessage msg = message(messageConstantLen);
-    msg.setType(NEWEPOCH);
+    msg.setType(REPLY);
     msg.setSignerId(nodeId);
     msg.setSrcAddr(nodeId);
     msg.setRound(round);
 
-    BroadcastPBFT(std::move(msg));
+    sendToPrimary(std::move(msg));
   }
 }
 
+
+void PBFTCorrect::sendRequestCircle(double inv) {
+  
+  sendRequest();
+  void (PBFTCorrect::*fp)(double) = &PBFTCorrect::sendRequestCircle;
+  nextRequestEvent = Simulator::Schedule(Seconds(inv), fp, this, inv);
+}
+
+
+void PBFTCorrect::sendBlame() {
+
+  // notify an outage possibly due to the leader
+  startViewChange((stage == NEWEPOCH ? pendingView : view) + 1);
+}
+
  
 void PBFTCorrect::updatePrimary() {
-  primaryId = round % totalNodes;
+  primaryId = view % totalNodes;
 }
 
 
@@ -720,18 +1878,17 @@ bool PBFTCorrect::isPrimary() {
 
 
 bool PBFTCorrect::isBackupPrimary() {
-  return nodeId == round % totalNodes;
+  return nodeId == getBackupPrimary();
 }
 
 
 uint32_t PBFTCorrect::getBackupPrimary() {
-  return round % totalNodes;
+  return (view + 1) % totalNodes;
 }
 
 
-int PBFTCorrect::incCount(std::set<int> &counter, int n) {
-  counter.insert(n);
-  return counter.size();
+int PBFTCorrect::incCount(VoteCounter &counter, int n) {
+  return counter.insert(n);
 }
 
 
@@ -752,11 +1909,44 @@ int PBFTCorrect::incBlameCount(int n) {
 
 int PBFTCorrect::incReplyCount(int r, int n) {
 
-  if ( (int) replyCount.size() <= r) {
-    replyCount.resize(r + 10);
+  VoteCounter *counter = getReplyCounter(r, true);
+
+  // a reply of a round already recycled
+  if (counter == NULL) return 0;
+
+  return incCount(*counter, n);
+}
+
+
+int PBFTCorrect::getReplyCount() {
+  VoteCounter *counter = getReplyCounter(round, false);
+  return counter == NULL ? 0 : counter->size();
+}
+
+
+VoteCounter* PBFTCorrect::getReplyCounter(uint32_t r, bool take) {
+
+  if (replyCount.empty()) {
+    // the pipeline may have a full window of rounds waiting for replies
+    uint32_t sz = std::max(replyRingSize, 2 * pipelineWindow);
+    replyCount.assign(sz, VoteCounter(totalNodes));
+    replyRound.assign(sz, std::numeric_limits<uint32_t>::max());
   }
 
-  return incCount(replyCount[r], n);
+  size_t slot = r % replyCount.size();
+
+  if (replyRound[slot] == r) return &replyCount[slot];
+
+  if (!take) return NULL;
+
+  // only a slot of an executed round is recycled, and never by an older round
+  if (replyRound[slot] != std::numeric_limits<uint32_t>::max() && 
+      (replyRound[slot] >= round || replyRound[slot] > r)) return NULL;
+
+  replyCount[slot].clear();
+  replyRound[slot] = r;
+
+  return &replyCount[slot];
 }
 
 
@@ -773,7 +1963,6 @@ void PBFTCorrect::newRound() {
   prepareCount.clear();
   commitCount.clear();
   blameCount.clear();
-  newEpochCount.clear();
   messageRecvPool.clear();
 
   invokePending();
@@ -787,12 +1976,17 @@ void PBFTCorrect::discardRound() {
   firstPreprepare = true;
   prepareCount.clear();
   commitCount.clear();
-  if (round < replyCount.size()) {
-    replyCount[round].clear();
+  VoteCounter *replies = getReplyCounter(round, false);
+  if (replies != NULL) {
+    replies->clear();
   }
   newEpochCount.clear();
   messageRecvPool.clear();
 
+  // in-flight sequence numbers are given up as well, the new primary restarts from the low watermark
+  pipeline.clear();
+  nextSeq = round;
+
   invokePending();
 
 }
@@ -810,6 +2004,11 @@ void PBFTCorrect::setStage(int s) {
 
 void PBFTCorrect::setTotalNode(int n) {
   totalNodes = n;
+
+  prepareCount.resize(n);
+  commitCount.resize(n);
+  blameCount.resize(n);
+  newEpochCount.resize(n);
 }
 
 
@@ -839,6 +2038,8 @@ void PBFTCorrect::sendToRoot(PBFTMessage msg, int duplicates) {
     corePeerMetric.pop();
   }
 
+  stampHop(msg);
+
   for (auto r: sentList) {
     root = r.first;
     corePeerMetric.push(r);
@@ -864,6 +2065,16 @@ void PBFTCorrect::BroadcastPBFT(PBFTMessage msg) {
 
   // todo: how to enforce that all possible relayType are processed grammaly ? (like match)
 
+  if (voteAggregation && (msg.getType() == PREPARE || msg.getType() == COMMIT)) {
+    castVote(msg.getType(), msg.getRound());
+    return;
+  }
+
+  if (isSendSaturated()) {
+    NS_LOG_INFO("node " << nodeId << " broadcasting with a saturated send queue, backlog: " 
+      << getSendBacklogBytes() << " bytes");
+  }
+
 	if (relayType == ConsensusMessageBase::RELAY) {
 
 		msg.setTransportType(ConsensusMessageBase::RELAY);
@@ -921,6 +2132,19 @@ void PBFTCorrect::BroadcastPBFT(PBFTMessage msg) {
 }
 
 
+/**
+ * with a pipeline every live sequence number needs the votes of every signer,
+ * so a queued vote is superseded only by a vote of the same signer, type and sequence number
+ * from a newer view, a vote of an older view is discarded by receivers anyway
+ */
+bool PBFTCorrect::getSupersedeKey(PBFTMessage& msg, uint64_t &key, uint32_t &r) {
+  if (msg.getType() != PREPARE && msg.getType() != COMMIT) return false;
+  key = ((uint64_t) msg.getRound() << 32) | ((uint64_t) (msg.getSignerId() & 0xffffff) << 8) | msg.getType();
+  r = msg.getNo();
+  return true;
+}
+
+
 void PBFTCorrect::BroadcastPBFT(PBFTMessage msg, double delay) {
 
   void (PBFTCorrect::*fp)(PBFTMessage) = &PBFTCorrect::BroadcastPBFT;
@@ -938,13 +2162,19 @@ void PBFTCorrect::BroadcastTest() {
  * send the packet to the primary node
  */
 void PBFTCorrect::sendToPrimary(PBFTMessage msg) {
+  sendToNode(std::move(msg), primaryId);
+}
+
+
+void PBFTCorrect::sendToNode(PBFTMessage msg, uint32_t id) {
 
   msg.setTransportType(ConsensusMessageBase::DIRECT);
 
-  if (primaryId != nodeId) {
-    msg.setDstAddr(primaryId);
+  if (id != nodeId) {
+    msg.setDstAddr(id);
+    stampHop(msg);
     Ptr<Packet> packet = msg.toPacket();
-    sendToPeer(packet, primaryId);
+    sendToPeer(packet, id);
   }
   else {
     if (replicaStat == RUNNING && validateMessage(msg)) {
@@ -954,6 +2184,174 @@ void PBFTCorrect::sendToPrimary(PBFTMessage msg) {
 }
 
 
+void PBFTCorrect::setVoteAggregation(bool on, double cost, double wait) {
+  voteAggregation = on;
+  aggregationCost = cost;
+  aggregationWait = wait;
+}
+
+
+/**
+ * vote aggregation
+ *
+ * a vote enters the aggregate of its <round, type> at the voter and climbs the primary's tree,
+ * every hop merges what it holds before it forwards. a node forwards once its own vote 
+ * and all children are in, or aggregationWait after its first vote otherwise
+ */
+void PBFTCorrect::castVote(uint32_t type, uint32_t r) {
+
+  // aggregates of executed rounds are of no use
+  aggregates.erase(aggregates.begin(), aggregates.lower_bound(std::make_pair(round, (uint32_t) 0)));
+  if (r < round) return;
+
+  PBFTAggregate &agg = aggregates[std::make_pair(r, type)];
+  if (agg.voted) return;
+
+  agg.voted = true;
+  agg.signers.insert(nodeId);
+  agg.merged++;
+
+  flushAggregate(r, type, false);
+}
+
+
+void PBFTCorrect::onAggregateVote(PBFTMessage msg) {
+
+  uint32_t r = msg.getRound();
+  uint32_t type = msg.getProof();
+
+  if (r < round) return;
+
+  PBFTAggregate &agg = aggregates[std::make_pair(r, type)];
+
+  for (auto id : decodeSigners(msg)) {
+    agg.signers.insert(id);
+  }
+  agg.children.insert(msg.getSignerId());
+  agg.merged++;
+
+  flushAggregate(r, type, false);
+}
+
+
+void PBFTCorrect::flushAggregate(uint32_t r, uint32_t type, bool force) {
+
+  auto it = aggregates.find(std::make_pair(r, type));
+  if (it == aggregates.end()) return;
+
+  PBFTAggregate &agg = it->second;
+  if (agg.merged == 0) return;
+
+  if (nodeId == primaryId) {
+    if (agg.flushed || agg.signers.size() <= quorum) return;
+  }
+  else {
+    int children = getAggregationChildren(primaryId).size();
+    bool complete = agg.voted && agg.children.size() >= children;
+
+    if (!(complete || force || agg.flushed)) {
+      if (!checkEventStatus(agg.waitEvent)) {
+        agg.waitEvent = Simulator::Schedule(Seconds(aggregationWait), 
+          &PBFTCorrect::onAggregateWait, this, r, type);
+      }
+      return;
+    }
+  }
+
+  agg.flushed = true;
+  if (checkEventStatus(agg.waitEvent)) {
+    Simulator::Cancel(agg.waitEvent);
+  }
+
+  double cost = aggregationCost * agg.merged;
+  agg.merged = 0;
+
+  if (cost > 0) {
+    Simulator::Schedule(Seconds(cost), &PBFTCorrect::emitAggregate, this, r, type);
+  }
+  else {
+    emitAggregate(r, type);
+  }
+}
+
+
+void PBFTCorrect::onAggregateWait(uint32_t r, uint32_t type) {
+  flushAggregate(r, type, true);
+}
+
+
+// send what the aggregate holds after aggregating, to the parent or as a certificate to all
+void PBFTCorrect::emitAggregate(uint32_t r, uint32_t type) {
+
+  auto it = aggregates.find(std::make_pair(r, type));
+  if (it == aggregates.end()) return;
+
+  PBFTMessage msg = message(messageConstantLen + (totalNodes + 7) / 8);
+  msg.setSignerId(nodeId);
+  msg.setRound(r);
+  msg.setNo(view);
+  msg.setProof(type);
+  encodeSigners(msg, it->second.signers);
+
+  aggregatesSent++;
+
+  if (nodeId == primaryId) {
+    msg.setType(VOTE_CERTIFICATE);
+    BroadcastPBFT(msg);
+    onVoteCertificate(std::move(msg));
+    return;
+  }
+
+  msg.setType(AGGREGATE_VOTE);
+
+  // off the tree, e.g. the primary is no core node, report to the primary directly
+  int parent = getAggregationParent(primaryId);
+  sendToNode(std::move(msg), parent < 0 ? primaryId : parent);
+}
+
+
+// count every signer of the certificate as if its vote arrived alone
+void PBFTCorrect::onVoteCertificate(PBFTMessage msg) {
+
+  PBFTMessage vote = message(messageConstantLen);
+  vote.setType(msg.getProof());
+  vote.setRound(msg.getRound());
+  vote.setNo(msg.getNo());
+  vote.setDstAddr(nodeId);
+
+  for (auto id : decodeSigners(msg)) {
+    if (id == nodeId) continue;
+    vote.setSignerId(id);
+    parseMessage(vote);
+  }
+}
+
+
+// one bit per node in the payload after the constant part
+void PBFTCorrect::encodeSigners(PBFTMessage &msg, VoteCounter &signers) {
+  unsigned char *bitmap = msg.getPayload() + messageConstantLen;
+  for (int id = 0; id < totalNodes; ++id) {
+    if (signers.has(id)) bitmap[id / 8] |= 1 << (id % 8);
+  }
+}
+
+
+std::vector<uint32_t> PBFTCorrect::decodeSigners(PBFTMessage &msg) {
+
+  std::vector<uint32_t> ids;
+
+  if ((int) msg.getPayloadLen() < messageConstantLen) return ids;
+
+  unsigned char *bitmap = msg.getPayload() + messageConstantLen;
+  int bits = std::min((int) (msg.getPayloadLen() - messageConstantLen) * 8, totalNodes);
+
+  for (int id = 0; id < bits; ++id) {
+    if (bitmap[id / 8] & (1 << (id % 8))) ids.push_back(id);
+  }
+  return ids;
+}
+
+
 void PBFTCorrect::setTimeoutEvent() {
 
   clearTimeoutEvent();
@@ -977,19 +2375,48 @@ void PBFTCorrect::clearScheduledEvent() {
     Simulator::Cancel(delayedFlood);
   }
 
+  if (checkEventStatus(batchTimerEvent)) {
+    Simulator::Cancel(batchTimerEvent);
+  }
+
+  if (checkEventStatus(stateRequestEvent)) {
+    Simulator::Cancel(stateRequestEvent);
+  }
+
+  for (auto &a : aggregates) {
+    if (checkEventStatus(a.second.waitEvent)) {
+      Simulator::Cancel(a.second.waitEvent);
+    }
+  }
+
 }
 
 
 void PBFTCorrect::invokePending() {
 
-  if (!pendingRequest.empty()) {
-    onRequest(pendingRequest.front());
+  if (batchingOn()) {
+    tryFlushBatch();
+  }
+
+  if (!pendingRequest.empty() && canPropose()) {
+    PBFTMessage msg = pendingRequest.front();
     pendingRequest.pop();
+    if (pipelineWindow > 1) onRequestPipelined(std::move(msg));
+    else onRequest(std::move(msg));
   }
 
 }
 
 
+void PBFTCorrect::onSendQueueReady() {
+
+  if (nodeId != primaryId) return;
+
+  if (pipelineWindow > 1) fillWindow();
+  else invokePending();
+}
+
+
 void PBFTCorrect::setBlockSize(int sz) {
   blockSize = sz;
 }
@@ -1029,8 +2456,8 @@ double PBFTCorrect::getAverageLatency() {
 
   NS_ASSERT(msgLatencyLogOn == true);
 
-  double latency = 0.0;
-  int count = 0;
+  double latency = truncatedLatency;
+  uint64_t count = truncatedLatencyCount;
 
   for (auto c : recvMsgLog) {
     latency += std::get<1>(c);
@@ -6,12 +6,63 @@
 
 #include "BlockChainApplicationBase.h"
 #include "PBFTMessage.h"
+#include "ns3/histogram.h"
 
 #include <algorithm>
+#include <deque>
 
 
 namespace ns3 {
 
+/**
+ * vote state of one in-flight sequence number in the pipelined mode
+ */
+struct PBFTSlot {
+
+  uint32_t stage = 0;   // PBFT_PRIMITIVE, IDLE until pre-prepared
+
+  VoteCounter prepareCount;
+  VoteCounter commitCount;
+
+  double preprepareTime = -1;
+  double prepareTime = -1;
+
+};
+
+
+/**
+ * votes of one type for one sequence number merged at a node of the aggregation tree
+ */
+struct PBFTAggregate {
+
+  VoteCounter signers;
+  VoteCounter children;   // children that reported
+
+  uint32_t merged = 0;    // vote messages merged since the last flush, each costs one aggregation
+
+  bool voted = false;     // own vote merged
+  bool flushed = false;   // sent to the parent once, later votes are forwarded as they arrive
+
+  EventId waitEvent;
+
+};
+
+
+/**
+ * view-change messages collected for one target view
+ * prepared certificates are modeled by the range of sequence numbers they cover and their size
+ */
+struct PBFTViewChange {
+
+  VoteCounter votes;
+
+  uint32_t low = 0;       // highest low watermark reported, rounds below are committed at some correct node
+  uint32_t high = 0;      // end of the highest prepared certificate reported
+  uint32_t lowSigner = 0; // a node that executed everything below low
+
+};
+
+
 /**
  * PBFT plus
  * basicly Practical Byzantine Fault Tolerance algorithm
@@ -38,14 +89,115 @@ protected:
   int broadcast_duplicates = 1;
 
   uint32_t primaryId;
+
+  /**
+   * view change
+   * the primary of view v is v % totalNodes, a replica that suspects the primary broadcasts a view-change
+   * for the next view carrying its low watermark and prepared certificates, the new primary
+   * collects a quorum of them and re-proposes every sequence number that may have been prepared.
+   * a view-change not followed by a new-view in time moves on to the next view, with a doubled timeout
+   */
+  uint32_t view = 0;
+  uint32_t pendingView = 0;   // target view while in NEWEPOCH stage
+
+  std::map<uint32_t, PBFTViewChange> viewChanges;
+
+  // pre-prepare, prepare and commit of a view not installed yet
+  std::vector<PBFTMessage> futureViewMessages;
+
+  // own request not pre-prepared yet, resent to a new primary
+  bool awaitingRequest = false;
+  // a request broadcast by a client, the primary is suspected if it is not pre-prepared in time
+  bool requestWatched = false;
+
+  void startViewChange(uint32_t v);
+  int recordViewChange(uint32_t v, uint32_t signer, uint32_t low, uint32_t high);
+  void installView(uint32_t v, uint32_t low, uint32_t high, uint32_t source);
+  void resumeView(uint32_t high);
+
+  /**
+   * failover latency
+   * view change: first suspicion of the primary to the new view installed
+   * outage: last execution before the view change to the first execution after it
+   */
+  double viewChangeStart = -1;
+  double viewChangeDuration = 0;
+  double lastExecuteTime = 0;
+  bool failoverPending = false;
+
+  // <view, view change, outage>
+  std::vector<std::tuple<uint32_t, double, double> > failoverLog;
+
+  void executed(uint32_t r);
+
+  /**
+   * state transfer
+   * a replica that has to skip rounds it did not execute (new view, pre-prepare or stable checkpoint
+   * above its low watermark) keeps consensus going from the new round and fetches the committed
+   * rounds from a peer in chunks of stateChunk rounds
+   */
+  std::deque<std::pair<uint32_t, uint32_t> > missingRounds;
+  uint32_t stateSource = 0;
+  uint32_t stateChunk = 16;
+
+  uint32_t stateTransferRounds = 0;
+  uint64_t stateTransferBytes = 0;
+
+  EventId stateRequestEvent;
+
+  void skipTo(uint32_t r, uint32_t source);
+  void nextStateSource();
+  void requestState();
+  void onStateTimeout();
+  void onStateRequest(PBFTMessage msg);
+  void onStateReply(PBFTMessage msg);
+
+  /**
+   * vote aggregation
+   * prepares and commits climb the primary's small packet tree instead of being broadcast,
+   * an interior node merges the votes of its children with its own into one message 
+   * (signer bitmap plus a constant size aggregated signature) and forwards it to its parent.
+   * the primary broadcasts a certificate once it holds a quorum of signers.
+   * a node waits aggregationWait seconds for slow children and spends aggregationCost seconds per merged vote
+   */
+  bool voteAggregation = false;
+  double aggregationCost = 0;     // second
+  double aggregationWait = 0.2;   // second
+
+  // <round, vote type>
+  std::map<std::pair<uint32_t, uint32_t>, PBFTAggregate> aggregates;
+
+  uint32_t aggregatesSent = 0;
+
+  void castVote(uint32_t type, uint32_t r);
+  void flushAggregate(uint32_t r, uint32_t type, bool force);
+  void onAggregateWait(uint32_t r, uint32_t type);
+  void emitAggregate(uint32_t r, uint32_t type);
+
+  void encodeSigners(PBFTMessage &msg, VoteCounter &signers);
+  std::vector<uint32_t> decodeSigners(PBFTMessage &msg);
+
+  void onAggregateVote(PBFTMessage msg);
+  void onVoteCertificate(PBFTMessage msg);
   
-  std::set<int> prepareCount;
-  std::set<int> commitCount;
-  std::set<int> blameCount;
+  VoteCounter prepareCount;
+  VoteCounter commitCount;
+  VoteCounter blameCount;
+
+  VoteCounter newEpochCount;
 
-  std::set<int> newEpochCount;
+  /**
+   * ring of per-round reply counters, round r is counted at slot r % size
+   * and the slot is recycled by a newer round once r has been executed; a reply for a round
+   * whose slot still counts an unexecuted round is dropped, the ring covers 2 * pipelineWindow rounds
+   */
+  std::vector<VoteCounter> replyCount;
+  std::vector<uint32_t> replyRound;  // round counted by each slot
 
-  std::vector<std::set<int> > replyCount;
+  uint32_t replyRingSize = 16;
+
+  // NULL if round r has no slot, take a slot for it if asked and the slot is free to recycle
+  VoteCounter* getReplyCounter(uint32_t r, bool take);
 
   EventId nextRequestEvent;
 
@@ -67,11 +219,140 @@ protected:
   // for latency statistic
   std::vector <std::tuple<u_int32_t, double, u_int64_t>> recvMsgLog;
 
+  // latency of log entries already truncated by a stable checkpoint
+  double truncatedLatency = 0;
+  uint64_t truncatedLatencyCount = 0;
+
+  /**
+   * checkpoints, every checkpointInterval executed rounds a node broadcasts a digest of its state,
+   * a quorum of matching digests makes the checkpoint stable and all state below it is discarded.
+   * in the pipelined mode the primary does not run more than two intervals ahead of the stable checkpoint.
+   * 0 disables checkpointing
+   */
+  uint32_t checkpointInterval = 0;
+  int lastStableCheckpoint = -1;
+
+  // round, signers of a matching digest
+  std::map<uint32_t, VoteCounter> checkpointVotes;
+
+  // checkpoint traffic overhead
+  uint32_t checkpointSent = 0;
+  uint64_t checkpointRecvBytes = 0;
+
+  // pre-prepare traffic, compact blocks and the transactions they fetch included
+  uint64_t blockRecvBytes = 0;
+
+  // backups only, pre-prepare sent by the primary to received complete
+  double blockPropagation = 0;
+  uint32_t blockPropagationCount = 0;
+  uint64_t totalRecvBytes = 0;
+  uint64_t totalRecvMessages = 0;
+
+  uint32_t checkpointDigest(uint32_t r);
+  void sendCheckpoint(uint32_t r);
+  void onCheckpoint(PBFTMessage msg);
+  void stableCheckpoint(uint32_t r);
+
   PBFTMessage message();
   PBFTMessage message(int l);
 
   std::queue<PBFTMessage> pendingRequest;
 
+  /**
+   * pipelined mode, enabled with a window larger than 1
+   * round is the low watermark, i.e. the lowest sequence number not executed yet,
+   * the primary keeps sequence numbers in [round, round + pipelineWindow) in flight
+   */
+  uint32_t pipelineWindow = 1;
+
+  // primary only, next sequence number to assign
+  uint32_t nextSeq = 0;
+
+  // in-flight sequence numbers
+  std::map<uint32_t, PBFTSlot> pipeline;
+
+  uint32_t executedCount = 0;
+
+  // backups only, pre-prepare received to executed
+  double commitLatency = 0;
+  uint32_t commitLatencyCount = 0;
+
+  void onRequestPipelined(PBFTMessage msg);
+  void onPrepreparePipelined(PBFTMessage msg);
+  void onPreparePipelined(PBFTMessage msg);
+  void onCommitPipelined(PBFTMessage msg);
+  void onReplyPipelined(PBFTMessage msg);
+
+  /**
+   * request batching at the primary, disabled unless a count limit above 1 or a byte limit is set
+   * a batch is proposed once it hits a limit or its oldest request waited batchMaxDelay,
+   * and as soon as the protocol can take a new proposal after that; with no delay limit
+   * a partial batch is proposed whenever the protocol can take one
+   */
+  uint32_t batchMaxCount = 1;   // 0 for no count limit
+  uint32_t batchMaxBytes = 0;   // 0 for no byte limit
+  double batchMaxDelay = 0;     // second, 0 for no delay limit
+
+  // <arrival time, payload bytes> of requests waiting for a batch
+  std::deque<std::pair<double, uint32_t> > batchBuffer;
+  uint32_t batchBytes = 0;
+  bool batchDue = false;
+
+  EventId batchTimerEvent;
+
+  // <client, request id> of the buffered requests, in step with batchBuffer
+  std::deque<std::pair<uint32_t, uint32_t> > batchClients;
+
+  // payload bytes of the next pre-prepare besides messageConstantLen
+  uint32_t proposalBytes = 0;
+
+  /**
+   * requests a workload client waits on, <client, request id>, id 0 is not tracked
+   * the primary remembers them per sequence number and tells each client once a majority executed it
+   */
+  std::vector<std::pair<uint32_t, uint32_t> > proposalRequests;
+  std::map<uint32_t, std::vector<std::pair<uint32_t, uint32_t> > > clientRequests;
+
+  void trackProposal(PBFTMessage &msg, uint32_t n);
+  void replyClients(uint32_t r);
+
+  /**
+   * mempool on, a pre-prepare lists the <client, request id> it orders after the constant part,
+   * backups keep them per sequence number and drop them from their mempool once executed
+   */
+  std::map<uint32_t, std::vector<std::pair<uint32_t, uint32_t> > > blockTxs;
+
+  uint32_t txListLen(uint32_t n);
+  void encodeTxs(PBFTMessage &msg, uint32_t n);
+  void decodeTxs(PBFTMessage &msg);
+
+  // the primary stamps the proposal time in the constant part of a pre-prepare
+  void stampProposal(PBFTMessage &msg);
+  void trackPropagation(PBFTMessage &msg);
+
+  virtual void sendTransaction(const MempoolTx &tx, int peer);
+  virtual void onMempoolTx(const MempoolTx &tx);
+  std::set<uint64_t> queuedTxs();
+
+  Histogram batchSizeHistogram;   // requests per proposal
+  Histogram batchDelayHistogram;  // second, request arrival to proposal
+
+  bool batchingOn() {return batchMaxCount > 1 || batchMaxBytes > 0;}
+  int voteSize(PBFTMessage &proposal);
+  bool canPropose();
+
+  void onBatchRequest(PBFTMessage msg);
+  void onBatchTimeout();
+  void tryFlushBatch();
+
+  void propose(PBFTMessage msg);
+  void issuePreprepare(PBFTMessage msg);
+  void preparedSeq(uint32_t n);
+  void committedSeq(uint32_t n);
+  void executeInOrder();
+  void advanceWatermark();
+  void fillWindow();
+
   template<class MessageType>
   bool validateMessage(MessageType& msg);
 
@@ -80,6 +361,9 @@ protected:
   virtual void DoDispose(void);
 
   void invokePending();
+  virtual void onSendQueueReady();
+
+  virtual bool getSupersedeKey(PBFTMessage& msg, uint64_t &key, uint32_t &r);
 
 public:
 
@@ -95,7 +379,19 @@ public:
     REPLY,
 
     NEWEPOCH,
-    CONFIRM_NEWEPOCH
+    CONFIRM_NEWEPOCH,
+
+    CHECKPOINT,
+
+    STATE_REQUEST,
+    STATE_REPLY,
+
+    AGGREGATE_VOTE,
+    VOTE_CERTIFICATE,
+
+    CLIENT_REPLY,
+
+    TRANSACTION     // mempool gossip between direct peers, proof: client, no: request id
   };
   
   static TypeId GetTypeId (void);
@@ -134,10 +430,12 @@ public:
 
   void sendRequest();
   void sendRequestCircle(double inv);
+
+  virtual void submitRequest(uint32_t reqId, uint32_t bytes);
   void sendReply();
 
   void sendBlame();
-  void sendNewEpoch();
+  void sendNewEpoch(uint32_t v);
 
   void RecvCallback (Ptr<Socket> socket);
 
@@ -146,6 +444,7 @@ public:
   uint32_t getBackupPrimary();
 
   void sendToPrimary(PBFTMessage msg);
+  void sendToNode(PBFTMessage msg, uint32_t id);
 
   void sendToRoot(PBFTMessage msg, int duplicates);
 
@@ -157,7 +456,7 @@ public:
   void newRound();
   void discardRound();
 
-  int incCount(std::set<int> &counter, int n);
+  int incCount(VoteCounter &counter, int n);
 
   int incPrepareCount(int n);
   int incCommitCount(int n);
@@ -179,13 +478,49 @@ public:
 
   void setBroadcastDuplicateCount(int c) {broadcast_duplicates = c;}
 
+  void setPipelineWindow(uint32_t w) {pipelineWindow = w;}
+
+  void setBatchPolicy(uint32_t maxCount, uint32_t maxBytes, double maxDelay);
+
+  void setCheckpointInterval(uint32_t k) {checkpointInterval = k;}
+  int getLastStableCheckpoint() {return lastStableCheckpoint;}
+  uint32_t getCheckpointSent() {return checkpointSent;}
+  uint64_t getCheckpointRecvBytes() {return checkpointRecvBytes;}
+  uint64_t getBlockRecvBytes() {return blockRecvBytes;}
+  double getAverageBlockPropagation() {return blockPropagationCount == 0 ? 0 : blockPropagation / blockPropagationCount;}
+  uint64_t getTotalRecvBytes() {return totalRecvBytes;}
+  uint64_t getTotalRecvMessages() {return totalRecvMessages;}
+
+  void setVoteAggregation(bool on, double cost, double wait);
+  uint32_t getAggregatesSent() {return aggregatesSent;}
+
+  void setStateTransferChunk(uint32_t c) {stateChunk = c;}
+  uint32_t getStateTransferRounds() {return stateTransferRounds;}
+  uint64_t getStateTransferBytes() {return stateTransferBytes;}
+
+  inline uint32_t getView() {return view;}
+  std::vector<std::tuple<uint32_t, double, double> >& getFailoverLog() {return failoverLog;}
+
+  // entries kept in the recv pool, latency log and vote tables, flat if state is truncated
+  size_t getRetainedStateSize();
+  Histogram& getBatchSizeHistogram() {return batchSizeHistogram;}
+  Histogram& getBatchDelayHistogram() {return batchDelayHistogram;}
+  uint32_t getPipelineWindow() {return pipelineWindow;}
+
+  // number of sequence numbers executed in order, by the primary: confirmed by a majority
+  uint32_t getExecutedCount() {return executedCount;}
+  int getInflightCount() {return pipeline.size();}
+
+  // second, averaged over rounds executed by a backup, 0 at the primary
+  double getAverageCommitLatency() {return commitLatencyCount == 0 ? 0 : commitLatency / commitLatencyCount;}
+
   inline int getRound() {return round;}
   inline int getStage() {return stage;}
   
   int getPrepareCount() {return prepareCount.size();}
   int getCommitCount() {return commitCount.size();}
   int getBlameCount() {return blameCount.size();}
-  int getReplyCount() {return replyCount.size() > round ? replyCount[round].size() : 0;}
+  int getReplyCount();
   int getNewEpochCount() {return newEpochCount.size();}
   int getPrimary() {return primaryId;}
 
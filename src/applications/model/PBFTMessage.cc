@@ -123,6 +123,17 @@ void PBFTMessage::reset(int payloadLen) {
 }
 
 
+void PBFTMessage::setPayload(unsigned char const payload[], uint32_t len) {
+
+  delete[] mPayload;
+
+  mLenPayload = len;
+  mPayload = new unsigned char[mLenPayload]();
+  memcpy(mPayload, payload, mLenPayload);
+
+}
+
+
 std::ostringstream PBFTMessage::serialization() {
     std::ostringstream out = ConsensusMessageBase::serialization();
     out.write((const char*) &mMagic, 1);
@@ -133,6 +144,7 @@ std::ostringstream PBFTMessage::serialization() {
     out.write((const char*) &mSignerId, 4);
     out.write((const char*) &mProof, 4);
     out.write((const char*) mPayload, mLenPayload);
+    serializeProvenance(out);
     return out;
 }
 
@@ -149,7 +161,11 @@ int PBFTMessage::deserialization(int size, unsigned char const serialInput[]) {
 
   switch (mBlockType) {
   
+  // compact blocks and their transaction requests differ in the payload only
   case ConsensusMessageBase::NORMAL_BLOCK:
+  case ConsensusMessageBase::COMPACT_HEAD:
+  case ConsensusMessageBase::REQUIRE:
+  case ConsensusMessageBase::BLOCK_TXN:
 
     size -= 1;
     if (size < 0) return 1;
@@ -194,29 +210,14 @@ int PBFTMessage::deserialization(int size, unsigned char const serialInput[]) {
     size -= mLenPayload;
     if (size < 0) return 1;
     memcpy(mPayload, serialInput, mLenPayload);
+    serialInput += mLenPayload;
 
-    return 0;
-
-    break;
-  
-  case ConsensusMessageBase::COMPACT_HEAD:
-  case ConsensusMessageBase::REQUIRE:
-    
-    size -= 4;
-    if (size < 0) return 1;
-    memcpy(&compactHeadSize, serialInput, 4);
-    serialInput += 4;
-
-    size -= compactHeadSize;
-    if (size < 0) return 1;
-    /**
-     * TODO: unsafe
-     */  
-    if (compactHead) {
-      delete[] compactHead;
+    // anything left is the optional provenance trailer
+    if (size > 0) {
+      return deserializeProvenance(size, serialInput) == 0 ? 0 : 1;
     }
-    compactHead = new unsigned char[compactHeadSize];
-    memcpy(compactHead, serialInput, compactHeadSize);
+
+    return 0;
 
     break;
   }
@@ -241,28 +242,12 @@ Ptr<Packet> PBFTMessage::toPacket() {
 
   switch (mBlockType) {
   case ConsensusMessageBase::NORMAL_BLOCK:
-    {
-      std::ostringstream msgStream(std::stringstream::binary);
-      msgStream = serialization();
-      pkt = Create<Packet> ((uint8_t*) msgStream.str().c_str(), msgStream.str().length());
-      return pkt;
-    }
   case ConsensusMessageBase::COMPACT_HEAD:
-    {
-      std::ostringstream msgStream(std::stringstream::binary);
-      msgStream = ConsensusMessageBase::serialization();
-      packHead();
-      msgStream.write((const char*) compactHeadSize, 4);
-      msgStream.write((const char*) compactHead, compactHeadSize);
-      pkt = Create<Packet> ((uint8_t*) msgStream.str().c_str(), msgStream.str().length());
-      return pkt;
-    }
   case ConsensusMessageBase::REQUIRE:
+  case ConsensusMessageBase::BLOCK_TXN:
     {
       std::ostringstream msgStream(std::stringstream::binary);
-      msgStream = ConsensusMessageBase::serialization();
-      msgStream.write((const char*) compactHeadSize, 4);
-      msgStream.write((const char*) compactHead, compactHeadSize);
+      msgStream = serialization();
       pkt = Create<Packet> ((uint8_t*) msgStream.str().c_str(), msgStream.str().length());
       return pkt;
     }
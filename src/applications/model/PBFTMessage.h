@@ -36,6 +36,9 @@ public:
   void reset();
   void reset(int payloadLen);
 
+  // replace the payload, other fields kept
+  void setPayload(unsigned char const payload[], uint32_t len);
+
   std::ostringstream serialization();
 
   int deserialization(int size, unsigned char const serialInput[]);
@@ -75,6 +78,12 @@ public:
   inline uint32_t getProof() {return mProof;}
 
 
+  inline uint32_t getPayloadLen() {return mLenPayload;}
+
+
+  inline unsigned char* getPayload() {return mPayload;}
+
+
   uint64_t uniqueMessageSeq();
 
 };
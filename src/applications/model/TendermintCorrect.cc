@@ -1,12 +1,12 @@
 // Yiqing Zhu
 // yiqing.zhu.314@gmail.com
 
-//unfinished
-
 #include "TendermintCorrect.h"
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
-
+#include <iostream>
+#include <algorithm>
+#include <cryptopp/sm3.h>
 
 
 namespace ns3 {
@@ -15,65 +15,167 @@ NS_OBJECT_ENSURE_REGISTERED(TendermintCorrect);
 
 NS_LOG_COMPONENT_DEFINE("TendermintCorrect");
 
+
+// signers of key in counter, 0 if none
+template <typename K>
+static int countOf(std::map<K, VoteCounter> &counter, const K &key) {
+  auto it = counter.find(key);
+  return it == counter.end() ? 0 : it->second.size();
+}
+
+
+/*
+ * merkle tree of the block parts, SM3 as in PBFTMessage::packHead,
+ * an odd node is paired with itself so that every proof is merkleDepth hashes long
+ */
+
+static const uint32_t hashLen = 32;
+
+static std::string sm3(const std::string &in) {
+  CryptoPP::SM3 hash;
+  std::string digest;
+  hash.Update((const CryptoPP::byte*) in.data(), in.size());
+  digest.resize(hash.DigestSize());
+  hash.Final((CryptoPP::byte*) &digest[0]);
+  return digest;
+}
+
+
+static uint32_t merkleDepth(uint32_t n) {
+  uint32_t d = 0;
+  while (((uint32_t) 1 << d) < n) d++;
+  return d;
+}
+
+
+static std::string partLeaf(uint32_t v, uint32_t i, const unsigned char *data, uint32_t len) {
+  std::string in((const char*) &v, 4);
+  in.append((const char*) &i, 4);
+  in.append((const char*) data, len);
+  return sm3(in);
+}
+
+
+static std::string merkleRoot(std::vector<std::string> level) {
+  if (level.empty()) return std::string(hashLen, 0);
+  while (level.size() > 1) {
+    std::vector<std::string> up;
+    for (size_t k = 0; k < level.size(); k += 2) {
+      up.push_back(sm3(level[k] + level[std::min(k + 1, level.size() - 1)]));
+    }
+    level.swap(up);
+  }
+  return level[0];
+}
+
+
+static std::vector<std::string> merkleProof(std::vector<std::string> level, uint32_t i) {
+  std::vector<std::string> proof;
+  while (level.size() > 1) {
+    proof.push_back(level[std::min((size_t) (i ^ 1), level.size() - 1)]);
+    std::vector<std::string> up;
+    for (size_t k = 0; k < level.size(); k += 2) {
+      up.push_back(sm3(level[k] + level[std::min(k + 1, level.size() - 1)]));
+    }
+    level.swap(up);
+    i /= 2;
+  }
+  return proof;
+}
+
+
+static bool merkleVerify(std::string h, uint32_t i, const std::vector<std::string> &proof, const std::string &root) {
+  for (auto &sibling : proof) {
+    h = (i & 1) ? sm3(sibling + h) : sm3(h + sibling);
+    i /= 2;
+  }
+  return h == root;
+}
+
+
 TypeId TendermintCorrect::GetTypeId (void) {
   static TypeId tid = TypeId ("ns3::TendermintCorrect")
     .SetParent<Application> ()
     .SetGroupName("Applications")
     .AddConstructor<TendermintCorrect> ()
     .AddTraceSource("Rx",
-                    "A packet has been received", 
+                    "A packet has been received",
                     MakeTraceSourceAccessor(&TendermintCorrect::mRxTrace),
-                    "ns3::Packet::TracedCallback");
+                    "ns3::Packet::TracedCallback")
+    .AddTraceSource("Provenance",
+                    "A message carrying a provenance trailer is delivered for the first time",
+                    MakeTraceSourceAccessor(&TendermintCorrect::mProvenanceTrace),
+                    "ns3::BlockChainApplicationBase::ProvenanceTracedCallback")
+    .AddTraceSource("SendQueueDepth",
+                    "Number of sends waiting in the sequencial send queue",
+                    MakeTraceSourceAccessor(&TendermintCorrect::mSendQueueDepth),
+                    "ns3::TracedValueCallback::Uint32")
+    .AddTraceSource("SendQueueBytes",
+                    "Bytes waiting in the sequencial send queue",
+                    MakeTraceSourceAccessor(&TendermintCorrect::mSendQueueBytes),
+                    "ns3::TracedValueCallback::Uint64")
+    .AddTraceSource("QueueingDelay",
+                    "Seconds the latest started send waited in the queue, SEQUENCIAL transfer model only",
+                    MakeTraceSourceAccessor(&TendermintCorrect::mQueueingDelay),
+                    "ns3::TracedValueCallback::Double")
+    .AddTraceSource("SendQueueDrops",
+                    "Number of sends dropped or coalesced by a bounded send queue, SEQUENCIAL transfer model only",
+                    MakeTraceSourceAccessor(&TendermintCorrect::mSendQueueDrops),
+                    "ns3::TracedValueCallback::Uint32");
   return tid;
 }
 
-TendermintCorrect::TendermintCorrect() {
-  step = TendermintMessage::PROPOSAL;
-}
-  
-TendermintCorrect::~TendermintCorrect() {
 
+void TendermintCorrect::DoDispose (void) {
+  BlockChainApplicationBase::DoDispose ();
 }
 
-void TendermintCorrect::StartApplication(void) {
 
+TendermintCorrect::TendermintCorrect(void) {}
+
+
+TendermintCorrect::~TendermintCorrect(void) {}
+
+
+void TendermintCorrect::StartApplication() {
+
+  // chain up with superclass setups
   BlockChainApplicationBase::StartApplication();
-    
+
+  // setup listening socket
   mListeningSocket->Listen();
   mListeningSocket->ShutdownSend();
-  
+
   mListeningSocket->SetRecvCallback(MakeCallback(&TendermintCorrect::RecvCallback, this));
   mListeningSocket->SetAcceptCallback(MakeNullCallback<bool, Ptr<Socket>, const Address &> (),
                                       MakeCallback(&TendermintCorrect::AcceptCallback, this));
   mListeningSocket->SetCloseCallbacks(MakeCallback(&TendermintCorrect::NormalCloseCallback, this),
                                       MakeCallback(&TendermintCorrect::ErrorCloseCallback, this));
 
-  for (auto address : mPeerAddress) {
-    Ptr<Socket> sock = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
-    InetSocketAddress peer = InetSocketAddress(Ipv4Address::ConvertFrom(address.second), port);
-    sock->Connect(peer);
-    mPeerSockets.insert(std::pair<int,Ptr<Socket>>(address.first, sock));
-  }
+  startRound(0);
+}
 
-	decision.push_back(TENDERMINT_NIL);
 
-	startRound(0);
+void TendermintCorrect::StopApplication() {
 
-}
+  BlockChainApplicationBase::StopApplication();
 
+  clearDelaySendEvent();
+  clearTimeouts();
 
-void TendermintCorrect::StopApplication(void) {
-	BlockChainApplicationBase::StopApplication();
-  clearTimeoutEvent();
-} 
-
+  if (checkEventStatus(delayedBroadcast)) {
+    Simulator::Cancel(delayedBroadcast);
+  }
 
-void TendermintCorrect::DoDispose(void) {
-  Application::DoDispose ();
+  if (checkEventStatus(delayedFlood)) {
+    Simulator::Cancel(delayedFlood);
+  }
 }
 
 
-void TendermintCorrect::RecvCallback (Ptr<Socket> socket) {
+void TendermintCorrect::RecvCallback (Ptr<Socket> sock) {
+
+  if (replicaStat != RUNNING) return;
 
   Ptr<Packet> packet = sock->Recv();
 
@@ -83,428 +185,838 @@ void TendermintCorrect::RecvCallback (Ptr<Socket> socket) {
   uint8_t *buffer = new uint8_t[payloadSize];
   packet->CopyData(buffer, payloadSize);
   try {
-    TendermintMessage msg(blockSize);
+    TendermintMessage msg = message(blockSize);
     msg.deserialization(payloadSize, buffer);
-    onMessageCallback(msg);
+
+    samplePeer(msg, payloadSize);
+
+    totalRecvMessages++;
+    totalRecvBytes += payloadSize;
+
+    onMessageCallback(std::move(msg));
   }
   catch(const std::exception& e) {
+    std::cerr << "parser message failed" << std::endl;
+  }
+  delete[] buffer;
+}
+
+
+void TendermintCorrect::parseMessage(TendermintMessage msg) {
+
+  if (msg.getDstAddr() != nodeId
+    && msg.getDstAddr() != std::numeric_limits<uint32_t>::infinity()) return;
+
+  if (msg.getType() == TendermintMessage::REQUEST) {
+    onRequest(std::move(msg));
+    return;
+  }
+
+  if (msg.getType() == TendermintMessage::TRANSACTION) {
+    mempoolAdd({msg.getValidRound(), msg.getValueId(), msg.getPayloadLen(), 0}, msg.getSignerId());
+    return;
+  }
+
+  uint32_t h = msg.getHeight();
+
+  if (h < height) return;
+
+  if (h > height) {
+    futureMessages[h].push_back(std::move(msg));
     return;
   }
 
+  uint32_t r = msg.getRound();
+
+  if (msg.getType() != TendermintMessage::BLOCK_PART && msg.getType() != TendermintMessage::PART_STATE) {
+    roundSigners[r].insert(msg.getSignerId());
+  }
+
+  switch (msg.getType()) {
+    case TendermintMessage::PROPOSAL:
+      onProposal(std::move(msg));
+      break;
+    case TendermintMessage::BLOCK_PART:
+      onBlockPart(std::move(msg));
+      break;
+    case TendermintMessage::PART_STATE:
+      onPartState(std::move(msg));
+      break;
+    case TendermintMessage::PRE_VOTE:
+      onPreVote(std::move(msg));
+      break;
+    case TendermintMessage::PRE_COMMIT:
+      onPreCommit(std::move(msg));
+      break;
+    default:
+      std::cerr << "Bad type" << std::endl;
+      break;
+  }
 }
 
-void TendermintCorrect::onTimeoutCallback(void) {
+
+void TendermintCorrect::onRequest(TendermintMessage msg) {
+
+  // every replica hears a broadcast request, no gossip
+  MempoolTx tx = {msg.getSignerId(), msg.getValueId(), msg.getPayloadLen(), Simulator::Now().GetSeconds()};
+
+  if (mempool.add(tx)) {
+    onMempoolTx(tx);
+  }
 }
 
 
-void TendermintCorrect::onTimeoutProposeCallback(void) {
-	if (height == proposeTimeoutHeight && round == proposeTimeoutRound && step == PROPOSAL) {
-		TendermintMessage msg;
-		msg.setType(TendermintMessage::PRE_VOTE);
-		msg.setSignerId(nodeId);
-		msg.setRound(round);
-		msg.setHeight(height);
-		msg.setValueId(TENDERMINT_NIL);
-		BroadcastTendermint(msg);
-		step = TendermintMessage::PRE_VOTE;
-	}
+void TendermintCorrect::onMempoolTx(const MempoolTx &tx) {
+
+  // idle until now, start the round
+  if (step == STEP_PROPOSE && !proposed) {
+    if (proposer(height, round) == nodeId) {
+      propose();
+      upon(round);
+    }
+    else if (!checkEventStatus(timeoutProposeEvent)) {
+      scheduleTimeout(TendermintMessage::PROPOSAL);
+    }
+  }
 }
 
 
-void TendermintCorrect::onTimeoutPrevoteCallback(void) {
-	if (height == prevoteTimeoutHeight && round == prevoteTimeoutRound && step == PRE_VOTE) {
-		TendermintMessage msg;
-		msg.setType(PRE_COMMIT);
-		msg.setSignerId(nodeId);
-		msg.setRound(round);
-		msg.setHeight(height);
-		msg.setValueId(TENDERMINT_NIL);
-		BroadcastTendermint(msg);
-		step = PRE_COMMIT;
-	}
+void TendermintCorrect::submitRequest(uint32_t reqId, uint32_t bytes) {
+
+  if (mempoolOn) {
+    mempoolAdd({nodeId, reqId, bytes, 0}, -1);
+    return;
+  }
+
+  TendermintMessage msg = message(bytes);
+  msg.setType(TendermintMessage::REQUEST);
+  msg.setSignerId(nodeId);
+  msg.setHeight(height);
+  msg.setValueId(reqId);
+
+  broadcast(msg, relayType);
+
+  onRequest(std::move(msg));
+}
+
+
+void TendermintCorrect::sendTransaction(const MempoolTx &tx, int peer) {
+
+  TendermintMessage msg = message(tx.bytes);
+  msg.setType(TendermintMessage::TRANSACTION);
+  msg.setSignerId(nodeId);
+  msg.setHeight(height);
+  msg.setValidRound(tx.client);
+  msg.setValueId(tx.reqId);
+
+  sendToNode(std::move(msg), peer);
+}
+
+
+bool TendermintCorrect::hasWork() {
+  return continous || mempool.size() > 0 || validValue != TENDERMINT_NIL;
 }
 
 
-void TendermintCorrect::onTimeoutPrecommitCallback(void) {
-	if (height == precommitTimeoutHeight && round == precommitTimeoutRound) {
-		startRound(round + 1);
-	}
+bool TendermintCorrect::isComplete(uint32_t v) {
+  auto it = values.find(v);
+  return it != values.end() && it->second.header && it->second.received.size() >= it->second.parts;
 }
 
 
-void TendermintCorrect::setTimeoutEvent(void) {
-  
-	clearTimeoutEvent();
+void TendermintCorrect::startRound(uint32_t r) {
 
-  void (TendermintCorrect::*fp)(void) = &TendermintCorrect::onTimeoutCallback;
-  timeoutEvent = Simulator::Schedule(Seconds(timeout), fp, this);
+  NS_LOG_INFO("startRound");
+  NS_LOG_INFO("at:"<<nodeId<<" height:"<<height<<" round:"<<r);
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  clearTimeouts();
+
+  round = r;
+  step = STEP_PROPOSE;
+
+  proposed = false;
+  prevoteWaitArmed = false;
+  precommitWaitArmed = false;
+  lockedThisRound = false;
+
+  if (hasWork()) {
+    if (proposer(height, round) == nodeId) {
+      propose();
+    }
+    else {
+      scheduleTimeout(TendermintMessage::PROPOSAL);
+    }
+  }
 
+  // messages of this round may be in already
+  upon(round);
 }
 
 
-void TendermintCorrect::clearTimeoutEvent() {
-  if (checkEventStatus(timeoutEvent)) {
-    Simulator::Cancel(timeoutEvent);
+/**
+ * propose the valid value if any, otherwise a new block of pending requests up to blockSize bytes,
+ * the header carries the requests ordered and the merkle root, the parts carry the bytes
+ */
+void TendermintCorrect::propose() {
+
+  proposed = true;
+
+  uint32_t v = validValue;
+
+  if (v == TENDERMINT_NIL) {
+
+    v = (nodeId << 20) + (++valueCount);
+
+    TendermintValue &val = values[v];
+    uint32_t bytes = 0;
+
+    for (auto &tx : mempool.reap(0, blockSize)) {
+      val.requests.push_back(std::make_pair(tx.client, tx.reqId));
+      bytes += tx.bytes;
+    }
+
+    if (val.requests.empty() && continous) {
+      bytes = blockSize;
+    }
+
+    val.header = true;
+    val.bytes = bytes;
+    val.parts = (bytes + partSize - 1) / partSize;
+    val.seenTime = Simulator::Now().GetSeconds();
+
+    // cut the block, then prefix every part with its proof
+    uint32_t depth = merkleDepth(val.parts);
+    std::vector<std::string> leaves;
+
+    for (uint32_t i = 0; i < val.parts; ++i) {
+
+      uint32_t len = std::min((uint32_t) partSize, bytes - i * partSize);
+
+      TendermintMessage part = message(depth * hashLen + len);
+      part.setType(TendermintMessage::BLOCK_PART);
+      part.setSignerId(nodeId);
+      part.setHeight(height);
+      part.setRound(round);
+      part.setValueId(v);
+      part.setPart(i);
+
+      leaves.push_back(partLeaf(v, i, part.getPayload() + depth * hashLen, len));
+      val.received.insert(std::make_pair(i, std::move(part)));
+    }
+
+    val.root = merkleRoot(leaves);
+
+    for (auto &part : val.received) {
+      std::vector<std::string> proof = merkleProof(leaves, part.first);
+      for (uint32_t d = 0; d < depth; ++d) {
+        memcpy(part.second.getPayload() + d * hashLen, proof[d].data(), hashLen);
+      }
+    }
+  }
+
+  TendermintValue &val = values[v];
+
+  proposals[round] = std::make_pair(v, validRound);
+
+  NS_LOG_INFO("propose:"<<v<<" at:"<<nodeId<<" height:"<<height<<" round:"<<round
+    <<" parts:"<<val.parts<<" time:"<<Simulator::Now().GetSeconds());
+
+  TendermintMessage msg = message(messageConstantLen + 8 * val.requests.size());
+  msg.setType(TendermintMessage::PROPOSAL);
+  msg.setSignerId(nodeId);
+  msg.setHeight(height);
+  msg.setRound(round);
+  msg.setValueId(v);
+  msg.setValidRound(validRound);
+  msg.setPart(val.parts);
+
+  memcpy(msg.getPayload(), val.root.data(), std::min((int) val.root.size(), messageConstantLen));
+
+  unsigned char* p = msg.getPayload() + messageConstantLen;
+  for (auto &req : val.requests) {
+    memcpy(p, &req.first, 4);
+    memcpy(p + 4, &req.second, 4);
+    p += 8;
   }
+
+  broadcast(std::move(msg), relayType);
+
+  sendParts(v);
 }
 
 
-void TendermintCorrect::onMessageCallback(TendermintMessage& msg) {
-  
-  switch(msg.getTransportType()) {
-  case ConsensusMessageBase::RELAY:
-    relay(msg);
-    break;
-  case ConsensusMessageBase::FLOOD:
-    flood(msg);
-    break;
-  case ConsensusMessageBase::MIXED:
-    if (msg.getTTL() != 0) {
-      flood(msg);
+// a re-proposed valid value goes out with the parts as they were first cut, so receivers drop them as duplicates
+void TendermintCorrect::sendParts(uint32_t v) {
+
+  TendermintValue &val = values[v];
+
+  for (auto &part : val.received) {
+    if (partGossip) {
+      forwardPart(v, part.first);
     }
     else {
-      msg.setSrcAddr(nodeId);
-      msg.setFromAddr(nodeId);
-      msg.setTransportType(ConsensusMessageBase::RELAY);
-      relay(msg);
+      broadcast(part.second, relayType);
+    }
+  }
+}
+
+
+void TendermintCorrect::onProposal(TendermintMessage msg) {
+
+  NS_LOG_INFO("onProposal");
+  NS_LOG_INFO("at:"<<nodeId<<" from:"<<msg.getSignerId()<<" height:"<<height);
+  NS_LOG_INFO("round:"<<round<<" r-round:"<<msg.getRound()<<" value:"<<msg.getValueId());
+  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
+  NS_LOG_INFO("");
+
+  uint32_t r = msg.getRound();
+  uint32_t v = msg.getValueId();
+
+  // one proposal per round, from its proposer
+  if (msg.getSignerId() != (uint32_t) proposer(height, r) || proposals.count(r)) return;
+
+  if (v == TENDERMINT_NIL) return;
+
+  proposals[r] = std::make_pair(v, msg.getValidRound());
+
+  TendermintValue &val = values[v];
+
+  if (val.seenTime == 0) {
+    val.seenTime = Simulator::Now().GetSeconds();
+  }
+
+  if (!val.header) {
+    val.header = true;
+    val.parts = msg.getPart();
+    val.root = std::string((const char*) msg.getPayload(), hashLen);
+
+    uint32_t n = msg.getPayloadLen() > (uint32_t) messageConstantLen ?
+      (msg.getPayloadLen() - messageConstantLen) / 8 : 0;
+
+    unsigned char* p = msg.getPayload() + messageConstantLen;
+    for (uint32_t i = 0; i < n; ++i) {
+      uint32_t client, reqId;
+      memcpy(&client, p, 4);
+      memcpy(&reqId, p + 4, 4);
+      val.requests.push_back(std::make_pair(client, reqId));
+      p += 8;
+    }
+
+    // parts that raced the header can be checked now
+    std::vector<TendermintMessage> early = std::move(val.unverified);
+    val.unverified.clear();
+
+    for (auto &part : early) {
+      acceptPart(std::move(part));
     }
 
+    if (partGossip && !isComplete(v)) {
+      advertiseParts(v);
+      Simulator::Schedule(Seconds(partRepairInterval), &TendermintCorrect::onPartRepair, this, height, v);
+    }
   }
 
-  NS_LOG_INFO("Parse Message");
-
-	if (msg.getHeight() == height && msg.getRound() > round) {
-
-		std::map<uint32_t, std::set<uint32_t> >::iterator it;
-		it = asyMessageCount.find(msg.getRound());
-
-		if (it == asyMessageCount.end()) {
-			std::set<uint32_t> newSet;
-			newSet.insert(msg.getSignerId());
-			asyMessageCount.insert(std::pair<uint32_t, std::set<uint32_t> >(msg.getRound(), newSet));
-		}
-
-		else {
-			it->second.insert(msg.getSignerId());
-			if (it->second.size() == quorumRound) {
-				startRound(msg.getRound());
-			}
-		}
-	}
-
-  switch (msg.getType())
-  {
-  case TendermintMessage::PROPOSAL:
-    onProposal(msg);
-    break;
-  case TendermintMessage::PRE_VOTE:
-    onPreVote(msg);
-    break;
-  case TendermintMessage::PRE_COMMIT:
-    onPreCommit(msg);
-    break;
-  default:
-    break;
-  }
-}
-
-
-void TendermintCorrect::startRound(int r); {
-	
-	round = r;
-	step = TendermintMessage::PROPOSAL;
-
-	if (getProposer(round, height) == nodeId) {
-
-		TendermintMessage msg;
-		msg.setType(TendermintMessage::PROPOSAL);
-		msg.setSignerId(nodeId);
-		msg.setRound(round);
-		msg.setHeight(height);
-		msg.setValidRound(validRound);
-
-		if (validValue != TENDERMINT_NIL) {
-			msg.setValueId(validValue);
-		}
-		else {
-			msg.setValueId(getNoneSpecialValue());
-		}
-				
-		BroadcastTendermint(msg);
-	}
-	else {
-
-		// onTimeoutPropose hp rp 
-		// timeout rp
-
-		setTimeoutEvent();
-	}
-}
-
-
-void TendermintCorrect::onProposal(TendermintMessage& msg) {
-	if (msg.getHeight() == height && 
-			msg.getSignerId() == getProposer(msg.getRound(), height)) {
-
-		if (msg.getRound() == round) {
-
-			// upon proposal hp rp from proposer
-
-			TendermintMessage rmsg;
-
-			if (msg.getValidRound() == TENDERMINT_MINUSONE && step == TendermintMessage::PROPOSAL) {
-				rmsg.setType(TendermintMessage::PROVOTE);
-				rmsg.setSignerId(nodeId);
-				rmsg.setRound(round);
-				rmsg.setHeight(height);
-				if (isValidValue(msg) && (lockedRound == -1 || lockedValue == msg.getValueId())) {
-					rmsg.setValueId(msg.getValueId());
-				}
-				else {
-					rmsg.setValueId(TENDERMINT_NIL);
-				}
-				BroadcastTendermint(rmsg);
-				step = TendermintMessage::PRE_VOTE;
-			}
-
-			if (msg.getValidRound() >= 0 && msg.getValidRound() <= round &&
-			 							step == TendermintMessage::PROPOSAL &&  getMessageCount(msg.getValueId(), round, preVoteCount) == quorum) {
-				rmsg.setType(TendermintMessage::PRE_VOTE);
-				rmsg.setSignerId(nodeId);
-				rmsg.setRound(round);
-				rmsg.setHeight(height);
-				if (isValidValue(msg) && (lockedRound <= msg.getValidRound() || lockedValue == msg.getValueId())) {
-					rmsg.setValueId(msg.getValueId());
-				}
-				else {
-					rmsg.setValueId(TENDERMINT_NIL);
-				}
-				BroadcastTendermint(rmsg);
-				step = TendermintMessage::PRE_VOTE;
-			}
-
-			if (step >= TendermintMessage::PRE_VOTE &&  getMessageCount(msg.getValueId(), round, preVoteCount) == quorum &&
-															 isValidValue(msg) && firstQuorumProposalIndicator) {
-
-        firstQuorumProposalIndicator = false;
-				if (step == TendermintMessage::PRE_VOTE) {
-					lockedValue = msg.getValueId();
-					lockedRound = round;
-					rmsg.setType(TendermintMessage::PRE_COMMIT);
-					rmsg.setSignerId(nodeId);
-					rmsg.setRound(round);
-					rmsg.setHeight(height);
-					rmsg.setValueId(msg.getValueId());
-					BroadcastTendermint(rmsg);
-					step = TendermintMessage::PRE_COMMIT;
-				}
-				validValue = msg.getValueId();
-				validRound = round;
-			}
-
-		}
-
-		else {
-
-			uint32_t r = msg.getRound();
-
-			if (getMessageCount(msg.getValueId(), r, preCommitCount) == quorum &&
-							 decision.at(height) == TENDERMINT_NIL) {
-			  if (isValidValue(msg)) {
-					decision.at(height) = msg.getValueId();
-					incHeight();
-					startRound(0);
-				}
-			}
-		}
-	}
-}
-
-
-void TendermintCorrect::onPreVote(TendermintMessage& msg) {
-
-	if (msg.getHeight() == height && step == PRE_VOTE && firstQuorumPrevoteIndicator && getMessageCount(round, preVoteCount) >= quorum) {
-		firstQuorumPrevoteIndicator = false;
-		setTimeoutEvent();
-		//TODO set timeout event
-	}
-
-	if (msg.getHeight() == height && step == PRE_VOTE && getMessageCount(TENDERMINT_NIL, round, preVoteCount) == quorum) {
-		TendermintMessage rmsg;
-		rmsg.setType(TendermintMessage::PRE_COMMIT);
-		rmsg.setRound(round);
-		rmsg.setSignerId(nodeId);
-		rmsg.setHeight(height);
-		rmsg.setValueId(TENDERMINT_NIL);
-		BroadcastTendermint(rmsg);
-		step = TendermintMessage::PRE_COMMIT;
-	}
-
-}
-
-
-void TendermintCorrect::onPreCommit(TendermintMessage& msg) {
-	if (msg.getHeight() == height && firstQuorumPrecommitIndicator && getMessageCount(round, preCommitCount) == quorum) {
-		firstQuorumPrecommitIndicator = false;
-		setTimeoutEvent();
-		//TODO set timeout event
-	}
+  upon(r);
 }
 
 
-/*
- * save distinct signers for a certain type of message voting for certain value
- * return the count of signers
- */
-uint32_t TendermintCorrect::incMessageCount(uint32_t id, uint32_t value, uint32_t round, MessageLog counter) {
+void TendermintCorrect::onBlockPart(TendermintMessage msg) {
+
+  uint32_t v = msg.getValueId();
+
+  if (v == TENDERMINT_NIL) return;
+
+  TendermintValue &val = values[v];
+
+  if (!val.header) {
+    val.unverified.push_back(std::move(msg));
+    return;
+  }
+
+  if (isComplete(v) || !acceptPart(std::move(msg)) || !isComplete(v)) return;
 
-	MessageLog::iterator it = counter.find(std::pair<uint32_t,uint32_t>(value,round));
-	if (it == counter.end()) {
-		std::set<uint32_t> newSet;
-		newSet.insert(id);
-		counter.insert(std::pair<std::pair<uint32_t,uint32_t>, std::set<uint32_t> >(std::pair<uint32_t,uint32_t>(value,round), newSet));
-		return 1;
-	}
-	else {
-		(it->second).insert(id);
-		return (it->second).size();
-	}
+  NS_LOG_INFO("value:"<<v<<" complete at:"<<nodeId<<" time:"<<Simulator::Now().GetSeconds());
+
+  // the rounds waiting on this value
+  uint32_t h = height;
+  std::vector<uint32_t> rounds;
+  for (auto &p : proposals) {
+    if (p.second.first == v) rounds.push_back(p.first);
+  }
+
+  for (uint32_t r : rounds) {
+    if (height != h) return;
+    upon(r);
+  }
+}
+
+
+// check a part against the merkle root of its value, keep it and pass it on, false if not new or bad
+bool TendermintCorrect::acceptPart(TendermintMessage msg) {
+
+  uint32_t v = msg.getValueId();
+  uint32_t i = msg.getPart();
+
+  TendermintValue &val = values[v];
+
+  // the forwarder holds it
+  if (partGossip && msg.getTransportType() == ConsensusMessageBase::DIRECT) {
+    val.peerParts[msg.getFromAddr()].insert(i);
+  }
+
+  if (i >= val.parts) return false;
+
+  if (val.received.count(i)) {
+    duplicateParts++;
+    return false;
+  }
+
+  uint32_t depth = merkleDepth(val.parts);
+  if (msg.getPayloadLen() < depth * hashLen) return false;
+
+  std::vector<std::string> proof;
+  for (uint32_t d = 0; d < depth; ++d) {
+    proof.push_back(std::string((const char*) msg.getPayload() + d * hashLen, hashLen));
+  }
+
+  uint32_t len = msg.getPayloadLen() - depth * hashLen;
+  std::string leaf = partLeaf(v, i, msg.getPayload() + depth * hashLen, len);
+
+  if (!merkleVerify(leaf, i, proof, val.root)) {
+    NS_LOG_INFO("bad part:"<<i<<" of value:"<<v<<" at:"<<nodeId);
+    return false;
+  }
+
+  val.bytes += len;
+  val.received.insert(std::make_pair(i, std::move(msg)));
+
+  if (partGossip) {
+    forwardPart(v, i);
+  }
+
+  return true;
+}
+
+
+// send part i to the direct peers not known to hold it
+void TendermintCorrect::forwardPart(uint32_t v, uint32_t i) {
+
+  TendermintValue &val = values[v];
+  auto it = val.received.find(i);
+  if (it == val.received.end()) return;
+
+  for (int peer : getDirectPeers()) {
+
+    if (val.peerParts[peer].has(i)) continue;
+    val.peerParts[peer].insert(i);
+
+    TendermintMessage part = it->second;
+    part.setTransportType(ConsensusMessageBase::DIRECT);
+    part.setFromAddr(nodeId);
+    part.setDstAddr(peer);
+    stampHop(part);
+    sendToPeer(part.toPacket(), peer);
+  }
+}
+
+
+// tell the direct peers which parts of v are here, they answer with the missing ones
+void TendermintCorrect::advertiseParts(uint32_t v) {
+
+  TendermintValue &val = values[v];
+
+  for (int peer : getDirectPeers()) {
+
+    TendermintMessage msg = message((val.parts + 7) / 8);
+    msg.setType(TendermintMessage::PART_STATE);
+    msg.setSignerId(nodeId);
+    msg.setHeight(height);
+    msg.setRound(round);
+    msg.setValueId(v);
+    msg.setPart(val.parts);
+
+    for (auto &part : val.received) {
+      msg.getPayload()[part.first / 8] |= 1 << (part.first % 8);
+    }
+
+    sendToNode(std::move(msg), peer);
+  }
+}
+
+
+void TendermintCorrect::onPartState(TendermintMessage msg) {
+
+  uint32_t v = msg.getValueId();
+  int peer = msg.getSignerId();
+
+  auto it = values.find(v);
+  if (it == values.end() || !it->second.header) return;
+
+  TendermintValue &val = it->second;
+
+  uint32_t n = std::min(val.parts, msg.getPayloadLen() * 8);
+
+  for (uint32_t i = 0; i < n; ++i) {
+    if (msg.getPayload()[i / 8] & (1 << (i % 8))) {
+      val.peerParts[peer].insert(i);
+    }
+  }
+
+  for (auto &part : val.received) {
+
+    if (val.peerParts[peer].has(part.first)) continue;
+    val.peerParts[peer].insert(part.first);
+
+    TendermintMessage p = part.second;
+    p.setTransportType(ConsensusMessageBase::DIRECT);
+    p.setFromAddr(nodeId);
+    p.setDstAddr(peer);
+    stampHop(p);
+    sendToPeer(p.toPacket(), peer);
+  }
+}
+
+
+// still missing parts, the advertised bitfield asks the peers again
+void TendermintCorrect::onPartRepair(uint32_t h, uint32_t v) {
+
+  if (replicaStat != RUNNING || h != height || !values.count(v) || isComplete(v)) return;
+
+  NS_LOG_INFO("repair value:"<<v<<" at:"<<nodeId<<" parts:"<<values[v].received.size()<<"/"<<values[v].parts);
+
+  // peers only know what they were told or sent, so forget it and ask all of them
+  values[v].peerParts.clear();
+
+  advertiseParts(v);
+
+  Simulator::Schedule(Seconds(partRepairInterval), &TendermintCorrect::onPartRepair, this, h, v);
+}
+
+void TendermintCorrect::onPreVote(TendermintMessage msg) {
+
+  uint32_t r = msg.getRound();
+
+  prevotes[std::make_pair(r, msg.getValueId())].insert(msg.getSignerId());
+  prevotesAny[r].insert(msg.getSignerId());
+
+  upon(r);
 }
 
 
-uint32_t TendermintCorrect::getMessageCount(uint32_t value, uint32_t round, MessageLog &counter) {
-	MessageLog::iterator it = counter.find(std::pair<uint32_t,uint32_t>(value,round));
-	if (it == counter.end()) {
-		return 0;
-	}
-	else {
-		return (it->second).size();
-	}
+void TendermintCorrect::onPreCommit(TendermintMessage msg) {
+
+  uint32_t r = msg.getRound();
+
+  precommits[std::make_pair(r, msg.getValueId())].insert(msg.getSignerId());
+  precommitsAny[r].insert(msg.getSignerId());
+
+  upon(r);
 }
 
 
-uint32_t TendermintCorrect::getMessageCount(uint32_t round, MessageLog &counter) {
-	
-	uint32_t count = 0;
+/**
+ * the upon rules of algorithm 1 after a message of round r came in,
+ * the decision rule for round r, the round skip to r, then the rules of the current round until none fires
+ */
+void TendermintCorrect::upon(uint32_t r) {
+
+  uint32_t h = height;
+
+  auto p = proposals.find(r);
+  if (p != proposals.end() && isComplete(p->second.first)
+    && countOf(precommits, std::make_pair(r, p->second.first)) >= quorum) {
+    decide(p->second.first);
+    return;
+  }
+
+  if (r > round && r != TENDERMINT_MINUSONE && countOf(roundSigners, r) >= quorumRound) {
+    startRound(r);
+    return;
+  }
+
+  bool progress = true;
+
+  while (progress && height == h) {
+
+    progress = false;
+
+    p = proposals.find(round);
+
+    bool hasProposal = p != proposals.end() && isComplete(p->second.first);
+    uint32_t v = hasProposal ? p->second.first : TENDERMINT_NIL;
+    uint32_t vr = hasProposal ? p->second.second : TENDERMINT_MINUSONE;
+
+    if (step == STEP_PROPOSE && hasProposal) {
+
+      if (vr == TENDERMINT_MINUSONE) {
+        bool accept = isValidValue(v) && (lockedRound == TENDERMINT_MINUSONE || lockedValue == v);
+        vote(TendermintMessage::PRE_VOTE, accept ? v : TENDERMINT_NIL);
+        progress = true;
+        continue;
+      }
+
+      if (vr < round && countOf(prevotes, std::make_pair(vr, v)) >= quorum) {
+        bool accept = isValidValue(v)
+          && (lockedRound == TENDERMINT_MINUSONE || lockedRound <= vr || lockedValue == v);
+        vote(TendermintMessage::PRE_VOTE, accept ? v : TENDERMINT_NIL);
+        progress = true;
+        continue;
+      }
+    }
+
+    if (step == STEP_PREVOTE && !prevoteWaitArmed && countOf(prevotesAny, round) >= quorum) {
+      prevoteWaitArmed = true;
+      scheduleTimeout(TendermintMessage::PRE_VOTE);
+    }
+
+    if (step >= STEP_PREVOTE && !lockedThisRound && hasProposal && isValidValue(v)
+      && countOf(prevotes, std::make_pair(round, v)) >= quorum) {
+
+      lockedThisRound = true;
+
+      if (step == STEP_PREVOTE) {
+        lockedValue = v;
+        lockedRound = round;
+        vote(TendermintMessage::PRE_COMMIT, v);
+      }
+
+      validValue = v;
+      validRound = round;
+
+      progress = true;
+      continue;
+    }
+
+    if (step == STEP_PREVOTE && countOf(prevotes, std::make_pair(round, (uint32_t) TENDERMINT_NIL)) >= quorum) {
+      vote(TendermintMessage::PRE_COMMIT, TENDERMINT_NIL);
+      progress = true;
+      continue;
+    }
+
+    if (!precommitWaitArmed && countOf(precommitsAny, round) >= quorum) {
+      precommitWaitArmed = true;
+      scheduleTimeout(TendermintMessage::PRE_COMMIT);
+    }
 
-	for (auto it = counter.begin(); it != counter.end(); ++it) {
-		if (it->first.second == round) {
-			count += (it->second).size();
-		}
-	}
-	return count;
+    if (hasProposal && countOf(precommits, std::make_pair(round, v)) >= quorum) {
+      decide(v);
+      return;
+    }
+  }
 }
 
 
-void TendermintCorrect::setTimeoutEvent(uint32_t eventType) {
+// broadcast a vote of the current round and count it here
+void TendermintCorrect::vote(uint32_t type, uint32_t v) {
 
-	
-	switch (eventType) {
+  NS_LOG_INFO((type == TendermintMessage::PRE_VOTE ? "prevote:" : "precommit:")<<v
+    <<" at:"<<nodeId<<" height:"<<height<<" round:"<<round<<" time:"<<Simulator::Now().GetSeconds());
 
-		case TendermintMessage::PROPOSAL:
-		void (TendermintCorrect::*fp)(void) = &TendermintCorrect::onTimeoutProposeCallback;
-  	timeoutProposeEvent=Simulator::Schedule(Seconds(timeoutPropose(round)), fp, this);
-		break;
+  if (type == TendermintMessage::PRE_VOTE) {
+    step = STEP_PREVOTE;
+    prevotes[std::make_pair(round, v)].insert(nodeId);
+    prevotesAny[round].insert(nodeId);
+  }
+  else {
+    step = STEP_PRECOMMIT;
+    precommits[std::make_pair(round, v)].insert(nodeId);
+    precommitsAny[round].insert(nodeId);
+  }
 
-		case TendermintMessage::PRE_VOTE:
-		void (TendermintCorrect::*fp)(void) = &TendermintCorrect::onTimeoutPrevoteCallback;
-	  timeoutPrevoteEvent=Simulator::Schedule(Seconds(timeoutPrevote(round)), fp, this);
-		break;
+  roundSigners[round].insert(nodeId);
 
-		case TendermintMessage::PRE_COMMIT:
-		void (TendermintCorrect::*fp)(void) = &TendermintCorrect::onTimeoutPrecommitCallback;
-  	timeoutPrecommitEvent=Simulator::Schedule(Seconds(timeoutPrecommit(round)), fp, this);
-		break;
-	}
+  TendermintMessage msg = message(messageConstantLen);
+  msg.setType(type);
+  msg.setSignerId(nodeId);
+  msg.setHeight(height);
+  msg.setRound(round);
+  msg.setValueId(v);
 
+  broadcast(std::move(msg), relayType);
 }
 
 
+void TendermintCorrect::decide(uint32_t v) {
+
+  TendermintValue &val = values[v];
+
+  double now = Simulator::Now().GetSeconds();
+
+  decision.push_back(v);
+  committedCount++;
+  commitLatency += now - val.seenTime;
+
+  NS_LOG_INFO("Decided");
+  NS_LOG_INFO("at:"<<nodeId<<" height:"<<height<<" value:"<<v<<" requests:"<<val.requests.size());
+  NS_LOG_INFO("time:"<<now);
+  NS_LOG_INFO("");
+
+  if ((v >> 20) == nodeId) {
+    std::cout<<"<commit: "<<height<<" "<<now<<" "<<now - val.seenTime<<" >"<<std::endl<<std::endl;
+  }
+
+  for (auto &req : val.requests) {
+    mempool.remove(req.first, req.second);
+    if (req.first == nodeId) {
+      notifyRequestReply(req.second);
+    }
+  }
+
+  incHeight();
+}
+
 
 void TendermintCorrect::incHeight() {
 
-	height++;
+  height++;
 
-	// reset all counters, indicators and clocks
+  lockedValue = TENDERMINT_NIL;
+  lockedRound = TENDERMINT_MINUSONE;
+  validValue = TENDERMINT_NIL;
+  validRound = TENDERMINT_MINUSONE;
 
-	lockedValue = TENDERMINT_NIL;
-	lockedRound = TENDERMINT_MINUSONE;
+  proposals.clear();
+  values.clear();
+  prevotes.clear();
+  precommits.clear();
+  prevotesAny.clear();
+  precommitsAny.clear();
+  roundSigners.clear();
 
-	validValue = TENDERMINT_NIL;
-	validRound = TENDERMINT_MINUSONE;
+  uint32_t h = height;
+  messageRecvPool.eraseIf([h](TendermintMessage &m) {
+    return m.getType() != TendermintMessage::REQUEST && m.getHeight() + 1 < h;
+  });
 
-	preVoteCount.clear();
-	preCommitCount.clear();
-	asyMessageCount.clear();
-	
+  startRound(0);
 
-	if (checkEventStatus(timeoutProposeEvent)) {
-    Simulator::Cancel(timeoutProposeEvent);
+  // replay what came in early, anything of an older height is dropped by parseMessage
+  futureMessages.erase(futureMessages.begin(), futureMessages.lower_bound(height));
+
+  auto it = futureMessages.find(height);
+  if (it == futureMessages.end()) return;
+
+  std::vector<TendermintMessage> early = std::move(it->second);
+  futureMessages.erase(it);
+
+  for (auto &m : early) {
+    parseMessage(std::move(m));
   }
+}
 
-	if (checkEventStatus(timeoutPrevoteEvent)) {
-    Simulator::Cancel(timeoutPrevoteEvent);
+
+void TendermintCorrect::onTimeoutPropose(uint32_t h, uint32_t r) {
+
+  if (replicaStat != RUNNING) return;
+
+  if (h == height && r == round && step == STEP_PROPOSE) {
+    vote(TendermintMessage::PRE_VOTE, TENDERMINT_NIL);
+    upon(round);
   }
+}
 
-	if (checkEventStatus(timeoutPrecommitEvent)) {
-    Simulator::Cancel(timeoutPrecommitEvent);
+
+void TendermintCorrect::onTimeoutPrevote(uint32_t h, uint32_t r) {
+
+  if (replicaStat != RUNNING) return;
+
+  if (h == height && r == round && step == STEP_PREVOTE) {
+    vote(TendermintMessage::PRE_COMMIT, TENDERMINT_NIL);
+    upon(round);
   }
+}
+
+
+void TendermintCorrect::onTimeoutPrecommit(uint32_t h, uint32_t r) {
 
-	firstQuorumProposalIndicator = true;
-	firstQuorumPrevoteIndicator = true;
-	firstQuorumPrecommitIndicator = true;
+  if (replicaStat != RUNNING) return;
 
+  if (h == height && r == round) {
+    startRound(round + 1);
+  }
 }
 
-void TendermintCorrect::setRound(int r) {
-	round = r;
+
+// timeouts grow with the round so that a round eventually lasts long enough
+void TendermintCorrect::scheduleTimeout(uint32_t type) {
+
+  double t = timeout + round * timeoutDelta;
+
+  switch (type) {
+    case TendermintMessage::PROPOSAL:
+      timeoutProposeEvent = Simulator::Schedule(Seconds(t),
+        &TendermintCorrect::onTimeoutPropose, this, height, round);
+      break;
+    case TendermintMessage::PRE_VOTE:
+      timeoutPrevoteEvent = Simulator::Schedule(Seconds(t),
+        &TendermintCorrect::onTimeoutPrevote, this, height, round);
+      break;
+    case TendermintMessage::PRE_COMMIT:
+      timeoutPrecommitEvent = Simulator::Schedule(Seconds(t),
+        &TendermintCorrect::onTimeoutPrecommit, this, height, round);
+      break;
+    default:
+      break;
+  }
 }
 
-void TendermintCorrect::setStep(int s) {
-	step = s;
+
+void TendermintCorrect::clearTimeouts() {
+
+  if (checkEventStatus(timeoutProposeEvent)) {
+    Simulator::Cancel(timeoutProposeEvent);
+  }
+
+  if (checkEventStatus(timeoutPrevoteEvent)) {
+    Simulator::Cancel(timeoutPrevoteEvent);
+  }
+
+  if (checkEventStatus(timeoutPrecommitEvent)) {
+    Simulator::Cancel(timeoutPrecommitEvent);
+  }
 }
 
-void TendermintCorrect::setTotalNode(int n) {
-	totalNodes = n;
+
+void TendermintCorrect::sendToNode(TendermintMessage msg, uint32_t id) {
+
+  msg.setTransportType(ConsensusMessageBase::DIRECT);
+
+  if (id != nodeId) {
+    msg.setDstAddr(id);
+    stampHop(msg);
+    Ptr<Packet> packet = msg.toPacket();
+    sendToPeer(packet, id);
+  }
+  else {
+    if (replicaStat == RUNNING) {
+      onMessageCallback(std::move(msg));
+    }
+  }
 }
 
+
+// f = (n - 1) / 3 faulty replicas tolerated
 void TendermintCorrect::setQuorum() {
-	quorum = (int) totalNodes * 2 / 3;
-	quorumRound = (int) totalNodes /2;
-}
-
-void TendermintCorrect::BroadcastTendermint(TendermintMessage& msg) {
-	if (relayType == DIRECT) {
-		Ptr<Packet> packet = msg.toPacket();
-		BroadcastToPeers(packet);
-	}
-	if (relayType == RELAY) {
-		msg.setRelayType(RELAY);
-		msg.setFrom(nodeId);
-		Ptr<Packet> packet = msg.toPacket();
-		RelayEntry k(msg.getSignerId(), nodeId);
-		BroadcastToPeers(packet, k);
-	}
-}
-
-
-// TODO should imple in super class since its a common function
-void TendermintCorrect::relay(TendermintMessage& msg) {
-	
-  NS_LOG_INFO("relayMessage");
-  NS_LOG_INFO("at:"<<nodeId<<" souce:"<<msg.getSignerId()<<" from:"<<msg.getFrom());
-  NS_LOG_INFO("time:"<<Simulator::Now().GetSeconds());
-  NS_LOG_INFO("");
+  int f = (totalNodes - 1) / 3;
+  quorum = totalNodes - f;
+  quorumRound = f + 1;
+}
 
 
-  RelayEntry k(msg.getSignerId(), msg.getFrom());
-  msg.setFrom(nodeId);
+TendermintMessage TendermintCorrect::message() {
+  TendermintMessage msg;
+  msg.setSeq(seq++);
+  return msg;
+}
 
-  Ptr<Packet> packet = msg.toPacket();
-  BroadcastToPeers(packet, k);
 
+TendermintMessage TendermintCorrect::message(int l) {
+  TendermintMessage msg(l);
+  msg.setSeq(seq++);
+  return msg;
 }
 
 
-
-}// namespace ns3
\ No newline at end of file
+} // namespace ns3
@@ -1,166 +1,221 @@
 // Yiqing Zhu
 // yiqing.zhu.314@gmail.com
 
-//unfinished
-
 #ifndef TENDERMINTCORRECT_H
 #define TENDERMINTCORRECT_H
 
 #include "BlockChainApplicationBase.h"
 #include "TendermintMessage.h"
+
+#include <deque>
 #include <set>
 
+
 namespace ns3 {
 
-class Address;
-class Socket;
-class Packet;
+/**
+ * Tendermint, algorithm 1 of "The latest gossip on BFT consensus"
+ * proposals, prevotes and precommits travel over the same relay, flood and mixed transports as PBFTCorrect,
+ * the proposer sends a proposal header followed by the block in parts of partSize bytes,
+ * a value counts as received once its header and all of its parts are in.
+ *
+ * the header carries the merkle root of the parts and every part its merkle proof.
+ * with part gossip on, parts only travel between direct peers as in the tendermint reactor:
+ * a replica advertises the parts it holds as a bitfield, a peer answers with the parts missing from it
+ * and every new part is forwarded to the peers not known to hold it.
+ * forwarded parts keep the seq of the proposer so that MessageRecvPool drops duplicates
+ *
+ * requests wait in the mempool of BlockChainApplicationBase, broadcast to every replica or, with the mempool on,
+ * gossiped between direct peers as transactions. the proposer of a height reaps its block from the mempool,
+ * replicas drop the requests of a decided block and the replica a request came from replies to its client.
+ */
+
+class TendermintCorrect : public BlockChainApplicationBase<TendermintMessage> {
 
-typedef std::map<std::pair<uint32_t, uint32_t>, std::set<uint32_t> > MessageLog;
+public:
 
+  /*
+   * -1 and nil described in the original paper
+   */
+  enum TENDERMINT_SPECIAL : uint32_t {
+    TENDERMINT_NIL = 0,
+    TENDERMINT_MINUSONE = 0xffffffff
+  };
 
-class TendermintCorrect : public BlockChainApplicationBase {
+  enum TENDERMINT_STEP : uint32_t {
+    STEP_PROPOSE,
+    STEP_PREVOTE,
+    STEP_PRECOMMIT
+  };
 
-private:
+  static TypeId GetTypeId (void);
 
-	uint32_t round = 0;
-	uint32_t height = 0;
+  TendermintCorrect();
 
-	uint32_t step;
+  virtual ~TendermintCorrect(void);
 
-	uint32_t lockedValue = TENDERMINT_NIL;
-	uint32_t lockedRound = TENDERMINT_MINUSONE;
-	
-	uint32_t validValue = TENDERMINT_NIL;
-	uint32_t validRound = TENDERMINT_MINUSONE;
+  void RecvCallback (Ptr<Socket> socket);
 
-	std::vector<uint32_t> decision;
+  void parseMessage(TendermintMessage msg);
 
-	int totalNodes;
-	uint32_t quorum;
-	uint32_t quorumRound;
-	int blockSize = 4;
-	int messageConstantLen = 20;
+  void onRequest(TendermintMessage msg);
+  void onProposal(TendermintMessage msg);
+  void onBlockPart(TendermintMessage msg);
+  void onPartState(TendermintMessage msg);
+  void onPreVote(TendermintMessage msg);
+  void onPreCommit(TendermintMessage msg);
 
-	// std::map<std::pair<uint32_t, uint32_t>, std::set<uint32_t> >
-	// map (value, nodes vote for that value in some round)
-	MessageLog preVoteCount;
-	MessageLog preCommitCount;
+  void onTimeoutPropose(uint32_t h, uint32_t r);
+  void onTimeoutPrevote(uint32_t h, uint32_t r);
+  void onTimeoutPrecommit(uint32_t h, uint32_t r);
+  void onPartRepair(uint32_t h, uint32_t v);
 
-	std::map<uint32_t, std::set<uint32_t> > asyMessageCount;
+  virtual void submitRequest(uint32_t reqId, uint32_t bytes);
 
-	uint32_t NoneSpecialValueCount = LAST_MARKER;
+  void setTotalNode(int n) {totalNodes = n;}
+  void setQuorum();
+  void setBlockSize(int sz) {blockSize = sz;}
+  void setPartSize(int sz) {partSize = sz > 0 ? sz : 1;}
 
-  EventId nextRequestEvent;
+  // parts between direct peers by bitfield, or broadcast over the transport like votes
+  void setPartGossip(bool b) {partGossip = b;}
+  // seconds an incomplete value waits before advertising its bitfield again
+  void setPartRepairInterval(double s) {partRepairInterval = s;}
+  void setContinous(bool c) {continous = c;}
 
-	EventId timeoutProposeEvent;
-	EventId timeoutPrevoteEvent;
-	EventId timeoutPrecommitEvent;
+  // timeout of round r is timeout + r * timeoutDelta
+  void setTimeoutDelta(double d) {timeoutDelta = d;}
 
-	uint32_t proposeTimeoutHeight;
-	uint32_t proposeTimeoutRound;
-	uint32_t prevoteTimeoutHeight;
-	uint32_t prevoteTimeoutRound;
-	uint32_t precommitTimeoutHeight;
-	uint32_t precommitTimeoutRound;
+  inline uint32_t getHeight() {return height;}
+  inline uint32_t getRound() {return round;}
+  inline int getProposer() {return proposer(height, round);}
 
+  uint32_t getCommittedCount() {return committedCount;}
 
-	double timeoutPropose(uint32_t round);
-	double timeoutPrevote(uint32_t round);
-	double timeoutPrecommit(uint32_t round);
+  // second, from a value first seen here to its decision, averaged
+  double getAverageCommitLatency() {return committedCount == 0 ? 0 : commitLatency / committedCount;}
 
-	bool firstQuorumProposalIndicator = true;
-	bool firstQuorumPrevoteIndicator = true;
-	bool firstQuorumPrecommitIndicator = true;
+  uint64_t getTotalRecvMessages() {return totalRecvMessages;}
+  uint64_t getTotalRecvBytes() {return totalRecvBytes;}
 
-	void onTimeoutProposeCallback(void);
-	void onTimeoutPrevoteCallback(void);
-	void onTimeoutPrecommitCallback(void);
+  // parts that got past the receive pool but were held already
+  uint32_t getDuplicateParts() {return duplicateParts;}
 
-	void onTimeoutCallback(void);
-  void setTimeoutEvent(void);
-	void setTimeoutEvent(uint32_t eventType);
-  void clearTimeoutEvent();
-  void onMessageCallback(TendermintMessage& msg);
+protected:
 
-	void RecvCallback (Ptr<Socket> socket);
+  struct TendermintValue {
+    bool header = false;   // proposal seen
+    uint32_t parts = 0;
+    uint32_t bytes = 0;
+    std::string root;      // merkle root of the parts
+    std::map<uint32_t, TendermintMessage> received;    // verified parts by index
+    std::vector<TendermintMessage> unverified;         // parts in before the header
+    std::map<int, VoteCounter> peerParts;              // direct peer -> parts it is known to hold
+    std::vector<std::pair<uint32_t, uint32_t> > requests;   // <client, request id>
+    double seenTime = 0;
+  };
 
-	void SendToLeader(Ptr<Packet> pkt);
-  void BroadcastToPeers(Ptr<Packet> pkt);
-  void BroadcastToPeers(Ptr<Packet> pkt, RelayEntry k);
-  void BroadcastToPeersWithDelay(Ptr<Packet> pkt, double delay);
-  void BroadcastToPeersWithDelay(Ptr<Packet> pkt, double delay, RelayEntry k);
-	void BroadcastTendermint(TendermintMessage& msg);
+  int totalNodes;
+  int quorum;        // 2f + 1
+  int quorumRound;   // f + 1
 
-	void onProposal(TendermintMessage& msg);
-	void onPreVote(TendermintMessage& msg);
-	void onPreCommit(TendermintMessage& msg);
+  int blockSize;
+  int partSize = 64;
 
-	void onTimeoutProposal();
-	void onTimeoutPreVote();
-	void onTimeoutPreCommit();
+  bool partGossip = true;
+  double partRepairInterval = 0.5;
 
-	int getProposer(int round, int height);
+  uint32_t duplicateParts = 0;
 
-	void incHeight();
+  // hash, sign etc, rough estimation
+  int messageConstantLen = 40;
 
-	uint32_t getNoneSpecialValue() {
-		
-		// external 
-		// return some payload
+  bool continous;
 
-		return NoneSpecialValueCount++;
-	}
+  double timeoutDelta = 0.5;
 
-	bool isValidValue(TendermintMessage& msg) {
+  uint32_t height = 0;
+  uint32_t round = 0;
+  uint32_t step = STEP_PROPOSE;
 
-		// external 
-		// check if the message is valid
+  uint32_t lockedValue = TENDERMINT_NIL;
+  uint32_t lockedRound = TENDERMINT_MINUSONE;
+  uint32_t validValue = TENDERMINT_NIL;
+  uint32_t validRound = TENDERMINT_MINUSONE;
 
-		return true;
+  // value ids are unique per proposer, never nil
+  uint32_t valueCount = 0;
 
-	}
+  // round -> <value, valid round> proposed by its proposer at this height
+  std::map<uint32_t, std::pair<uint32_t, uint32_t> > proposals;
 
-	uint32_t incMessageCount(uint32_t id, uint32_t value, uint32_t round, MessageLog counter);
-	uint32_t getMessageCount(uint32_t value, uint32_t round, MessageLog counter);
-	uint32_t getMessageCount(uint32_t round, MessageLog counter);
+  // value id -> block, of this height
+  std::map<uint32_t, TendermintValue> values;
 
-	void relay(TendermintMessage& msg);
+  // <round, value> -> signers, and round -> signers of any value
+  std::map<std::pair<uint32_t, uint32_t>, VoteCounter> prevotes;
+  std::map<std::pair<uint32_t, uint32_t>, VoteCounter> precommits;
+  std::map<uint32_t, VoteCounter> prevotesAny;
+  std::map<uint32_t, VoteCounter> precommitsAny;
 
-protected:
+  // round -> signers of any message, f + 1 of a higher round skip to it
+  std::map<uint32_t, VoteCounter> roundSigners;
 
-  virtual void StartApplication(void);  
-  virtual void StopApplication(void);   
-  virtual void DoDispose(void);
+  // "for the first time" rules of the current round
+  bool proposed = false;
+  bool prevoteWaitArmed = false;
+  bool precommitWaitArmed = false;
+  bool lockedThisRound = false;
 
-public:
+  // messages of heights not reached yet
+  std::map<uint32_t, std::vector<TendermintMessage> > futureMessages;
 
-	/*
-	* -1 and nil discribed in the orignal paper
-	*/
-	enum TENDERMINT_SPECIAL : uint32_t {
-		TENDERMINT_MINUSONE,
-		TENDERMINT_NIL,
+  std::vector<uint32_t> decision;
 
+  uint32_t committedCount = 0;
+  double commitLatency = 0;   // sum over decided values
 
-		LAST_MARKER // do not remove 
-	};
+  uint64_t totalRecvMessages = 0;
+  uint64_t totalRecvBytes = 0;
 
-  static TypeId GetTypeId (void);
+  EventId timeoutProposeEvent;
+  EventId timeoutPrevoteEvent;
+  EventId timeoutPrecommitEvent;
 
-  TendermintCorrect();
-  
-  virtual ~TendermintCorrect(void);
+  TendermintMessage message();
+  TendermintMessage message(int l);
 
-	void startRound(int r);
+  virtual void StartApplication(void);
+  virtual void StopApplication(void);
+  virtual void DoDispose(void);
 
-	void setRound(int r);
-  void setStep(int s);
-  void setTotalNode(int n);
-  void setQuorum();
+  int proposer(uint32_t h, uint32_t r) {return (h + r) % totalNodes;}
+
+  bool hasWork();
+  bool isComplete(uint32_t v);
+  bool isValidValue(uint32_t v) {return v != TENDERMINT_NIL;}
+
+  void startRound(uint32_t r);
+  void propose();
+  void sendParts(uint32_t v);
+  bool acceptPart(TendermintMessage msg);
+  void forwardPart(uint32_t v, uint32_t i);
+  void advertiseParts(uint32_t v);
+  void vote(uint32_t type, uint32_t v);
+  void upon(uint32_t r);
+  void decide(uint32_t v);
+  void incHeight();
+
+  void scheduleTimeout(uint32_t type);
+  void clearTimeouts();
+
+  void sendToNode(TendermintMessage msg, uint32_t id);
+
+  virtual void sendTransaction(const MempoolTx &tx, int peer);
+  virtual void onMempoolTx(const MempoolTx &tx);
 
 };
 
 
 } //namespace ns3
-#endif 
\ No newline at end of file
+#endif
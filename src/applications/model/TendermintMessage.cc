@@ -1,57 +1,169 @@
 // Yiqing Zhu
 // yiqing.zhu.314@gmail.com
 
-//unfinished
 
 #include "TendermintMessage.h"
+#include <cryptopp/sm3.h>
 
 namespace ns3 {
 
+TendermintMessage::TendermintMessage(void) : ConsensusMessageBase() {
+  mMessageType = 0;
+  mLenPayload = 4;
+  mRound = 0;
+  mHeight = 0;
+  mSignerId = 0;
+  mValueId = 0;
+  mValidRound = 0;
+  mPart = 0;
+  mPayload = new unsigned char[mLenPayload]();
+}
 
-TendermintMessage::TendermintMessage() {
 
-  ConsensusMessageBase();
+TendermintMessage::TendermintMessage(int payloadLen) : ConsensusMessageBase() {
   mMessageType = 0;
-  mLenPayload = 4;
+  mLenPayload = payloadLen;
   mRound = 0;
+  mHeight = 0;
   mSignerId = 0;
+  mValueId = 0;
+  mValidRound = 0;
+  mPart = 0;
   mPayload = new unsigned char[mLenPayload]();
+}
+
+
+TendermintMessage::TendermintMessage(const TendermintMessage& msg) : ConsensusMessageBase(msg) {
+  mMessageType = msg.mMessageType;
+  mLenPayload = msg.mLenPayload;
+  mRound = msg.mRound;
+  mHeight = msg.mHeight;
+  mSignerId = msg.mSignerId;
+  mValueId = msg.mValueId;
+  mValidRound = msg.mValidRound;
+  mPart = msg.mPart;
+  mPayload = new unsigned char[mLenPayload];
+  memcpy(mPayload, msg.mPayload, mLenPayload);
+}
+
+
+TendermintMessage& TendermintMessage::operator=(TendermintMessage other) noexcept {
+  swap(*this, other);
+  return *this;
+}
+
 
+TendermintMessage::TendermintMessage(TendermintMessage&& msg) noexcept : ConsensusMessageBase(msg) {
+  swap(*this, msg);
 }
 
-TendermintMessage::TendermintMessage(int lenPayload) {
 
-  ConsensusMessageBase();
+bool TendermintMessage::operator==(const TendermintMessage& other) {
+  if (!ConsensusMessageBase::operator==(other)) {
+    return false;
+  }
+
+  if (mMessageType != other.mMessageType || 
+      mLenPayload != other.mLenPayload ||
+      mRound != other.mRound ||
+      mHeight != other.mHeight ||
+      mSignerId != other.mSignerId ||
+      mValueId != other.mValueId ||
+      mValidRound != other.mValidRound ||
+      mPart != other.mPart)
+  {
+    return false;
+  }
+  else {
+    for (size_t i = 0; i < mLenPayload; ++i) {
+      if (mPayload[i] != other.mPayload[i]) return false;
+    }
+    return true;
+  }
+}
+
+
+TendermintMessage::~TendermintMessage(void) {
+  if (mPayload) delete[] mPayload;
+}
+
+
+// friend
+void swap(TendermintMessage& a, TendermintMessage& b) noexcept {
+  swap(static_cast<ConsensusMessageBase&>(a), static_cast<ConsensusMessageBase&>(b));
+  std::swap(a.mMessageType, b.mMessageType);
+  std::swap(a.mLenPayload, b.mLenPayload);
+  std::swap(a.mRound, b.mRound);
+  std::swap(a.mHeight, b.mHeight);
+  std::swap(a.mSignerId, b.mSignerId);
+  std::swap(a.mValueId, b.mValueId);
+  std::swap(a.mValidRound, b.mValidRound);
+  std::swap(a.mPart, b.mPart);
+  std::swap(a.mPayload, b.mPayload);
+}
+
+
+void TendermintMessage::reset() {
+
+  ConsensusMessageBase::reset();
+
   mMessageType = 0;
-  mLenPayload = lenPayload;
+  mLenPayload = 4;
   mRound = 0;
+  mHeight = 0;
   mSignerId = 0;
+  mValueId = 0;
+  mValidRound = 0;
+  mPart = 0;
   mPayload = new unsigned char[mLenPayload]();
 
 }
 
-TendermintMessage::~TendermintMessage() {
-	delete[] mPayload;
+
+void TendermintMessage::reset(int payloadLen) {
+
+  ConsensusMessageBase::reset();
+
+  mMessageType = 0;
+  mLenPayload = payloadLen;
+  mRound = 0;
+  mHeight = 0;
+  mSignerId = 0;
+  mValueId = 0;
+  mValidRound = 0;
+  mPart = 0;
+  mPayload = new unsigned char[mLenPayload]();
+
 }
 
 
-std::ostringstream TendermintMessage::serialization() {
+void TendermintMessage::setPayload(unsigned char const payload[], uint32_t len) {
 
-	std::ostringstream out = ConsensusMessageBase::serialization();
-	out.write((const char*) &mMagic, 1);
-	out.write((const char*) &mMessageType, 4);
-	out.write((const char*) &mLenPayload, 4);
-	out.write((const char*) &mRound, 4);
-	out.write((const char*) &mHeight, 4);
-	out.write((const char*) &mSignerId, 4);
-	out.write((const char*) &mValueId, 4);
-  out.write((const char*) &mValidRound, 4);
-	out.write((const char*) mPayload, mLenPayload);
-	return out;
+  delete[] mPayload;
+
+  mLenPayload = len;
+  mPayload = new unsigned char[mLenPayload]();
+  memcpy(mPayload, payload, mLenPayload);
 
 }
 
 
+std::ostringstream TendermintMessage::serialization() {
+    std::ostringstream out = ConsensusMessageBase::serialization();
+    out.write((const char*) &mMagic, 1);
+    out.write((const char*) &mMessageType, 4);
+    out.write((const char*) &mLenPayload, 4);
+    out.write((const char*) &mRound, 4);
+    out.write((const char*) &mHeight, 4);
+    out.write((const char*) &mSignerId, 4);
+    out.write((const char*) &mValueId, 4);
+    out.write((const char*) &mValidRound, 4);
+    out.write((const char*) &mPart, 4);
+    out.write((const char*) mPayload, mLenPayload);
+    serializeProvenance(out);
+    return out;
+}
+
 
 int TendermintMessage::deserialization(int size, unsigned char const serialInput[]) {
 
@@ -63,75 +175,154 @@ int TendermintMessage::deserialization(int size, unsigned char const serialInput
   size -= mHeadSize;
   serialInput += mHeadSize;
 
+  switch (mBlockType) {
+  
+  // compact blocks and their transaction requests differ in the payload only
+  case ConsensusMessageBase::NORMAL_BLOCK:
+  case ConsensusMessageBase::COMPACT_HEAD:
+  case ConsensusMessageBase::REQUIRE:
+  case ConsensusMessageBase::BLOCK_TXN:
+
+    size -= 1;
+    if (size < 0) return 1;
+    uint8_t rMagic;
+    memcpy(&rMagic, serialInput, 1);
+    if (rMagic != mMagic) return 1;
+    serialInput += 1;
+
+    size -= 4;
+    if (size < 0) return 1;
+    memcpy(&mMessageType, serialInput, 4);
+    serialInput += 4;
+
+    size -= 4;
+    if (size < 0) return 1;
+    memcpy(&mLenPayload, serialInput, 4);
+    serialInput += 4;
+
+    size -= 4;
+    if (size < 0) return 1;
+    memcpy(&mRound, serialInput, 4);
+    serialInput += 4;
+
+    size -= 4;
+    if (size < 0) return 1;
+    memcpy(&mHeight, serialInput, 4);
+    serialInput += 4;
+
+    size -= 4;
+    if (size < 0) return 1;
+    memcpy(&mSignerId, serialInput, 4);
+    serialInput += 4;
+
+    size -= 4;
+    if (size < 0) return 1;
+    memcpy(&mValueId, serialInput, 4);
+    serialInput += 4;
+
+    size -= 4;
+    if (size < 0) return 1;
+    memcpy(&mValidRound, serialInput, 4);
+    serialInput += 4;
+
+    size -= 4;
+    if (size < 0) return 1;
+    memcpy(&mPart, serialInput, 4);
+    serialInput += 4;
+
+    delete[] mPayload;
+    mPayload = new unsigned char[mLenPayload]();
+
+    size -= mLenPayload;
+    if (size < 0) return 1;
+    memcpy(mPayload, serialInput, mLenPayload);
+    serialInput += mLenPayload;
+
+    // anything left is the optional provenance trailer
+    if (size > 0) {
+      return deserializeProvenance(size, serialInput) == 0 ? 0 : 1;
+    }
+
+    return 0;
+
+    break;
+  }
+  return 0;
 
-  size -= 1;
-  if (size < 0) return 1;
-  uint8_t rMagic;
-  memcpy(&rMagic, serialInput, 1);
-  if (rMagic != mMagic) return 1;
-  serialInput += 1;
-
-  size -= 4;
-  if (size < 0) return 1;
-  memcpy(&mMessageType, serialInput, 4);
-  serialInput += 4;
-
-  size -= 4;
-  if (size < 0) return 1;
-  memcpy(&mLenPayload, serialInput, 4);
-  serialInput += 4;
-
-  size -= 4;
-  if (size < 0) return 1;
-  memcpy(&mRound, serialInput, 4);
-  serialInput += 4;
-
-  size -= 4;
-  if (size < 0) return 1;
-  memcpy(&mHeight, serialInput, 4);
-  serialInput += 4;
-
-  size -= 4;
-  if (size < 0) return 1;
-  memcpy(&mSignerId, serialInput, 4);
-  serialInput += 4;
-
-  size -= 4;
-  if (size < 0) return 1;
-  memcpy(&mValueId, serialInput, 4);
-  serialInput += 4;
-
-  size -= 4;
-  if (size < 0) return 1;
-  memcpy(&mValidRound, serialInput, 4);
-  serialInput += 4;
-
-  delete[] mPayload;
-  mPayload = new unsigned char[mLenPayload]();
+}
 
-  size -= 4;
-  if (size < 0) return 1;
-  memcpy(mPayload, serialInput, mLenPayload);
 
-  return 0;
+Ptr<Packet> TendermintMessage::toPacket() {
 
+  /**
+   * we omit the network-byteorder to host-byteorder matter
+   * since it is a simulation and will not face different byteorders
+   * which should be handled in real implementations
+   */
+
+
+  // set departure timestamp
+  mTs = Simulator::Now().GetSeconds();
+
+  Ptr<Packet> pkt;
+
+  switch (mBlockType) {
+  case ConsensusMessageBase::NORMAL_BLOCK:
+  case ConsensusMessageBase::COMPACT_HEAD:
+  case ConsensusMessageBase::REQUIRE:
+  case ConsensusMessageBase::BLOCK_TXN:
+    {
+      std::ostringstream msgStream(std::stringstream::binary);
+      msgStream = serialization();
+      pkt = Create<Packet> ((uint8_t*) msgStream.str().c_str(), msgStream.str().length());
+      return pkt;
+    }
+    default:
+      return pkt;
+  }
 }
 
-Ptr<Packet> TendermintMessage::toPacket() {
+
+void TendermintMessage::packHead() {
+
+  /**
+   * set compactHead with SM3 hash of the packet 
+   */
+
+  CryptoPP::SM3 hash;
+
   std::ostringstream msgStream(std::stringstream::binary);
+  msgStream.write((const char*) &mMagic, 1);
+  msgStream.write((const char*) &mMessageType, 4);
+  msgStream.write((const char*) &mLenPayload, 4);
+  msgStream.write((const char*) &mRound, 4);
+  msgStream.write((const char*) &mHeight, 4);
+  msgStream.write((const char*) &mSignerId, 4);
+  msgStream.write((const char*) &mValueId, 4);
+  msgStream.write((const char*) &mValidRound, 4);
+  msgStream.write((const char*) &mPart, 4);
+  msgStream.write((const char*) mPayload, mLenPayload);
+  msgStream.write((const char*) &mSeq, 4);
 
-  /*
-  we omit the network-byteorder to host-byteorder matter
-  since it is a simulation and will not face different byteorders
-  which should be handled in real implementations
-  */
+  std::string digest;
 
-  msgStream = serialization();
+  hash.Update((const CryptoPP::byte*) msgStream.str().data(), msgStream.str().size());
+  digest.resize(hash.DigestSize());
+  hash.Final((CryptoPP::byte*)&digest[0]);
 
-  Ptr<Packet> pkt = Create<Packet> ((uint8_t*) msgStream.str().c_str(), msgStream.str().length());
+  compactHeadSize = digest.length();
+  compactHead = new unsigned char[compactHeadSize];
+
+  memcpy(compactHead, digest.data(), compactHeadSize);
 
-  return pkt;
 }
 
 
-} //namespace ns3
\ No newline at end of file
+uint64_t TendermintMessage::uniqueMessageSeq() {
+  uint64_t ret = (uint64_t) getSignerId();
+  ret = ret << 32;
+  ret = ret ^ (uint64_t) getSeq();
+  return ret;
+}
+
+}
\ No newline at end of file
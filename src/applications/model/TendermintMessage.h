@@ -1,9 +1,6 @@
 // Yiqing Zhu
 // yiqing.zhu.314@gmail.com
 
-//unfinished
-
-
 #ifndef TENDERMINTMESSAGE_H
 #define TENDERMINTMESSAGE_H
 
@@ -17,48 +14,80 @@ class TendermintMessage : public ConsensusMessageBase {
 
 private:
 
-	uint8_t mMagic = 0x7a;
-	uint32_t mMessageType;
-	uint32_t mLenPayload;
-	uint32_t mRound;
-	uint32_t mHeight;
-	uint32_t mSignerId;
-	uint32_t mValueId;
-	uint32_t mValidRound;
-	unsigned char* mPayload;
+  uint8_t mMagic = 0x7a;
+  uint32_t mMessageType;
+  uint32_t mLenPayload = 0;
+  uint32_t mRound;
+  uint32_t mHeight;
+  uint32_t mSignerId;
+  uint32_t mValueId;
+  uint32_t mValidRound;
+  uint32_t mPart;   // BLOCK_PART: index of the part, PROPOSAL: number of parts
+  unsigned char* mPayload = NULL;
 
 public:
 
   enum tendermintState : uint32_t {
     PROPOSAL,
     PRE_VOTE,
-    PRE_COMMIT
+    PRE_COMMIT,
+
+    BLOCK_PART,
+    REQUEST,
+    PART_STATE,   // bitfield of the parts of a value the signer holds
+    TRANSACTION   // mempool gossip, valid round: client, value id: request id
   };
 
-	TendermintMessage();
-  TendermintMessage(int lenPayload);
-	~TendermintMessage();
+  TendermintMessage();
+  TendermintMessage(int payloadLen);
+  TendermintMessage(const TendermintMessage& msg);
+  TendermintMessage& operator=(TendermintMessage other) noexcept;
+  TendermintMessage(TendermintMessage&& msg) noexcept;
+
+  bool operator==(const TendermintMessage& other);
+
+  virtual ~TendermintMessage();
+
+  friend void swap(TendermintMessage& a, TendermintMessage& b) noexcept;
+
+  void reset();
+  void reset(int payloadLen);
+
+  // replace the payload, other fields kept
+  void setPayload(unsigned char const payload[], uint32_t len);
+
   std::ostringstream serialization();
+
   int deserialization(int size, unsigned char const serialInput[]);
 
-	Ptr<Packet> toPacket();
+  Ptr<Packet> toPacket();
+
+  void packHead();
+
+
+  inline void setType(uint32_t type) {mMessageType = type;}
+  inline void setSignerId(uint32_t id) {mSignerId = id;}
+  inline void setRound(uint32_t round) {mRound = round;}
+  inline void setHeight(uint32_t h) {mHeight = h;}
+  inline void setValueId(uint32_t id) {mValueId = id;}
+  inline void setValidRound(uint32_t r) {mValidRound = r;}
+  inline void setPart(uint32_t p) {mPart = p;}
+
+  inline uint32_t getType() {return mMessageType;}
+  inline uint32_t getSignerId() {return mSignerId;}
+  inline uint32_t getRound() {return mRound;}
+  inline uint32_t getHeight() {return mHeight;}
+  inline uint32_t getValueId() {return mValueId;}
+  inline uint32_t getValidRound() {return mValidRound;}
+  inline uint32_t getPart() {return mPart;}
 
-  void setType(uint32_t type) {mMessageType = type;}
-  void setSignerId(uint32_t id) {mSignerId = id;}
-  void setRound(uint32_t round) {mRound = round;}
-	void setHeight(uint32_t h) {mHeight = h;}
-	void setValueId(uint32_t id) {mValueId = id;}
-	void setValidRound(uint32_t r) {mValidRound = r;}
+  inline uint32_t getPayloadLen() {return mLenPayload;}
+  inline unsigned char* getPayload() {return mPayload;}
 
-  uint32_t getType() {return mMessageType;}
-  uint32_t getSignerId() {return mSignerId;}
-  uint32_t getRound() {return mRound;}
-	uint32_t getHeight() {return mHeight;}
-	uint32_t getValueId() {return mValueId;}
-	uint32_t getValidRound() {return mValidRound;}
+  uint64_t uniqueMessageSeq();
 
 };
 
 
 } // namespace ns3
-#endif
\ No newline at end of file
+#endif
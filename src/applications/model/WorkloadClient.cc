@@ -0,0 +1,160 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#include "WorkloadClient.h"
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include <iostream>
+
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED(WorkloadClient);
+
+NS_LOG_COMPONENT_DEFINE("WorkloadClient");
+
+
+TypeId WorkloadClient::GetTypeId (void) {
+  static TypeId tid = TypeId ("ns3::WorkloadClient")
+    .SetParent<Application> ()
+    .SetGroupName("Applications")
+    .AddConstructor<WorkloadClient> ();
+  return tid;
+}
+
+
+WorkloadClient::WorkloadClient(void) {
+  mInterval = CreateObject<ExponentialRandomVariable>();
+  mSize = CreateObject<UniformRandomVariable>();
+
+  mLatencyHistogram.SetDefaultBinWidth(0.01);
+}
+
+
+WorkloadClient::~WorkloadClient(void) {}
+
+
+void WorkloadClient::DoDispose (void) {
+  mReplica = 0;
+  Application::DoDispose ();
+}
+
+
+void WorkloadClient::setArrival(uint8_t process, double rate) {
+  mProcess = process;
+  mRate = rate;
+
+  if (rate > 0) {
+    mInterval->SetAttribute("Mean", DoubleValue(1.0 / rate));
+  }
+}
+
+
+void WorkloadClient::setRequestSize(uint32_t min, uint32_t max) {
+  mSizeMin = min;
+  mSizeMax = std::max(min, max);
+}
+
+
+void WorkloadClient::StartApplication() {
+
+  Ptr<Node> node = GetNode();
+
+  for (uint32_t i = 0; i < node->GetNApplications() && !mReplica; ++i) {
+    mReplica = DynamicCast<BlockChainOverlayNode>(node->GetApplication(i));
+  }
+
+  NS_ASSERT_MSG(mReplica, "no consensus application on node " << node->GetId());
+
+  mReplica->setRequestReplyCallback(MakeCallback(&WorkloadClient::onReply, this));
+
+  mStartTime = Simulator::Now().GetSeconds();
+  mTraceIndex = 0;
+
+  scheduleNext();
+}
+
+
+void WorkloadClient::StopApplication() {
+
+  Simulator::Cancel(mNextArrival);
+}
+
+
+void WorkloadClient::scheduleNext() {
+
+  double wait = 0;
+
+  switch (mProcess) {
+    case POISSON:
+      if (mRate <= 0) return;
+      wait = mInterval->GetValue();
+      break;
+    case CONSTANT:
+      if (mRate <= 0) return;
+      wait = 1.0 / mRate;
+      break;
+    case TRACE:
+      if (mTraceIndex >= mTrace.size()) return;
+      wait = std::max(0.0, mStartTime + mTrace[mTraceIndex].first - Simulator::Now().GetSeconds());
+      break;
+    default:
+      return;
+  }
+
+  mNextArrival = Simulator::Schedule(Seconds(wait), &WorkloadClient::onArrival, this);
+}
+
+
+void WorkloadClient::onArrival() {
+
+  uint32_t bytes = 0;
+
+  if (mProcess == TRACE) {
+    bytes = mTrace[mTraceIndex++].second;
+  }
+
+  if (bytes == 0) {
+    bytes = mSize->GetInteger(mSizeMin, mSizeMax);
+  }
+
+  submit(bytes);
+
+  // open loop, the next arrival does not wait for the reply
+  scheduleNext();
+}
+
+
+void WorkloadClient::submit(uint32_t bytes) {
+
+  uint32_t reqId = mNextReqId++;
+
+  mOutstanding[reqId] = Simulator::Now().GetSeconds();
+  mSent++;
+
+  NS_LOG_INFO("request:"<<reqId<<" at:"<<GetNode()->GetId()<<" bytes:"<<bytes
+    <<" time:"<<Simulator::Now().GetSeconds());
+
+  mReplica->submitRequest(reqId, bytes);
+}
+
+
+void WorkloadClient::onReply(uint32_t reqId) {
+
+  auto it = mOutstanding.find(reqId);
+
+  // a duplicate or not sent by this client
+  if (it == mOutstanding.end()) return;
+
+  double latency = Simulator::Now().GetSeconds() - it->second;
+  mOutstanding.erase(it);
+
+  mCompleted++;
+  mLatencySum += latency;
+  mLatencyHistogram.AddValue(latency);
+  mLatencies.push_back(latency);
+
+  NS_LOG_INFO("reply:"<<reqId<<" at:"<<GetNode()->GetId()<<" latency:"<<latency);
+}
+
+}
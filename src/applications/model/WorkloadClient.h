@@ -0,0 +1,104 @@
+// Yiqing Zhu
+// yiqing.zhu.314@gmail.com
+
+#ifndef WORKLOADCLIENT_H
+#define WORKLOADCLIENT_H
+
+#include "BlockChainApplicationBase.h"
+#include "ns3/application.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/histogram.h"
+
+#include <unordered_map>
+
+
+namespace ns3 {
+
+/**
+ * open-loop workload generator
+ * submits requests through the consensus application installed on the same node,
+ * arrivals do not wait for replies so the offered load is independent of the protocol.
+ * latency is measured from submission to the reply of the replica that ordered the request
+ */
+
+class WorkloadClient : public Application {
+
+public:
+
+  enum ARRIVAL_PROCESS : uint8_t {
+    POISSON,    // exponential inter-arrival times
+    CONSTANT,   // fixed inter-arrival time
+    TRACE       // replay of <second since start, bytes> arrivals
+  };
+
+  static TypeId GetTypeId (void);
+
+  WorkloadClient();
+
+  virtual ~WorkloadClient(void);
+
+  // rate in requests per second, ignored by TRACE
+  void setArrival(uint8_t process, double rate);
+
+  // bytes, uniform in [min, max]
+  void setRequestSize(uint32_t min, uint32_t max);
+
+  // arrivals sorted by time, a size of 0 takes one from setRequestSize
+  void setTrace(std::vector<std::pair<double, uint32_t> > trace) {mTrace = trace;}
+
+  void onReply(uint32_t reqId);
+
+  uint32_t getSentCount() {return mSent;}
+  uint32_t getCompletedCount() {return mCompleted;}
+  uint32_t getOutstandingCount() {return mOutstanding.size();}
+
+  // second
+  double getAverageLatency() {return mCompleted == 0 ? 0 : mLatencySum / mCompleted;}
+  Histogram& getLatencyHistogram() {return mLatencyHistogram;}
+  const std::vector<double>& getLatencySamples() {return mLatencies;}
+
+protected:
+
+  virtual void StartApplication(void);
+  virtual void StopApplication(void);
+  virtual void DoDispose(void);
+
+  void scheduleNext();
+  void submit(uint32_t bytes);
+  void onArrival();
+
+  // the consensus application of this node
+  Ptr<BlockChainOverlayNode> mReplica;
+
+  uint8_t mProcess = POISSON;
+  double mRate = 1;
+
+  uint32_t mSizeMin = 4;
+  uint32_t mSizeMax = 4;
+
+  std::vector<std::pair<double, uint32_t> > mTrace;
+  size_t mTraceIndex = 0;
+
+  Ptr<ExponentialRandomVariable> mInterval;
+  Ptr<UniformRandomVariable> mSize;
+
+  EventId mNextArrival;
+  double mStartTime = 0;
+
+  uint32_t mNextReqId = 1;
+
+  // request id -> submission time
+  std::unordered_map<uint32_t, double> mOutstanding;
+
+  uint32_t mSent = 0;
+  uint32_t mCompleted = 0;
+  double mLatencySum = 0;
+
+  Histogram mLatencyHistogram;
+  std::vector<double> mLatencies;
+
+};
+
+}
+
+#endif